@@ -242,6 +242,16 @@ IF(HAVE_MMAP)
   ADD_DEFINITIONS(-DHAVE_MMAP)
 ENDIF(HAVE_MMAP)
 
+CHECK_FUNCTION_EXISTS(epoll_create1 HAVE_EPOLL)
+IF(HAVE_EPOLL)
+  ADD_DEFINITIONS(-DHAVE_EPOLL)
+ENDIF(HAVE_EPOLL)
+
+CHECK_FUNCTION_EXISTS(eventfd HAVE_EVENTFD)
+IF(HAVE_EVENTFD)
+  ADD_DEFINITIONS(-DHAVE_EVENTFD)
+ENDIF(HAVE_EVENTFD)
+
 # Check necessary libraries.
 
 # Check if libltdl-dev is installed
@@ -275,7 +285,7 @@ IF(NOT LIBXML2_FOUND AND GGL_BUILD_LIBXML2_XML_PARSER)
   SET(GGL_BUILD_LIBXML2_XML_PARSER 0)
 ENDIF(NOT LIBXML2_FOUND AND GGL_BUILD_LIBXML2_XML_PARSER)
 
-GET_CONFIG(libcurl 7.15 LIBCURL LIBCURL_FOUND)
+GET_CONFIG(libcurl 7.16 LIBCURL LIBCURL_FOUND)
 IF(NOT LIBCURL_FOUND)
   IF(GGL_BUILD_CURL_XML_HTTP_REQUEST)
     MESSAGE("Library curl is not available, curl-xml-http-request extension won't be built.")
@@ -38,6 +38,10 @@ namespace curl {
 
 static const long kMaxRedirections = 10;
 static const long kConnectTimeoutSec = 20;
+// Upper limit of idle connections kept alive for reuse.
+static const long kMaxCachedConnections = 16;
+// Upper limit of concurrent connections to one host.
+static const long kMaxHostConnections = 4;
 
 static const Variant kOpenDefaultArgs[] = {
   Variant(), Variant(),
@@ -78,15 +82,320 @@ static const char *ReformatHttpHeaderValue(const char *value) {
 }
 #endif
 
+/**
+ * Drives all asynchronous requests through one curl multi handle from the
+ * main loop, so that connections and DNS lookups are cached and reused
+ * among requests instead of paying a new thread, DNS lookup and TCP/TLS
+ * handshake for each request.
+ *
+ * Everything in this class, including the callbacks of the transfers,
+ * runs in the main thread.
+ */
+class CurlMultiEngine {
+ public:
+  /** Receives the result of a transfer added by AddTransfer(). */
+  class Transfer {
+   public:
+    virtual ~Transfer() { }
+    /**
+     * Called when the transfer finished, failed or was cancelled. The curl
+     * handle has already been removed from the engine, and is owned by the
+     * callee.
+     */
+    virtual void OnTransferDone(CURL *curl, CURLcode code) = 0;
+  };
+
+  explicit CurlMultiEngine(MainLoopInterface *main_loop)
+      : main_loop_(main_loop),
+        multi_(NULL),
+        timer_watch_(0),
+        cancel_watch_(0),
+        busy_(false) {
+    curl_global_init(CURL_GLOBAL_ALL);
+    multi_ = curl_multi_init();
+    curl_multi_setopt(multi_, CURLMOPT_SOCKETFUNCTION, SocketCallback);
+    curl_multi_setopt(multi_, CURLMOPT_SOCKETDATA, this);
+    curl_multi_setopt(multi_, CURLMOPT_TIMERFUNCTION, TimerCallback);
+    curl_multi_setopt(multi_, CURLMOPT_TIMERDATA, this);
+#if LIBCURL_VERSION_NUM >= 0x071003
+    curl_multi_setopt(multi_, CURLMOPT_MAXCONNECTS, kMaxCachedConnections);
+#endif
+#if LIBCURL_VERSION_NUM >= 0x071e00
+    curl_multi_setopt(multi_, CURLMOPT_MAX_HOST_CONNECTIONS,
+                      kMaxHostConnections);
+#endif
+  }
+
+  ~CurlMultiEngine() {
+    if (timer_watch_)
+      main_loop_->RemoveWatch(timer_watch_);
+    if (cancel_watch_)
+      main_loop_->RemoveWatch(cancel_watch_);
+    for (Transfers::iterator it = active_.begin(); it != active_.end(); ++it)
+      curl_multi_remove_handle(multi_, *it);
+    // Socket watches are removed by SocketCallback during the cleanup.
+    curl_multi_cleanup(multi_);
+    curl_global_cleanup();
+  }
+
+  /**
+   * Starts a transfer. If it's called from a callback of another transfer,
+   * the transfer will be actually started after the callback returns.
+   *
+   * @return false if the transfer can't be started. transfer won't be
+   *     called in this case.
+   */
+  bool AddTransfer(CURL *curl, Transfer *transfer) {
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, transfer);
+    if (busy_) {
+      // libcurl doesn't allow the multi handle to be changed in callbacks.
+      pending_.push_back(curl);
+      return true;
+    }
+    return StartTransfer(curl);
+  }
+
+  /**
+   * Cancels an active transfer. Its Transfer::OnTransferDone() will be called
+   * with CURLE_ABORTED_BY_CALLBACK later in the main loop, never inside this
+   * method, because the callee may release the object calling this method,
+   * and never inside a callback of libcurl.
+   */
+  void CancelTransfer(CURL *curl) {
+    cancelled_.push_back(curl);
+    if (!cancel_watch_) {
+      cancel_watch_ = main_loop_->AddTimeoutWatch(
+          0, new WatchCallbackSlot(
+              NewSlot(this, &CurlMultiEngine::OnCancelTimeout)));
+    }
+  }
+
+ private:
+  struct SocketWatches {
+    SocketWatches() : read_watch(0), write_watch(0), what(CURL_POLL_NONE) { }
+    int read_watch;
+    int write_watch;
+    // The events requested by libcurl.
+    int what;
+  };
+
+  bool StartTransfer(CURL *curl) {
+    CURLMcode code = curl_multi_add_handle(multi_, curl);
+    if (code != CURLM_OK) {
+      DLOG("CurlMultiEngine: curl_multi_add_handle failed: %s",
+           curl_multi_strerror(code));
+      return false;
+    }
+    active_.insert(curl);
+    return true;
+  }
+
+  void FinishTransfer(CURL *curl, CURLcode code) {
+    curl_multi_remove_handle(multi_, curl);
+    active_.erase(curl);
+    // The handle may be reused for another transfer after this one, which
+    // must not be affected by a pending cancellation of this one.
+    cancelled_.erase(std::remove(cancelled_.begin(), cancelled_.end(), curl),
+                     cancelled_.end());
+    char *transfer = NULL;
+    curl_easy_getinfo(curl, CURLINFO_PRIVATE, &transfer);
+    reinterpret_cast<Transfer *>(transfer)->OnTransferDone(curl, code);
+  }
+
+  void SocketAction(curl_socket_t socket, int flags) {
+    if (busy_) {
+      // A callback may run a nested main loop, e.g. for a modal dialog, but
+      // libcurl doesn't allow to be called from its callbacks. The action is
+      // run by the outermost call after the callbacks return.
+      deferred_.push_back(std::make_pair(socket, flags));
+      return;
+    }
+
+    busy_ = true;
+    int running = 0;
+    while (curl_multi_socket_action(multi_, socket, flags, &running) ==
+           CURLM_CALL_MULTI_PERFORM);
+    while (!deferred_.empty()) {
+      std::vector<std::pair<curl_socket_t, int> > deferred;
+      deferred.swap(deferred_);
+      for (size_t i = 0; i < deferred.size(); ++i) {
+        RestoreWatches(deferred[i].first);
+        while (curl_multi_socket_action(multi_, deferred[i].first,
+                                        deferred[i].second, &running) ==
+               CURLM_CALL_MULTI_PERFORM);
+      }
+    }
+    busy_ = false;
+
+    // Transfers started during the callbacks.
+    std::vector<CURL *> pending;
+    pending.swap(pending_);
+    for (size_t i = 0; i < pending.size(); ++i) {
+      if (!StartTransfer(pending[i])) {
+        char *transfer = NULL;
+        curl_easy_getinfo(pending[i], CURLINFO_PRIVATE, &transfer);
+        reinterpret_cast<Transfer *>(transfer)->OnTransferDone(
+            pending[i], CURLE_FAILED_INIT);
+      }
+    }
+
+    CURLMsg *msg;
+    int msgs_left = 0;
+    while ((msg = curl_multi_info_read(multi_, &msgs_left)) != NULL) {
+      if (msg->msg == CURLMSG_DONE) {
+        // The message is invalid after removing the handle, so copy it.
+        CURL *curl = msg->easy_handle;
+        CURLcode code = msg->data.result;
+        FinishTransfer(curl, code);
+      }
+    }
+
+    // Transfers cancelled during the callbacks.
+    FinishCancelledTransfers();
+  }
+
+  void FinishCancelledTransfers() {
+    // FinishTransfer() removes the handles finished by the callbacks from
+    // cancelled_, so never iterate over a copy of it.
+    while (!cancelled_.empty()) {
+      CURL *curl = cancelled_.back();
+      cancelled_.pop_back();
+      // Transfers pending in a nested main loop are not started yet.
+      if (active_.find(curl) != active_.end())
+        FinishTransfer(curl, CURLE_ABORTED_BY_CALLBACK);
+    }
+  }
+
+  void UpdateWatches(curl_socket_t s, SocketWatches *watches) {
+    bool remove = (watches->what == CURL_POLL_REMOVE);
+    UpdateWatch(&watches->read_watch,
+                !remove && (watches->what & CURL_POLL_IN), true, s);
+    UpdateWatch(&watches->write_watch,
+                !remove && (watches->what & CURL_POLL_OUT), false, s);
+  }
+
+  // Adds the watches of a socket dropped by OnSocketReady() back.
+  void RestoreWatches(curl_socket_t s) {
+    Sockets::iterator it = sockets_.find(s);
+    if (it != sockets_.end())
+      UpdateWatches(s, it->second);
+  }
+
+  void UpdateWatch(int *watch_id, bool wanted, bool read, curl_socket_t s) {
+    if (wanted && !*watch_id) {
+      WatchCallbackSlot *callback = new WatchCallbackSlot(
+          NewSlot(this, &CurlMultiEngine::OnSocketReady));
+      *watch_id = read ? main_loop_->AddIOReadWatch(s, callback) :
+                         main_loop_->AddIOWriteWatch(s, callback);
+    } else if (!wanted && *watch_id) {
+      main_loop_->RemoveWatch(*watch_id);
+      *watch_id = 0;
+    }
+  }
+
+  static int SocketCallback(CURL *curl, curl_socket_t s, int what,
+                            void *user_p, void *socket_p) {
+    GGL_UNUSED(curl);
+    CurlMultiEngine *this_p = static_cast<CurlMultiEngine *>(user_p);
+    SocketWatches *watches = static_cast<SocketWatches *>(socket_p);
+    if (!watches) {
+      if (what == CURL_POLL_REMOVE)
+        return 0;
+      watches = new SocketWatches;
+      curl_multi_assign(this_p->multi_, s, watches);
+      this_p->sockets_[s] = watches;
+    }
+
+    watches->what = what;
+    this_p->UpdateWatches(s, watches);
+    if (what == CURL_POLL_REMOVE) {
+      curl_multi_assign(this_p->multi_, s, NULL);
+      this_p->sockets_.erase(s);
+      delete watches;
+    }
+    return 0;
+  }
+
+  static int TimerCallback(CURLM *multi, long timeout_ms, void *user_p) {
+    GGL_UNUSED(multi);
+    CurlMultiEngine *this_p = static_cast<CurlMultiEngine *>(user_p);
+    if (this_p->timer_watch_) {
+      this_p->main_loop_->RemoveWatch(this_p->timer_watch_);
+      this_p->timer_watch_ = 0;
+    }
+    if (timeout_ms >= 0) {
+      this_p->timer_watch_ = this_p->main_loop_->AddTimeoutWatch(
+          static_cast<int>(timeout_ms),
+          new WatchCallbackSlot(
+              NewSlot(this_p, &CurlMultiEngine::OnTimeout)));
+    }
+    return 0;
+  }
+
+  bool OnSocketReady(int watch_id) {
+    int fd = main_loop_->GetWatchData(watch_id);
+    bool read = main_loop_->GetWatchType(watch_id) ==
+                MainLoopInterface::IO_READ_WATCH;
+    SocketAction(fd, read ? CURL_CSELECT_IN : CURL_CSELECT_OUT);
+    if (busy_) {
+      // The action is deferred, so the socket stays ready. Drops the watch
+      // until the action is run, otherwise the nested main loop would spin
+      // on it.
+      Sockets::iterator it = sockets_.find(fd);
+      if (it != sockets_.end())
+        (read ? it->second->read_watch : it->second->write_watch) = 0;
+      return false;
+    }
+    // The watch may have been removed by SocketCallback, which is fine.
+    return true;
+  }
+
+  bool OnTimeout(int watch_id) {
+    GGL_UNUSED(watch_id);
+    // The timer is one-shot. TimerCallback may set a new one during the
+    // action below.
+    timer_watch_ = 0;
+    SocketAction(CURL_SOCKET_TIMEOUT, 0);
+    return false;
+  }
+
+  bool OnCancelTimeout(int watch_id) {
+    GGL_UNUSED(watch_id);
+    cancel_watch_ = 0;
+    // Removing a handle inside a callback of libcurl isn't allowed. The
+    // cancellations are finished by SocketAction() in this case.
+    if (!busy_)
+      FinishCancelledTransfers();
+    return false;
+  }
+
+  typedef LightSet<CURL *> Transfers;
+  typedef LightMap<curl_socket_t, SocketWatches *> Sockets;
+
+  MainLoopInterface *main_loop_;
+  CURLM *multi_;
+  Transfers active_;
+  std::vector<CURL *> pending_;
+  std::vector<CURL *> cancelled_;
+  // Socket actions requested in nested main loops run by callbacks.
+  std::vector<std::pair<curl_socket_t, int> > deferred_;
+  Sockets sockets_;
+  int timer_watch_;
+  int cancel_watch_;
+  bool busy_;
+};
+
 class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
  public:
   DEFINE_CLASS_ID(0xda25f528f28a4319, XMLHttpRequestInterface);
 
-  XMLHttpRequest(CURLSH *share, MainLoopInterface *main_loop,
+  XMLHttpRequest(CURLSH *share, CurlMultiEngine *engine,
+                 MainLoopInterface *main_loop,
                  XMLParserInterface *xml_parser,
                  const std::string &default_user_agent)
       : curl_(NULL),
         share_(share),
+        engine_(engine),
         main_loop_(main_loop),
         xml_parser_(xml_parser),
         response_dom_(NULL),
@@ -99,8 +408,6 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
         succeeded_(false) {
     VERIFY_M(EnsureXHRBackoffOptions(main_loop->GetCurrentTime()),
              ("Required options module have not been loaded"));
-    pthread_attr_init(&thread_attr_);
-    pthread_attr_setdetachstate(&thread_attr_, PTHREAD_CREATE_DETACHED);
   }
 
   virtual void DoClassRegister() {
@@ -141,7 +448,6 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
 
   ~XMLHttpRequest() {
     Abort();
-    pthread_attr_destroy(&thread_attr_);
   }
 
   virtual Connection *ConnectOnReadyStateChange(Slot0<void> *handler) {
@@ -306,7 +612,7 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
     return NO_ERR;
   }
 
-  struct WorkerContext {
+  struct WorkerContext : public CurlMultiEngine::Transfer {
     WorkerContext(XMLHttpRequest *a_this_p, CURL *a_curl, bool a_async,
                   curl_slist *a_request_headers,
                   const std::string &a_request_data)
@@ -315,6 +621,11 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
           request_data(a_request_data),
           request_offset(0), async(a_async) {
     }
+    virtual void OnTransferDone(CURL *a_curl, CURLcode code) {
+      ASSERT(a_curl == curl);
+      GGL_UNUSED(a_curl);
+      AsyncWorkerDone(this, code);
+    }
     XMLHttpRequest *this_p;
     CURL *curl;
     curl_slist *request_headers;
@@ -390,8 +701,9 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
     curl_easy_setopt(curl_, CURLOPT_VERBOSE, 1);
   #endif
     curl_easy_setopt(curl_, CURLOPT_HTTPHEADER, context->request_headers);
-    curl_easy_setopt(curl_, CURLOPT_FRESH_CONNECT, 1);
-    curl_easy_setopt(curl_, CURLOPT_FORBID_REUSE, 1);
+#if LIBCURL_VERSION_NUM >= 0x071900
+    curl_easy_setopt(curl_, CURLOPT_TCP_KEEPALIVE, 1L);
+#endif
     curl_easy_setopt(curl_, CURLOPT_AUTOREFERER, 1);
     curl_easy_setopt(curl_, CURLOPT_FOLLOWLOCATION, 1);
     curl_easy_setopt(curl_, CURLOPT_MAXREDIRS, kMaxRedirections);
@@ -407,9 +719,8 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
       // this object from being GC'ed during the request.
       Ref();
       send_flag_ = true;
-      pthread_t thread;
-      if (pthread_create(&thread, &thread_attr_, Worker, context) != 0) {
-        DLOG("Failed to create worker thread");
+      if (!engine_->AddTransfer(curl_, context)) {
+        DLOG("Failed to start the transfer");
         Unref();
         send_flag_ = false;
         Abort();
@@ -422,9 +733,7 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
       }
     } else {
       send_flag_ = true;
-      // Run the worker directly in this thread.
-      // Returns NULL means failed.
-      void *result = Worker(context);
+      bool result = SyncWorker(context);
       send_flag_ = false;
       if (!result)
         return NETWORK_ERR;
@@ -451,10 +760,8 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
     *effective_url = url_ptr ? url_ptr : "";
   }
 
-  // If async, this method runs in a separate thread.
-  static void *Worker(void *arg) {
-    WorkerContext *context = static_cast<WorkerContext *>(arg);
-
+  // Performs a synchronous request in the calling thread.
+  static bool SyncWorker(WorkerContext *context) {
     CURLcode code = curl_easy_perform(context->curl);
 
     unsigned short status = 0;
@@ -471,11 +778,50 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
            curl_easy_strerror(code));
     }
 
-    WorkerDone(status, effective_url, context, code == CURLE_OK);
+    // Write blank data to ensure the header is parsed.
+    context->this_p->WriteBody("", status, effective_url);
+    context->this_p->Done(false, code == CURLE_OK);
     delete context;
+    return code == CURLE_OK;
+  }
+
+  // Called by the CurlMultiEngine in the main thread when an asynchronous
+  // request finishes.
+  static void AsyncWorkerDone(WorkerContext *context, CURLcode code) {
+    XMLHttpRequest *this_p = context->this_p;
+    unsigned short status = 0;
+    std::string effective_url;
+    GetStatusAndEffectiveUrl(context->curl, &status, &effective_url);
 
-    // Returns something that isn't NULL when success.
-    return code == CURLE_OK ? arg : NULL;
+    if (context->request_headers) {
+      curl_slist_free_all(context->request_headers);
+      context->request_headers = NULL;
+    }
+
+    if (code != CURLE_OK) {
+      DLOG("XMLHttpRequest: Send: async request failed: %s",
+           curl_easy_strerror(code));
+    }
+
+    curl_easy_cleanup(context->curl);
+    // This cleanup of share handle will only succeed if this request is the
+    // final request that was active when the belonging session has been
+    // destroyed before this request finishes.
+    if (curl_share_cleanup(this_p->share_) == CURLSHE_OK) {
+      this_p->share_ = NULL;
+      DLOG("Hangover share handle successfully cleaned up");
+    }
+
+    if (this_p->curl_ == context->curl) {
+      // Write blank data to ensure the header is parsed.
+      this_p->WriteBody("", status, effective_url);
+      if (this_p->curl_ == context->curl)
+        this_p->Done(false, code == CURLE_OK);
+    }
+    delete context;
+    // Remove the internal reference that was added when the request was
+    // started.
+    this_p->Unref();
   }
 
   static size_t ReadCallback(void *ptr, size_t size, size_t mem_block,
@@ -504,105 +850,6 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
     return data_size;
   }
 
-  // Passes the WriteHeader() request from worker thread to the main thread.
-  class WriteHeaderTask : public WatchCallbackInterface {
-   public:
-    WriteHeaderTask(const void *ptr, size_t size,
-                    const WorkerContext *worker_context)
-        : data_(static_cast<const char *>(ptr), size),
-          worker_context_(*worker_context) {
-    }
-    virtual bool Call(MainLoopInterface *main_loop, int watch_id) {
-      GGL_UNUSED(main_loop);
-      GGL_UNUSED(watch_id);
-      if (worker_context_.this_p->curl_ == worker_context_.curl &&
-          worker_context_.this_p->WriteHeader(data_) != data_.size()) {
-        // WriteHeader() failed. Terminate the request.
-        worker_context_.this_p->Done(false, false);
-      }
-      return false;
-    }
-    virtual void OnRemove(MainLoopInterface *main_loop, int watch_id) {
-      GGL_UNUSED(main_loop);
-      GGL_UNUSED(watch_id);
-      delete this;
-    }
-
-    std::string data_;
-    WorkerContext worker_context_;
-  };
-
-  // Passes the WriteBody() request from worker thread to the main thread.
-  class WriteBodyTask : public WriteHeaderTask {
-   public:
-    WriteBodyTask(const void *ptr, size_t size,
-                  unsigned short status, const std::string &effective_url,
-                  const WorkerContext *worker_context)
-        : WriteHeaderTask(ptr, size, worker_context),
-          effective_url_(effective_url),
-          status_(status) {
-    }
-    virtual bool Call(MainLoopInterface *main_loop, int watch_id) {
-      GGL_UNUSED(main_loop);
-      GGL_UNUSED(watch_id);
-      if (worker_context_.this_p->curl_ == worker_context_.curl &&
-        worker_context_.this_p->WriteBody(data_, status_, effective_url_) !=
-            data_.size()) {
-        // WriteBody() failed. Terminate the request.
-        worker_context_.this_p->Done(false, false);
-      }
-      return false;
-    }
-
-    std::string effective_url_;
-    unsigned short status_;
-  };
-
-  // Passes the Done() request from worker thread to the main thread.
-  class DoneTask : public WriteBodyTask {
-   public:
-    DoneTask(unsigned short status, const std::string &effective_url,
-             const WorkerContext *worker_context, bool succeeded)
-          // Write blank data to ensure the header is parsed.
-        : WriteBodyTask("", 0, status, effective_url, worker_context),
-          succeeded_(succeeded) {
-    }
-    virtual bool Call(MainLoopInterface *main_loop, int watch_id) {
-      curl_easy_cleanup(worker_context_.curl);
-      // This cleanup of share handle will only succeed if this request is the
-      // final request that was active when the belonging session has been
-      // destroyed before this request finishes.
-      if (curl_share_cleanup(worker_context_.this_p->share_) == CURLSHE_OK) {
-        worker_context_.this_p->share_ = NULL;
-        DLOG("Hangover share handle successfully cleaned up");
-      }
-
-      WriteBodyTask::Call(main_loop, watch_id);
-      if (worker_context_.this_p->curl_ == worker_context_.curl)
-        worker_context_.this_p->Done(false, succeeded_);
-      // Remove the internal reference that was added when the request was
-      // started.
-      worker_context_.this_p->Unref();
-      return false;
-    }
-
-    bool succeeded_;
-  };
-
-  static void WorkerDone(unsigned short status,
-                         const std::string &effective_url,
-                         WorkerContext *context, bool succeeded) {
-    if (context->async) {
-      // Do actual work in the main thread. AddTimeoutWatch() is threadsafe.
-      context->this_p->main_loop_->AddTimeoutWatch(
-          0, new DoneTask(status, effective_url, context, succeeded));
-    } else {
-      // Write blank data to ensure the header is parsed.
-      context->this_p->WriteBody("", status, effective_url);
-      context->this_p->Done(false, succeeded);
-    }
-  }
-
   static size_t WriteHeaderCallback(void *ptr, size_t size,
                                     size_t mem_block, void *user_p) {
     if (!CheckSize(0, size, mem_block))
@@ -612,21 +859,13 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
     WorkerContext *context = static_cast<WorkerContext *>(user_p);
     // DLOG("XMLHttpRequest: WriteHeaderCallback: %zu*%zu this=%p",
     //      size, mem_block, context->this_p);
-    if (context->async) {
-      if (context->this_p->curl_ != context->curl) {
-        // The current XMLHttpRequest has been aborted, so abort the
-        // curl request.
-        return 0;
-      }
-
-      // Do actual work in the main thread. AddTimeoutWatch() is threadsafe.
-      context->this_p->main_loop_->AddTimeoutWatch(
-          0, new WriteHeaderTask(ptr, data_size, context));
-      return size * mem_block;
-    } else {
-      return context->this_p->WriteHeader(
-          std::string(static_cast<char *>(ptr), data_size));
+    if (context->async && context->this_p->curl_ != context->curl) {
+      // The current XMLHttpRequest has been aborted, so abort the
+      // curl request.
+      return 0;
     }
+    return context->this_p->WriteHeader(
+        std::string(static_cast<char *>(ptr), data_size));
   }
 
   size_t WriteHeader(const std::string &data) {
@@ -654,27 +893,18 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
 
     size_t data_size = size * mem_block;
     WorkerContext *context = static_cast<WorkerContext *>(user_p);
+    if (context->async && context->this_p->curl_ != context->curl) {
+      // The current XMLHttpRequest has been aborted, so abort the
+      // curl request.
+      return 0;
+    }
 
     unsigned short status = 0;
     std::string effective_url;
     GetStatusAndEffectiveUrl(context->curl, &status, &effective_url);
-
-    if (context->async) {
-      if (context->this_p->curl_ != context->curl) {
-        // The current XMLHttpRequest has been aborted, so abort the
-        // curl request.
-        return 0;
-      }
-
-      // Do actual work in the main thread. AddTimeoutWatch() is threadsafe.
-      context->this_p->main_loop_->AddTimeoutWatch(
-          0, new WriteBodyTask(ptr, data_size, status, effective_url, context));
-      return data_size;
-    } else {
-      return context->this_p->WriteBody(
-          std::string(static_cast<char *>(ptr), data_size),
-          status, effective_url);
-    }
+    return context->this_p->WriteBody(
+        std::string(static_cast<char *>(ptr), data_size),
+        status, effective_url);
   }
 
   size_t WriteBody(const std::string &data, unsigned short status,
@@ -719,6 +949,10 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
         // be cleaned up when the request finishes or is aborted by error
         // return value of WriteHeader() and WriteBody().
         curl_easy_cleanup(curl_);
+      } else if (async_ && aborting) {
+        // Don't wait for the next callback of the transfer, which may never
+        // come if the server stalls.
+        engine_->CancelTransfer(curl_);
       }
       curl_ = NULL;
     }
@@ -1006,6 +1240,7 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
 
   CURL *curl_;
   CURLSH *share_;
+  CurlMultiEngine *engine_;
   MainLoopInterface *main_loop_;
   XMLParserInterface *xml_parser_;
   DOMDocumentInterface *response_dom_;
@@ -1024,7 +1259,6 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
   std::string response_body_;
   std::string response_text_;
   std::string default_user_agent_;
-  pthread_attr_t thread_attr_;
 
   unsigned short status_;
   State state_ : 3;
@@ -1041,7 +1275,7 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
 
 class XMLHttpRequestFactory : public XMLHttpRequestFactoryInterface {
  public:
-  XMLHttpRequestFactory() : next_session_id_(1) {
+  XMLHttpRequestFactory() : engine_(NULL), next_session_id_(1) {
   }
 
   virtual int CreateSession() {
@@ -1085,14 +1319,20 @@ class XMLHttpRequestFactory : public XMLHttpRequestFactoryInterface {
 
   virtual XMLHttpRequestInterface *CreateXMLHttpRequest(
       int session_id, XMLParserInterface *parser) {
+    MainLoopInterface *main_loop = GetGlobalMainLoop();
+    // The engine lives as long as the process, because requests may still
+    // be active when the extension is finalized.
+    if (!engine_)
+      engine_ = new CurlMultiEngine(main_loop);
+
     if (session_id == 0) {
-      return new XMLHttpRequest(NULL, GetGlobalMainLoop(), parser,
+      return new XMLHttpRequest(NULL, engine_, main_loop, parser,
                                 default_user_agent_);
     }
 
     Sessions::iterator it = sessions_.find(session_id);
     if (it != sessions_.end()) {
-      return new XMLHttpRequest(it->second.share, GetGlobalMainLoop(), parser,
+      return new XMLHttpRequest(it->second.share, engine_, main_loop, parser,
                                 default_user_agent_);
     }
 
@@ -1130,6 +1370,7 @@ class XMLHttpRequestFactory : public XMLHttpRequestFactoryInterface {
   };
 
   typedef LightMap<int, Session> Sessions;
+  CurlMultiEngine *engine_;
   Sessions sessions_;
   int next_session_id_;
   std::string default_user_agent_;
@@ -0,0 +1,165 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include <cstdlib>
+#include <unistd.h>
+#include "ggadget/native_main_loop.h"
+#include "unittest/gtest.h"
+#include "../curl_xml_http_request.cc"
+
+using namespace ggadget;
+using namespace ggadget::curl;
+
+static NativeMainLoop g_main_loop;
+
+// Records the result of a transfer, and optionally starts another transfer
+// with the same handle when it finishes, like a reopened XMLHttpRequest.
+class TestTransfer : public CurlMultiEngine::Transfer {
+ public:
+  explicit TestTransfer(CurlMultiEngine *engine)
+      : engine_(engine), next_(NULL), done_(false), code_(CURLE_OK) {
+  }
+
+  virtual void OnTransferDone(CURL *curl, CURLcode code) {
+    done_ = true;
+    code_ = code;
+    if (next_)
+      ASSERT_TRUE(engine_->AddTransfer(curl, next_));
+    else
+      curl_easy_cleanup(curl);
+  }
+
+  CurlMultiEngine *engine_;
+  TestTransfer *next_;
+  bool done_;
+  CURLcode code_;
+};
+
+// Cancels the transfer when the first data is received, and lets the
+// transfer finish before the cancellation is handled.
+struct CancellingWriter {
+  CurlMultiEngine *engine;
+  CURL *curl;
+  bool cancelled;
+};
+
+static size_t WriteData(void *ptr, size_t size, size_t nmemb, void *user_p) {
+  CancellingWriter *writer = static_cast<CancellingWriter *>(user_p);
+  if (!writer->cancelled) {
+    writer->cancelled = true;
+    writer->engine->CancelTransfer(writer->curl);
+  }
+  return size * nmemb;
+}
+
+TEST(CurlMultiEngine, CancelFinishedAndReuse) {
+  char path[] = "/tmp/curl_multi_engine_testXXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_NE(-1, fd);
+  ASSERT_EQ(4, write(fd, "data", 4));
+  close(fd);
+
+  CurlMultiEngine engine(&g_main_loop);
+  CURL *curl = curl_easy_init();
+  CancellingWriter writer = { &engine, curl, false };
+  curl_easy_setopt(curl, CURLOPT_URL, (std::string("file://") + path).c_str());
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteData);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &writer);
+
+  TestTransfer first(&engine), second(&engine);
+  first.next_ = &second;
+  ASSERT_TRUE(engine.AddTransfer(curl, &first));
+  for (int i = 0; i < 100 && !second.done_; i++)
+    g_main_loop.DoIteration(false);
+
+  // The cancellation of the first transfer must not affect the second one
+  // which reuses the handle.
+  ASSERT_TRUE(first.done_);
+  EXPECT_EQ(CURLE_OK, first.code_);
+  ASSERT_TRUE(second.done_);
+  EXPECT_EQ(CURLE_OK, second.code_);
+  unlink(path);
+}
+
+// Runs a nested main loop when the first data is received, like alert() in
+// onreadystatechange, after cancelling the transfer.
+struct NestingWriter {
+  CurlMultiEngine *engine;
+  CURL *curl;
+  TestTransfer *transfer;
+  bool nested;
+  bool done_in_callback;
+};
+
+static int g_write_depth = 0;
+static bool g_write_reentered = false;
+
+static size_t NestingWriteData(void *ptr, size_t size, size_t nmemb,
+                               void *user_p) {
+  NestingWriter *writer = static_cast<NestingWriter *>(user_p);
+  if (g_write_depth)
+    g_write_reentered = true;
+  if (!writer->nested) {
+    writer->nested = true;
+    ++g_write_depth;
+    writer->engine->CancelTransfer(writer->curl);
+    for (int i = 0; i < 10; i++)
+      g_main_loop.DoIteration(false);
+    writer->done_in_callback = writer->transfer->done_;
+    --g_write_depth;
+  }
+  return size * nmemb;
+}
+
+TEST(CurlMultiEngine, NestedMainLoop) {
+  char path[] = "/tmp/curl_multi_engine_testXXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_NE(-1, fd);
+  ASSERT_EQ(4, write(fd, "data", 4));
+  close(fd);
+  std::string url = std::string("file://") + path;
+
+  CurlMultiEngine engine(&g_main_loop);
+  TestTransfer first(&engine), second(&engine);
+  NestingWriter writers[] = {
+    { &engine, curl_easy_init(), &first, false, false },
+    { &engine, curl_easy_init(), &second, false, false },
+  };
+  for (size_t i = 0; i < arraysize(writers); i++) {
+    curl_easy_setopt(writers[i].curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(writers[i].curl, CURLOPT_WRITEFUNCTION,
+                     NestingWriteData);
+    curl_easy_setopt(writers[i].curl, CURLOPT_WRITEDATA, &writers[i]);
+    ASSERT_TRUE(engine.AddTransfer(writers[i].curl,
+                                   writers[i].transfer));
+  }
+  for (int i = 0; i < 100 && !(first.done_ && second.done_); i++)
+    g_main_loop.DoIteration(false);
+
+  // Neither libcurl nor the cancellations are run inside the callbacks.
+  EXPECT_FALSE(g_write_reentered);
+  for (size_t i = 0; i < arraysize(writers); i++) {
+    EXPECT_TRUE(writers[i].nested);
+    EXPECT_FALSE(writers[i].done_in_callback);
+    EXPECT_TRUE(writers[i].transfer->done_);
+  }
+  unlink(path);
+}
+
+int main(int argc, char **argv) {
+  testing::ParseGTestFlags(&argc, argv);
+  return RUN_ALL_TESTS();
+}
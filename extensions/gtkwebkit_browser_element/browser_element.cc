@@ -624,6 +624,10 @@ void BrowserElement::Layout() {
   impl_->Layout();
 }
 
+bool BrowserElement::IsLayoutVolatile() const {
+  return true;
+}
+
 void BrowserElement::DoDraw(CanvasInterface *canvas) {
 }
 
@@ -64,6 +64,7 @@ class BrowserElement : public BasicElement {
 
  protected:
   virtual void Layout();
+  virtual bool IsLayoutVolatile() const;
   virtual void DoDraw(CanvasInterface *canvas);
 
  private:
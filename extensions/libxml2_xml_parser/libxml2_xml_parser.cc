@@ -32,6 +32,8 @@ namespace libxml2 {
 
 // Entity will be ignored if size bigger than this limit.
 static const size_t kMaxEntitySize = 65536U;
+// Entity references nested deeper than this will be ignored.
+static const int kMaxEntityDepth = 16;
 
 static inline char *FromXmlCharPtr(xmlChar *xml_char_ptr) {
   return reinterpret_cast<char *>(xml_char_ptr);
@@ -208,7 +210,11 @@ static void ReplaceXMLEncodingDecl(std::string *xml) {
                " encoding=\"UTF-8\"");
 }
 
+class DOMBuilder;
+
 struct ContextData {
+  // Not NULL if the DOM is built by SAX2 callbacks during parsing.
+  DOMBuilder *builder;
   const StringMap *extra_entities;
   getEntitySAXFunc original_get_entity_handler;
   entityDeclSAXFunc original_entity_decl_handler;
@@ -294,159 +300,378 @@ static bool IsBlankText(const char *text) {
   return true;
 }
 
-static bool IsTextNode(xmlNode *xmlnode) {
-  return xmlnode && (xmlnode->type == XML_TEXT_NODE ||
-                     xmlnode->type == XML_ENTITY_REF_NODE);
-}
+// Builds the DOM directly from the SAX2 events of libxml2 during parsing,
+// without the intermediate libxml2 tree of the whole document.
+class DOMBuilder {
+ public:
+  explicit DOMBuilder(DOMDocumentInterface *domdoc)
+      : ctxt_(NULL),
+        domdoc_(domdoc),
+        current_(domdoc),
+        last_cdata_(NULL),
+        text_row_(0),
+        skipped_depth_(0),
+        prev_is_text_(false),
+        has_root_element_(false) {
+  }
 
-static void ConvertCharacterDataIntoDOM(DOMDocumentInterface *domdoc,
-                                        DOMNodeInterface *parent,
-                                        xmlNode *xmlnode) {
-  char *text = FromXmlCharPtr(xmlNodeGetContent(xmlnode));
-  UTF16String utf16_text;
-  if (text) {
-    if (domdoc->PreservesWhiteSpace() ||
-        xmlnode->type != XML_TEXT_NODE ||
-        IsTextNode(xmlnode->prev) || IsTextNode(xmlnode->next) ||
-        !IsBlankText(text)) {
-      // Don't trim the text. The caller can trim based on their own
-      // requirements.
-      ConvertStringUTF8ToUTF16(text, strlen(text), &utf16_text);
+  void SetContext(xmlParserCtxt *ctxt) {
+    ctxt_ = ctxt;
+  }
+
+  // Returns false for the events of the nested contexts in which libxml2
+  // checks the content of entities. Entity references are handled in
+  // AppendReference() instead.
+  bool IsOwnContext(void *ctx) const {
+    return ctx == ctxt_;
+  }
+
+  bool HasRootElement() const {
+    return has_root_element_;
+  }
+
+  void StartElement(const xmlChar *localname, const xmlChar *prefix,
+                    int nb_namespaces, const xmlChar **namespaces,
+                    int nb_attributes, const xmlChar **attributes) {
+    if (skipped_depth_) {
+      skipped_depth_++;
+      return;
+    }
+    FlushText(false);
+    DOMElementInterface *element;
+    domdoc_->CreateElement(FromXmlCharPtr(localname), &element);
+    if (!element || DOM_NO_ERR != current_->AppendChild(element)) {
+      // Unlikely to happen. Skip the whole element.
+      DLOG("Failed to create DOM element or to add it to parent");
+      delete element;
+      skipped_depth_ = 1;
+      return;
+    }
+    if (current_ == domdoc_)
+      has_root_element_ = true;
+    current_ = element;
+    prev_is_text_ = false;
+    last_cdata_ = NULL;
+
+    // We don't support full DOM2 namespaces, but we must keep all namespace
+    // related information in the result DOM.
+    if (prefix)
+      element->SetPrefix(FromXmlCharPtr(prefix));
+    // namespaces contains pairs of prefix and URI.
+    for (int i = 0; i < nb_namespaces; i++) {
+      const xmlChar *ns_prefix = namespaces[i * 2];
+      DOMAttrInterface *attr;
+      if (ns_prefix && *ns_prefix) {
+        // xmlns:prefix="uri" case.
+        domdoc_->CreateAttribute(FromXmlCharPtr(ns_prefix), &attr);
+        if (attr)
+          attr->SetPrefix("xmlns");
+      } else {
+        // xmlns="uri" case.
+        domdoc_->CreateAttribute("xmlns", &attr);
+      }
+      if (!attr || DOM_NO_ERR != element->SetAttributeNode(attr)) {
+        // Unlikely to happen.
+        DLOG("Failed to create xmlns attribute or to add it to element");
+        delete attr;
+        continue;
+      }
+      attr->SetValue(FromXmlCharPtr(namespaces[i * 2 + 1]));
+    }
+
+    // libxml2 doesn't support node column position for now.
+    element->SetRow(GetRow());
+    // attributes contains tuples of localname, prefix, URI, value and end of
+    // value, and the value is not null-terminated.
+    for (int i = 0; i < nb_attributes; i++) {
+      const xmlChar **xmlattr = attributes + i * 5;
+      DOMAttrInterface *attr;
+      domdoc_->CreateAttribute(FromXmlCharPtr(xmlattr[0]), &attr);
+      if (!attr || DOM_NO_ERR != element->SetAttributeNode(attr)) {
+        // Unlikely to happen.
+        DLOG("Failed to create DOM attribute or to add it to element");
+        delete attr;
+        continue;
+      }
+
+      attr->SetValue(DecodeAttributeValue(xmlattr[3], xmlattr[4]).c_str());
+      if (xmlattr[1])
+        attr->SetPrefix(FromXmlCharPtr(xmlattr[1]));
     }
-    xmlFree(text);
   }
 
-  DOMCharacterDataInterface *data = NULL;
-  switch (xmlnode->type) {
-    case XML_TEXT_NODE:
-      // Don't create empty text nodes.
-      if (!utf16_text.empty())
-        data = domdoc->CreateTextNode(utf16_text.c_str());
-      break;
-    case XML_ENTITY_REF_NODE:
-      data = domdoc->CreateTextNode(utf16_text.c_str());
-      break;
-    case XML_CDATA_SECTION_NODE:
-      data = domdoc->CreateCDATASection(utf16_text.c_str());
-      break;
-    case XML_COMMENT_NODE:
-      data = domdoc->CreateComment(utf16_text.c_str());
-      break;
-    default:
-      ASSERT(false);
-      break;
+  void EndElement() {
+    if (skipped_depth_) {
+      skipped_depth_--;
+      return;
+    }
+    FlushText(false);
+    DOMNodeInterface *parent = current_->GetParentNode();
+    ASSERT(parent);
+    if (parent)
+      current_ = parent;
+    prev_is_text_ = false;
+    last_cdata_ = NULL;
   }
-  if (data) {
-    data->SetRow(static_cast<int>(xmlGetLineNo(xmlnode)));
-    parent->AppendChild(data);
+
+  void AppendText(const xmlChar *text, int len) {
+    if (skipped_depth_)
+      return;
+    if (text_.empty())
+      text_row_ = GetRow();
+    text_.append(FromXmlCharPtr(text), len);
   }
-}
 
-static void ConvertPIIntoDOM(DOMDocumentInterface *domdoc,
-                             DOMNodeInterface *parent,
-                             xmlNode *xmlpi) {
-  const char *target = FromXmlCharPtr(xmlpi->name);
-  char *data = FromXmlCharPtr(xmlNodeGetContent(xmlpi));
-  DOMProcessingInstructionInterface *pi;
-  domdoc->CreateProcessingInstruction(target, data, &pi);
-  if (pi) {
-    pi->SetRow(static_cast<int>(xmlGetLineNo(xmlpi)));
-    parent->AppendChild(pi);
-  }
-  if (data)
-    xmlFree(data);
-}
+  void AppendCDATA(const xmlChar *value, int len) {
+    if (skipped_depth_)
+      return;
+    FlushText(false);
+    UTF16String utf16_value;
+    ConvertStringUTF8ToUTF16(FromXmlCharPtr(value), len, &utf16_value);
+    prev_is_text_ = false;
+    if (last_cdata_) {
+      // A CDATA section may be reported in several blocks.
+      last_cdata_->AppendData(utf16_value);
+      return;
+    }
+    last_cdata_ = domdoc_->CreateCDATASection(utf16_value);
+    AppendCharacterData(last_cdata_, GetRow());
+  }
 
-static void ConvertElementIntoDOM(DOMDocumentInterface *domdoc,
-                                  DOMNodeInterface *parent,
-                                  xmlNode *xmlele);
-
-static void ConvertChildrenIntoDOM(DOMDocumentInterface *domdoc,
-                                   DOMNodeInterface *parent,
-                                   xmlNode *xmlnode) {
-  for (xmlNode *child = xmlnode->children; child != NULL; child = child->next) {
-    switch (child->type) {
-      case XML_ELEMENT_NODE:
-        ConvertElementIntoDOM(domdoc, parent, child);
-        break;
-      case XML_TEXT_NODE:
-      case XML_ENTITY_REF_NODE:
-      case XML_CDATA_SECTION_NODE:
-      case XML_COMMENT_NODE:
-        ConvertCharacterDataIntoDOM(domdoc, parent, child);
-        break;
-      case XML_PI_NODE:
-        ConvertPIIntoDOM(domdoc, parent, child);
-        break;
-      case XML_DTD_NODE:
-        break;
-      default:
-        DLOG("Ignore XML Node of type %d", child->type);
-        break;
+  void AppendComment(const xmlChar *value) {
+    if (skipped_depth_)
+      return;
+    FlushText(false);
+    UTF16String utf16_value;
+    if (value) {
+      const char *utf8_value = FromXmlCharPtr(value);
+      ConvertStringUTF8ToUTF16(utf8_value, strlen(utf8_value), &utf16_value);
     }
+    AppendCharacterData(domdoc_->CreateComment(utf16_value), GetRow());
+    prev_is_text_ = false;
+    last_cdata_ = NULL;
   }
-}
 
-static void ConvertElementIntoDOM(DOMDocumentInterface *domdoc,
-                                  DOMNodeInterface *parent,
-                                  xmlNode *xmlele) {
-  DOMElementInterface *element;
-  domdoc->CreateElement(FromXmlCharPtr(xmlele->name), &element);
-  if (!element || DOM_NO_ERR != parent->AppendChild(element)) {
-    // Unlikely to happen.
-    DLOG("Failed to create DOM element or to add it to parent");
-    delete element;
-    return;
+  void AppendPI(const xmlChar *target, const xmlChar *data) {
+    if (skipped_depth_)
+      return;
+    FlushText(false);
+    DOMProcessingInstructionInterface *pi;
+    domdoc_->CreateProcessingInstruction(FromXmlCharPtr(target),
+                                         data ? FromXmlCharPtr(data) : "",
+                                         &pi);
+    if (pi) {
+      pi->SetRow(GetRow());
+      current_->AppendChild(pi);
+    }
+    prev_is_text_ = false;
+    last_cdata_ = NULL;
   }
 
-  // We don't support full DOM2 namespaces, but we must keep all namespace
-  // related information in the result DOM.
-  if (xmlele->ns && xmlele->ns->prefix)
-    element->SetPrefix(FromXmlCharPtr(xmlele->ns->prefix));
-  for (xmlNsPtr ns = xmlele->nsDef; ns; ns = ns->next) {
-    DOMAttrInterface *attr;
-    if (ns->prefix && *ns->prefix) {
-      // xmlns:prefix="uri" case.
-      domdoc->CreateAttribute(FromXmlCharPtr(ns->prefix), &attr);
-      if (attr)
-        attr->SetPrefix("xmlns");
-    } else {
-      // xmlns="uri" case.
-      domdoc->CreateAttribute("xmlns", &attr);
+  // An entity reference becomes a text node of the expanded entity.
+  void AppendReference(const xmlChar *name) {
+    if (skipped_depth_)
+      return;
+    FlushText(true);
+    std::string text;
+    xmlEntity *entity = ctxt_->sax->getEntity(ctxt_, name);
+    if (entity)
+      AppendEntityText(entity, 0, &text);
+    UTF16String utf16_text;
+    ConvertStringUTF8ToUTF16(text, &utf16_text);
+    AppendCharacterData(domdoc_->CreateTextNode(utf16_text), GetRow());
+    prev_is_text_ = true;
+    last_cdata_ = NULL;
+  }
+
+  void Finish() {
+    FlushText(false);
+  }
+
+  // Removes the partial DOM of a document failed to parse.
+  void Clear() {
+    text_.clear();
+    last_cdata_ = NULL;
+    current_ = domdoc_;
+    DOMNodeInterface *child;
+    while ((child = domdoc_->GetFirstChild()) != NULL)
+      domdoc_->RemoveChild(child);
+  }
+
+ private:
+  int GetRow() const {
+    return ctxt_->input ? ctxt_->input->line : 0;
+  }
+
+  void AppendCharacterData(DOMCharacterDataInterface *data, int row) {
+    if (data) {
+      data->SetRow(row);
+      current_->AppendChild(data);
     }
-    if (!attr || DOM_NO_ERR != element->SetAttributeNode(attr)) {
-      // Unlikely to happen.
-      DLOG("Failed to create xmlns attribute or to add it to element");
-      delete attr;
-      continue;
+  }
+
+  // Appends the pending text. Blank text is omitted unless white spaces are
+  // preserved or it's adjacent to other text, for example, an entity
+  // reference.
+  void FlushText(bool next_is_text) {
+    if (text_.empty())
+      return;
+    if (domdoc_->PreservesWhiteSpace() || prev_is_text_ || next_is_text ||
+        !IsBlankText(text_.c_str())) {
+      // Don't trim the text. The caller can trim based on their own
+      // requirements.
+      UTF16String utf16_text;
+      ConvertStringUTF8ToUTF16(text_, &utf16_text);
+      AppendCharacterData(domdoc_->CreateTextNode(utf16_text), text_row_);
     }
-    attr->SetValue(FromXmlCharPtr(ns->href));
-  }
-
-  // libxml2 doesn't support node column position for now.
-  element->SetRow(static_cast<int>(xmlGetLineNo(xmlele)));
-  for (xmlAttr *xmlattr = xmlele->properties; xmlattr != NULL;
-       xmlattr = xmlattr->next) {
-    const char *name = FromXmlCharPtr(xmlattr->name);
-    DOMAttrInterface *attr;
-    domdoc->CreateAttribute(name, &attr);
-    if (!attr || DOM_NO_ERR != element->SetAttributeNode(attr)) {
-      // Unlikely to happen.
-      DLOG("Failed to create DOM attribute or to add it to element");
-      delete attr;
-      continue;
+    text_.clear();
+    prev_is_text_ = true;
+    last_cdata_ = NULL;
+  }
+
+  // Appends the expanded text of an entity. The entity content is not parsed
+  // into libxml2 nodes in SAX mode, so it's parsed here. The nested entity
+  // references in it are left empty by libxml2, because the nested entities
+  // have been checked but not built, so they are expanded here too. The text
+  // is cached as the only child of the entity, like ExpandEntity() does.
+  void AppendEntityText(xmlEntity *entity, int depth, std::string *text) {
+    if (!entity->children && entity->content) {
+      if (depth > kMaxEntityDepth) {
+        LOG("Entity '%s' is nested too deeply, ignored", entity->name);
+        return;
+      }
+      std::string expanded;
+      xmlNode *list = NULL;
+      if (xmlParseBalancedChunkMemory(ctxt_->myDoc, NULL, NULL, 0,
+                                      entity->content, &list) == 0) {
+        for (xmlNode *node = list; node; node = node->next)
+          AppendNodeText(node, depth, &expanded);
+        xmlFreeNodeList(list);
+      }
+      if (expanded.size() > kMaxEntitySize) {
+        LOG("Entity '%s' is too long, truncated", entity->name);
+        expanded.resize(kMaxEntitySize);
+      }
+      xmlAddChild(reinterpret_cast<xmlNode *>(entity),
+                  xmlNewTextLen(ToXmlCharPtr(expanded.c_str()),
+                                static_cast<int>(expanded.size())));
+      entity->length = static_cast<int>(expanded.size());
     }
+    for (xmlNode *child = entity->children; child; child = child->next)
+      AppendNodeText(child, depth, text);
+  }
 
-    char *value = FromXmlCharPtr(
-        xmlNodeGetContent(reinterpret_cast<xmlNode *>(xmlattr)));
-    attr->SetValue(value);
-    if (xmlattr->ns)
-      attr->SetPrefix(FromXmlCharPtr(xmlattr->ns->prefix));
-    if (value)
-      xmlFree(value);
+  // Appends the text of a node of parsed entity content, with markup
+  // flattened.
+  void AppendNodeText(xmlNode *node, int depth, std::string *text) {
+    if (text->size() > kMaxEntitySize)
+      return;
+    if (node->type == XML_ENTITY_REF_NODE) {
+      xmlEntity *nested = ctxt_->sax->getEntity(ctxt_, node->name);
+      if (nested)
+        AppendEntityText(nested, depth + 1, text);
+    } else if (node->type == XML_ELEMENT_NODE) {
+      for (xmlNode *child = node->children; child; child = child->next)
+        AppendNodeText(child, depth, text);
+    } else if (node->content) {
+      text->append(FromXmlCharPtr(node->content));
+    }
+  }
+
+  // Attribute values may still contain entity references, and '&' in them
+  // is kept as a character reference.
+  std::string DecodeAttributeValue(const xmlChar *value,
+                                   const xmlChar *value_end) {
+    const char *start = FromXmlCharPtr(value);
+    size_t len = value_end - value;
+    if (!memchr(start, '&', len))
+      return std::string(start, len);
+
+    std::string result;
+    ctxt_->depth++;
+    char *decoded = FromXmlCharPtr(xmlStringLenDecodeEntities(
+        ctxt_, value, static_cast<int>(len), XML_SUBSTITUTE_REF, 0, 0, 0));
+    ctxt_->depth--;
+    if (decoded) {
+      result = decoded;
+      xmlFree(decoded);
+    }
+    return result;
+  }
+
+  xmlParserCtxt *ctxt_;
+  DOMDocumentInterface *domdoc_;
+  DOMNodeInterface *current_;
+  // The last appended CDATA section, if no other node has been added since.
+  DOMCDATASectionInterface *last_cdata_;
+  std::string text_;
+  int text_row_;
+  // Depth inside an element failed to be added, whose content is skipped.
+  int skipped_depth_;
+  bool prev_is_text_;
+  bool has_root_element_;
+};
+
+static DOMBuilder *GetDOMBuilder(void *ctx) {
+  xmlParserCtxt *ctxt = static_cast<xmlParserCtxt *>(ctx);
+  ContextData *data = static_cast<ContextData *>(ctxt->_private);
+  return data && data->builder->IsOwnContext(ctx) ? data->builder : NULL;
+}
+
+static void StartElementNsHandler(void *ctx, const xmlChar *localname,
+                                  const xmlChar *prefix, const xmlChar *uri,
+                                  int nb_namespaces,
+                                  const xmlChar **namespaces,
+                                  int nb_attributes, int nb_defaulted,
+                                  const xmlChar **attributes) {
+  GGL_UNUSED(uri);
+  GGL_UNUSED(nb_defaulted);
+  DOMBuilder *builder = GetDOMBuilder(ctx);
+  if (builder) {
+    builder->StartElement(localname, prefix, nb_namespaces, namespaces,
+                          nb_attributes, attributes);
   }
+}
+
+static void EndElementNsHandler(void *ctx, const xmlChar *localname,
+                                const xmlChar *prefix, const xmlChar *uri) {
+  GGL_UNUSED(localname);
+  GGL_UNUSED(prefix);
+  GGL_UNUSED(uri);
+  DOMBuilder *builder = GetDOMBuilder(ctx);
+  if (builder)
+    builder->EndElement();
+}
+
+static void CharactersHandler(void *ctx, const xmlChar *ch, int len) {
+  DOMBuilder *builder = GetDOMBuilder(ctx);
+  if (builder)
+    builder->AppendText(ch, len);
+}
+
+static void CDATABlockHandler(void *ctx, const xmlChar *value, int len) {
+  DOMBuilder *builder = GetDOMBuilder(ctx);
+  if (builder)
+    builder->AppendCDATA(value, len);
+}
+
+static void CommentHandler(void *ctx, const xmlChar *value) {
+  DOMBuilder *builder = GetDOMBuilder(ctx);
+  if (builder)
+    builder->AppendComment(value);
+}
 
-  ConvertChildrenIntoDOM(domdoc, element, xmlele);
+static void ProcessingInstructionHandler(void *ctx, const xmlChar *target,
+                                         const xmlChar *data) {
+  DOMBuilder *builder = GetDOMBuilder(ctx);
+  if (builder)
+    builder->AppendPI(target, data);
+}
+
+static void ReferenceHandler(void *ctx, const xmlChar *name) {
+  DOMBuilder *builder = GetDOMBuilder(ctx);
+  if (builder)
+    builder->AppendReference(name);
 }
 
 static const char* SkipSpaces(const char* str) {
@@ -631,11 +856,15 @@ static bool ConvertToUTF8(const std::string &content, const char *filename,
   return result;
 }
 
+// If domdoc is not NULL, the DOM is built into it during parsing, and the
+// returned document contains only the DTD, because building the libxml2 tree
+// of a large document and then converting it doubles the peak memory usage.
 static xmlDoc *ParseXML(const std::string &xml,
                         const StringMap *extra_entities,
                         const char *filename,
                         const char *encoding_hint,
                         const char *encoding_fallback,
+                        DOMDocumentInterface *domdoc,
                         std::string *encoding,
                         std::string *utf8_content) {
   xmlDoc *xmldoc = NULL;
@@ -652,7 +881,7 @@ static xmlDoc *ParseXML(const std::string &xml,
   // possible to recover from encoding conversion failures.
   if (!ConvertToUTF8(xml, filename, NULL, encoding_hint, encoding_fallback,
                      &use_encoding, &converted_xml)) {
-    return false;
+    return NULL;
   }
 
   if (utf8_content)
@@ -668,7 +897,9 @@ static xmlDoc *ParseXML(const std::string &xml,
     return NULL;
 
   ASSERT(ctxt->sax);
+  DOMBuilder builder(domdoc);
   ContextData data;
+  data.builder = NULL;
   ctxt->_private = &data;
   if (extra_entities) {
     // Hook getEntity handler to provide extra entities.
@@ -682,6 +913,19 @@ static xmlDoc *ParseXML(const std::string &xml,
   ctxt->sax->entityDecl = EntityDeclHandler;
   ctxt->sax->resolveEntity = NULL;
 
+  if (domdoc) {
+    builder.SetContext(ctxt);
+    data.builder = &builder;
+    ctxt->sax->startElementNs = StartElementNsHandler;
+    ctxt->sax->endElementNs = EndElementNsHandler;
+    ctxt->sax->characters = CharactersHandler;
+    ctxt->sax->ignorableWhitespace = CharactersHandler;
+    ctxt->sax->cdataBlock = CDATABlockHandler;
+    ctxt->sax->comment = CommentHandler;
+    ctxt->sax->processingInstruction = ProcessingInstructionHandler;
+    ctxt->sax->reference = ReferenceHandler;
+  }
+
   // Let the built-in libxml2 error reporter print the correct filename.
   ctxt->input->filename = xmlMemStrdup(filename);
 
@@ -690,12 +934,22 @@ static xmlDoc *ParseXML(const std::string &xml,
   xmlParseDocument(ctxt);
   xmlSetGenericErrorFunc(NULL, old_error_func);
 
-  if (ctxt->wellFormed) {
+  bool succeeded = ctxt->wellFormed && ctxt->myDoc;
+  if (succeeded && domdoc) {
+    builder.Finish();
+    if (!builder.HasRootElement()) {
+      LOG("No root element in XML file: %s", filename);
+      succeeded = false;
+    }
+  }
+  if (succeeded) {
     // Successfully parsed the document.
     xmldoc = ctxt->myDoc;
   } else {
     xmlFreeDoc(ctxt->myDoc);
     ctxt->myDoc = NULL;
+    if (domdoc)
+      builder.Clear();
   }
   xmlFreeParserCtxt(ctxt);
 
@@ -760,18 +1014,11 @@ class XMLParser : public XMLParserInterface {
       ASSERT(!domdoc || !domdoc->HasChildNodes());
       xmlDoc *xmldoc = ParseXML(content, extra_entities, filename,
                                 encoding_hint, encoding_fallback,
-                                encoding, utf8_content);
+                                domdoc, encoding, utf8_content);
       if (!xmldoc) {
         result = false;
       } else {
-        if (!xmlDocGetRootElement(xmldoc)) {
-          LOG("No root element in XML file: %s", filename);
-          result = false;
-        } else {
-          ConvertChildrenIntoDOM(domdoc, domdoc,
-                                 reinterpret_cast<xmlNode *>(xmldoc));
-          domdoc->Normalize();
-        }
+        domdoc->Normalize();
         xmlFreeDoc(xmldoc);
       }
     } else {
@@ -792,7 +1039,7 @@ class XMLParser : public XMLParserInterface {
                                     const char *encoding_fallback,
                                     StringMap *table) {
     xmlDoc *xmldoc = ParseXML(xml, extra_entities, filename, encoding_hint,
-                              encoding_fallback, NULL, NULL);
+                              encoding_fallback, NULL, NULL, NULL);
     if (!xmldoc)
       return false;
 
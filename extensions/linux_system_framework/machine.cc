@@ -40,74 +40,75 @@ static const char* kKeysInMachineInfo[] = {
 // Represents the file names for reading CPU info.
 static const char kCPUInfoFile[] = "/proc/cpuinfo";
 
-Machine::Machine() {
+// The Hal specification changed one time, so both new and old property
+// names are queried.
+static const char *kHalProperties[][2] = {
+  { kHalPropSystemUUID, kHalPropSystemUUIDOld },
+  { kHalPropSystemVendor, kHalPropSystemVendorOld },
+  { kHalPropSystemProduct, kHalPropSystemProductOld },
+};
+
+Machine::Machine() : hal_proxy_(NULL), hal_batch_(NULL) {
   InitArchInfo();
   InitProcInfo();
-  DBusProxy *proxy = DBusProxy::NewSystemProxy(kHalDBusName,
-                                               kHalObjectComputer,
-                                               kHalInterfaceDevice);
-  if (!proxy) {
+  hal_proxy_ = DBusProxy::NewSystemProxy(kHalDBusName, kHalObjectComputer,
+                                         kHalInterfaceDevice);
+  if (!hal_proxy_) {
     DLOG("Failed to connect to DBus Hal service.");
     return;
   }
 
-  DBusStringReceiver string_receiver;
-
-  if (!proxy->CallMethod(kHalMethodGetProperty, true, kDefaultDBusTimeout,
-                         string_receiver.NewSlot(),
-                         MESSAGE_TYPE_STRING, kHalPropSystemUUID,
-                         MESSAGE_TYPE_INVALID)) {
-    /** The Hal specification changed one time. */
-    proxy->CallMethod(kHalMethodGetProperty, true, kDefaultDBusTimeout,
-                      string_receiver.NewSlot(),
-                      MESSAGE_TYPE_STRING, kHalPropSystemUUIDOld,
-                      MESSAGE_TYPE_INVALID);
-  }
-  serial_number_ = string_receiver.GetValue();
-  string_receiver.Reset();
-
-  /** get machine vendor */
-  if (!proxy->CallMethod(kHalMethodGetProperty, true, kDefaultDBusTimeout,
-                         string_receiver.NewSlot(),
-                         MESSAGE_TYPE_STRING, kHalPropSystemVendor,
-                         MESSAGE_TYPE_INVALID)) {
-    /** The Hal specification changed one time. */
-    proxy->CallMethod(kHalMethodGetProperty, true, kDefaultDBusTimeout,
-                      string_receiver.NewSlot(),
-                      MESSAGE_TYPE_STRING, kHalPropSystemVendorOld,
-                      MESSAGE_TYPE_INVALID);
-  }
-  machine_vendor_ = string_receiver.GetValue();
-  string_receiver.Reset();
-
-  /** get machine model*/
-  if (!proxy->CallMethod(kHalMethodGetProperty, true, kDefaultDBusTimeout,
-                         string_receiver.NewSlot(),
-                         MESSAGE_TYPE_STRING, kHalPropSystemProduct,
-                         MESSAGE_TYPE_INVALID)) {
-    /** The Hal specification changed one time. */
-    proxy->CallMethod(kHalMethodGetProperty, true, kDefaultDBusTimeout,
-                      string_receiver.NewSlot(),
-                      MESSAGE_TYPE_STRING, kHalPropSystemProductOld,
-                      MESSAGE_TYPE_INVALID);
+  // All properties are queried in one batch to avoid waiting for each reply,
+  // and the batch is only waited for when a property is needed.
+  hal_batch_ = new DBusCallBatch();
+  for (size_t i = 0; i < arraysize(kHalProperties); ++i) {
+    for (size_t j = 0; j < 2; ++j) {
+      Variant name(kHalProperties[i][j]);
+      hal_batch_->AddMethodCall(hal_proxy_, kHalMethodGetProperty, 1, &name);
+    }
   }
-  machine_model_ = string_receiver.GetValue();
-
-  delete proxy;
+  hal_batch_->Start(false, kDefaultDBusTimeout,
+                    NewSlot(this, &Machine::OnHalPropertiesReceived));
 }
 
 Machine::~Machine() {
+  delete hal_batch_;
+  delete hal_proxy_;
+}
+
+void Machine::OnHalPropertiesReceived() {
+  std::string *values[] = {
+    &serial_number_, &machine_vendor_, &machine_model_
+  };
+  for (size_t i = 0; i < arraysize(kHalProperties); ++i) {
+    int call = static_cast<int>(i * 2);
+    if (!hal_batch_->IsSucceeded(call))
+      ++call;
+    hal_batch_->GetResult(call, 0).ConvertToString(values[i]);
+  }
+  // The proxy is kept until the machine is deleted, because deleting a proxy
+  // in the callback of its own call is not safe.
+  delete hal_batch_;
+  hal_batch_ = NULL;
+}
+
+void Machine::WaitForHalProperties() const {
+  if (hal_batch_)
+    hal_batch_->Wait();
 }
 
 std::string Machine::GetBiosSerialNumber() const {
+  WaitForHalProperties();
   return serial_number_;
 }
 
 std::string Machine::GetMachineManufacturer() const {
+  WaitForHalProperties();
   return machine_vendor_;
 }
 
 std::string Machine::GetMachineModel() const {
+  WaitForHalProperties();
   return machine_model_;
 }
 
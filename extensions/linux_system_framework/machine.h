@@ -19,6 +19,7 @@
 
 #include <string>
 #include <ggadget/framework_interface.h>
+#include <ggadget/dbus/dbus_proxy.h>
 
 namespace ggadget {
 namespace framework {
@@ -54,6 +55,12 @@ class Machine : public MachineInterface {
    */
   void InitProcInfo();
 
+  /** Stores the properties returned by Hal. */
+  void OnHalPropertiesReceived();
+
+  /** Blocks until the properties are returned by Hal, if still pending. */
+  void WaitForHalProperties() const;
+
  private:
   enum {
     CPU_FAMILY,
@@ -69,6 +76,8 @@ class Machine : public MachineInterface {
   std::string serial_number_;
   std::string machine_vendor_;
   std::string machine_model_;
+  dbus::DBusProxy *hal_proxy_;
+  dbus::DBusCallBatch *hal_batch_;
 
   std::string sysinfo_[CPU_KEYS_COUNT];
   int cpu_count_;
@@ -37,13 +37,28 @@ static const int kDeviceTypeEthernet = NM_DEVICE_TYPE_ETHERNET;
 
 static const int kDeviceTypeUnknown = 0;
 
+// Gets a property of a device from the result of the call of
+// GetAllProperties() in the batch.
+static Variant GetDeviceProperty(const DBusCallBatch &batch, int call,
+                                 const char *name) {
+  Variant properties = batch.GetResult(call, 0);
+  if (properties.type() == Variant::TYPE_SCRIPTABLE) {
+    ScriptableInterface *dict =
+        VariantValue<ScriptableInterface *>()(properties);
+    if (dict)
+      return dict->GetProperty(name).v();
+  }
+  return Variant();
+}
+
 Network::Network()
   : is_new_api_(false),
     is_online_(true), // treats online by default
     connection_type_(CONNECTION_TYPE_802_3),
     physcial_media_type_(PHYSICAL_MEDIA_TYPE_UNSPECIFIED),
     network_manager_(NULL),
-    on_signal_connection_(NULL) {
+    on_signal_connection_(NULL),
+    update_batch_(NULL) {
   network_manager_ = DBusProxy::NewSystemProxy(NM_DBUS_SERVICE, NM_DBUS_PATH,
                                                NM_DBUS_INTERFACE);
   if (!network_manager_) {
@@ -84,6 +99,7 @@ Network::Network()
 Network::~Network() {
   if (on_signal_connection_)
     on_signal_connection_->Disconnect();
+  CancelUpdate();
   delete network_manager_;
 }
 
@@ -112,67 +128,107 @@ void Network::OnSignal(const std::string &name, int argc, const Variant *argv) {
     Update();
 }
 
+void Network::CancelUpdate() {
+  // The batch is deleted first, so that its pending calls won't fail when
+  // the devices are deleted.
+  delete update_batch_;
+  update_batch_ = NULL;
+  for (size_t i = 0; i < devices_.size(); ++i)
+    delete devices_[i];
+  devices_.clear();
+}
+
+// The information is updated asynchronously in two steps, getting the list of
+// devices, then the states of all devices at once, to avoid blocking the main
+// loop while waiting for replies.
 void Network::Update() {
   DLOG("Update network information.");
+  CancelUpdate();
+  update_batch_ = new DBusCallBatch();
+  update_batch_->AddMethodCall(network_manager_,
+                               is_new_api_ ? "GetDevices" : "getDevices",
+                               0, NULL);
+  update_batch_->Start(false, kDefaultDBusTimeout,
+                       NewSlot(this, &Network::OnDevicesReceived));
+}
+
+void Network::OnDevicesReceived() {
   StringVector devices;
   DBusStringArrayReceiver result(&devices);
+  if (update_batch_->IsSucceeded(0))
+    result.Callback(0, update_batch_->GetResult(0, 0));
+  // Deleting the batch in its callback is allowed.
+  CancelUpdate();
+
+  std::string dev_interface(NM_DBUS_INTERFACE);
+  dev_interface.append(is_new_api_ ? ".Device" : ".Devices");
+  for(StringVector::iterator it = devices.begin();
+      it != devices.end(); ++it) {
+    DLOG("Found network device: %s", it->c_str());
+    DBusProxy *dev = DBusProxy::NewSystemProxy(NM_DBUS_SERVICE, *it,
+                                               dev_interface);
+    if (dev)
+      devices_.push_back(dev);
+    else
+      DLOG("Failed to create dbus object for device: %s", it->c_str());
+  }
 
-  if (network_manager_->CallMethod(is_new_api_ ? "GetDevices" : "getDevices",
-                                   true, kDefaultDBusTimeout, result.NewSlot(),
-                                   MESSAGE_TYPE_INVALID) && devices.size()) {
-    std::string dev_interface(NM_DBUS_INTERFACE);
-    dev_interface.append(is_new_api_ ? ".Device" : ".Devices");
-    for(StringVector::iterator it = devices.begin();
-        it != devices.end(); ++it) {
-      DLOG("Found network device: %s", it->c_str());
-      DBusProxy *dev = DBusProxy::NewSystemProxy(NM_DBUS_SERVICE, *it,
-                                                 dev_interface);
-      if (dev) {
-        bool active = false;
-        int type = kDeviceTypeUnknown;
-        if (is_new_api_) {
-          int state;
-          if (dev->GetProperty("State").v().ConvertToInt(&state))
-            active = (state == 8); // NM_DEVICE_STATE_ACTIVATED
-        } else {
-          DBusBooleanReceiver result;
-          if (dev->CallMethod("getLinkActive", true, kDefaultDBusTimeout,
-                              result.NewSlot(), MESSAGE_TYPE_INVALID))
-            active = result.GetValue();
-        }
-
-        if (active) {
-          if (is_new_api_) {
-            dev->GetProperty("DeviceType").v().ConvertToInt(&type);
-          } else {
-            DBusIntReceiver result;
-            if (dev->CallMethod("getType", true, kDefaultDBusTimeout,
-                                result.NewSlot(), MESSAGE_TYPE_INVALID))
-              type = static_cast<int>(result.GetValue());
-          }
-          DLOG("device %s is active, type: %d", it->c_str(), type);
-        }
-        delete dev;
-
-        if (active) {
-          if (type == kDeviceTypeEthernet) {
-            connection_type_ = CONNECTION_TYPE_802_3;
-            physcial_media_type_ = PHYSICAL_MEDIA_TYPE_UNSPECIFIED;
-          } else if (type == kDeviceTypeWifi) {
-            connection_type_ = CONNECTION_TYPE_NATIVE_802_11;
-            physcial_media_type_ = PHYSICAL_MEDIA_TYPE_NATIVE_802_11;
-          } else {
-            connection_type_ = CONNECTION_TYPE_UNKNOWN;
-            physcial_media_type_ = PHYSICAL_MEDIA_TYPE_UNSPECIFIED;
-          }
-
-          // No need to check more devices.
-          if (connection_type_ != CONNECTION_TYPE_UNKNOWN)
-            break;
-        }
+  // Fetches the states of all devices at once, instead of waiting for each
+  // property of each device. nm 0.6.x doesn't support GetAll, so two methods
+  // are called for each device instead.
+  update_batch_ = new DBusCallBatch();
+  for (size_t i = 0; i < devices_.size(); ++i) {
+    if (is_new_api_) {
+      update_batch_->AddGetAllProperties(devices_[i]);
+    } else {
+      update_batch_->AddMethodCall(devices_[i], "getLinkActive", 0, NULL);
+      update_batch_->AddMethodCall(devices_[i], "getType", 0, NULL);
+    }
+  }
+  update_batch_->Start(false, kDefaultDBusTimeout,
+                       NewSlot(this, &Network::OnDevicesUpdated));
+}
+
+// The batch and the devices are kept until the next update, because deleting
+// a proxy in the callback of its own call is not safe.
+void Network::OnDevicesUpdated() {
+  for (size_t i = 0; i < devices_.size(); ++i) {
+    bool active = false;
+    int type = kDeviceTypeUnknown;
+    if (is_new_api_) {
+      int call = static_cast<int>(i);
+      int state;
+      if (GetDeviceProperty(*update_batch_, call,
+                            "State").ConvertToInt(&state))
+        active = (state == 8); // NM_DEVICE_STATE_ACTIVATED
+      if (active)
+        GetDeviceProperty(*update_batch_, call,
+                          "DeviceType").ConvertToInt(&type);
+    } else {
+      int call = static_cast<int>(i * 2);
+      update_batch_->GetResult(call, 0).ConvertToBool(&active);
+      if (active)
+        update_batch_->GetResult(call + 1, 0).ConvertToInt(&type);
+    }
+
+    if (active) {
+      DLOG("device %s is active, type: %d",
+           devices_[i]->GetPath().c_str(), type);
+
+      if (type == kDeviceTypeEthernet) {
+        connection_type_ = CONNECTION_TYPE_802_3;
+        physcial_media_type_ = PHYSICAL_MEDIA_TYPE_UNSPECIFIED;
+      } else if (type == kDeviceTypeWifi) {
+        connection_type_ = CONNECTION_TYPE_NATIVE_802_11;
+        physcial_media_type_ = PHYSICAL_MEDIA_TYPE_NATIVE_802_11;
       } else {
-        DLOG("Failed to create dbus object for device: %s", it->c_str());
+        connection_type_ = CONNECTION_TYPE_UNKNOWN;
+        physcial_media_type_ = PHYSICAL_MEDIA_TYPE_UNSPECIFIED;
       }
+
+      // No need to check more devices.
+      if (connection_type_ != CONNECTION_TYPE_UNKNOWN)
+        break;
     }
   }
 
@@ -55,6 +55,9 @@ class Network : public NetworkInterface {
  private:
   void OnSignal(const std::string &name, int argc, const Variant *argv);
   void Update();
+  void CancelUpdate();
+  void OnDevicesReceived();
+  void OnDevicesUpdated();
 
  private:
   // true if using nm 0.7 or above, false if using nm 0.6.x
@@ -65,6 +68,9 @@ class Network : public NetworkInterface {
 
   DBusProxy *network_manager_;
   Connection *on_signal_connection_;
+  // The batch of calls to update the information and the devices it queries.
+  DBusCallBatch *update_batch_;
+  std::vector<DBusProxy *> devices_;
   Wireless wireless_;
 
   DISALLOW_EVIL_CONSTRUCTORS(Network);
@@ -20,129 +20,64 @@
 #include <map>
 #include <cmath>
 #include <cstring>
+#include <string>
 #include <ggadget/common.h>
 #include <ggadget/light_map.h>
 #include <ggadget/main_loop_interface.h>
+#include "proc_sampler.h"
 
 namespace ggadget {
 namespace framework {
 namespace linux_system {
 
-// Internal structure for holding real-time CPU statistics.
-// All fields in this structure are measured in units of USER_HZ.
-struct CpuStat {
-  CpuStat()
-      : user(0),
-        nice(0),
-        system(0),
-        idle(0),
-        iowait(0),
-        hardirq(0),
-        softirq(0),
-        steal(0),
-        uptime(0),
-        worktime(0) {}
-  int64_t user;
-  int64_t nice;
-  int64_t system;
-  int64_t idle;
-  int64_t iowait;
-  int64_t hardirq;
-  int64_t softirq;
-  int64_t steal;
-  int64_t uptime;
-  int64_t worktime;
-};
-
-// the threshold for distinguish different cpu usage value.
-static const double kCpuUsageThreshold = 0.001;
-// the max length of a line
-static const int kMaxLineLength = 1024;
+// the threshold for distinguish different cpu usage value (in percent).
+static const double kCpuUsageThreshold = 0.1;
 // the time interval for time out watch (milliseconds)
 static const int kUpdateInterval = 2000;
 
-// the filename for CPU state in proc system
-static const char kProcStatFile[] = "/proc/stat";
 // the cpu usage operation
 static const char kPerfmonCpuUsage[] = "\\Processor(_Total)\\% Processor Time";
-// the cpu state head name
-static const char kCpuHeader[] = "cpu";
-
-// the current cpu usage status
-static CpuStat current_cpu_status;
-// the last cpu usage status
-static CpuStat last_cpu_status;
-
-// Gets the current cpu usage
-static double GetCurrentCpuUsage() {
-  FILE* fp = fopen(kProcStatFile, "rt");
-  if (!fp)
-    return 0.0;
-
-  char line[kMaxLineLength];
-
-  if (!fgets(line, kMaxLineLength, fp)) {
-    fclose(fp);
-    return 0.0;
-  }
-
-  fclose(fp);
-
-  if (strlen(line) < arraysize(kCpuHeader))
-    return 0.0;
-
-  if (!strncmp(line, kCpuHeader, arraysize(kCpuHeader) - 1)) {
-    sscanf(line + arraysize(kCpuHeader),
-           "%jd %jd %jd %jd %jd %jd %jd",
-           &current_cpu_status.user,
-           &current_cpu_status.nice,
-           &current_cpu_status.system,
-           &current_cpu_status.idle,
-           &current_cpu_status.iowait,
-           &current_cpu_status.hardirq,
-           &current_cpu_status.softirq);
-
-    // calculates the cpu total time
-    current_cpu_status.uptime =
-      current_cpu_status.user + current_cpu_status.nice +
-      current_cpu_status.system + current_cpu_status.idle +
-      current_cpu_status.iowait + current_cpu_status.hardirq +
-      current_cpu_status.softirq;
-
-    // calculates the cpu working time
-    current_cpu_status.worktime =
-          current_cpu_status.user + current_cpu_status.nice +
-          current_cpu_status.system + current_cpu_status.hardirq +
-          current_cpu_status.softirq;
-
-    // calculates percentage of cpu usage
-    int64_t current_work_time = current_cpu_status.worktime
-                                - last_cpu_status.worktime;
-
-    int64_t current_total_time = current_cpu_status.uptime
-                                 - last_cpu_status.uptime;
-
-    // update the last cpu status
-    last_cpu_status = current_cpu_status;
-
-    return current_total_time
-            ? (double) current_work_time / (double) current_total_time
-            : 0.0;
+// the prefix and suffix of the usage counters of each cpu, such as
+// "\\Processor(0)\\% Processor Time".
+static const char kPerfmonCpuPrefix[] = "\\Processor(";
+static const char kPerfmonCpuSuffix[] = ")\\% Processor Time";
+
+// Parses a cpu usage counter path, -1 for the total usage of all cpus.
+static bool ParseCpuCounter(const char *counter_path, int *cpu) {
+  if (!counter_path)
+    return false;
+  if (!strcmp(counter_path, kPerfmonCpuUsage)) {
+    *cpu = -1;
+    return true;
   }
+  size_t prefix_length = arraysize(kPerfmonCpuPrefix) - 1;
+  if (strncmp(counter_path, kPerfmonCpuPrefix, prefix_length))
+    return false;
+  const char *p = counter_path + prefix_length;
+  int index = 0;
+  for (; *p >= '0' && *p <= '9' && index < 10000; ++p)
+    index = index * 10 + (*p - '0');
+  if (p == counter_path + prefix_length || strcmp(p, kPerfmonCpuSuffix))
+    return false;
+  *cpu = index;
+  return true;
+}
 
-  return 0.0;
+// Gets the current cpu usage in percent.
+static double GetCurrentCpuUsage(int cpu) {
+  return ProcSampler::GetInstance()->GetCpuUsage(cpu) * 100.0;
 }
 
 class CpuUsageWatch : public WatchCallbackInterface {
  public:
   CpuUsageWatch()
-    : watch_id_(-1),
-      current_cpu_usage_(0.0) {
+    : watch_id_(-1) {
   }
 
   ~CpuUsageWatch() {
-    for (SlotMap::iterator it = slots_.begin(); it != slots_.end(); ++it)
-      delete it->second;
+    for (CounterMap::iterator it = counters_.begin();
+         it != counters_.end(); ++it)
+      delete it->second.slot;
     if (watch_id_ >= 0)
       GetGlobalMainLoop()->RemoveWatch(watch_id_);
   }
@@ -150,13 +85,14 @@ class CpuUsageWatch : public WatchCallbackInterface {
   virtual bool Call(MainLoopInterface *main_loop, int watch_id) {
     GGL_UNUSED(main_loop);
     GGL_UNUSED(watch_id);
-    double last = current_cpu_usage_;
-    current_cpu_usage_ = GetCurrentCpuUsage();
-
-    if (std::abs(current_cpu_usage_ - last) >= kCpuUsageThreshold) {
-      Variant usage(current_cpu_usage_ * 100.0);
-      for (SlotMap::iterator it = slots_.begin(); it != slots_.end(); ++it)
-        (*it->second)(kPerfmonCpuUsage, usage);
+    // All counters are served from the same snapshot of the sampler.
+    for (CounterMap::iterator it = counters_.begin();
+         it != counters_.end(); ++it) {
+      Counter *counter = &it->second;
+      double last = counter->usage;
+      counter->usage = GetCurrentCpuUsage(counter->cpu);
+      if (std::abs(counter->usage - last) >= kCpuUsageThreshold)
+        (*counter->slot)(counter->path.c_str(), Variant(counter->usage));
     }
 
     return true;
@@ -169,12 +105,17 @@ class CpuUsageWatch : public WatchCallbackInterface {
     watch_id_ = -1;
   }
 
-  void AddCounter(int index, PerfmonInterface::CallbackSlot *slot) {
-    SlotMap::iterator it = slots_.find(index);
-    if (it != slots_.end())
-      delete it->second;
+  void AddCounter(int index, const char *counter_path, int cpu,
+                  PerfmonInterface::CallbackSlot *slot) {
+    CounterMap::iterator it = counters_.find(index);
+    if (it != counters_.end())
+      delete it->second.slot;
 
-    slots_[index] = slot;
+    Counter *counter = &counters_[index];
+    counter->path = counter_path;
+    counter->cpu = cpu;
+    counter->usage = 0.0;
+    counter->slot = slot;
 
     // Add timeout watch only when there is any counter added.
     if (watch_id_ < 0)
@@ -182,33 +123,44 @@ class CpuUsageWatch : public WatchCallbackInterface {
   }
 
   void RemoveCounter(int index) {
-    SlotMap::iterator it = slots_.find(index);
-    if (it != slots_.end()) {
-      delete it->second;
-      slots_.erase(it);
+    CounterMap::iterator it = counters_.find(index);
+    if (it != counters_.end()) {
+      delete it->second.slot;
+      counters_.erase(it);
     }
 
     // Remove watch if there is no more counter.
-    if (!slots_.size() && watch_id_ >= 0) {
+    if (!counters_.size() && watch_id_ >= 0) {
       GetGlobalMainLoop()->RemoveWatch(watch_id_);
       watch_id_ = -1;
     }
   }
 
-  double GetCurrentValue() {
+  double GetCurrentValue(int cpu) {
     // If the timeout watch is added, then just return stored value.
-    if (watch_id_ >= 0)
-      return current_cpu_usage_ * 100.0;
+    if (watch_id_ >= 0) {
+      for (CounterMap::iterator it = counters_.begin();
+           it != counters_.end(); ++it) {
+        if (it->second.cpu == cpu)
+          return it->second.usage;
+      }
+    }
 
-    return GetCurrentCpuUsage() * 100.0;
+    return GetCurrentCpuUsage(cpu);
   }
 
  private:
+  struct Counter {
+    std::string path;
+    int cpu;
+    double usage;
+    PerfmonInterface::CallbackSlot *slot;
+  };
+
   int watch_id_;
-  double current_cpu_usage_;
 
-  typedef LightMap<int, PerfmonInterface::CallbackSlot *> SlotMap;
-  SlotMap slots_;
+  typedef LightMap<int, Counter> CounterMap;
+  CounterMap counters_;
 };
 
 class Perfmon::Impl {
@@ -230,20 +182,22 @@ Perfmon::~Perfmon() {
 
 Variant Perfmon::GetCurrentValue(const char *counter_path) {
   double value = 0;
-  if (counter_path && !strcmp(counter_path, kPerfmonCpuUsage)) {
-    value = impl_->cpu_usage_watch_.GetCurrentValue();
+  int cpu;
+  if (ParseCpuCounter(counter_path, &cpu)) {
+    value = impl_->cpu_usage_watch_.GetCurrentValue(cpu);
   }
 
   return Variant(value);
 }
 
 int Perfmon::AddCounter(const char *counter_path, CallbackSlot *slot) {
-  if (slot && counter_path && !strcmp(counter_path, kPerfmonCpuUsage)) {
+  int cpu;
+  if (slot && ParseCpuCounter(counter_path, &cpu)) {
     // In case the counter_index_ is wrapped.
     if (impl_->counter_index_ < 0) impl_->counter_index_ = 0;
 
     int index = impl_->counter_index_++;
-    impl_->cpu_usage_watch_.AddCounter(index, slot);
+    impl_->cpu_usage_watch_.AddCounter(index, counter_path, cpu, slot);
     return index;
   }
 
@@ -0,0 +1,446 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "proc_sampler.h"
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <ggadget/logger.h>
+
+namespace ggadget {
+namespace framework {
+namespace linux_system {
+
+// The minimum interval between two snapshots (milliseconds).
+static const uint64_t kMinSampleInterval = 1000;
+// The size of the buffer holding /proc/stat and /proc/meminfo. The parts
+// beyond it are not needed.
+static const size_t kBufferSize = 32768;
+// The size of the buffer holding /proc/<pid>/stat.
+static const size_t kProcessStatSize = 1024;
+
+static const char kProcDir[] = "/proc";
+static const char kProcStatFile[] = "/proc/stat";
+static const char kMemInfoFile[] = "/proc/meminfo";
+static const char kCpuHeader[] = "cpu";
+
+// The keys of the memory counters in /proc/meminfo, in the order of
+// ProcSampler::MemInfoField.
+static const char *kMemInfoKeys[] = {
+  "MemTotal:", "MemFree:", "SwapTotal:",
+  "SwapFree:", "Buffers:", "Cached:", "SwapCached:"
+};
+
+// Scans a piece of text from the proc file system in place.
+class ProcScanner {
+ public:
+  ProcScanner(const char *begin, const char *end) : pos_(begin), end_(end) { }
+
+  // Splits the next complete line, without the trailing '\n', into @a line.
+  bool NextLine(ProcScanner *line) {
+    const char *eol = static_cast<const char *>(
+        memchr(pos_, '\n', end_ - pos_));
+    if (!eol)
+      return false;
+    *line = ProcScanner(pos_, eol);
+    pos_ = eol + 1;
+    return true;
+  }
+
+  // Skips the prefix if the text starts with it.
+  bool MatchPrefix(const char *prefix, size_t length) {
+    if (static_cast<size_t>(end_ - pos_) < length ||
+        memcmp(pos_, prefix, length) != 0)
+      return false;
+    pos_ += length;
+    return true;
+  }
+
+  void SkipSpaces() {
+    while (pos_ < end_ && (*pos_ == ' ' || *pos_ == '\t'))
+      ++pos_;
+  }
+
+  void SkipDigits() {
+    while (pos_ < end_ && *pos_ >= '0' && *pos_ <= '9')
+      ++pos_;
+  }
+
+  void SkipField() {
+    SkipSpaces();
+    while (pos_ < end_ && *pos_ != ' ' && *pos_ != '\t')
+      ++pos_;
+  }
+
+  bool ReadUInt64(uint64_t *value) {
+    SkipSpaces();
+    if (pos_ >= end_ || *pos_ < '0' || *pos_ > '9')
+      return false;
+    uint64_t result = 0;
+    while (pos_ < end_ && *pos_ >= '0' && *pos_ <= '9')
+      result = result * 10 + (*pos_++ - '0');
+    *value = result;
+    return true;
+  }
+
+ private:
+  const char *pos_;
+  const char *end_;
+};
+
+// Opens a proc file to be reread with pread().
+static int OpenProcFile(const char *filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    LOG("Failed to open %s", filename);
+  else
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+  return fd;
+}
+
+// Reads the executable path of a process.
+static void ReadExecutablePath(int pid, std::string *path) {
+  char filename[PATH_MAX + 2] = {0};
+  snprintf(filename, sizeof(filename) - 1, "%s/%d/exe", kProcDir, pid);
+
+  char command[PATH_MAX + 2] = {0};
+  if (readlink(filename, command, sizeof(command) - 1) < 0) {
+    path->clear();
+    return;
+  }
+
+  for (int i = 0; command[i]; i++) {
+    if (command[i] == ' ' || command[i] == '\n') {
+      command[i] = 0;
+      break;
+    }
+  }
+  path->assign(command);
+}
+
+static uint64_t GetCurrentTimeMs() {
+  timeval tv;
+  gettimeofday(&tv, NULL);
+  return static_cast<uint64_t>(tv.tv_sec) * 1000 + tv.tv_usec / 1000;
+}
+
+class ProcSampler::Impl {
+ public:
+  // The times of a processor, in units of USER_HZ.
+  struct CpuTimes {
+    CpuTimes() : work(0), total(0) { }
+    uint64_t work;
+    uint64_t total;
+  };
+
+  Impl()
+      : stat_fd_(OpenProcFile(kProcStatFile)),
+        meminfo_fd_(OpenProcFile(kMemInfoFile)),
+        page_size_(sysconf(_SC_PAGESIZE)),
+        system_time_(0),
+        processes_time_(0),
+        processes_cpu_total_(0),
+        generation_(0) {
+    memset(mem_info_, 0, sizeof(mem_info_));
+  }
+
+  ~Impl() {
+    if (stat_fd_ >= 0)
+      close(stat_fd_);
+    if (meminfo_fd_ >= 0)
+      close(meminfo_fd_);
+  }
+
+  static bool IsExpired(uint64_t time, uint64_t now) {
+    // The time may have been changed backwards.
+    return !time || now < time || now - time >= kMinSampleInterval;
+  }
+
+  // Reads a whole proc file, or the first kBufferSize bytes of it.
+  size_t ReadProcFile(int fd) {
+    if (fd < 0)
+      return 0;
+    ssize_t size = pread(fd, buffer_, sizeof(buffer_), 0);
+    return size > 0 ? static_cast<size_t>(size) : 0;
+  }
+
+  // Parses the next line of /proc/stat if it holds the times of a processor.
+  static bool ParseCpuTimes(ProcScanner *scanner, CpuTimes *times) {
+    ProcScanner line(NULL, NULL);
+    if (!scanner->NextLine(&line) ||
+        !line.MatchPrefix(kCpuHeader, arraysize(kCpuHeader) - 1))
+      return false;
+    // Skips the index of the processor, which is absent in the first line.
+    line.SkipDigits();
+    uint64_t user = 0, nice = 0, system = 0, idle = 0;
+    uint64_t iowait = 0, hardirq = 0, softirq = 0;
+    if (!line.ReadUInt64(&user) || !line.ReadUInt64(&nice) ||
+        !line.ReadUInt64(&system) || !line.ReadUInt64(&idle))
+      return false;
+    // These fields are missing in old kernels.
+    if (line.ReadUInt64(&iowait) && line.ReadUInt64(&hardirq))
+      line.ReadUInt64(&softirq);
+    times->work = user + nice + system + hardirq + softirq;
+    times->total = times->work + idle + iowait;
+    return true;
+  }
+
+  void ParseStat(size_t size) {
+    ProcScanner scanner(buffer_, buffer_ + size);
+    // The first line is the sum of all processors, followed by a line per
+    // processor.
+    size_t count = 0;
+    CpuTimes times;
+    while (ParseCpuTimes(&scanner, &times)) {
+      if (count == cpu_current_.size()) {
+        cpu_current_.push_back(CpuTimes());
+        cpu_last_.push_back(CpuTimes());
+      }
+      cpu_last_[count] = cpu_current_[count];
+      cpu_current_[count] = times;
+      ++count;
+    }
+    // Processors may have been taken offline.
+    cpu_current_.resize(count);
+    cpu_last_.resize(count);
+  }
+
+  void ParseMemInfo(size_t size) {
+    ProcScanner scanner(buffer_, buffer_ + size), line(NULL, NULL);
+    while (scanner.NextLine(&line)) {
+      for (int i = 0; i < MEM_INFO_COUNT; ++i) {
+        uint64_t value;
+        if (line.MatchPrefix(kMemInfoKeys[i], strlen(kMemInfoKeys[i]))) {
+          if (line.ReadUInt64(&value))
+            mem_info_[i] = static_cast<int64_t>(value) * 1024;
+          break;
+        }
+      }
+    }
+  }
+
+  void SampleStat(const std::string &stat) {
+    size_t size = std::min(stat.size(), sizeof(buffer_));
+    memcpy(buffer_, stat.data(), size);
+    ParseStat(size);
+    system_time_ = GetCurrentTimeMs();
+  }
+
+  void SampleSystem(uint64_t now) {
+    ParseStat(ReadProcFile(stat_fd_));
+    ParseMemInfo(ReadProcFile(meminfo_fd_));
+    system_time_ = now;
+  }
+
+  void UpdateSystem() {
+    uint64_t now = GetCurrentTimeMs();
+    if (IsExpired(system_time_, now))
+      SampleSystem(now);
+  }
+
+  // Reads the total time of all processors at this moment, without taking a
+  // snapshot, which would shorten the period of the CPU usage.
+  uint64_t ReadCpuTotal() {
+    size_t size = ReadProcFile(stat_fd_);
+    ProcScanner scanner(buffer_, buffer_ + size);
+    CpuTimes times;
+    return ParseCpuTimes(&scanner, &times) ? times.total : 0;
+  }
+
+  // Samples a process from /proc/<pid>/stat, see proc(5) for its format.
+  ProcessSample *SampleProcess(int pid, uint64_t cpu_delta) {
+    char filename[32];
+    snprintf(filename, sizeof(filename), "%s/%d/stat", kProcDir, pid);
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+      return NULL;
+    char buffer[kProcessStatSize];
+    ssize_t size = read(fd, buffer, sizeof(buffer));
+    close(fd);
+    if (size <= 0)
+      return NULL;
+
+    // The command name may contain spaces and parentheses, so the fields
+    // are counted from the last ')'.
+    const char *end = buffer + size;
+    const char *pos = end;
+    while (pos > buffer && *--pos != ')');
+    if (*pos != ')')
+      return NULL;
+    ProcScanner scanner(pos + 1, end);
+    // Skips fields 3 (state) to 13 (cmajflt).
+    for (int i = 3; i < 14; ++i)
+      scanner.SkipField();
+    uint64_t utime, stime, start_time, rss;
+    if (!scanner.ReadUInt64(&utime) || !scanner.ReadUInt64(&stime))
+      return NULL;
+    // Skips fields 16 (cutime) to 21 (itrealvalue).
+    for (int i = 16; i < 22; ++i)
+      scanner.SkipField();
+    if (!scanner.ReadUInt64(&start_time))
+      return NULL;
+    scanner.SkipField();
+    if (!scanner.ReadUInt64(&rss))
+      rss = 0;
+
+    uint64_t cpu_time = utime + stime;
+    ProcessSample *sample = &processes_[pid];
+    if (sample->start_time != start_time || !sample->generation) {
+      // A new process, or the pid has been reused.
+      *sample = ProcessSample();
+      sample->start_time = start_time;
+      ReadExecutablePath(pid, &sample->path);
+    } else if (cpu_delta && cpu_time >= sample->cpu_time) {
+      sample->cpu_usage = std::min(
+          1.0, static_cast<double>(cpu_time - sample->cpu_time) /
+                static_cast<double>(cpu_delta));
+    } else {
+      sample->cpu_usage = 0.0;
+    }
+    sample->cpu_time = cpu_time;
+    sample->rss = static_cast<int64_t>(rss) * page_size_;
+    sample->generation = generation_;
+    return sample;
+  }
+
+  void ScanProcesses(uint64_t now) {
+    UpdateSystem();
+    // The times of the processes are read now, so is the total time they
+    // are compared with.
+    uint64_t cpu_total = ReadCpuTotal();
+    uint64_t cpu_delta = processes_cpu_total_ && cpu_total >
+        processes_cpu_total_ ? cpu_total - processes_cpu_total_ : 0;
+    processes_cpu_total_ = cpu_total;
+    processes_time_ = now;
+    ++generation_;
+
+    DIR *dir = opendir(kProcDir);
+    if (dir) {
+      struct dirent *entry;
+      while ((entry = readdir(dir)) != NULL) {
+        int pid = 0;
+        const char *name = entry->d_name;
+        for (; *name >= '0' && *name <= '9'; ++name)
+          pid = pid * 10 + (*name - '0');
+        // Skips the entries which aren't processes.
+        if (pid && !*name)
+          SampleProcess(pid, cpu_delta);
+      }
+      closedir(dir);
+    }
+
+    // Removes the processes which have exited.
+    for (ProcessMap::iterator it = processes_.begin();
+         it != processes_.end();) {
+      if (it->second.generation != generation_)
+        processes_.erase(it++);
+      else
+        ++it;
+    }
+  }
+
+  void UpdateProcesses() {
+    uint64_t now = GetCurrentTimeMs();
+    if (IsExpired(processes_time_, now))
+      ScanProcesses(now);
+  }
+
+  int stat_fd_;
+  int meminfo_fd_;
+  int64_t page_size_;
+  uint64_t system_time_;
+  uint64_t processes_time_;
+  uint64_t processes_cpu_total_;
+  uint64_t generation_;
+  // The first item is the sum of all processors.
+  std::vector<CpuTimes> cpu_current_;
+  std::vector<CpuTimes> cpu_last_;
+  int64_t mem_info_[MEM_INFO_COUNT];
+  ProcessMap processes_;
+  char buffer_[kBufferSize];
+};
+
+ProcSampler::ProcSampler() : impl_(new Impl()) {
+}
+
+ProcSampler::~ProcSampler() {
+  delete impl_;
+  impl_ = NULL;
+}
+
+ProcSampler *ProcSampler::GetInstance() {
+  // Intentionally leaked, so that it's usable in the destructors of static
+  // objects.
+  static ProcSampler *sampler = new ProcSampler();
+  return sampler;
+}
+
+int ProcSampler::GetCpuCount() {
+  impl_->UpdateSystem();
+  return impl_->cpu_current_.empty() ?
+         0 : static_cast<int>(impl_->cpu_current_.size()) - 1;
+}
+
+double ProcSampler::GetCpuUsage(int cpu) {
+  impl_->UpdateSystem();
+  size_t index = static_cast<size_t>(cpu + 1);
+  if (cpu < -1 || index >= impl_->cpu_current_.size())
+    return 0.0;
+  const Impl::CpuTimes &current = impl_->cpu_current_[index];
+  const Impl::CpuTimes &last = impl_->cpu_last_[index];
+  if (current.total <= last.total || current.work < last.work)
+    return 0.0;
+  return std::min(1.0, static_cast<double>(current.work - last.work) /
+                       static_cast<double>(current.total - last.total));
+}
+
+int64_t ProcSampler::GetMemInfo(MemInfoField field) {
+  ASSERT(field >= 0 && field < MEM_INFO_COUNT);
+  impl_->UpdateSystem();
+  return impl_->mem_info_[field];
+}
+
+void ProcSampler::SampleStat(const std::string &stat) {
+  impl_->SampleStat(stat);
+}
+
+const ProcSampler::ProcessMap &ProcSampler::GetProcesses() {
+  impl_->UpdateProcesses();
+  return impl_->processes_;
+}
+
+const ProcSampler::ProcessSample *ProcSampler::GetProcess(int pid) {
+  if (pid <= 0)
+    return NULL;
+  impl_->UpdateProcesses();
+  ProcessMap::const_iterator it = impl_->processes_.find(pid);
+  if (it != impl_->processes_.end())
+    return &it->second;
+  // The process has started after the last snapshot.
+  return impl_->SampleProcess(pid, 0);
+}
+
+} // namespace linux_system
+} // namespace framework
+} // namespace ggadget
@@ -0,0 +1,122 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#ifndef EXTENSIONS_LINUX_SYSTEM_FRAMEWORK_PROC_SAMPLER_H__
+#define EXTENSIONS_LINUX_SYSTEM_FRAMEWORK_PROC_SAMPLER_H__
+
+#include <map>
+#include <string>
+#include <ggadget/common.h>
+
+namespace ggadget {
+namespace framework {
+namespace linux_system {
+
+/**
+ * Samples the system counters from the proc file system, shared by the
+ * perfmon, memory and process APIs.
+ *
+ * The counters of all callers are served from the same snapshot, which is
+ * taken at most once per second, so that several gadgets polling the system
+ * don't multiply the cost. /proc/stat and /proc/meminfo are kept open and
+ * reread with pread(), and parsed in place without memory allocation. The
+ * per-process data is cached by pid and start time, so that the executable
+ * path of a process is only read once.
+ *
+ * The sampler isn't thread safe, and must only be used in the main thread.
+ */
+class ProcSampler {
+ public:
+  /** The memory counters, in bytes. */
+  enum MemInfoField {
+    MEM_TOTAL,
+    MEM_FREE,
+    SWAP_TOTAL,
+    SWAP_FREE,
+    BUFFERS,
+    CACHED,
+    SWAP_CACHED,
+    MEM_INFO_COUNT
+  };
+
+  /** The sample of a process. */
+  struct ProcessSample {
+    ProcessSample()
+        : start_time(0), cpu_time(0), cpu_usage(0.0), rss(0),
+          generation(0) {
+    }
+    /** The executable path, empty if it's not readable. */
+    std::string path;
+    /** The start time after boot, in clock ticks. */
+    uint64_t start_time;
+    /** The CPU time consumed in both user and kernel mode, in clock ticks. */
+    uint64_t cpu_time;
+    /**
+     * The share of the total CPU time of all processors used by the process
+     * between the last two snapshots, in range [0, 1].
+     */
+    double cpu_usage;
+    /** The resident set size, in bytes. */
+    int64_t rss;
+    /** The snapshot in which the process was seen the last time. */
+    uint64_t generation;
+  };
+  typedef std::map<int, ProcessSample> ProcessMap;
+
+  static ProcSampler *GetInstance();
+
+  /** Gets the number of processors. */
+  int GetCpuCount();
+
+  /**
+   * Gets the CPU usage between the last two snapshots, in range [0, 1].
+   * @param cpu the index of the processor, or -1 for all processors.
+   */
+  double GetCpuUsage(int cpu);
+
+  /** Gets a memory counter, in bytes. */
+  int64_t GetMemInfo(MemInfoField field);
+
+  /**
+   * Takes a snapshot of the processor times from the given content of
+   * /proc/stat instead of the real file. For testing.
+   */
+  void SampleStat(const std::string &stat);
+
+  /** Gets the samples of all processes, keyed by pid. */
+  const ProcessMap &GetProcesses();
+
+  /**
+   * Gets the sample of a process. A process which isn't in the snapshot yet
+   * is sampled at once.
+   * @return @c NULL if the process doesn't exist.
+   */
+  const ProcessSample *GetProcess(int pid);
+
+ private:
+  ProcSampler();
+  ~ProcSampler();
+
+  class Impl;
+  Impl *impl_;
+  DISALLOW_EVIL_CONSTRUCTORS(ProcSampler);
+};
+
+} // namespace linux_system
+} // namespace framework
+} // namespace ggadget
+
+#endif // EXTENSIONS_LINUX_SYSTEM_FRAMEWORK_PROC_SAMPLER_H__
@@ -14,10 +14,6 @@
   limitations under the License.
 */
 
-#include <sys/types.h>
-#include <dirent.h>
-#include <cstdlib>
-
 #ifdef HAVE_X11
 #include <X11/Xlib.h>
 #include <X11/Xatom.h>
@@ -25,15 +21,12 @@
 
 #include "process.h"
 #include "machine.h"
+#include "proc_sampler.h"
 
 namespace ggadget {
 namespace framework {
 namespace linux_system {
 
-static const char* kDirName = "/proc";
-
-static bool ReadCmdPath(int pid, std::string *cmdline);
-
 // ---------------------------PrcoessInfo Class-------------------------------//
 
 ProcessInfo::ProcessInfo(int pid, const std::string &path) :
@@ -73,26 +66,13 @@ ProcessInfoInterface *Processes::GetItem(int index) {
 }
 
 void Processes::InitProcesses() {
-  DIR *dir = NULL;
-  struct dirent *entry = NULL;
-
-  dir = opendir(kDirName);
-  if (!dir) // if can't open the directory, just return
-    return;
-
-  while ((entry = readdir(dir)) != NULL) {
-    char *name = entry->d_name;
-    char *end;
-    int pid = static_cast<int>(strtol(name, &end, 10));
-
-    // if it is not a process folder, so skip it
-    if (!pid || *end)
-      continue;
-
-    std::string cmdline;
-    if (ReadCmdPath(pid, &cmdline) && cmdline != "") {
-      procs_.push_back(IntStringPair(pid, cmdline));
-    }
+  const ProcSampler::ProcessMap &processes =
+      ProcSampler::GetInstance()->GetProcesses();
+  procs_.reserve(processes.size());
+  for (ProcSampler::ProcessMap::const_iterator it = processes.begin();
+       it != processes.end(); ++it) {
+    if (!it->second.path.empty())
+      procs_.push_back(IntStringPair(it->first, it->second.path));
   }
 }
 
@@ -185,42 +165,14 @@ ProcessInfoInterface *Process::GetForeground() {
 #endif // HAVE_X11
 
 ProcessInfoInterface *Process::GetInfo(int pid) {
-  std::string cmdline;
-  if (ReadCmdPath(pid, &cmdline)) {
-    return new ProcessInfo(pid, cmdline);
+  const ProcSampler::ProcessSample *sample =
+      ProcSampler::GetInstance()->GetProcess(pid);
+  if (sample && !sample->path.empty()) {
+    return new ProcessInfo(pid, sample->path);
   }
   return NULL;
 }
 
-
-// ---------------------------Utility Functions-------------------------------//
-
-// Reads the command path with pid from proc system.
-// EMPTY string will be returned if any error.
-static bool ReadCmdPath(int pid, std::string *cmdline) {
-  if (pid <= 0 || !cmdline)
-    return false;
-
-  char filename[PATH_MAX + 2] = {0};
-  snprintf(filename, sizeof(filename) - 1, "%s/%d/exe", kDirName, pid);
-
-  char command[PATH_MAX + 2] = {0};
-  if (readlink(filename, command, sizeof(command) - 1) < 0) {
-    *cmdline = "";
-    return false;
-  }
-
-  for (int i = 0; command[i]; i++) {
-    if (command[i] == ' ' || command[i] == '\n') {
-      command[i] = 0;
-      break;
-    }
-  }
-  *cmdline = std::string(command);
-
-  return true;
-}
-
 } // namespace linux_system
 } // namespace framework
 } // namespace ggadget
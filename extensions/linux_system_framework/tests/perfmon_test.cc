@@ -19,7 +19,7 @@
 #include <ggadget/logger.h>
 #include <ggadget/framework_interface.h>
 #include <ggadget/variant.h>
-#include "ggadget/tests/native_main_loop.h"
+#include "ggadget/native_main_loop.h"
 #include <unittest/gtest.h>
 #include "../perfmon.cc"
 
@@ -89,6 +89,21 @@ TEST(Perfmon, GetCurrentValue_Accuray) {
   }
 }
 
+// Accuracy test for GetCurrentValue of each cpu.
+TEST(Perfmon, GetCurrentValue_EachCpu) {
+  Perfmon perfmon;
+  Variant value = perfmon.GetCurrentValue("\\Processor(0)\\% Processor Time");
+  EXPECT_EQ(Variant::TYPE_DOUBLE, value.type());
+  double result = 0.0;
+  value.ConvertToDouble(&result);
+  EXPECT_GE(result, 0.0);
+  EXPECT_LE(result, 100.0);
+  EXPECT_EQ(kInvalidCpuUsage,
+            perfmon.GetCurrentValue("\\Processor(x)\\% Processor Time"));
+  EXPECT_EQ(kInvalidCpuUsage,
+            perfmon.GetCurrentValue("\\Processor(0)"));
+}
+
 // Failure test for GetCurrentValue when the input counter path is NULL.
 TEST(Perfmon, GetCurrentValue_Failure_NullCounterPath) {
   Perfmon perfmon;
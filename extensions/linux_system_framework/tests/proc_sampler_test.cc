@@ -0,0 +1,129 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+
+#include <unistd.h>
+#include <cstdio>
+#include <ggadget/common.h>
+#include <ggadget/logger.h>
+#include <unittest/gtest.h>
+#include "../proc_sampler.h"
+
+using namespace ggadget;
+using namespace ggadget::framework::linux_system;
+
+TEST(ProcSampler, CpuUsage) {
+  ProcSampler *sampler = ProcSampler::GetInstance();
+  int count = sampler->GetCpuCount();
+  EXPECT_GT(count, 0);
+  for (int i = -1; i < count; ++i) {
+    double usage = sampler->GetCpuUsage(i);
+    EXPECT_GE(usage, 0.0);
+    EXPECT_LE(usage, 1.0);
+    LOG("The usage of cpu %d: %lf", i, usage);
+  }
+  EXPECT_EQ(0.0, sampler->GetCpuUsage(count));
+  EXPECT_EQ(0.0, sampler->GetCpuUsage(-2));
+}
+
+TEST(ProcSampler, ParseStat) {
+  ProcSampler *sampler = ProcSampler::GetInstance();
+  sampler->SampleStat(
+      "cpu  1000 0 500 8000 500 0 0 0 0 0\n"
+      "cpu0 500 0 250 4000 250 0 0 0 0 0\n"
+      "cpu1 500 0 250 4000 250 0 0 0 0 0\n"
+      "intr 12345\n");
+  // The total increases by 1000, of which 250 is busy.
+  sampler->SampleStat(
+      "cpu  1200 0 550 8700 550 0 0 0 0 0\n"
+      "cpu0 700 0 300 4200 300 0 0 0 0 0\n"
+      "cpu1 500 0 250 4500 250 0 0 0 0 0\n"
+      "intr 12345\n");
+  ASSERT_EQ(2, sampler->GetCpuCount());
+  EXPECT_DOUBLE_EQ(0.25, sampler->GetCpuUsage(-1));
+  EXPECT_DOUBLE_EQ(0.5, sampler->GetCpuUsage(0));
+  EXPECT_DOUBLE_EQ(0.0, sampler->GetCpuUsage(1));
+}
+
+TEST(ProcSampler, ScanProcessesKeepsCpuUsage) {
+  ProcSampler *sampler = ProcSampler::GetInstance();
+  sampler->SampleStat(
+      "cpu  1000 0 500 8000 500 0 0 0 0 0\n"
+      "cpu0 500 0 250 4000 250 0 0 0 0 0\n"
+      "intr 12345\n");
+  sampler->SampleStat(
+      "cpu  1200 0 550 8700 550 0 0 0 0 0\n"
+      "cpu0 700 0 300 4200 300 0 0 0 0 0\n"
+      "intr 12345\n");
+  EXPECT_DOUBLE_EQ(0.25, sampler->GetCpuUsage(-1));
+  // Scanning the processes doesn't take a new snapshot of the processors
+  // before the current one expires.
+  EXPECT_GT(sampler->GetProcesses().size(), 0U);
+  EXPECT_DOUBLE_EQ(0.25, sampler->GetCpuUsage(-1));
+  EXPECT_TRUE(sampler->GetProcess(getpid()) != NULL);
+  EXPECT_DOUBLE_EQ(0.25, sampler->GetCpuUsage(-1));
+  EXPECT_DOUBLE_EQ(0.5, sampler->GetCpuUsage(0));
+}
+
+TEST(ProcSampler, MemInfo) {
+  ProcSampler *sampler = ProcSampler::GetInstance();
+  int64_t total = sampler->GetMemInfo(ProcSampler::MEM_TOTAL);
+  int64_t free = sampler->GetMemInfo(ProcSampler::MEM_FREE);
+  EXPECT_GT(total, 0);
+  EXPECT_GT(free, 0);
+  EXPECT_GE(total, free);
+  EXPECT_GE(sampler->GetMemInfo(ProcSampler::SWAP_TOTAL),
+            sampler->GetMemInfo(ProcSampler::SWAP_FREE));
+}
+
+TEST(ProcSampler, Processes) {
+  ProcSampler *sampler = ProcSampler::GetInstance();
+  const ProcSampler::ProcessMap &processes = sampler->GetProcesses();
+  EXPECT_GT(processes.size(), 0U);
+
+  ProcSampler::ProcessMap::const_iterator it = processes.find(getpid());
+  ASSERT_TRUE(it != processes.end());
+  const ProcSampler::ProcessSample &self = it->second;
+  EXPECT_NE("", self.path);
+  EXPECT_GT(self.start_time, 0U);
+  EXPECT_GT(self.rss, 0);
+  EXPECT_GE(self.cpu_usage, 0.0);
+  EXPECT_LE(self.cpu_usage, 1.0);
+  LOG("Self: %s rss: %jd", self.path.c_str(), self.rss);
+
+  // Burns some cpu time, and waits for the next snapshot.
+  uint64_t cpu_time = self.cpu_time;
+  std::string path = self.path;
+  volatile int sum = 0;
+  for (int i = 0; i < 100000000; ++i)
+    sum += i;
+  sleep(1);
+  const ProcSampler::ProcessSample *sample = sampler->GetProcess(getpid());
+  ASSERT_TRUE(sample != NULL);
+  // The cached entry of the process is reused.
+  EXPECT_EQ(path, sample->path);
+  EXPECT_GT(sample->cpu_time, cpu_time);
+  EXPECT_GT(sample->cpu_usage, 0.0);
+
+  EXPECT_TRUE(sampler->GetProcess(0) == NULL);
+  EXPECT_TRUE(sampler->GetProcess(-1) == NULL);
+}
+
+int main(int argc, char **argv) {
+  testing::ParseGTestFlags(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
@@ -207,8 +207,8 @@ void FreeNativeValue(const Variant &native_val) {
 }
 
 bool ConvertJSArgsToNative(QScriptContext *ctx, Slot *slot,
-                           int *expected_argc, Variant **argv) {
-  *argv = NULL;
+                           int *expected_argc, VariantArgs *argv) {
+  argv->Reset();
   int argc = ctx->argumentCount();
   *expected_argc = argc;
   const Variant::Type *arg_types = NULL;
@@ -219,7 +219,7 @@ bool ConvertJSArgsToNative(QScriptContext *ctx, Slot *slot,
     *expected_argc = slot->GetArgCount();
     if (*expected_argc == INT_MAX) {
       // Simply converts each arguments to native.
-      *argv = new Variant[argc];
+      argv->Resize(argc);
       *expected_argc = argc;
       int arg_type_idx = 0;
       for (int i = 0; i < argc; ++i) {
@@ -236,8 +236,7 @@ bool ConvertJSArgsToNative(QScriptContext *ctx, Slot *slot,
         if (!result) {
           for (int j = 0; j < i; j++)
             FreeNativeValue((*argv)[j]);
-          delete [] *argv;
-          *argv = NULL;
+          argv->Reset();
           ctx->throwError(QString("Failed to convert argument %1 to native")
                           .arg(i));
           return false;
@@ -267,7 +266,7 @@ bool ConvertJSArgsToNative(QScriptContext *ctx, Slot *slot,
   }
 
   if (*expected_argc > 0) {
-    *argv = new Variant[*expected_argc];
+    argv->Resize(*expected_argc);
     // Fill up trailing default argument values.
     for (int i = argc; i < *expected_argc; i++) {
       (*argv)[i] = default_args[i];
@@ -285,8 +284,7 @@ bool ConvertJSArgsToNative(QScriptContext *ctx, Slot *slot,
       if (!result) {
         for (int j = 0; j < i; j++)
           FreeNativeValue((*argv)[j]);
-        delete [] *argv;
-        *argv = NULL;
+        argv->Reset();
         ctx->throwError(QString("Failed to convert argument %1 to native")
                         .arg(i));
         return false;
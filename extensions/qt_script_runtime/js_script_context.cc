@@ -288,15 +288,15 @@ static QScriptValue SlotCaller(QScriptContext *context, QScriptEngine *engine) {
       static_cast<SlotCallerWrapper*>(callee.data().toQObject());
   ASSERT(wrapper);
 
-  Variant *argv = NULL;
+  VariantArgs argv;
   int expected_argc = context->argumentCount();
   bool ret = ConvertJSArgsToNative(context, wrapper->slot_,
                                    &expected_argc,  &argv);
   if (!ret) return engine->undefinedValue();
 
   ResultVariant res = wrapper->slot_->Call(wrapper->object_,
-                                           expected_argc, argv);
-  delete [] argv;
+                                           expected_argc, argv.get());
+  argv.Reset();
 
   QScriptValue exception;
   if (!CheckException(context, wrapper->object_, &exception))
@@ -541,13 +541,13 @@ QVariant ResolverScriptClass::extension(Extension extension,
   DLOG("Object called as function");
   QScriptContext *context = qvariant_cast<QScriptContext*>(argument);
 
-  Variant *argv = NULL;
+  VariantArgs argv;
   int expected_argc = context->argumentCount();
   if (!ConvertJSArgsToNative(context, call_slot_, &expected_argc, &argv))
     return QVariant();
 
-  ResultVariant res = call_slot_->Call(object_, expected_argc, argv);
-  delete [] argv;
+  ResultVariant res = call_slot_->Call(object_, expected_argc, argv.get());
+  argv.Reset();
   if (!CheckException(context, object_, NULL))
     return QVariant();
 
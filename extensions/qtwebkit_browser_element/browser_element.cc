@@ -97,6 +97,10 @@ void BrowserElement::Layout() {
   impl_->Layout();
 }
 
+bool BrowserElement::IsLayoutVolatile() const {
+  return true;
+}
+
 void BrowserElement::DoDraw(CanvasInterface *) {
 }
 
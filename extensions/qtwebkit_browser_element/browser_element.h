@@ -67,6 +67,7 @@ class BrowserElement : public BasicElement {
 
  protected:
   virtual void Layout();
+  virtual bool IsLayoutVolatile() const;
   virtual void DoDraw(CanvasInterface *canvas);
 
  private:
@@ -49,6 +49,10 @@ static JSBool ConvertJSToNativeVoid(JSContext *cx, jsval js_val,
 
 static JSBool ConvertJSToNativeBool(JSContext *cx, jsval js_val,
                                     Variant *native_val) {
+  if (JSVAL_IS_BOOLEAN(js_val)) {
+    *native_val = Variant(JSVAL_TO_BOOLEAN(js_val) != JS_FALSE);
+    return JS_TRUE;
+  }
   if (JSVAL_IS_STRING(js_val)) {
     JSString *js_string = JSVAL_TO_STRING(js_val);
     char *bytes = JS_GetStringBytes(js_string);
@@ -76,10 +80,8 @@ static JSBool ConvertJSToNativeInt(JSContext *cx, jsval js_val,
 
   JSBool result = JS_FALSE;
   if (JSVAL_IS_INT(js_val)) {
-    int32 int_val;
-    result = JS_ValueToECMAInt32(cx, js_val, &int_val);
-    if (result)
-      *native_val = Variant(int_val);
+    *native_val = Variant(JSVAL_TO_INT(js_val));
+    result = JS_TRUE;
   } else {
     jsdouble double_val = 0;
     result = JS_ValueToNumber(cx, js_val, &double_val);
@@ -101,6 +103,15 @@ static JSBool ConvertJSToNativeDouble(JSContext *cx, jsval js_val,
     *native_val = Variant(0.0);
     return JS_TRUE;
   }
+  // Fast paths for numbers, which are most of the values.
+  if (JSVAL_IS_INT(js_val)) {
+    *native_val = Variant(static_cast<double>(JSVAL_TO_INT(js_val)));
+    return JS_TRUE;
+  }
+  if (JSVAL_IS_DOUBLE(js_val)) {
+    *native_val = Variant(static_cast<double>(*JSVAL_TO_DOUBLE(js_val)));
+    return JS_TRUE;
+  }
 
   jsdouble double_val = 0;
   JSBool result = JS_ValueToNumber(cx, js_val, &double_val);
@@ -394,8 +405,8 @@ std::string PrintJSValue(JSContext *cx, jsval js_val) {
 JSBool ConvertJSArgsToNative(JSContext *cx, NativeJSWrapper *owner,
                              const char *name, Slot *slot,
                              uintN argc, jsval *argv,
-                             Variant **params, uintN *expected_argc) {
-  *params = NULL;
+                             VariantArgs *params, uintN *expected_argc) {
+  params->Reset();
   const Variant::Type *arg_types = NULL;
   *expected_argc = argc;
   const Variant *default_args = NULL;
@@ -404,7 +415,7 @@ JSBool ConvertJSArgsToNative(JSContext *cx, NativeJSWrapper *owner,
     *expected_argc = static_cast<uintN>(slot->GetArgCount());
     if (*expected_argc == INT_MAX) {
       // Simply converts each arguments to native.
-      *params = new Variant[argc];
+      params->Resize(argc);
       *expected_argc = argc;
       uintN arg_type_idx = 0;
       for (uintN i = 0; i < argc; i++) {
@@ -420,8 +431,7 @@ JSBool ConvertJSArgsToNative(JSContext *cx, NativeJSWrapper *owner,
         if (!result) {
           for (uintN j = 0; j < i; j++)
             FreeNativeValue((*params)[j]);
-          delete [] *params;
-          *params = NULL;
+          params->Reset();
           RaiseException(cx,
                          "Failed to convert argument %d(%s) of function(%s) to"
                          " native", i, PrintJSValue(cx, argv[i]).c_str(), name);
@@ -453,7 +463,7 @@ JSBool ConvertJSArgsToNative(JSContext *cx, NativeJSWrapper *owner,
   }
 
   if (*expected_argc > 0) {
-    *params = new Variant[*expected_argc];
+    params->Resize(*expected_argc);
     // Fill up trailing default argument values.
     for (uintN i = argc; i < *expected_argc; i++) {
       ASSERT(default_args);  // Otherwise already returned JS_FALSE.
@@ -477,8 +487,7 @@ JSBool ConvertJSArgsToNative(JSContext *cx, NativeJSWrapper *owner,
         if (!result) {
           for (uintN j = 0; j < i; j++)
             FreeNativeValue((*params)[j]);
-          delete [] *params;
-          *params = NULL;
+          params->Reset();
           RaiseException(cx,
                          "Failed to convert argument %d(%s) of function(%s) to"
                          " native", i, PrintJSValue(cx, argv[i]).c_str(), name);
@@ -528,7 +537,17 @@ static JSBool ConvertNativeToJSInt(JSContext *cx,
 static JSBool ConvertNativeToJSDouble(JSContext *cx,
                                       const Variant &native_val,
                                       jsval *js_val) {
-  jsdouble *pdouble = JS_NewDouble(cx, VariantValue<double>()(native_val));
+  double value = VariantValue<double>()(native_val);
+  // Integral values, such as most coordinates, needn't allocate a double in
+  // the JavaScript heap. -0 must still be a double.
+  if (value >= JSVAL_INT_MIN && value <= JSVAL_INT_MAX) {
+    int32 int_value = static_cast<int32>(value);
+    if (int_value == value && (int_value != 0 || 1 / value > 0)) {
+      *js_val = INT_TO_JSVAL(int_value);
+      return JS_TRUE;
+    }
+  }
+  jsdouble *pdouble = JS_NewDouble(cx, value);
   if (pdouble) {
     *js_val = DOUBLE_TO_JSVAL(pdouble);
     return JS_TRUE;
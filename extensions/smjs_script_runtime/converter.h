@@ -69,7 +69,7 @@ std::string PrintJSValue(JSContext *cx, jsval js_val);
 JSBool ConvertJSArgsToNative(JSContext *cx, NativeJSWrapper *owner,
                              const char *name, Slot *slot,
                              uintN argc, jsval *argv,
-                             Variant **params, uintN *expected_argc);
+                             VariantArgs *params, uintN *expected_argc);
 
 /**
  * Converts a @c Variant to a @c jsval.
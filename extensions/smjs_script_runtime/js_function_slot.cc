@@ -86,14 +86,20 @@ ResultVariant JSFunctionSlot::Call(ScriptableInterface *object, int argc,
   if (JS_IsExceptionPending(context_))
     return ResultVariant(return_value);
 
-  scoped_array<jsval> js_args;
+  // Most callbacks have few arguments, which needn't be allocated.
+  jsval small_args[4];
+  scoped_array<jsval> large_args;
+  jsval *js_args = small_args;
   {
     AutoLocalRootScope local_root_scope(context_);
     if (!local_root_scope.good())
       return ResultVariant(return_value);
 
     if (argc > 0) {
-      js_args.reset(new jsval[argc]);
+      if (static_cast<size_t>(argc) > arraysize(small_args)) {
+        large_args.reset(new jsval[argc]);
+        js_args = large_args.get();
+      }
       for (int i = 0; i < argc; i++) {
         if (!ConvertNativeToJS(context_, argv[i], &js_args[i])) {
           RaiseException(context_,
@@ -123,7 +129,7 @@ ResultVariant JSFunctionSlot::Call(ScriptableInterface *object, int argc,
   jsval rval;
   JSBool ret = JS_CallFunctionValue(context_, this_object,
                                     OBJECT_TO_JSVAL(function_),
-                                    argc, js_args.get(), &rval);
+                                    argc, js_args, &rval);
   if (!*death_flag_ptr) {
     if (death_flag_ptr == &death_flag)
       death_flag_ptr_ = NULL;
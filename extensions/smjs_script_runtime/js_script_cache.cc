@@ -0,0 +1,301 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "js_script_cache.h"
+
+#include <cstring>
+#include <ctime>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+#include <ggadget/digest_utils.h>
+#include <ggadget/file_manager_interface.h>
+#include <ggadget/js/jscript_massager.h>
+#include <ggadget/logger.h>
+#include <ggadget/slot.h>
+#include <ggadget/small_object.h>
+#include <ggadget/string_utils.h>
+#include <ggadget/unicode_utils.h>
+
+namespace ggadget {
+namespace smjs {
+
+// Directory in the file manager to store compiled scripts.
+static const char kCacheDir[] = "profile://script_cache/";
+// Scripts shorter than this are cheaper to compile than to look up.
+static const size_t kMinCachedScriptSize = 1024;
+// Upper limit of the total size of compiled scripts cached in memory.
+static const size_t kMaxMemoryBytes = 8 * 1024 * 1024;
+// Upper limit of the number of compiled scripts persisted.
+static const size_t kMaxDiskEntries = 1024;
+// Persisted scripts that haven't been written for this long are removed.
+static const uint64_t kMaxDiskIdleTime = 30 * 86400 * 1000ULL;
+// Persisted scripts read from the disk are written again if they haven't
+// been written for this long, so that scripts in use are never removed.
+static const uint64_t kDiskTouchInterval = 86400 * 1000ULL;
+// Version tag of the persisted script format.
+static const char kDiskFormatVersion[] = "GGLJSXDR1\n";
+
+class JSScriptCache::Impl : public SmallObject<> {
+ public:
+  typedef std::list<std::string> LRUList;
+  struct Entry {
+    std::string data;
+    LRUList::iterator lru;
+  };
+  typedef std::map<std::string, Entry> EntryMap;
+
+  Impl(FileManagerInterface *file_manager)
+      : file_manager_(file_manager),
+        memory_bytes_(0),
+        lookups_(0),
+        hits_(0),
+        disk_pruned_(false) {
+  }
+
+  static std::string GetKey(JSContext *cx, const std::string &script,
+                            const char *filename, int lineno) {
+    std::string input(kDiskFormatVersion);
+#ifdef JSXDR_BYTECODE_VERSION
+    StringAppendPrintf(&input, "%u\n", JSXDR_BYTECODE_VERSION);
+#endif
+    StringAppendPrintf(&input, "%s\n%u\n%d\n%s\n%d\n",
+                       JS_GetImplementationVersion(), JS_GetOptions(cx),
+                       static_cast<int>(JS_GetVersion(cx)),
+                       filename ? filename : "", lineno);
+    input.append(script);
+
+    std::string digest, key;
+    GenerateSHA1(input, &digest);
+    WebSafeEncodeBase64(digest, false, &key);
+    return key;
+  }
+
+  static std::string GetFileName(const std::string &key) {
+    return kCacheDir + key;
+  }
+
+  static JSScript *CompileSource(JSContext *cx, JSObject *obj,
+                                 const std::string &massaged_script,
+                                 const char *filename, int lineno,
+                                 bool *cacheable) {
+    UTF16String utf16_string;
+    if (ConvertStringUTF8ToUTF16(massaged_script, &utf16_string) ==
+        massaged_script.size()) {
+      *cacheable = true;
+      return JS_CompileUCScript(cx, obj, utf16_string.c_str(),
+                                utf16_string.size(), filename, lineno);
+    }
+    *cacheable = false;
+    JS_ReportWarning(cx, "Script %s contains invalid UTF-8 sequences "
+                     "and will be treated as ISO8859-1", filename);
+    return JS_CompileScript(cx, obj, massaged_script.c_str(),
+                            massaged_script.size(), filename, lineno);
+  }
+
+  static bool EncodeScript(JSContext *cx, JSScript *script,
+                           std::string *data) {
+    JSXDRState *xdr = JS_XDRNewMem(cx, JSXDR_ENCODE);
+    if (!xdr)
+      return false;
+    bool result = false;
+    if (JS_XDRScript(xdr, &script)) {
+      uint32 length = 0;
+      void *bytes = JS_XDRMemGetData(xdr, &length);
+      if (bytes) {
+        data->assign(static_cast<const char *>(bytes), length);
+        result = true;
+      }
+    } else {
+      JS_ClearPendingException(cx);
+    }
+    JS_XDRDestroy(xdr);
+    return result;
+  }
+
+  static JSScript *DecodeScript(JSContext *cx, const std::string &data) {
+    JSXDRState *xdr = JS_XDRNewMem(cx, JSXDR_DECODE);
+    if (!xdr)
+      return NULL;
+    JS_XDRMemSetData(xdr, const_cast<char *>(data.c_str()),
+                     static_cast<uint32>(data.size()));
+    JSScript *script = NULL;
+    if (!JS_XDRScript(xdr, &script)) {
+      // The data was written by an incompatible SpiderMonkey.
+      script = NULL;
+      JS_ClearPendingException(cx);
+    }
+    // The data is owned by the cache, don't let JS_XDRDestroy() free it.
+    JS_XDRMemSetData(xdr, NULL, 0);
+    JS_XDRDestroy(xdr);
+    return script;
+  }
+
+  bool CollectDiskFile(const char *name, std::vector<std::string> *files) {
+    files->push_back(std::string(kCacheDir) + name);
+    return true;
+  }
+
+  // Removes persisted scripts that haven't been written for a long time, and
+  // the oldest ones if there are too many.
+  void PruneDisk(uint64_t now) {
+    disk_pruned_ = true;
+    std::vector<std::string> files;
+    file_manager_->EnumerateFiles(
+        kCacheDir, NewSlot(this, &Impl::CollectDiskFile, &files));
+
+    std::multimap<uint64_t, std::string> files_by_time;
+    for (size_t i = 0; i < files.size(); ++i) {
+      uint64_t time = file_manager_->GetLastModifiedTime(files[i].c_str());
+      if (time + kMaxDiskIdleTime < now)
+        file_manager_->RemoveFile(files[i].c_str());
+      else
+        files_by_time.insert(std::make_pair(time, files[i]));
+    }
+    while (files_by_time.size() > kMaxDiskEntries) {
+      file_manager_->RemoveFile(files_by_time.begin()->second.c_str());
+      files_by_time.erase(files_by_time.begin());
+    }
+  }
+
+  void EvictMemory() {
+    while (memory_bytes_ > kMaxMemoryBytes && !lru_.empty()) {
+      EntryMap::iterator it = entries_.find(lru_.back());
+      ASSERT(it != entries_.end());
+      memory_bytes_ -= it->second.data.size();
+      entries_.erase(it);
+      lru_.pop_back();
+    }
+  }
+
+  void Remove(const std::string &key) {
+    EntryMap::iterator it = entries_.find(key);
+    if (it != entries_.end()) {
+      memory_bytes_ -= it->second.data.size();
+      lru_.erase(it->second.lru);
+      entries_.erase(it);
+    }
+    if (file_manager_)
+      file_manager_->RemoveFile(GetFileName(key).c_str());
+  }
+
+  const std::string *Put(const std::string &key, const std::string &data,
+                         bool persist) {
+    if (persist && file_manager_) {
+      file_manager_->WriteFile(GetFileName(key).c_str(),
+                               kDiskFormatVersion + data, true);
+    }
+    lru_.push_front(key);
+    Entry *entry = &entries_[key];
+    entry->data = data;
+    entry->lru = lru_.begin();
+    memory_bytes_ += data.size();
+    EvictMemory();
+    EntryMap::iterator it = entries_.find(key);
+    return it == entries_.end() ? NULL : &it->second.data;
+  }
+
+  // Finds the compiled script in memory, or loads it from the file manager.
+  const std::string *Get(const std::string &key) {
+    EntryMap::iterator it = entries_.find(key);
+    if (it != entries_.end()) {
+      lru_.splice(lru_.begin(), lru_, it->second.lru);
+      return &it->second.data;
+    }
+
+    if (!file_manager_)
+      return NULL;
+    uint64_t now = time(NULL) * 1000ULL;
+    if (!disk_pruned_)
+      PruneDisk(now);
+
+    std::string data;
+    std::string file_name = GetFileName(key);
+    size_t header_size = sizeof(kDiskFormatVersion) - 1;
+    if (!file_manager_->ReadFile(file_name.c_str(), &data) ||
+        data.compare(0, header_size, kDiskFormatVersion) != 0)
+      return NULL;
+    // Persisted scripts are pruned by the time they were written.
+    if (file_manager_->GetLastModifiedTime(file_name.c_str()) +
+        kDiskTouchInterval < now)
+      file_manager_->WriteFile(file_name.c_str(), data, true);
+    return Put(key, data.substr(header_size), false);
+  }
+
+  JSScript *Compile(JSContext *cx, JSObject *obj, const char *script,
+                    const char *filename, int lineno) {
+    // The massager memoizes its results, and logs the warnings about the
+    // script again on its hits.
+    std::string massaged_script =
+        js::MassageJScript(script, false, filename, lineno);
+    bool cacheable = false;
+    if (strlen(script) < kMinCachedScriptSize) {
+      return CompileSource(cx, obj, massaged_script, filename, lineno,
+                           &cacheable);
+    }
+
+    lookups_++;
+    std::string key = GetKey(cx, massaged_script, filename, lineno);
+    const std::string *data = Get(key);
+    if (data) {
+      JSScript *result = DecodeScript(cx, *data);
+      if (result) {
+        hits_++;
+        return result;
+      }
+      Remove(key);
+    }
+
+    JSScript *result = CompileSource(cx, obj, massaged_script, filename,
+                                     lineno, &cacheable);
+    std::string encoded;
+    if (result && cacheable && EncodeScript(cx, result, &encoded))
+      Put(key, encoded, true);
+    return result;
+  }
+
+  FileManagerInterface *file_manager_;
+  EntryMap entries_;
+  LRUList lru_;
+  size_t memory_bytes_;
+  size_t lookups_;
+  size_t hits_;
+  bool disk_pruned_;
+};
+
+JSScriptCache::JSScriptCache(FileManagerInterface *file_manager)
+    : impl_(new Impl(file_manager)) {
+}
+
+JSScriptCache::~JSScriptCache() {
+  delete impl_;
+  impl_ = NULL;
+}
+
+JSScript *JSScriptCache::Compile(JSContext *cx, JSObject *obj,
+                                 const char *script, const char *filename,
+                                 int lineno) {
+  return script ? impl_->Compile(cx, obj, script, filename, lineno) : NULL;
+}
+
+void JSScriptCache::GetStats(size_t *lookups, size_t *hits) const {
+  if (lookups) *lookups = impl_->lookups_;
+  if (hits) *hits = impl_->hits_;
+}
+
+} // namespace smjs
+} // namespace ggadget
@@ -0,0 +1,86 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#ifndef EXTENSIONS_SMJS_SCRIPT_RUNTIME_JS_SCRIPT_CACHE_H__
+#define EXTENSIONS_SMJS_SCRIPT_RUNTIME_JS_SCRIPT_CACHE_H__
+
+#include <ggadget/common.h>
+#include "libmozjs_glue.h"
+
+namespace ggadget {
+
+class FileManagerInterface;
+
+namespace smjs {
+
+/**
+ * Caches compiled scripts in XDR format, so that a script executed again,
+ * either by another instance of the same gadget or in a later session, needn't
+ * be massaged, parsed and compiled again.
+ *
+ * Scripts are keyed by the digest of their massaged source, file name, line
+ * number, the SpiderMonkey version, the JavaScript version and the options of
+ * the context. The encoded scripts are kept in memory and persisted under
+ * profile://script_cache/ in the file manager, if any.
+ *
+ * The source is keyed after being massaged, so that a changed massager never
+ * reuses scripts compiled from the output of the old one, and the warnings of
+ * the massager are logged on hits too. The massager memoizes its results in
+ * its own cache under profile://massager_cache/, so a hit seldom massages the
+ * script again. The two caches are pruned independently.
+ */
+class JSScriptCache {
+ public:
+  /**
+   * @param file_manager where to persist the compiled scripts. Can be @c NULL
+   *     to cache scripts in memory only.
+   */
+  explicit JSScriptCache(FileManagerInterface *file_manager);
+  ~JSScriptCache();
+
+  /**
+   * Gets the compiled script of the source, by decoding the cached one or
+   * compiling the source.
+   *
+   * @param cx the context in which to compile the script.
+   * @param obj the object to compile the script against.
+   * @param script the original UTF-8 source, before massaged.
+   * @param filename the file name of the script.
+   * @param lineno the line number of the first line of the script.
+   * @return the compiled script, which must be destroyed with
+   *     @c JS_DestroyScript() after use, or @c NULL on errors, in which case
+   *     an error has been reported in @a cx.
+   */
+  JSScript *Compile(JSContext *cx, JSObject *obj, const char *script,
+                    const char *filename, int lineno);
+
+  /**
+   * Gets the statistics of the cache.
+   * @param[out] lookups the number of scripts compiled through the cache.
+   * @param[out] hits the number of scripts decoded from the cache.
+   */
+  void GetStats(size_t *lookups, size_t *hits) const;
+
+ private:
+  class Impl;
+  Impl *impl_;
+  DISALLOW_EVIL_CONSTRUCTORS(JSScriptCache);
+};
+
+} // namespace smjs
+} // namespace ggadget
+
+#endif  // EXTENSIONS_SMJS_SCRIPT_RUNTIME_JS_SCRIPT_CACHE_H__
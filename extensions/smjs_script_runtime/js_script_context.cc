@@ -24,6 +24,7 @@
 #include "converter.h"
 #include "js_function_slot.h"
 #include "js_native_wrapper.h"
+#include "js_script_cache.h"
 #include "js_script_runtime.h"
 #include "native_js_wrapper.h"
 
@@ -387,9 +388,14 @@ void JSScriptContext::Destroy() {
 void JSScriptContext::Execute(const char *script,
                               const char *filename,
                               int lineno) {
-  jsval rval;
-  EvaluateScript(context_, JS_GetGlobalObject(context_), script,
-                 filename, lineno, &rval);
+  JSObject *global = JS_GetGlobalObject(context_);
+  JSScript *compiled = runtime_->GetScriptCache()->Compile(
+      context_, global, script, filename, lineno);
+  if (compiled) {
+    jsval rval;
+    JS_ExecuteScript(context_, global, compiled, &rval);
+    JS_DestroyScript(context_, compiled);
+  }
 }
 
 Slot *JSScriptContext::Compile(const char *script,
@@ -486,7 +492,7 @@ JSBool JSScriptContext::ConstructObject(JSContext *cx, JSObject *obj,
   // This wrapper is important if there are any JavaScript callbacks in the
   // constructor argument list.
   NativeJSWrapper *wrapper = new NativeJSWrapper(cx, obj, NULL);
-  Variant *params = NULL;
+  VariantArgs params;
   uintN expected_argc = argc;
   if (!ConvertJSArgsToNative(cx, wrapper, cls->js_class_.name,
                              cls->constructor_, argc, argv,
@@ -494,8 +500,8 @@ JSBool JSScriptContext::ConstructObject(JSContext *cx, JSObject *obj,
     return JS_FALSE;
 
   ResultVariant return_value = cls->constructor_->Call(NULL, expected_argc,
-                                                       params);
-  delete [] params;
+                                                       params.get());
+  params.Reset();
 
   ASSERT(return_value.v().type() == Variant::TYPE_SCRIPTABLE);
   ScriptableInterface *scriptable =
@@ -17,8 +17,10 @@
 #include "js_script_runtime.h"
 
 #include <unistd.h>
+#include <ggadget/file_manager_factory.h>
 #include <ggadget/logger.h>
 #include <ggadget/signals.h>
+#include "js_script_cache.h"
 #include "js_script_context.h"
 
 namespace ggadget {
@@ -48,7 +50,8 @@ static void *TriggerOperationCallbacksThread(void *data) {
 #endif
 
 JSScriptRuntime::JSScriptRuntime()
-    : runtime_(JS_NewRuntime(kDefaultContextSize)) {
+    : runtime_(JS_NewRuntime(kDefaultContextSize)),
+      script_cache_(NULL) {
   ASSERT(runtime_);
   // Use the similar policy as Mozilla Gecko that unconstrains the runtime's
   // threshold on nominal heap size, to avoid triggering GC too often.
@@ -86,6 +89,7 @@ JSScriptRuntime::~JSScriptRuntime() {
     usleep(10000); // 10ms is enough for the thread to exit the hazard zone.
   }
 #endif
+  delete script_cache_;
   JS_DestroyRuntime(runtime_);
 }
 
@@ -102,5 +106,13 @@ void JSScriptRuntime::DestroyContext(JSScriptContext *context) {
   delete context;
 }
 
+JSScriptCache *JSScriptRuntime::GetScriptCache() {
+  // Created lazily, because the global file manager might not be ready when
+  // the runtime is created.
+  if (!script_cache_)
+    script_cache_ = new JSScriptCache(GetGlobalFileManager());
+  return script_cache_;
+}
+
 } // namespace smjs
 } // namespace ggadget
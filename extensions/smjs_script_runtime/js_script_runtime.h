@@ -23,6 +23,7 @@
 namespace ggadget {
 namespace smjs {
 
+class JSScriptCache;
 class JSScriptContext;
 
 /**
@@ -38,9 +39,16 @@ class JSScriptRuntime : public ScriptRuntimeInterface {
 
   void DestroyContext(JSScriptContext *context);
 
+  /**
+   * Gets the cache of compiled scripts shared by all contexts of this
+   * runtime.
+   */
+  JSScriptCache *GetScriptCache();
+
  private:
   DISALLOW_EVIL_CONSTRUCTORS(JSScriptRuntime);
   JSRuntime *runtime_;
+  JSScriptCache *script_cache_;
 };
 
 // The maximum execution time of a piece of script (10 seconds).
@@ -41,6 +41,7 @@ namespace libmozjs {
 #undef JS_CallFunctionValue
 #undef JS_ClearPendingException
 #undef JS_CompileFunction
+#undef JS_CompileScript
 #undef JS_CompileUCFunction
 #undef JS_CompileUCScript
 #undef JS_ConvertStub
@@ -69,6 +70,7 @@ namespace libmozjs {
 #undef JS_GetFunctionName
 #undef JS_GetFunctionObject
 #undef JS_GetGlobalObject
+#undef JS_GetImplementationVersion
 #undef JS_GetOptions
 #undef JS_GetPendingException
 #undef JS_GetPrivate
@@ -80,6 +82,7 @@ namespace libmozjs {
 #undef JS_GetStringChars
 #undef JS_GetStringLength
 #undef JS_GetUCProperty
+#undef JS_GetVersion
 #undef JS_IdToValue
 #undef JS_InitClass
 #undef JS_InitStandardClasses
@@ -122,6 +125,7 @@ namespace libmozjs {
 #undef JS_SetReservedSlot
 #undef JS_SetRuntimePrivate
 #undef JS_SetUCProperty
+#undef JS_SetVersion
 #undef JS_TriggerAllOperationCallbacks
 #undef JS_TypeOfValue
 #undef JS_ValueToBoolean
@@ -131,6 +135,11 @@ namespace libmozjs {
 #undef JS_ValueToInt32
 #undef JS_ValueToNumber
 #undef JS_ValueToString
+#undef JS_XDRDestroy
+#undef JS_XDRMemGetData
+#undef JS_XDRMemSetData
+#undef JS_XDRNewMem
+#undef JS_XDRScript
 #undef JS_GetClass
 
 // Define real function pointers.
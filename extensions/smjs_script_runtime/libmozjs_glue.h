@@ -23,6 +23,7 @@
 
 #include <jsapi.h>
 #include <jsdhash.h>
+#include <jsxdr.h>
 
 // This file only makes sense when XPCOM_GLUE is defined.
 #ifdef XPCOM_GLUE
@@ -43,6 +44,7 @@ MOZJS_API(JSBool, JS_CallFunctionName, (JSContext *cx, JSObject *obj, const char
 MOZJS_API(JSBool, JS_CallFunctionValue, (JSContext *cx, JSObject *obj, jsval fval, uintN argc, jsval *argv, jsval *rval));
 MOZJS_API(void, JS_ClearPendingException, (JSContext *cx));
 MOZJS_API(JSFunction *, JS_CompileFunction, (JSContext *cx, JSObject *obj, const char *name, uintN nargs, const char **argnames, const char *bytes, size_t length, const char *filename, uintN lineno));
+MOZJS_API(JSScript *, JS_CompileScript, (JSContext *cx, JSObject *obj, const char *bytes, size_t length, const char *filename, uintN lineno));
 MOZJS_API(JSFunction *, JS_CompileUCFunction, (JSContext *cx, JSObject *obj, const char *name, uintN nargs, const char **argnames, const jschar *chars, size_t length, const char *filename, uintN lineno));
 MOZJS_API(JSScript *, JS_CompileUCScript, (JSContext *cx, JSObject *obj, const jschar *chars, size_t length, const char *filename, uintN lineno));
 MOZJS_API(JSBool, JS_ConvertStub, (JSContext *cx, JSObject *obj, JSType type, jsval *vp));
@@ -71,6 +73,7 @@ MOZJS_API(JSBool, JS_GetElement, (JSContext *cx, JSObject *obj, jsint index, jsv
 MOZJS_API(const char *, JS_GetFunctionName, (JSFunction *fun));
 MOZJS_API(JSObject *, JS_GetFunctionObject, (JSFunction *fun));
 MOZJS_API(JSObject *, JS_GetGlobalObject, (JSContext *cx));
+MOZJS_API(const char *, JS_GetImplementationVersion, (void));
 MOZJS_API(uint32, JS_GetOptions, (JSContext *cx));
 MOZJS_API(JSBool, JS_GetPendingException, (JSContext *cx, jsval *vp));
 MOZJS_API(void *, JS_GetPrivate, (JSContext *cx, JSObject *obj));
@@ -82,6 +85,7 @@ MOZJS_API(char *, JS_GetStringBytes, (JSString *str));
 MOZJS_API(jschar *, JS_GetStringChars, (JSString *str));
 MOZJS_API(size_t, JS_GetStringLength, (JSString *str));
 MOZJS_API(JSBool, JS_GetUCProperty, (JSContext *cx, JSObject *obj, const jschar *name, size_t namelen, jsval *vp));
+MOZJS_API(JSVersion, JS_GetVersion, (JSContext *cx));
 MOZJS_API(JSBool, JS_IdToValue, (JSContext *cx, jsid id, jsval *vp));
 MOZJS_API(JSObject *, JS_InitClass, (JSContext *cx, JSObject *obj, JSObject *parent_proto, JSClass *clasp, JSNative constructor, uintN nargs, JSPropertySpec *ps, JSFunctionSpec *fs, JSPropertySpec *static_ps, JSFunctionSpec *static_fs));
 MOZJS_API(JSBool, JS_InitStandardClasses, (JSContext *cx, JSObject *obj));
@@ -123,6 +127,7 @@ MOZJS_API(JSBool, JS_SetProperty, (JSContext *cx, JSObject *obj, const char *nam
 MOZJS_API(JSBool, JS_SetReservedSlot, (JSContext *cx, JSObject *obj, uint32 index, jsval v));
 MOZJS_API(void, JS_SetRuntimePrivate, (JSRuntime *rt, void *data));
 MOZJS_API(JSBool, JS_SetUCProperty, (JSContext *cx, JSObject *obj, const jschar *name, size_t namelen, jsval *vp));
+MOZJS_API(JSVersion, JS_SetVersion, (JSContext *cx, JSVersion version));
 MOZJS_API(void, JS_TriggerAllOperationCallbacks, (JSRuntime *rt));
 MOZJS_API(JSType, JS_TypeOfValue, (JSContext *cx, jsval v));
 MOZJS_API(JSBool, JS_ValueToBoolean, (JSContext *cx, jsval v, JSBool *bp));
@@ -132,6 +137,11 @@ MOZJS_API(JSBool, JS_ValueToId, (JSContext *cx, jsval v, jsid *idp));
 MOZJS_API(JSBool, JS_ValueToInt32, (JSContext *cx, jsval v, int32 *ip));
 MOZJS_API(JSBool, JS_ValueToNumber, (JSContext *cx, jsval v, jsdouble *dp));
 MOZJS_API(JSString *, JS_ValueToString, (JSContext *cx, jsval v));
+MOZJS_API(void, JS_XDRDestroy, (JSXDRState *xdr));
+MOZJS_API(void *, JS_XDRMemGetData, (JSXDRState *xdr, uint32 *lp));
+MOZJS_API(void, JS_XDRMemSetData, (JSXDRState *xdr, void *data, uint32 len));
+MOZJS_API(JSXDRState *, JS_XDRNewMem, (JSContext *cx, JSXDRMode mode));
+MOZJS_API(JSBool, JS_XDRScript, (JSXDRState *xdr, JSScript **scriptp));
 #ifdef JS_THREADSAFE
 MOZJS_API(JSClass *, JS_GetClass, (JSContext *cx, JSObject *obj));
 #else
@@ -154,6 +164,7 @@ MOZJS_API(void, JS_SetOperationCallback, (JSContext *cx, JSOperationCallback cal
   MOZJS_FUNC(JS_CallFunctionValue) \
   MOZJS_FUNC(JS_ClearPendingException) \
   MOZJS_FUNC(JS_CompileFunction) \
+  MOZJS_FUNC(JS_CompileScript) \
   MOZJS_FUNC(JS_CompileUCFunction) \
   MOZJS_FUNC(JS_CompileUCScript) \
   MOZJS_FUNC(JS_ConvertStub) \
@@ -182,6 +193,7 @@ MOZJS_API(void, JS_SetOperationCallback, (JSContext *cx, JSOperationCallback cal
   MOZJS_FUNC(JS_GetFunctionName) \
   MOZJS_FUNC(JS_GetFunctionObject) \
   MOZJS_FUNC(JS_GetGlobalObject) \
+  MOZJS_FUNC(JS_GetImplementationVersion) \
   MOZJS_FUNC(JS_GetOptions) \
   MOZJS_FUNC(JS_GetPendingException) \
   MOZJS_FUNC(JS_GetPrivate) \
@@ -193,6 +205,7 @@ MOZJS_API(void, JS_SetOperationCallback, (JSContext *cx, JSOperationCallback cal
   MOZJS_FUNC(JS_GetStringChars) \
   MOZJS_FUNC(JS_GetStringLength) \
   MOZJS_FUNC(JS_GetUCProperty) \
+  MOZJS_FUNC(JS_GetVersion) \
   MOZJS_FUNC(JS_IdToValue) \
   MOZJS_FUNC(JS_InitClass) \
   MOZJS_FUNC(JS_InitStandardClasses) \
@@ -235,6 +248,7 @@ MOZJS_API(void, JS_SetOperationCallback, (JSContext *cx, JSOperationCallback cal
   MOZJS_FUNC(JS_SetReservedSlot) \
   MOZJS_FUNC(JS_SetRuntimePrivate) \
   MOZJS_FUNC(JS_SetUCProperty) \
+  MOZJS_FUNC(JS_SetVersion) \
   MOZJS_FUNC(JS_TriggerAllOperationCallbacks) \
   MOZJS_FUNC(JS_TypeOfValue) \
   MOZJS_FUNC(JS_ValueToBoolean) \
@@ -244,6 +258,11 @@ MOZJS_API(void, JS_SetOperationCallback, (JSContext *cx, JSOperationCallback cal
   MOZJS_FUNC(JS_ValueToInt32) \
   MOZJS_FUNC(JS_ValueToNumber) \
   MOZJS_FUNC(JS_ValueToString) \
+  MOZJS_FUNC(JS_XDRDestroy) \
+  MOZJS_FUNC(JS_XDRMemGetData) \
+  MOZJS_FUNC(JS_XDRMemSetData) \
+  MOZJS_FUNC(JS_XDRNewMem) \
+  MOZJS_FUNC(JS_XDRScript) \
   MOZJS_FUNC(JS_GetClass) \
 
 #define MOZJS_FUNC(fname) extern fname##Type fname;
@@ -259,6 +278,7 @@ MOZJS_FUNCTIONS
 #define JS_CallFunctionValue ggadget::libmozjs::JS_CallFunctionValue.func
 #define JS_ClearPendingException ggadget::libmozjs::JS_ClearPendingException.func
 #define JS_CompileFunction ggadget::libmozjs::JS_CompileFunction.func
+#define JS_CompileScript ggadget::libmozjs::JS_CompileScript.func
 #define JS_CompileUCFunction ggadget::libmozjs::JS_CompileUCFunction.func
 #define JS_CompileUCScript ggadget::libmozjs::JS_CompileUCScript.func
 #define JS_DefineFunction ggadget::libmozjs::JS_DefineFunction.func
@@ -285,6 +305,7 @@ MOZJS_FUNCTIONS
 #define JS_GetFunctionName ggadget::libmozjs::JS_GetFunctionName.func
 #define JS_GetFunctionObject ggadget::libmozjs::JS_GetFunctionObject.func
 #define JS_GetGlobalObject ggadget::libmozjs::JS_GetGlobalObject.func
+#define JS_GetImplementationVersion ggadget::libmozjs::JS_GetImplementationVersion.func
 #define JS_GetOptions ggadget::libmozjs::JS_GetOptions.func
 #define JS_GetPendingException ggadget::libmozjs::JS_GetPendingException.func
 #define JS_GetPrivate ggadget::libmozjs::JS_GetPrivate.func
@@ -296,6 +317,7 @@ MOZJS_FUNCTIONS
 #define JS_GetStringChars ggadget::libmozjs::JS_GetStringChars.func
 #define JS_GetStringLength ggadget::libmozjs::JS_GetStringLength.func
 #define JS_GetUCProperty ggadget::libmozjs::JS_GetUCProperty.func
+#define JS_GetVersion ggadget::libmozjs::JS_GetVersion.func
 #define JS_IdToValue ggadget::libmozjs::JS_IdToValue.func
 #define JS_InitClass ggadget::libmozjs::JS_InitClass.func
 #define JS_InitStandardClasses ggadget::libmozjs::JS_InitStandardClasses.func
@@ -336,6 +358,7 @@ MOZJS_FUNCTIONS
 #define JS_SetReservedSlot ggadget::libmozjs::JS_SetReservedSlot.func
 #define JS_SetRuntimePrivate ggadget::libmozjs::JS_SetRuntimePrivate.func
 #define JS_SetUCProperty ggadget::libmozjs::JS_SetUCProperty.func
+#define JS_SetVersion ggadget::libmozjs::JS_SetVersion.func
 #define JS_TriggerAllOperationCallbacks ggadget::libmozjs::JS_TriggerAllOperationCallbacks.func
 #define JS_TypeOfValue ggadget::libmozjs::JS_TypeOfValue.func
 #define JS_ValueToBoolean ggadget::libmozjs::JS_ValueToBoolean.func
@@ -345,6 +368,11 @@ MOZJS_FUNCTIONS
 #define JS_ValueToInt32 ggadget::libmozjs::JS_ValueToInt32.func
 #define JS_ValueToNumber ggadget::libmozjs::JS_ValueToNumber.func
 #define JS_ValueToString ggadget::libmozjs::JS_ValueToString.func
+#define JS_XDRDestroy ggadget::libmozjs::JS_XDRDestroy.func
+#define JS_XDRMemGetData ggadget::libmozjs::JS_XDRMemGetData.func
+#define JS_XDRMemSetData ggadget::libmozjs::JS_XDRMemSetData.func
+#define JS_XDRNewMem ggadget::libmozjs::JS_XDRNewMem.func
+#define JS_XDRScript ggadget::libmozjs::JS_XDRScript.func
 #define JS_GetClass ggadget::libmozjs::JS_GetClass.func
 
 // Stub functions are likely be used in static initialization code.
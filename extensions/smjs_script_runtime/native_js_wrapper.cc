@@ -14,11 +14,14 @@
   limitations under the License.
 */
 
+#include <cstring>
+#include <ggadget/atom_table.h>
 #include <ggadget/logger.h>
 #include <ggadget/scriptable_interface.h>
 #include <ggadget/signals.h>
 #include <ggadget/slot.h>
 #include <ggadget/string_utils.h>
+#include <ggadget/unicode_utils.h>
 
 #include "native_js_wrapper.h"
 #include "converter.h"
@@ -35,6 +38,60 @@
 namespace ggadget {
 namespace smjs {
 
+// Number of entries in the property name cache, must be a power of 2.
+static const size_t kNameCacheSize = 256;
+
+// Caches the interned UTF-8 names of the recently accessed native properties,
+// so that hot accesses needn't convert the names again. Property ids are
+// atomized JSStrings, so the same name mostly comes in the same JSString.
+// The content is still compared, because the JSString may have been
+// collected and its address reused.
+class PropertyNameCache {
+ public:
+  PropertyNameCache() {
+    for (size_t i = 0; i < kNameCacheSize; ++i)
+      entries_[i].str = NULL;
+  }
+
+  const char *Get(JSString *str, std::string *buffer) {
+    const jschar *chars = JS_GetStringChars(str);
+    size_t length = JS_GetStringLength(str);
+    size_t index = (reinterpret_cast<uintptr_t>(str) >> 3) &
+                   (kNameCacheSize - 1);
+    Entry *entry = &entries_[index];
+    if (entry->str == str && entry->chars.size() == length &&
+        memcmp(entry->chars.c_str(), chars, length * sizeof(jschar)) == 0)
+      return entry->name;
+
+    ConvertStringUTF16ToUTF8(chars, length, buffer);
+    // Only cache the names of registered properties, which are all
+    // interned. Other names are mostly of the dynamic properties.
+    Atom atom = FindAtom(buffer->c_str());
+    if (atom == kInvalidAtom)
+      return buffer->c_str();
+    entry->str = str;
+    entry->chars.assign(chars, length);
+    entry->name = GetAtomName(atom);
+    return entry->name;
+  }
+
+ private:
+  struct Entry {
+    JSString *str;
+    UTF16String chars;
+    const char *name;
+  };
+  Entry entries_[kNameCacheSize];
+};
+
+// Converts a property id into UTF-8. The result is either an interned name
+// or the content of @a buffer.
+static const char *GetPropertyName(JSString *str, std::string *buffer) {
+  // All JavaScript runs in the main thread.
+  static PropertyNameCache *cache = new PropertyNameCache();
+  return cache->Get(str, buffer);
+}
+
 // This JSClass is used to create wrapper JSObjects.
 JSClass NativeJSWrapper::wrapper_js_class_ = {
   "NativeJSWrapper",
@@ -417,15 +474,15 @@ JSBool NativeJSWrapper::CallNativeSlot(const char *name, Slot *slot,
                                        uintN argc, jsval *argv, jsval *rval) {
   ASSERT(scriptable_);
 
-  Variant *params = NULL;
+  VariantArgs params;
   uintN expected_argc = argc;
   if (!ConvertJSArgsToNative(js_context_, this, name, slot, argc, argv,
                              &params, &expected_argc))
     return JS_FALSE;
 
-  ResultVariant return_value = slot->Call(scriptable_, expected_argc, params);
-  delete [] params;
-  params = NULL;
+  ResultVariant return_value = slot->Call(scriptable_, expected_argc,
+                                          params.get());
+  params.Reset();
 
   if (!CheckException(js_context_, scriptable_))
     return JS_FALSE;
@@ -545,8 +602,9 @@ JSBool NativeJSWrapper::GetPropertyByName(jsval id, jsval *vp) {
 
   const jschar *utf16_name = JS_GetStringChars(idstr);
   size_t name_length = JS_GetStringLength(idstr);
-  UTF16ToUTF8Converter utf8_name(utf16_name, name_length);
-  ResultVariant return_value = scriptable_->GetProperty(utf8_name.get());
+  std::string name_buffer;
+  const char *utf8_name = GetPropertyName(idstr, &name_buffer);
+  ResultVariant return_value = scriptable_->GetProperty(utf8_name);
   if (!CheckException(js_context_, scriptable_))
     return JS_FALSE;
 
@@ -561,7 +619,7 @@ JSBool NativeJSWrapper::GetPropertyByName(jsval id, jsval *vp) {
   if (!ConvertNativeToJS(js_context_, return_value.v(), vp)) {
     RaiseException(js_context_,
                    "Failed to convert native property %s value(%s) to jsval",
-                   utf8_name.get(), return_value.v().Print().c_str());
+                   utf8_name, return_value.v().Print().c_str());
     return JS_FALSE;
   }
   return JS_TRUE;
@@ -579,9 +637,10 @@ JSBool NativeJSWrapper::SetPropertyByName(jsval id, jsval js_val) {
 
   const jschar *utf16_name = JS_GetStringChars(idstr);
   size_t name_length = JS_GetStringLength(idstr);
-  UTF16ToUTF8Converter utf8_name(utf16_name, name_length);
+  std::string name_buffer;
+  const char *utf8_name = GetPropertyName(idstr, &name_buffer);
   Variant prototype;
-  if (scriptable_->GetPropertyInfo(utf8_name.get(), &prototype) ==
+  if (scriptable_->GetPropertyInfo(utf8_name, &prototype) ==
       ScriptableInterface::PROPERTY_NOT_EXIST) {
     // This must be a dynamic property which is no more available.
     // Remove the property and fallback to the default handler.
@@ -596,14 +655,14 @@ JSBool NativeJSWrapper::SetPropertyByName(jsval id, jsval js_val) {
   if (!ConvertJSToNative(js_context_, this, prototype, js_val, &value)) {
     RaiseException(js_context_,
                    "Failed to convert JS property %s value(%s) to native.",
-                   utf8_name.get(), PrintJSValue(js_context_, js_val).c_str());
+                   utf8_name, PrintJSValue(js_context_, js_val).c_str());
     return JS_FALSE;
   }
 
-  if (!scriptable_->SetProperty(utf8_name.get(), value)) {
+  if (!scriptable_->SetProperty(utf8_name, value)) {
     RaiseException(js_context_,
                    "Failed to set native property %s (may be readonly).",
-                   utf8_name.get());
+                   utf8_name);
     FreeNativeValue(value);
     return JS_FALSE;
   }
@@ -684,7 +743,8 @@ JSBool NativeJSWrapper::ResolveProperty(jsval id, uintN flags,
 
   const jschar *utf16_name = JS_GetStringChars(idstr);
   size_t name_length = JS_GetStringLength(idstr);
-  UTF16ToUTF8Converter utf8_name(utf16_name, name_length);
+  std::string name_buffer;
+  const char *utf8_name = GetPropertyName(idstr, &name_buffer);
 
   // The JS program defines a new symbol. This has higher priority than the
   // properties of the global scriptable object.
@@ -693,14 +753,14 @@ JSBool NativeJSWrapper::ResolveProperty(jsval id, uintN flags,
 
   Variant prototype;
   ScriptableInterface::PropertyType type =
-      scriptable_->GetPropertyInfo(utf8_name.get(), &prototype);
+      scriptable_->GetPropertyInfo(utf8_name, &prototype);
   if (type == ScriptableInterface::PROPERTY_NOT_EXIST) {
-    if (strcmp(utf8_name.get(), "toString") == 0) {
+    if (strcmp(utf8_name, "toString") == 0) {
       // Define a default toString() operator to ease debugging.
       JS_DefineUCFunction(js_context_, js_object_, utf16_name, name_length,
                           WrapperDefaultToString, 0, 0);
       *objp = js_object_;
-    } else if (strcmp(utf8_name.get(), "__NATIVE_CLASS_ID__") == 0) {
+    } else if (strcmp(utf8_name, "__NATIVE_CLASS_ID__") == 0) {
       // Register __NATIVE_CLASS_ID__ property for JS debugging.
       jsval js_val;
       ConvertNativeToJS(js_context_,
@@ -0,0 +1,215 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include <clocale>
+#include <cstdio>
+#include <ctime>
+#include <map>
+#include <string>
+#include <jsapi.h>
+#include "../js_script_cache.h"
+#include "../js_script_context.h"
+#include "../js_script_runtime.h"
+#include "ggadget/string_utils.h"
+#include "ggadget/tests/mocked_file_manager.h"
+#include "unittest/gtest.h"
+
+using namespace ggadget;
+using namespace ggadget::smjs;
+
+// Returns a script which evaluates to value, padded to be long enough to be
+// cached.
+static std::string MakeScript(int value) {
+  std::string script;
+  for (int i = 0; i < 32; i++)
+    script += "// Padding to make the script worth caching.\n";
+  StringAppendPrintf(&script, "var result = %d;\nresult;\n", value);
+  return script;
+}
+
+// Counts the writes, and reports the given modification time for all files.
+class TimedFileManager : public MockedFileManager {
+ public:
+  TimedFileManager() : time_(0), writes_(0) { }
+  virtual bool WriteFile(const char *file, const std::string &data,
+                         bool overwrite) {
+    writes_++;
+    return MockedFileManager::WriteFile(file, data, overwrite);
+  }
+  virtual uint64_t GetLastModifiedTime(const char *file) { return time_; }
+
+  uint64_t time_;
+  int writes_;
+};
+
+class JSScriptCacheTest : public testing::Test {
+ protected:
+  virtual void SetUp() {
+    runtime_ = new JSScriptRuntime();
+    context_ = down_cast<JSScriptContext *>(runtime_->CreateContext());
+    cx_ = context_->context();
+    global_ = JS_NewObject(cx_, NULL, NULL, NULL);
+    JS_SetGlobalObject(cx_, global_);
+  }
+
+  virtual void TearDown() {
+    context_->Destroy();
+    delete runtime_;
+  }
+
+  // Compiles the script through the cache, and returns the result of
+  // executing it, or -1 on errors.
+  int Run(JSScriptCache *cache, const std::string &script,
+          const char *filename) {
+    JSScript *compiled = cache->Compile(cx_, global_, script.c_str(),
+                                        filename, 1);
+    if (!compiled)
+      return -1;
+    jsval rval;
+    int result = -1;
+    if (JS_ExecuteScript(cx_, global_, compiled, &rval) &&
+        JSVAL_IS_INT(rval))
+      result = JSVAL_TO_INT(rval);
+    JS_DestroyScript(cx_, compiled);
+    return result;
+  }
+
+  JSScriptRuntime *runtime_;
+  JSScriptContext *context_;
+  JSContext *cx_;
+  JSObject *global_;
+};
+
+TEST_F(JSScriptCacheTest, Hit) {
+  JSScriptCache cache(NULL);
+  size_t lookups = 0, hits = 0;
+  EXPECT_EQ(1, Run(&cache, MakeScript(1), "a.js"));
+  cache.GetStats(&lookups, &hits);
+  EXPECT_EQ(1U, lookups);
+  EXPECT_EQ(0U, hits);
+
+  // The decoded script behaves the same as the compiled one.
+  EXPECT_EQ(1, Run(&cache, MakeScript(1), "a.js"));
+  cache.GetStats(&lookups, &hits);
+  EXPECT_EQ(2U, lookups);
+  EXPECT_EQ(1U, hits);
+
+  // Short scripts bypass the cache.
+  EXPECT_EQ(2, Run(&cache, "2", "a.js"));
+  cache.GetStats(&lookups, &hits);
+  EXPECT_EQ(2U, lookups);
+}
+
+TEST_F(JSScriptCacheTest, KeyChanges) {
+  JSScriptCache cache(NULL);
+  size_t lookups = 0, hits = 0;
+  EXPECT_EQ(1, Run(&cache, MakeScript(1), "a.js"));
+
+  // Changed script text.
+  EXPECT_EQ(2, Run(&cache, MakeScript(2), "a.js"));
+  cache.GetStats(&lookups, &hits);
+  EXPECT_EQ(0U, hits);
+
+  // Changed file name.
+  EXPECT_EQ(1, Run(&cache, MakeScript(1), "b.js"));
+  cache.GetStats(&lookups, &hits);
+  EXPECT_EQ(0U, hits);
+
+  // Changed JavaScript version.
+  JSVersion version = JS_GetVersion(cx_);
+  JS_SetVersion(cx_, version == JSVERSION_1_5 ? JSVERSION_1_6 :
+                                                JSVERSION_1_5);
+  EXPECT_EQ(1, Run(&cache, MakeScript(1), "a.js"));
+  cache.GetStats(&lookups, &hits);
+  EXPECT_EQ(0U, hits);
+  JS_SetVersion(cx_, version);
+
+  // The original script is still cached.
+  EXPECT_EQ(1, Run(&cache, MakeScript(1), "a.js"));
+  cache.GetStats(&lookups, &hits);
+  EXPECT_EQ(5U, lookups);
+  EXPECT_EQ(1U, hits);
+}
+
+TEST_F(JSScriptCacheTest, Persist) {
+  MockedFileManager file_manager;
+  size_t lookups = 0, hits = 0;
+  {
+    JSScriptCache cache(&file_manager);
+    EXPECT_EQ(1, Run(&cache, MakeScript(1), "a.js"));
+  }
+  ASSERT_EQ(1U, file_manager.data_.size());
+
+  // A new cache, as in a later session, decodes the persisted script.
+  {
+    JSScriptCache cache(&file_manager);
+    EXPECT_EQ(1, Run(&cache, MakeScript(1), "a.js"));
+    cache.GetStats(&lookups, &hits);
+    EXPECT_EQ(1U, hits);
+  }
+
+  // Persisted scripts in other formats are ignored and replaced.
+  std::string *data = &file_manager.data_.begin()->second;
+  (*data)[0] = 'X';
+  {
+    JSScriptCache cache(&file_manager);
+    EXPECT_EQ(1, Run(&cache, MakeScript(1), "a.js"));
+    cache.GetStats(&lookups, &hits);
+    EXPECT_EQ(0U, hits);
+  }
+  EXPECT_EQ('G', (*data)[0]);
+}
+
+TEST_F(JSScriptCacheTest, DiskTouch) {
+  TimedFileManager file_manager;
+  file_manager.time_ = time(NULL) * 1000ULL;
+  {
+    JSScriptCache cache(&file_manager);
+    EXPECT_EQ(1, Run(&cache, MakeScript(1), "a.js"));
+  }
+  EXPECT_EQ(1, file_manager.writes_);
+
+  // Recently written scripts are not written again on hits.
+  {
+    JSScriptCache cache(&file_manager);
+    EXPECT_EQ(1, Run(&cache, MakeScript(1), "a.js"));
+  }
+  EXPECT_EQ(1, file_manager.writes_);
+
+  // Old scripts are written again on hits, to keep them from being pruned.
+  file_manager.time_ = 0;
+  {
+    JSScriptCache cache(&file_manager);
+    EXPECT_EQ(1, Run(&cache, MakeScript(1), "a.js"));
+    size_t hits = 0;
+    cache.GetStats(NULL, &hits);
+    EXPECT_EQ(1U, hits);
+  }
+  EXPECT_EQ(2, file_manager.writes_);
+  EXPECT_EQ(1U, file_manager.data_.size());
+}
+
+int main(int argc, char *argv[]) {
+#ifdef XPCOM_GLUE
+  if (!ggadget::libmozjs::LibmozjsGlueStartup()) {
+    printf("Failed to load libmozjs.so\n");
+    return 1;
+  }
+#endif
+  setlocale(LC_ALL, "");
+  testing::ParseGTestFlags(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -384,9 +384,9 @@ std::string PrintJSValue(JSScriptContext *ctx, JSValueRef js_val) {
 bool ConvertJSArgsToNative(JSScriptContext *ctx, JSObjectRef owner,
                            const char *name, Slot *slot,
                            size_t argc, const JSValueRef argv[],
-                           Variant **params, size_t *expected_argc,
+                           VariantArgs *params, size_t *expected_argc,
                            JSValueRef *exception) {
-  *params = NULL;
+  params->Reset();
   const Variant::Type *arg_types = NULL;
   *expected_argc = argc;
   const Variant *default_args = NULL;
@@ -395,7 +395,7 @@ bool ConvertJSArgsToNative(JSScriptContext *ctx, JSObjectRef owner,
     *expected_argc = static_cast<size_t>(slot->GetArgCount());
     if (*expected_argc == INT_MAX) {
       // Simply converts each arguments to native.
-      *params = new Variant[argc];
+      params->Resize(argc);
       *expected_argc = argc;
       size_t arg_type_idx = 0;
       for (size_t i = 0; i < argc; ++i) {
@@ -411,8 +411,7 @@ bool ConvertJSArgsToNative(JSScriptContext *ctx, JSObjectRef owner,
         if (!result) {
           for (size_t j = 0; j < i; ++j)
             FreeNativeValue((*params)[j]);
-          delete [] *params;
-          *params = NULL;
+          params->Reset();
           RaiseJSException(ctx, exception,
                            "Failed to convert argument %zu (%s) of function(%s)"
                            " to native.", i, PrintJSValue(ctx, argv[i]).c_str(),
@@ -446,7 +445,7 @@ bool ConvertJSArgsToNative(JSScriptContext *ctx, JSObjectRef owner,
   }
 
   if (*expected_argc > 0) {
-    *params = new Variant[*expected_argc];
+    params->Resize(*expected_argc);
     // Fill up trailing default argument values.
     for (size_t i = argc; i < *expected_argc; ++i) {
       ASSERT(default_args);  // Otherwise already returned JS_FALSE.
@@ -471,8 +470,7 @@ bool ConvertJSArgsToNative(JSScriptContext *ctx, JSObjectRef owner,
         if (!result) {
           for (size_t j = 0; j < i; ++j)
             FreeNativeValue((*params)[j]);
-          delete [] *params;
-          *params = NULL;
+          params->Reset();
           RaiseJSException(ctx, exception,
                            "Failed to convert argument %zu (%s) of function(%s)"
                            " to native.", i, PrintJSValue(ctx, argv[i]).c_str(),
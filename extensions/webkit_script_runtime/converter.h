@@ -69,7 +69,7 @@ std::string PrintJSValue(JSScriptContext *ctx, JSValueRef js_val);
 bool ConvertJSArgsToNative(JSScriptContext *ctx, JSObjectRef owner,
                            const char *name, Slot *slot,
                            size_t argc, const JSValueRef argv[],
-                           Variant **params, size_t *expected_argc,
+                           VariantArgs *params, size_t *expected_argc,
                            JSValueRef *exception);
 
 /**
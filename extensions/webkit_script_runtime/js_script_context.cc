@@ -18,8 +18,10 @@
 
 #include <set>
 #include <cstdlib>
+#include <cstring>
 #include <sys/types.h>
 #include <signal.h>
+#include <ggadget/atom_table.h>
 #include <ggadget/logger.h>
 #include <ggadget/unicode_utils.h>
 #include <ggadget/slot.h>
@@ -52,6 +54,64 @@
 namespace ggadget {
 namespace webkit {
 
+// Number of entries in the property name cache, must be a power of 2.
+static const size_t kNameCacheSize = 256;
+
+// Caches the interned UTF-8 names of the recently accessed native properties,
+// so that hot accesses needn't convert the names again. JavaScriptCore
+// creates a new JSString for the property name of each callback, so the
+// entries are keyed by the characters instead of the JSString.
+class PropertyNameCache {
+ public:
+  PropertyNameCache() {
+    for (size_t i = 0; i < kNameCacheSize; ++i)
+      entries_[i].name = NULL;
+  }
+
+  const char *Find(JSStringRef js_str) {
+    const JSChar *chars = JSStringGetCharactersPtr(js_str);
+    size_t length = JSStringGetLength(js_str);
+    Entry *entry = &entries_[Hash(chars, length)];
+    return entry->chars.size() == length &&
+           memcmp(entry->chars.c_str(), chars, length * sizeof(JSChar)) == 0 ?
+           entry->name : NULL;
+  }
+
+  // Only caches the names of registered properties, which are all interned.
+  // Other names are mostly of the dynamic properties.
+  void Add(JSStringRef js_str, const char *utf8_name) {
+    Atom atom = FindAtom(utf8_name);
+    if (atom == kInvalidAtom)
+      return;
+    const JSChar *chars = JSStringGetCharactersPtr(js_str);
+    size_t length = JSStringGetLength(js_str);
+    Entry *entry = &entries_[Hash(chars, length)];
+    entry->chars.assign(reinterpret_cast<const UTF16Char *>(chars), length);
+    entry->name = GetAtomName(atom);
+  }
+
+ private:
+  // FNV-1a.
+  static size_t Hash(const JSChar *chars, size_t length) {
+    uint32_t hash = 2166136261U;
+    for (size_t i = 0; i < length; ++i)
+      hash = (hash ^ chars[i]) * 16777619U;
+    return hash & (kNameCacheSize - 1);
+  }
+
+  struct Entry {
+    UTF16String chars;
+    const char *name;
+  };
+  Entry entries_[kNameCacheSize];
+};
+
+static PropertyNameCache *GetPropertyNameCache() {
+  // All JavaScript runs in the main thread.
+  static PropertyNameCache *cache = new PropertyNameCache();
+  return cache;
+}
+
 class JSScriptContext::Impl : public SmallObject<> {
   // A class to hold necessary information of a Scriptable to JSObject wrapper.
   // Its instance will be attached to wrapper JSObject as private data.
@@ -110,6 +170,10 @@ class JSScriptContext::Impl : public SmallObject<> {
   class JSStringUTF8Accessor {
    public:
     JSStringUTF8Accessor(JSStringRef js_str) : result_(NULL) {
+      PropertyNameCache *cache = GetPropertyNameCache();
+      result_ = cache->Find(js_str);
+      if (result_)
+        return;
       size_t max_size = JSStringGetMaximumUTF8CStringSize(js_str);
       if (max_size <= kCacheSize) {
         JSStringGetUTF8CString(js_str, fixed_cache_, kCacheSize);
@@ -119,6 +183,7 @@ class JSScriptContext::Impl : public SmallObject<> {
         result_ = dynamic_cache_.c_str();
         DLOG("JSStringUTF8Accessor: Too long: %s", result_);
       }
+      cache->Add(js_str, result_);
     }
 
     const char *Get() const { return result_; }
@@ -1596,7 +1661,7 @@ class JSScriptContext::Impl : public SmallObject<> {
                             ScriptableInterface *scriptable, Slot *slot,
                             size_t argc, const JSValueRef argv[],
                             JSValueRef *exception) {
-    Variant *params = NULL;
+    VariantArgs params;
     size_t expected_argc = argc;
 
     if (!ConvertJSArgsToNative(owner_, this_obj, name, slot, argc, argv,
@@ -1605,9 +1670,8 @@ class JSScriptContext::Impl : public SmallObject<> {
     }
 
     ResultVariant result =
-        slot->Call(scriptable, static_cast<int>(expected_argc), params);
-    delete [] params;
-    params = NULL;
+        slot->Call(scriptable, static_cast<int>(expected_argc), params.get());
+    params.Reset();
 
     if (!CheckScriptableException(scriptable, exception))
       return NULL;
@@ -19,7 +19,7 @@
 #include <ggadget/scriptable_interface.h>
 #include <ggadget/extension_manager.h>
 #include <ggadget/script_context_interface.h>
-#include <ggadget/tests/native_main_loop.h>
+#include <ggadget/native_main_loop.h>
 #include <ggadget/tests/init_extensions.h>
 #include "../js_script_context.h"
 
@@ -0,0 +1,142 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include <cstring>
+#include <vector>
+#include "atom_table.h"
+#include "common.h"
+
+namespace ggadget {
+
+// Initial number of buckets, must be a power of 2.
+static const size_t kInitialBuckets = 1024;
+// Size of the blocks to store interned strings in.
+static const size_t kNameBlockSize = 4096;
+
+class AtomTable {
+ public:
+  AtomTable()
+      : buckets_(kInitialBuckets, kInvalidAtom),
+        block_(NULL), block_left_(0) {
+    // Atom 0 is kInvalidAtom.
+    names_.push_back(NULL);
+    hashes_.push_back(0);
+  }
+
+  // FNV-1a.
+  static uint32_t Hash(const char *name, size_t *length) {
+    uint32_t hash = 2166136261U;
+    const char *p = name;
+    for (; *p; ++p)
+      hash = (hash ^ static_cast<unsigned char>(*p)) * 16777619U;
+    *length = p - name;
+    return hash;
+  }
+
+  // Returns the bucket where the name is, or where it should be inserted.
+  size_t Lookup(const char *name, uint32_t hash) const {
+    size_t mask = buckets_.size() - 1;
+    size_t i = hash & mask;
+    while (true) {
+      Atom atom = buckets_[i];
+      if (atom == kInvalidAtom ||
+          (hashes_[atom] == hash && strcmp(names_[atom], name) == 0))
+        return i;
+      i = (i + 1) & mask;
+    }
+  }
+
+  const char *CopyName(const char *name, size_t length) {
+    if (length + 1 > kNameBlockSize)
+      return strcpy(new char[length + 1], name);
+    if (length + 1 > block_left_) {
+      block_ = new char[kNameBlockSize];
+      block_left_ = kNameBlockSize;
+    }
+    char *result = block_;
+    memcpy(result, name, length + 1);
+    block_ += length + 1;
+    block_left_ -= length + 1;
+    return result;
+  }
+
+  void Grow() {
+    std::vector<Atom> buckets(buckets_.size() * 2, kInvalidAtom);
+    buckets_.swap(buckets);
+    size_t mask = buckets_.size() - 1;
+    for (size_t atom = 1; atom < names_.size(); ++atom) {
+      size_t i = hashes_[atom] & mask;
+      while (buckets_[i] != kInvalidAtom)
+        i = (i + 1) & mask;
+      buckets_[i] = static_cast<Atom>(atom);
+    }
+  }
+
+  Atom Find(const char *name) const {
+    size_t length;
+    return buckets_[Lookup(name, Hash(name, &length))];
+  }
+
+  Atom Intern(const char *name) {
+    size_t length;
+    uint32_t hash = Hash(name, &length);
+    size_t i = Lookup(name, hash);
+    if (buckets_[i] != kInvalidAtom)
+      return buckets_[i];
+
+    Atom atom = static_cast<Atom>(names_.size());
+    names_.push_back(CopyName(name, length));
+    hashes_.push_back(hash);
+    buckets_[i] = atom;
+    // Keep the load factor under 1/2.
+    if (names_.size() * 2 > buckets_.size())
+      Grow();
+    return atom;
+  }
+
+  std::vector<Atom> buckets_;
+  std::vector<const char *> names_;
+  std::vector<uint32_t> hashes_;
+  char *block_;
+  size_t block_left_;
+};
+
+static AtomTable *GetAtomTable() {
+  // Intentionally leaked, because the names are referenced by static objects.
+  static AtomTable *table = new AtomTable();
+  return table;
+}
+
+Atom InternAtom(const char *name) {
+  ASSERT(name);
+  return GetAtomTable()->Intern(name);
+}
+
+Atom FindAtom(const char *name) {
+  return name ? GetAtomTable()->Find(name) : kInvalidAtom;
+}
+
+const char *GetAtomName(Atom atom) {
+  AtomTable *table = GetAtomTable();
+  return atom > 0 && static_cast<size_t>(atom) < table->names_.size() ?
+         table->names_[atom] : NULL;
+}
+
+size_t GetAtomCount() {
+  return GetAtomTable()->names_.size() - 1;
+}
+
+} // namespace ggadget
@@ -0,0 +1,71 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#ifndef GGADGET_ATOM_TABLE_H__
+#define GGADGET_ATOM_TABLE_H__
+
+#include <cstddef>
+
+namespace ggadget {
+
+/**
+ * @defgroup AtomTable Atom table
+ * @ingroup Utilities
+ *
+ * Interned strings identified by small integers, used to look up property
+ * names by integer comparison instead of string comparison.
+ *
+ * Interned strings are never freed. The functions are not thread safe and
+ * should only be called in the main thread, like the other scriptable
+ * facilities.
+ * @{
+ */
+
+/** The integer id of an interned string. */
+typedef int Atom;
+
+/** The atom that no string is interned as. */
+const Atom kInvalidAtom = 0;
+
+/**
+ * Interns a string.
+ * @param name the string to intern, must not be @c NULL.
+ * @return the atom of the string, the same for all equal strings.
+ */
+Atom InternAtom(const char *name);
+
+/**
+ * Finds the atom of a string without interning it.
+ * @return the atom of the string, or @c kInvalidAtom if the string has never
+ *     been interned.
+ */
+Atom FindAtom(const char *name);
+
+/**
+ * Gets the interned copy of the string of an atom. The result is valid
+ * during the whole life of the process.
+ * @return the string, or @c NULL if @a atom is invalid.
+ */
+const char *GetAtomName(Atom atom);
+
+/** Gets the number of interned strings. */
+size_t GetAtomCount();
+
+/** @} */
+
+} // namespace ggadget
+
+#endif  // GGADGET_ATOM_TABLE_H__
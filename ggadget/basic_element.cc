@@ -51,6 +51,10 @@
 
 namespace ggadget {
 
+// Number of successive draws without content change before an element with
+// children is promoted to a cached layer.
+static const int kLayerPromotionDrawCount = 10;
+
 class BasicElement::Impl : public SmallObject<> {
  public:
   Impl(View *view, const char *tag_name, const char *name,
@@ -68,10 +72,12 @@ class BasicElement::Impl : public SmallObject<> {
         index_(kInvalidIndex), // Invalid until set by Elements.
         width_(0.0), height_(0.0), pwidth_(0.0), pheight_(0.0),
         min_width_(0.0), min_height_(0.0),
+        layout_client_width_(-1.0), layout_client_height_(-1.0),
         x_(0.0), y_(0.0), px_(0.0), py_(0.0),
         pin_x_(0.0), pin_y_(0.0), ppin_x_(0.0), ppin_y_(0.0),
         rotation_(0.0),
         opacity_(1.0),
+        clean_draw_count_(0),
         name_(name ? name : ""),
 #ifdef _DEBUG
         debug_color_index_(++total_debug_color_index_),
@@ -93,8 +99,11 @@ class BasicElement::Impl : public SmallObject<> {
         position_changed_(true),
         size_changed_(true),
         cache_enabled_(false),
+        auto_cached_(false),
         content_changed_(false),
         draw_queued_(false),
+        layout_queued_(true),
+        children_layout_queued_(false),
         designer_mode_(false),
         show_focus_overlay_(false),
         show_focus_overlay_set_(false),
@@ -105,6 +114,7 @@ class BasicElement::Impl : public SmallObject<> {
   ~Impl() {
     DestroyImage(mask_image_);
     delete children_;
+    DemoteLayer();
     DestroyCanvas(cache_);
   }
 
@@ -259,6 +269,8 @@ class BasicElement::Impl : public SmallObject<> {
       QueueDraw();
 
       // Frees canvas cache when the element becomes invisible to save memory.
+      if (!visible)
+        DemoteLayer();
       if (!visible && cache_) {
         DestroyCanvas(cache_);
         cache_ = NULL;
@@ -526,6 +538,11 @@ class BasicElement::Impl : public SmallObject<> {
   }
 
   void Layout() {
+    bool layout_children = layout_queued_;
+    layout_queued_ = false;
+    children_layout_queued_ = false;
+    view_->IncreaseLayoutCount();
+
     CalculateRelativeAttributes();
     if (position_changed_ || size_changed_ || visibility_changed_) {
       AddToClipRegion(NULL);
@@ -535,14 +552,28 @@ class BasicElement::Impl : public SmallObject<> {
 
     if (size_changed_)
       PostSizeEvent();
-    if (children_)
+    if (children_) {
+      // A change of this element or of its client size may affect any child,
+      // otherwise only the children queued for layout need to be visited.
+      if (layout_children || IsClientSizeChanged())
+        children_->QueueLayout();
+      layout_client_width_ = owner_->GetClientWidth();
+      layout_client_height_ = owner_->GetClientHeight();
       children_->Layout();
+    }
 
     // Call element's layout to let it layout itself.
     // It should be called after children_->Layout() because some elements needs
     // the position and size of children elements to do its own layout.
     owner_->Layout();
 
+    // The client size may be changed by owner_->Layout(), for example, when a
+    // scrollbar is shown, let the children follow it in the next layout.
+    if (children_ && IsClientSizeChanged())
+      QueueChildrenLayout();
+    if (owner_->IsLayoutVolatile())
+      QueueLayout();
+
     if (content_changed_) {
       // To let all associated copy elements to update their content.
       FireOnContentChangedSignal();
@@ -570,8 +601,11 @@ class BasicElement::Impl : public SmallObject<> {
         force_draw = true;
       }
 
+      UpdateLayerPromotion(width, height);
+      bool use_cache = cache_enabled_ || auto_cached_;
+
       // Creates the canvas cache only when necessary.
-      if (cache_enabled_) {
+      if (use_cache) {
         if (!cache_) {
           cache_ = view_->GetGraphics()->NewCanvas(width, height);
           force_draw = true;
@@ -588,16 +622,25 @@ class BasicElement::Impl : public SmallObject<> {
       // - The element has mask;
       // - The element's flips in x or y;
       // - Opacity of the element is not 1.0 and it has children.
-      // - Canvas cache is enabled.
-      bool indirect_draw = cache_enabled_ || mask || flip_ != FLIP_NONE ||
+      // - Canvas cache is enabled or the element is promoted to a layer.
+      bool indirect_draw = use_cache || mask || flip_ != FLIP_NONE ||
           (opacity_ != 1.0 && children_ && children_->GetCount());
       if (indirect_draw) {
         if (cache_) {
           target = cache_;
           target->PushState();
         } else {
-          target = view_->GetGraphics()->NewCanvas(width, height);
-          force_draw = true;
+          target = view_->AcquireScratchCanvas(width, height);
+          if (target) {
+            // The pooled canvas might be larger than the element.
+            target->IntersectRectClipRegion(0, 0, width, height);
+            force_draw = true;
+          } else {
+            // Draws directly if no canvas is available.
+            target = canvas;
+            indirect_draw = false;
+            use_cache = false;
+          }
         }
       }
 
@@ -609,7 +652,10 @@ class BasicElement::Impl : public SmallObject<> {
       // Only do draw when it's direct draw or the content has been changed.
       if (!indirect_draw || content_changed_ || force_draw) {
         // Disable clip region, so that all children can be drawn correctly.
-        if (cache_enabled_)
+        // The old state must be restored afterwards, because the element
+        // might be inside another cached element.
+        bool clip_region_enabled = view_->IsClipRegionEnabled();
+        if (use_cache)
           view_->EnableClipRegion(false);
 
         owner_->DoDraw(target);
@@ -625,8 +671,8 @@ class BasicElement::Impl : public SmallObject<> {
                                  -1, -1, -1, -1);
         }
 
-        if (cache_enabled_)
-          view_->EnableClipRegion(true);
+        if (use_cache)
+          view_->EnableClipRegion(clip_region_enabled);
       }
 
       if (indirect_draw) {
@@ -647,7 +693,7 @@ class BasicElement::Impl : public SmallObject<> {
 
         // Don't destroy canvas cache.
         if (cache_ != target)
-          target->Destroy();
+          view_->ReleaseScratchCanvas(target);
         else
           target->PopState();
       }
@@ -675,6 +721,46 @@ class BasicElement::Impl : public SmallObject<> {
     draw_queued_ = false;
   }
 
+  // Promotes an element with children to a cached layer automatically, if it
+  // has been drawn for several times without any change in its subtree, so
+  // that following draws only need to blit the cache. The layer is demoted as
+  // soon as its content changes.
+  void UpdateLayerPromotion(double width, double height) {
+    if (auto_cached_) {
+      if (content_changed_ || !cache_)
+        DemoteLayer();
+      else
+        view_->TouchLayerCache(owner_);
+      return;
+    }
+    if (cache_enabled_ || !children_ || !children_->GetCount())
+      return;
+    if (content_changed_) {
+      clean_draw_count_ = 0;
+      return;
+    }
+    if (++clean_draw_count_ < kLayerPromotionDrawCount)
+      return;
+
+    clean_draw_count_ = 0;
+    double zoom = view_->GetGraphics()->GetZoom();
+    size_t bytes = static_cast<size_t>(ceil(width * zoom) *
+                                       ceil(height * zoom)) * 4;
+    if (view_->ReserveLayerCache(owner_, bytes))
+      auto_cached_ = true;
+  }
+
+  void DemoteLayer() {
+    if (!auto_cached_)
+      return;
+    view_->ReleaseLayerCache(owner_);
+    auto_cached_ = false;
+    if (!cache_enabled_ && cache_) {
+      DestroyCanvas(cache_);
+      cache_ = NULL;
+    }
+  }
+
   void DrawChildren(CanvasInterface *canvas) {
     if (children_)
       children_->Draw(canvas);
@@ -741,7 +827,33 @@ class BasicElement::Impl : public SmallObject<> {
     owner_->AggregateMoreClipRegion(Rectangle(), NULL);
   }
 
+  bool IsClientSizeChanged() {
+    return owner_->GetClientWidth() != layout_client_width_ ||
+           owner_->GetClientHeight() != layout_client_height_;
+  }
+
+  // Marks all ancestors, so that RecursiveLayout() of each of them will visit
+  // the path down to this element. Private children are laid out by their
+  // owners, whose flags are never cleared, so the whole chain is always
+  // marked instead of stopping at the first marked ancestor.
+  void QueueAncestorsLayout() {
+    BasicElement *elm = owner_->GetParentElement();
+    for (; elm; elm = elm->GetParentElement())
+      elm->impl_->children_layout_queued_ = true;
+  }
+
+  void QueueLayout() {
+    layout_queued_ = true;
+    QueueAncestorsLayout();
+  }
+
+  void QueueChildrenLayout() {
+    children_layout_queued_ = true;
+    QueueAncestorsLayout();
+  }
+
   void QueueDraw() {
+    QueueLayout();
     if ((visible_ || visibility_changed_) && !draw_queued_) {
       draw_queued_ = true;
       AddToClipRegion(NULL);
@@ -755,6 +867,7 @@ class BasicElement::Impl : public SmallObject<> {
   }
 
   void QueueDrawRect(const Rectangle &rect) {
+    QueueLayout();
     if ((visible_ || visibility_changed_) && !draw_queued_) {
       // Don't set draw_queued_, because it's only queued part of the element.
       // Other part might be queued later.
@@ -769,6 +882,7 @@ class BasicElement::Impl : public SmallObject<> {
   }
 
   void QueueDrawRegion(const ClipRegion &region) {
+    QueueLayout();
     if ((visible_ || visibility_changed_) && !draw_queued_) {
       // Don't set draw_queued_, because it's only queued part of the element.
       // Other part might be queued later.
@@ -806,21 +920,33 @@ class BasicElement::Impl : public SmallObject<> {
   void PositionChanged() {
     position_changed_ = true;
     draw_queued_ = false;
+    InvalidateSiblingsHitGrid();
     QueueDraw();
   }
 
   void WidthChanged() {
     size_changed_ = true;
     draw_queued_ = false;
+    InvalidateSiblingsHitGrid();
     QueueDraw();
   }
 
   void HeightChanged() {
     size_changed_ = true;
     draw_queued_ = false;
+    InvalidateSiblingsHitGrid();
     QueueDraw();
   }
 
+  // The hit grid of the siblings is otherwise only rebuilt after the next
+  // layout, so that hit-testing in between would use the old geometry.
+  void InvalidateSiblingsHitGrid() {
+    Elements *siblings = parent_ ? parent_->GetChildren() :
+                         view_->GetChildren();
+    if (siblings)
+      siblings->InvalidateHitGrid();
+  }
+
   void MarkRedraw() {
     if (children_)
       children_->MarkRedraw();
@@ -1130,10 +1256,13 @@ class BasicElement::Impl : public SmallObject<> {
 
   double width_, height_, pwidth_, pheight_;
   double min_width_, min_height_;
+  // Client size with which the children were laid out last time.
+  double layout_client_width_, layout_client_height_;
   double x_, y_, px_, py_;
   double pin_x_, pin_y_, ppin_x_, ppin_y_;
   double rotation_;
   double opacity_;
+  int clean_draw_count_;
 
   std::string name_;
   std::string tooltip_;
@@ -1205,8 +1334,11 @@ class BasicElement::Impl : public SmallObject<> {
   bool position_changed_        : 1;
   bool size_changed_            : 1;
   bool cache_enabled_           : 1;
+  bool auto_cached_             : 1;
   bool content_changed_         : 1;
   bool draw_queued_             : 1;
+  bool layout_queued_           : 1;
+  bool children_layout_queued_  : 1;
   bool designer_mode_           : 1;
   bool show_focus_overlay_      : 1;
   bool show_focus_overlay_set_  : 1;
@@ -1854,6 +1986,10 @@ bool BasicElement::IsCanvasCacheEnabled() const {
   return impl_->cache_enabled_;
 }
 
+void BasicElement::DemoteLayer() {
+  impl_->DemoteLayer();
+}
+
 std::string BasicElement::GetTooltip() const {
   return impl_->tooltip_;
 }
@@ -1954,8 +2090,12 @@ void BasicElement::DrawChildren(CanvasInterface *canvas) {
 }
 
 void BasicElement::CalculateSize() {
-  if (impl_->children_)
+  if (impl_->children_) {
+    // The default size of a child may depend on this element.
+    if (impl_->layout_queued_)
+      impl_->children_->QueueLayout();
     impl_->children_->CalculateSize();
+  }
   if (!impl_->width_specified_ || !impl_->height_specified_) {
     double width, height;
     GetDefaultSize(&width, &height);
@@ -1978,6 +2118,10 @@ void BasicElement::Layout() {
   // Do nothing.
 }
 
+bool BasicElement::IsLayoutVolatile() const {
+  return false;
+}
+
 void BasicElement::DoDraw(CanvasInterface * /* canvas */) {
   // Do nothing.
 }
@@ -2085,6 +2229,14 @@ void BasicElement::QueueDrawRegion(const ClipRegion &region) {
   impl_->QueueDrawRegion(region);
 }
 
+void BasicElement::QueueLayout() {
+  impl_->QueueLayout();
+}
+
+bool BasicElement::IsLayoutQueued() const {
+  return impl_->layout_queued_ || impl_->children_layout_queued_;
+}
+
 void BasicElement::MarkRedraw() {
   impl_->MarkRedraw();
 }
@@ -145,6 +145,12 @@ class BasicElement: public ScriptableHelperNativeOwnedDefault {
   /** Checks if the canvas cache is enabled. */
   bool IsCanvasCacheEnabled() const;
 
+  /**
+   * Frees the canvas cache of the element if it was promoted to a cached
+   * layer automatically. Used by the view to keep such caches in budget.
+   */
+  void DemoteLayer();
+
  public:
   /**
    * Retrieves the width in pixels.
@@ -527,6 +533,21 @@ class BasicElement: public ScriptableHelperNativeOwnedDefault {
    */
   void QueueDrawRegion(const ClipRegion &region);
 
+  /**
+   * Requests this element to be visited by the next layout, without requesting
+   * a redraw. @c QueueDraw() and its variants call this implicitly.
+   *
+   * The ancestors of the element are marked too, so that the layout can skip
+   * the subtrees without any pending changes.
+   */
+  void QueueLayout();
+
+  /**
+   * Checks whether this element or any of its descendants has been queued for
+   * layout since the element was last visited by @c RecursiveLayout().
+   */
+  bool IsLayoutQueued() const;
+
   /**
    * Checks to see if position of the element has changed relative to the
    * parent since the last draw. Specifically, this checks for changes in
@@ -928,6 +949,13 @@ public: // Other overridable public methods.
    */
    virtual void Layout();
 
+  /**
+   * Returns true if the element must be visited by every layout even if
+   * nothing in it has changed, for example, an element that keeps a native
+   * widget at its absolute position in the view. Returns false by default.
+   */
+  virtual bool IsLayoutVolatile() const;
+
   /**
    * Draws the element onto the canvas.
    * To be implemented by subclasses. If the element has children,
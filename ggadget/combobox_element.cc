@@ -268,7 +268,7 @@ class ComboBoxElement::Impl : public SmallObject<> {
     double height = std::max(
         0.0, owner_->BasicElement::GetPixelHeight() - item_pixel_height_);
     if (max_items_ > 0) {
-      size_t items = std::min(droplist_->GetChildren()->GetCount(), max_items_);
+      size_t items = std::min(droplist_->GetItemCount(), max_items_);
       height = std::min(height,
                         static_cast<double>(items) * item_pixel_height_);
     }
@@ -18,6 +18,7 @@ limitations under the License.
 #include "dbus_utils.h"
 
 #include <algorithm>
+#include <cstring>
 #include <vector>
 #include <map>
 #include <dbus/dbus.h>
@@ -68,6 +69,9 @@ class DBusProxy::Impl : public SmallObject<> {
   };
   typedef LightMap<std::string, PropertyPrototype> PropertyPrototypeMap;
 
+  // Cached values of properties.
+  typedef LightMap<std::string, ResultVariant> PropertyValueMap;
+
   typedef LightMap<int, DBusPendingCall *> PendingCallMap;
 
   // Class to hold owner<->names mapping information.
@@ -285,8 +289,10 @@ class DBusProxy::Impl : public SmallObject<> {
             dbus_bus_remove_match(bus_, match_rule.c_str(), NULL);
           }
           UnmonitorImplName(impl);
-          delete impl;
+          // Erased first, because deleting the impl fails its pending calls,
+          // whose callbacks may create new proxies.
           proxies_.erase(it);
+          delete impl;
           if (proxies_.size() == 0) {
             DLOG("No proxy left, destroy %s bus.", GetTypeName());
             // No more proxy, destroy the connection to save resource.
@@ -575,6 +581,14 @@ class DBusProxy::Impl : public SmallObject<> {
   };
 
  public:
+  // Callback to receive all return values of a method call at once. It's
+  // owned by the call, like ResultCallback.
+  class ReplyCallback {
+   public:
+    virtual ~ReplyCallback() { }
+    virtual void OnReply(bool succeeded, const Arguments &results) = 0;
+  };
+
   Impl(Manager *manager, const std::string &name, const std::string &path,
        const std::string &interface)
     : manager_(manager),
@@ -583,7 +597,10 @@ class DBusProxy::Impl : public SmallObject<> {
       interface_(interface),
       on_name_owner_changed_connection_(NULL),
       refcount_(1),
-      call_id_counter_(1) {
+      call_id_counter_(1),
+      property_cache_filled_(false),
+      get_all_call_id_(0),
+      get_all_failed_(false) {
   }
   ~Impl() {
     CancelAllPendingCalls();
@@ -621,17 +638,26 @@ class DBusProxy::Impl : public SmallObject<> {
   }
 
   void OnNameOwnerChanged() {
+    // The callbacks of the cancelled calls may delete the last proxy of this
+    // impl.
+    Ref();
     CancelAllPendingCalls();
+    ClearPropertyCache();
     Introspect(false);
+    Unref();
   }
 
   void CancelAllPendingCalls() {
-    PendingCallMap::iterator it = pending_calls_.begin();
-    for (; it != pending_calls_.end(); ++it) {
+    // The reply callbacks of the cancelled calls are told the calls failed,
+    // and may cancel or start calls of this proxy, so the map is detached
+    // before iterating it.
+    PendingCallMap pending_calls;
+    pending_calls.swap(pending_calls_);
+    PendingCallMap::iterator it = pending_calls.begin();
+    for (; it != pending_calls.end(); ++it) {
       dbus_pending_call_cancel(it->second);
       dbus_pending_call_unref(it->second);
     }
-    pending_calls_.clear();
   }
 
   int CallMethod(const std::string &method, bool sync, int timeout,
@@ -646,13 +672,26 @@ class DBusProxy::Impl : public SmallObject<> {
 
   int CallMethod(const std::string &method, bool sync, int timeout,
                  ResultCallback *callback, Arguments *in_args) {
+    return CallInterfaceMethod(interface_, method, sync, timeout,
+                               callback, NULL, in_args);
+  }
+
+  // Calls a method of any interface of the remote object. The return values
+  // will be passed to callback one by one, and to reply_callback all at once.
+  // Returns call id, 0 means failed.
+  int CallInterfaceMethod(const std::string &interface,
+                          const std::string &method, bool sync, int timeout,
+                          ResultCallback *callback,
+                          ReplyCallback *reply_callback,
+                          Arguments *in_args) {
     Arguments out_args;
-    MethodSignalPrototypeMap::iterator it = methods_.find(method);
-    if (it != methods_.end()) {
+    const MethodSignalPrototype *proto = GetMethodPrototype(interface, method);
+    if (proto) {
       // Validate input arguments number and type.
-      if (!ValidateArguments(it->second.in_args, in_args,
+      if (!ValidateArguments(proto->in_args, in_args,
                              "method", method.c_str())) {
-        CallAndFreeResultCallback(callback, out_args, false);
+        FinishCall(interface, method, false, &out_args,
+                   callback, reply_callback);
         return 0;
       }
     }
@@ -663,39 +702,48 @@ class DBusProxy::Impl : public SmallObject<> {
       if (sync) {
         // Generate a new call id for sync all.
         int call_id = NewCallId();
-        bool ret = CallMethodSync(bus, interface_.c_str(), method.c_str(),
+        bool ret = CallMethodSync(bus, interface.c_str(), method.c_str(),
                                   *in_args, &out_args, timeout);
-        // Only validate return values when caller cares about them
-        // (callback is not NULL).
-        if (ret && it != methods_.end() && callback) {
-          // Validate return values.
-          ret = ValidateArguments(it->second.out_args, &out_args,
-                                  "method", method.c_str());
-        }
+        ret = FinishCall(interface, method, ret, &out_args,
+                         callback, reply_callback);
         if (!ret) {
           DLOG("Failed to call method %s of %s|%s|%s synchronously.",
                method.c_str(), name_.c_str(), path_.c_str(),
-               interface_.c_str());
+               interface.c_str());
         }
-        CallAndFreeResultCallback(callback, out_args, ret);
         return ret ? call_id : 0;
       } else {
-        return CallMethodAsync(bus, interface_.c_str(), method.c_str(),
-                               *in_args, callback, timeout);
+        return CallMethodAsync(bus, interface.c_str(), method.c_str(),
+                               *in_args, callback, reply_callback, timeout);
       }
     }
     DLOG("Failed to call method %s of %s|%s|%s",
-         method.c_str(), name_.c_str(), path_.c_str(), interface_.c_str());
-    CallAndFreeResultCallback(callback, out_args, false);
+         method.c_str(), name_.c_str(), path_.c_str(), interface.c_str());
+    FinishCall(interface, method, false, &out_args, callback, reply_callback);
     return 0;
   }
 
+  // Blocks until the reply of a pending method call is received and passed
+  // to the callbacks.
+  void BlockMethodCall(int index) {
+    PendingCallMap::iterator it = pending_calls_.find(index);
+    if (it != pending_calls_.end()) {
+      DBusPendingCall *pending = it->second;
+      // The notify function releases the reference held by pending_calls_.
+      dbus_pending_call_ref(pending);
+      dbus_pending_call_block(pending);
+      dbus_pending_call_unref(pending);
+    }
+  }
+
   bool CancelMethodCall(int index) {
     PendingCallMap::iterator it = pending_calls_.find(index);
     if (it != pending_calls_.end()) {
-      dbus_pending_call_cancel(it->second);
-      dbus_pending_call_unref(it->second);
+      DBusPendingCall *pending = it->second;
+      // Erased first, because freeing the call runs its reply callback.
       pending_calls_.erase(it);
+      dbus_pending_call_cancel(pending);
+      dbus_pending_call_unref(pending);
       return true;
     }
     return false;
@@ -768,6 +816,19 @@ class DBusProxy::Impl : public SmallObject<> {
       expect_type = GetVariantTypeFromSignature(it->second.signature);
     }
 
+    if (IsPropertyCacheEnabled()) {
+      PropertyValueMap::iterator cache_it = property_cache_.find(property);
+      if (cache_it != property_cache_.end())
+        return CheckPropertyType(property, expect_type, cache_it->second);
+      // Fetch all properties in background, later calls will be served by
+      // the cache, which is kept up to date by PropertiesChanged signal.
+      // This call still gets the property by itself, so it never waits for
+      // more than one property.
+      if (!property_cache_filled_ && !IsMethodCallPending(get_all_call_id_))
+        get_all_call_id_ =
+            GetAllProperties(false, kDefaultDBusTimeout, NULL, NULL);
+    }
+
     DBusConnection *bus = GetBus();
     if (bus) {
       Arguments in_args;
@@ -778,17 +839,8 @@ class DBusProxy::Impl : public SmallObject<> {
       Arguments out_args;
       if (CallMethodSync(bus, DBUS_INTERFACE_PROPERTIES, "Get", in_args,
                          &out_args, kDefaultDBusTimeout)) {
-        if (out_args.size() > 0) {
-          if (expect_type != Variant::TYPE_VARIANT &&
-              out_args[0].value.v().type() != expect_type) {
-            DLOG("Type mismatch of property %s of %s|%s|%s, "
-                 "expect:%d actual:%d", property.c_str(),
-                 name_.c_str(), path_.c_str(), interface_.c_str(),
-                 expect_type, out_args[0].value.v().type());
-            return ResultVariant();
-          }
-          return out_args[0].value;
-        }
+        if (out_args.size() > 0)
+          return CheckPropertyType(property, expect_type, out_args[0].value);
       }
     }
     DLOG("Failed to get property %s of %s|%s|%s", property.c_str(),
@@ -796,6 +848,16 @@ class DBusProxy::Impl : public SmallObject<> {
     return ResultVariant();
   }
 
+  int GetAllProperties(bool sync, int timeout, ResultCallback *callback,
+                       ReplyCallback *reply_callback) {
+    Arguments in_args;
+    // See http://dbus.freedesktop.org/doc/dbus-specification.html
+    // org.freedesktop.DBus.Properties interface
+    in_args.push_back(Argument(Variant(interface_)));
+    return CallInterfaceMethod(DBUS_INTERFACE_PROPERTIES, "GetAll", sync,
+                               timeout, callback, reply_callback, &in_args);
+  }
+
   bool SetProperty(const std::string &property, const Variant &value) {
     Arguments in_args;
     // See http://dbus.freedesktop.org/doc/dbus-specification.html
@@ -825,6 +887,8 @@ class DBusProxy::Impl : public SmallObject<> {
     }
     DBusConnection *bus = GetBus();
     if (bus) {
+      // The new value will be fetched again when it's needed.
+      property_cache_.erase(property);
       // No need to wait for reply.
       return SendMessage(bus, DBUS_INTERFACE_PROPERTIES, "Set",
                          in_args, NULL, -1);
@@ -975,6 +1039,12 @@ class DBusProxy::Impl : public SmallObject<> {
       } else {
         DLOG("Unknown signal received: %s, emit anyway", member);
       }
+      // Update the cache before emitting the signal, so that the receivers
+      // can get new values of the properties.
+      if (out_args.size() == 1 && strcmp(member, "PropertiesChanged") == 0 &&
+          IsPropertyCacheEnabled()) {
+        UpdatePropertyCache(out_args[0].value.v());
+      }
       Variant *vars = NULL;
       if (out_args.size()) {
         vars = new Variant[out_args.size()];
@@ -1042,6 +1112,98 @@ class DBusProxy::Impl : public SmallObject<> {
   }
 
  private:
+  // The values of properties are only cached if the remote object notifies
+  // the changes with PropertiesChanged signal, and supports GetAll.
+  bool IsPropertyCacheEnabled() const {
+    return !get_all_failed_ &&
+        signals_.find("PropertiesChanged") != signals_.end();
+  }
+
+  bool CacheProperty(const char *name, ScriptableInterface::PropertyType type,
+                     const Variant &value) {
+    GGL_UNUSED(type);
+    property_cache_[name] = ResultVariant(value);
+    return true;
+  }
+
+  // Stores the properties returned by GetAll or carried by PropertiesChanged
+  // signal, which are held by a dictionary, into the cache.
+  void UpdatePropertyCache(const Variant &properties) {
+    if (properties.type() == Variant::TYPE_SCRIPTABLE) {
+      ScriptableInterface *dict =
+          VariantValue<ScriptableInterface *>()(properties);
+      if (dict)
+        dict->EnumerateProperties(NewSlot(this, &Impl::CacheProperty));
+    }
+  }
+
+  void ClearPropertyCache() {
+    property_cache_.clear();
+    property_cache_filled_ = false;
+  }
+
+  ResultVariant CheckPropertyType(const std::string &property,
+                                  Variant::Type expect_type,
+                                  const ResultVariant &value) {
+    if (expect_type != Variant::TYPE_VARIANT &&
+        value.v().type() != expect_type) {
+      DLOG("Type mismatch of property %s of %s|%s|%s, "
+           "expect:%d actual:%d", property.c_str(),
+           name_.c_str(), path_.c_str(), interface_.c_str(),
+           expect_type, value.v().type());
+      return ResultVariant();
+    }
+    return value;
+  }
+
+  const MethodSignalPrototype *GetMethodPrototype(
+      const std::string &interface, const std::string &method) const {
+    if (interface == interface_) {
+      MethodSignalPrototypeMap::const_iterator it = methods_.find(method);
+      if (it != methods_.end())
+        return &it->second;
+    }
+    return NULL;
+  }
+
+  static bool IsGetAllCall(const std::string &interface,
+                           const std::string &method) {
+    return method == "GetAll" && interface == DBUS_INTERFACE_PROPERTIES;
+  }
+
+  // Validates the return values of a finished method call, stores the result
+  // of GetAll into the property cache, then passes the return values to the
+  // callbacks and deletes them.
+  // Returns false if the call failed.
+  bool FinishCall(const std::string &interface, const std::string &method,
+                  bool success, Arguments *out_args,
+                  ResultCallback *callback, ReplyCallback *reply_callback) {
+    // Only validate return values when caller cares about them.
+    if (success && (callback || reply_callback)) {
+      const MethodSignalPrototype *proto =
+          GetMethodPrototype(interface, method);
+      if (proto) {
+        success = ValidateArguments(proto->out_args, out_args,
+                                    "method", method.c_str());
+      }
+    }
+    if (IsGetAllCall(interface, method)) {
+      if (!success) {
+        // Falls back to get properties one by one.
+        get_all_failed_ = true;
+        ClearPropertyCache();
+      } else if (out_args->size() && IsPropertyCacheEnabled()) {
+        UpdatePropertyCache((*out_args)[0].value.v());
+        property_cache_filled_ = true;
+      }
+    }
+    CallAndFreeResultCallback(callback, *out_args, success);
+    if (reply_callback)
+      reply_callback->OnReply(success, *out_args);
+    delete reply_callback;
+    return success;
+  }
+
   // function_type and function_name are for debug purpose.
   bool ValidateArguments(const ArgPrototypeVector &expect_args,
                          Arguments *real_args,
@@ -1191,8 +1353,10 @@ class DBusProxy::Impl : public SmallObject<> {
   struct PendingCallClosure {
     Impl *impl;
     int call_id;
+    std::string interface;
     std::string method;
     ResultCallback *callback;
+    ReplyCallback *reply_callback;
   };
 
   static void PendingCallClosureFree(void *data) {
@@ -1204,6 +1368,14 @@ class DBusProxy::Impl : public SmallObject<> {
            closure->impl->name_.c_str(), closure->impl->path_.c_str());
 #endif
       delete closure->callback;
+      // The reply is never received if the call was cancelled, then the
+      // reply callback is told the call failed, so that it won't wait for
+      // ever.
+      if (closure->reply_callback) {
+        Arguments out_args;
+        closure->reply_callback->OnReply(false, out_args);
+        delete closure->reply_callback;
+      }
       delete closure;
     }
   }
@@ -1217,22 +1389,22 @@ class DBusProxy::Impl : public SmallObject<> {
            closure->impl->name_.c_str(), closure->impl->path_.c_str());
 #endif
       Impl *impl = closure->impl;
-      if (closure->callback) {
-        Arguments out_args;
-        bool ret = impl->RetrieveReplyMessage(pending, &out_args);
-        if (ret) {
-          MethodSignalPrototypeMap::iterator it =
-              impl->methods_.find(closure->method);
-          if (it != closure->impl->methods_.end()) {
-            // Validate return values.
-            ret = impl->ValidateArguments(it->second.out_args, &out_args,
-                                          "method", closure->method.c_str());
-          }
-        }
-        CallResultCallback(closure->callback, out_args, ret);
-      }
-      // Remove this pending call from impl's pending call map.
-      closure->impl->pending_calls_.erase(closure->call_id);
+      // The callbacks will be deleted by FinishCall().
+      ResultCallback *callback = closure->callback;
+      ReplyCallback *reply_callback = closure->reply_callback;
+      closure->callback = NULL;
+      closure->reply_callback = NULL;
+      // Remove this pending call from impl's pending call map, before calling
+      // the callbacks, which may cancel the call.
+      impl->pending_calls_.erase(closure->call_id);
+
+      Arguments out_args;
+      bool ret = false;
+      if (callback || reply_callback ||
+          IsGetAllCall(closure->interface, closure->method))
+        ret = impl->RetrieveReplyMessage(pending, &out_args);
+      impl->FinishCall(closure->interface, closure->method, ret, &out_args,
+                       callback, reply_callback);
     }
     dbus_pending_call_unref(pending);
   }
@@ -1268,7 +1440,8 @@ class DBusProxy::Impl : public SmallObject<> {
   // Returns call id, 0 means failed.
   int CallMethodAsync(DBusConnection *bus, const char *interface,
                       const char *method, const Arguments &in_args,
-                      ResultCallback *callback, int timeout) {
+                      ResultCallback *callback, ReplyCallback *reply_callback,
+                      int timeout) {
 #ifdef DBUS_VERBOSE_LOG
     DLOG("Call method asynchronously: %s|%s|%s|%s",
          name_.c_str(), path_.c_str(), interface, method);
@@ -1281,8 +1454,10 @@ class DBusProxy::Impl : public SmallObject<> {
       PendingCallClosure *closure = new PendingCallClosure;
       closure->impl = this;
       closure->call_id = NewCallId();
+      closure->interface = interface;
       closure->method = method;
       closure->callback = callback;
+      closure->reply_callback = reply_callback;
       dbus_pending_call_set_notify(pending, PendingCallNotify,
                                    closure, PendingCallClosureFree);
       pending_calls_[closure->call_id] = pending;
@@ -1293,6 +1468,11 @@ class DBusProxy::Impl : public SmallObject<> {
     }
 
     delete callback;
+    if (reply_callback) {
+      Arguments out_args;
+      reply_callback->OnReply(false, out_args);
+      delete reply_callback;
+    }
     if (pending)
       dbus_pending_call_unref(pending);
 
@@ -1311,6 +1491,8 @@ class DBusProxy::Impl : public SmallObject<> {
   }
 
   void ClearIntrospectData() {
+    ClearPropertyCache();
+    get_all_failed_ = false;
     methods_.clear();
     signals_.clear();
     properties_.clear();
@@ -1357,7 +1539,7 @@ class DBusProxy::Impl : public SmallObject<> {
           CallMethodAsync(bus, DBUS_INTERFACE_INTROSPECTABLE,
                           "Introspect", in_args,
                           NewSlot(this, &Impl::IntrospectResultReceiver),
-                          -1);
+                          NULL, -1);
       if (call_id == 0) {
         ClearIntrospectData();
         // IntrospectResultReceiver() won't be called if CallMethodAsync()
@@ -1639,6 +1821,14 @@ class DBusProxy::Impl : public SmallObject<> {
   StringVector interfaces_;
   StringVector children_;
 
+  PropertyValueMap property_cache_;
+  // Whether all properties have been fetched into property_cache_.
+  bool property_cache_filled_;
+  // Id of the GetAll call started by GetProperty() to fill the cache.
+  int get_all_call_id_;
+  // Whether the remote object doesn't support GetAll.
+  bool get_all_failed_;
+
   Signal3<void, const std::string &, int, const Variant *>
       on_signal_emit_signal_;
 
@@ -1707,6 +1897,10 @@ ResultVariant DBusProxy::GetProperty(const std::string &property) {
 bool DBusProxy::SetProperty(const std::string &property, const Variant &value) {
   return impl_->SetProperty(property, value);
 }
+int DBusProxy::GetAllProperties(bool sync, int timeout,
+                                ResultCallback *callback) {
+  return impl_->GetAllProperties(sync, timeout, callback, NULL);
+}
 DBusProxy::PropertyAccess DBusProxy::GetPropertyInfo(
     const std::string &property, Variant::Type *type) {
   return impl_->GetPropertyInfo(property, type);
@@ -1755,5 +1949,195 @@ DBusProxy* DBusProxy::NewSessionProxy(const std::string &name,
   return DBusProxy::Impl::NewSessionProxy(name, path, interface);
 }
 
+class DBusCallBatch::Impl : public SmallObject<> {
+ public:
+  class CallReplyCallback;
+
+  struct Call {
+    Call() : proxy(NULL), proxy_impl(NULL), get_all(false), call_id(0),
+             reply_callback(NULL), finished(false), succeeded(false) { }
+    DBusProxy *proxy;
+    // The impl of the proxy, which outlives the proxy if it's shared, and
+    // fails all pending calls otherwise.
+    DBusProxy::Impl *proxy_impl;
+    std::string method;
+    Arguments in_args;
+    bool get_all;
+    // Id of the call in the proxy, 0 if the call is not pending.
+    int call_id;
+    // Owned by the pending call, only valid while call_id is not 0.
+    CallReplyCallback *reply_callback;
+    bool finished;
+    bool succeeded;
+    Arguments results;
+  };
+  typedef std::vector<Call> CallVector;
+
+  class CallReplyCallback : public DBusProxy::Impl::ReplyCallback {
+   public:
+    CallReplyCallback(Impl *impl, size_t index)
+      : impl_(impl), index_(index) {
+    }
+    virtual void OnReply(bool succeeded, const Arguments &results) {
+      if (impl_)
+        impl_->OnReply(succeeded, results, index_);
+    }
+    // Ignores the reply, used when the batch cancels the call itself.
+    void Disarm() {
+      impl_ = NULL;
+    }
+   private:
+    Impl *impl_;
+    size_t index_;
+  };
+
+  Impl() : started_(false), pending_(0), callback_(NULL) {
+  }
+
+  void OnReply(bool succeeded, const Arguments &results, size_t index) {
+    Call *call = &calls_[index];
+    call->call_id = 0;
+    call->reply_callback = NULL;
+    call->finished = true;
+    call->succeeded = succeeded;
+    call->results = results;
+    ReleasePending();
+  }
+
+  // Calls the callback when all calls finished. The batch may be deleted by
+  // the callback, so nothing can be touched after it.
+  void ReleasePending() {
+    ASSERT(pending_ > 0);
+    if (--pending_ == 0) {
+      DoneCallback *callback = callback_;
+      callback_ = NULL;
+      if (callback) {
+        (*callback)();
+        delete callback;
+      }
+    }
+  }
+
+  // Blocks until the replies of all pending calls are received.
+  void BlockPendingCalls() {
+    for (size_t i = 0; i < calls_.size(); ++i) {
+      Call *call = &calls_[i];
+      if (call->call_id)
+        call->proxy_impl->BlockMethodCall(call->call_id);
+    }
+  }
+
+  const Call *GetCall(int call) const {
+    if (call >= 0 && call < static_cast<int>(calls_.size()))
+      return &calls_[call];
+    return NULL;
+  }
+
+  CallVector calls_;
+  bool started_;
+  size_t pending_;
+  DoneCallback *callback_;
+};
+
+DBusCallBatch::DBusCallBatch() : impl_(new Impl()) {
+}
+DBusCallBatch::~DBusCallBatch() {
+  Impl::CallVector::iterator it = impl_->calls_.begin();
+  for (; it != impl_->calls_.end(); ++it) {
+    if (it->call_id) {
+      it->reply_callback->Disarm();
+      it->proxy_impl->CancelMethodCall(it->call_id);
+    }
+  }
+  delete impl_->callback_;
+  delete impl_;
+}
+int DBusCallBatch::AddMethodCall(DBusProxy *proxy, const std::string &method,
+                                 int argc, const Variant *argv) {
+  ASSERT(proxy);
+  ASSERT(!impl_->started_);
+  ASSERT(argc == 0 || argv);
+  Impl::Call call;
+  call.proxy = proxy;
+  call.method = method;
+  for (int i = 0; i < argc; ++i)
+    call.in_args.push_back(Argument(argv[i]));
+  impl_->calls_.push_back(call);
+  return static_cast<int>(impl_->calls_.size() - 1);
+}
+int DBusCallBatch::AddGetAllProperties(DBusProxy *proxy) {
+  ASSERT(proxy);
+  ASSERT(!impl_->started_);
+  Impl::Call call;
+  call.proxy = proxy;
+  call.get_all = true;
+  impl_->calls_.push_back(call);
+  return static_cast<int>(impl_->calls_.size() - 1);
+}
+bool DBusCallBatch::Start(bool sync, int timeout, DoneCallback *callback) {
+  if (impl_->started_) {
+    delete callback;
+    return false;
+  }
+  impl_->started_ = true;
+  impl_->callback_ = callback;
+  // Holds an extra count until all calls are sent, because the replies may
+  // be received synchronously.
+  impl_->pending_ = impl_->calls_.size() + 1;
+
+  // Sends all calls before waiting for any reply.
+  for (size_t i = 0; i < impl_->calls_.size(); ++i) {
+    Impl::Call *call = &impl_->calls_[i];
+    DBusProxy::Impl *proxy = call->proxy->impl_;
+    Impl::CallReplyCallback *reply_callback =
+        new Impl::CallReplyCallback(impl_, i);
+    call->proxy_impl = proxy;
+    int call_id = call->get_all ?
+        proxy->GetAllProperties(false, timeout, NULL, reply_callback) :
+        proxy->CallInterfaceMethod(proxy->GetInterface(), call->method,
+                                   false, timeout, NULL, reply_callback,
+                                   &call->in_args);
+    if (!call->finished) {
+      call->call_id = call_id;
+      call->reply_callback = reply_callback;
+    }
+  }
+
+  if (sync)
+    impl_->BlockPendingCalls();
+  impl_->ReleasePending();
+  return true;
+}
+void DBusCallBatch::Wait() {
+  if (IsPending()) {
+    // Holds an extra count, so that the batch isn't deleted by the callback
+    // before all calls are checked.
+    ++impl_->pending_;
+    impl_->BlockPendingCalls();
+    impl_->ReleasePending();
+  }
+}
+bool DBusCallBatch::IsPending() const {
+  return impl_->started_ && impl_->pending_ > 0;
+}
+int DBusCallBatch::GetCallCount() const {
+  return static_cast<int>(impl_->calls_.size());
+}
+bool DBusCallBatch::IsSucceeded(int call) const {
+  const Impl::Call *c = impl_->GetCall(call);
+  return c && c->succeeded;
+}
+int DBusCallBatch::GetResultCount(int call) const {
+  const Impl::Call *c = impl_->GetCall(call);
+  return c && c->succeeded ? static_cast<int>(c->results.size()) : 0;
+}
+Variant DBusCallBatch::GetResult(int call, int index) const {
+  const Impl::Call *c = impl_->GetCall(call);
+  if (c && c->succeeded && index >= 0 &&
+      index < static_cast<int>(c->results.size()))
+    return c->results[index].value.v();
+  return Variant();
+}
+
 }  // namespace dbus
 }  // namespace ggadget
@@ -214,6 +214,25 @@ class DBusProxy : public SmallObject<> {
    */
   bool SetProperty(const std::string &property, const Variant &value);
 
+  /**
+   * Gets the values of all properties of the remote object in one round trip,
+   * by calling org.freedesktop.DBus.Properties.GetAll.
+   *
+   * If the interface of the proxy has a PropertiesChanged signal, the values
+   * are also stored in the property cache, which serves later
+   * @c GetProperty() calls and is kept up to date by the signal.
+   *
+   * @param sync @c true to block until the reply is received.
+   * @param timeout timeout in milisecond, see @c CallMethod().
+   * @param callback callback to receive the result, which will be called with
+   *        index 0 and a @c ScriptableInterface holding all properties as its
+   *        constant properties, or with index -1 on errors. It will be
+   *        deleted after being called.
+   * @return a number greater than zero when succeeds, otherwise zero. For
+   *    async call, the returned number can be used to cancel the call.
+   */
+  int GetAllProperties(bool sync, int timeout, ResultCallback *callback);
+
   /**
    * Gets the information of a known property by its name.
    *
@@ -343,6 +362,7 @@ class DBusProxy : public SmallObject<> {
  private:
   class Impl;
   Impl *impl_;
+  friend class DBusCallBatch;
 
   /**
    * Private constructor to prevent creating DBusProxy object directly.
@@ -352,6 +372,106 @@ class DBusProxy : public SmallObject<> {
   DISALLOW_EVIL_CONSTRUCTORS(DBusProxy);
 };
 
+/**
+ * Issues a batch of method calls, possibly to different proxies, without
+ * waiting for a reply before sending the next call, and reports the results of
+ * all calls at once, when the last reply is received.
+ *
+ * Usage:
+ *
+ * DBusCallBatch batch;
+ * int devices = batch.AddMethodCall(network_manager, "GetDevices", 0, NULL);
+ * int props = batch.AddGetAllProperties(access_point);
+ * batch.Start(true, kDefaultDBusTimeout, NULL);
+ * if (batch.IsSucceeded(devices)) {
+ *   Variant result = batch.GetResult(devices, 0);
+ *   ...
+ * }
+ *
+ * A call fails if it's cancelled by its proxy, for example when the proxy
+ * is deleted, or the owner of the remote object changes, so the batch
+ * always finishes. The values returned by @c GetResult() are valid as long
+ * as the batch.
+ */
+class DBusCallBatch : public SmallObject<> {
+ public:
+  /**
+   * Callback to be called when all calls in a batch finished. The batch can
+   * be deleted in the callback.
+   */
+  typedef Slot0<void> DoneCallback;
+
+  DBusCallBatch();
+  /** Cancels the calls still pending. */
+  ~DBusCallBatch();
+
+  /**
+   * Adds a method call to the batch.
+   *
+   * @param proxy the proxy of the remote object.
+   * @param method method name to call.
+   * @param argc number of arguments.
+   * @param argv array to hold arguments.
+   * @return the index of the call in the batch.
+   */
+  int AddMethodCall(DBusProxy *proxy, const std::string &method,
+                    int argc, const Variant *argv);
+
+  /**
+   * Adds a call of @c DBusProxy::GetAllProperties() to the batch. The only
+   * result of the call is a @c ScriptableInterface holding all properties.
+   *
+   * @param proxy the proxy of the remote object.
+   * @return the index of the call in the batch.
+   */
+  int AddGetAllProperties(DBusProxy *proxy);
+
+  /**
+   * Sends all calls in the batch. A batch can only be started once.
+   *
+   * @param sync @c true to block until all replies are received. The calls
+   *        are still sent without waiting for each other.
+   * @param timeout timeout in milisecond of each call, see
+   *        @c DBusProxy::CallMethod().
+   * @param callback to be called when all calls finished. It can be @c NULL,
+   *        and will be deleted by the batch.
+   * @return @c false if the batch has been started.
+   */
+  bool Start(bool sync, int timeout, DoneCallback *callback);
+
+  /**
+   * Blocks until all calls in a started batch finished. The callback passed
+   * to @c Start() is called before returning.
+   */
+  void Wait();
+
+  /** Checks if any call in the batch is still pending. */
+  bool IsPending() const;
+
+  /** Gets the number of calls in the batch. */
+  int GetCallCount() const;
+
+  /** Checks if a call finished successfully. */
+  bool IsSucceeded(int call) const;
+
+  /** Gets the number of values returned by a call. */
+  int GetResultCount(int call) const;
+
+  /**
+   * Gets a value returned by a call.
+   * @param call the index of the call.
+   * @param index the index of the return value.
+   * @return the value, or a @c Variant of type @c Variant::TYPE_VOID if the
+   *     call failed or has no such return value.
+   */
+  Variant GetResult(int call, int index) const;
+
+ private:
+  class Impl;
+  Impl *impl_;
+  DISALLOW_EVIL_CONSTRUCTORS(DBusCallBatch);
+};
+
 /** @} */
 
 }  // namespace dbus
@@ -21,7 +21,8 @@ limitations under the License.
 #include <dbus/dbus.h>
 
 #include "ggadget/dbus/dbus_proxy.h"
-#include "ggadget/tests/native_main_loop.h"
+#include "ggadget/native_main_loop.h"
+#include "ggadget/scriptable_interface.h"
 #include "ggadget/logger.h"
 #include "ggadget/slot.h"
 #include "ggadget/tests/init_extensions.h"
@@ -34,6 +35,7 @@ namespace {
 
 const char* kName        = "com.google.Gadget";
 const char* kPath        = "/com/google/Gadget/Test";
+const char* kPropsPath   = "/com/google/Gadget/Props";
 const char* kInterface   = "com.google.Gadget.Test";
 const char* kDisconnect  = "Disconnected";
 const char* kSystemRule  = "type='signal',interface='"DBUS_INTERFACE_LOCAL "'";
@@ -212,6 +214,99 @@ DBusObjectPathVTable echo_vtable = {
   NULL,
 };
 
+// The object at kPropsPath has a property Count, which is increased by the
+// method Change and notified by PropertiesChanged signal. The method Stats
+// returns the number of Get and GetAll calls received.
+const char* kPropsIntrospectXML =
+  "<node>"
+  " <interface name=\"com.google.Gadget.Test\">"
+  "  <method name=\"Change\"/>"
+  "  <method name=\"Stats\">"
+  "   <arg name=\"get\" type=\"i\" direction=\"out\"/>"
+  "   <arg name=\"get_all\" type=\"i\" direction=\"out\"/>"
+  "  </method>"
+  "  <signal name=\"PropertiesChanged\">"
+  "   <arg name=\"properties\" type=\"a{sv}\"/>"
+  "  </signal>"
+  "  <property name=\"Count\" type=\"i\" access=\"read\"/>"
+  " </interface>"
+  "</node>";
+
+static dbus_int32_t g_count = 0;
+static dbus_int32_t g_get_calls = 0;
+static dbus_int32_t g_get_all_calls = 0;
+
+void AppendCount(DBusMessageIter *iter) {
+  DBusMessageIter variant;
+  dbus_message_iter_open_container(iter, DBUS_TYPE_VARIANT,
+                                   DBUS_TYPE_INT32_AS_STRING, &variant);
+  dbus_message_iter_append_basic(&variant, DBUS_TYPE_INT32, &g_count);
+  dbus_message_iter_close_container(iter, &variant);
+}
+
+void AppendProperties(DBusMessage *message) {
+  DBusMessageIter iter, dict, entry;
+  const char *name = "Count";
+  dbus_message_iter_init_append(message, &iter);
+  dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "{sv}", &dict);
+  dbus_message_iter_open_container(&dict, DBUS_TYPE_DICT_ENTRY, NULL, &entry);
+  dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &name);
+  AppendCount(&entry);
+  dbus_message_iter_close_container(&dict, &entry);
+  dbus_message_iter_close_container(&iter, &dict);
+}
+
+DBusHandlerResult props_message_func(DBusConnection *connection,
+                                     DBusMessage *message,
+                                     void *user_data) {
+  DBusMessage *reply = NULL;
+  if (dbus_message_is_method_call(message, DBUS_INTERFACE_INTROSPECTABLE,
+                                  "Introspect")) {
+    reply = dbus_message_new_method_return(message);
+    dbus_message_append_args(reply, DBUS_TYPE_STRING, &kPropsIntrospectXML,
+                             DBUS_TYPE_INVALID);
+  } else if (dbus_message_is_method_call(message, DBUS_INTERFACE_PROPERTIES,
+                                         "Get")) {
+    ++g_get_calls;
+    reply = dbus_message_new_method_return(message);
+    DBusMessageIter iter;
+    dbus_message_iter_init_append(reply, &iter);
+    AppendCount(&iter);
+  } else if (dbus_message_is_method_call(message, DBUS_INTERFACE_PROPERTIES,
+                                         "GetAll")) {
+    ++g_get_all_calls;
+    reply = dbus_message_new_method_return(message);
+    AppendProperties(reply);
+  } else if (dbus_message_is_method_call(message, kInterface, "Change")) {
+    ++g_count;
+    reply = dbus_message_new_method_return(message);
+    DBusMessage *signal = dbus_message_new_signal(kPropsPath, kInterface,
+                                                  "PropertiesChanged");
+    AppendProperties(signal);
+    dbus_connection_send(connection, signal, NULL);
+    dbus_message_unref(signal);
+  } else if (dbus_message_is_method_call(message, kInterface, "Stats")) {
+    reply = dbus_message_new_method_return(message);
+    dbus_message_append_args(reply,
+                             DBUS_TYPE_INT32, &g_get_calls,
+                             DBUS_TYPE_INT32, &g_get_all_calls,
+                             DBUS_TYPE_INVALID);
+  } else {
+    DLOG("server: the message was not handled.");
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+  }
+  dbus_connection_send(connection, reply, NULL);
+  dbus_connection_flush(connection);
+  dbus_message_unref(reply);
+  return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+DBusObjectPathVTable props_vtable = {
+  path_unregistered_func,
+  props_message_func,
+  NULL,
+};
+
 void StartDBusServer(int feed) {
   DBusError error;
   dbus_error_init(&error);
@@ -247,6 +342,9 @@ void StartDBusServer(int feed) {
   if (!dbus_connection_register_object_path(bus, kPath, &echo_vtable,
                                             (void*)&f))
     DLOG("server: register failed.");
+  if (!dbus_connection_register_object_path(bus, kPropsPath, &props_vtable,
+                                            NULL))
+    DLOG("server: register failed.");
 
   while (dbus_connection_read_write_dispatch(bus, -1))
     ;
@@ -427,6 +525,224 @@ TEST(DBusProxy, ConnectToSignal) {
   delete proxy;
 }
 
+TEST(DBusCallBatch, SyncBatch) {
+  DBusProxy *proxy = DBusProxy::NewSessionProxy(kName, kPath, kInterface);
+  ASSERT(proxy);
+  DBusCallBatch batch;
+  Variant hello("Hello world");
+  int echo = batch.AddMethodCall(proxy, "Echo", 1, &hello);
+  int feed = batch.AddMethodCall(proxy, "Hello", 0, NULL);
+  EXPECT_EQ(2, batch.GetCallCount());
+  EXPECT_TRUE(batch.Start(true, -1, NULL));
+  EXPECT_FALSE(batch.IsPending());
+
+  std::string str;
+  int value = 0;
+  EXPECT_TRUE(batch.IsSucceeded(echo));
+  EXPECT_EQ(1, batch.GetResultCount(echo));
+  EXPECT_TRUE(batch.GetResult(echo, 0).ConvertToString(&str));
+  EXPECT_STREQ("Hello world", str.c_str());
+  EXPECT_TRUE(batch.IsSucceeded(feed));
+  EXPECT_TRUE(batch.GetResult(feed, 0).ConvertToInt(&value));
+  EXPECT_EQ(g_feed, value);
+  EXPECT_EQ(Variant::TYPE_VOID, batch.GetResult(feed, 1).type());
+
+  // A batch can only be started once.
+  EXPECT_FALSE(batch.Start(true, -1, NULL));
+  delete proxy;
+}
+
+class BatchCallback {
+ public:
+  BatchCallback() : value_(0) {}
+  int value() const { return value_; }
+  void Callback() {
+    ++value_;
+    g_mainloop->Quit();
+  }
+ private:
+  int value_;
+};
+
+TEST(DBusCallBatch, AsyncBatch) {
+  DBusProxy *proxy = DBusProxy::NewSessionProxy(kName, kPath, kInterface);
+  ASSERT(proxy);
+  DBusCallBatch batch;
+  BatchCallback callback;
+  for (int i = 0; i < 10; ++i)
+    batch.AddMethodCall(proxy, "Hello", 0, NULL);
+  EXPECT_TRUE(batch.Start(false, -1,
+                          NewSlot(&callback, &BatchCallback::Callback)));
+  EXPECT_TRUE(batch.IsPending());
+  g_mainloop->Run();
+  EXPECT_EQ(1, callback.value());
+  EXPECT_FALSE(batch.IsPending());
+  for (int i = 0; i < 10; ++i) {
+    int value = 0;
+    EXPECT_TRUE(batch.IsSucceeded(i));
+    EXPECT_TRUE(batch.GetResult(i, 0).ConvertToInt(&value));
+    EXPECT_EQ(g_feed, value);
+  }
+  delete proxy;
+}
+
+TEST(DBusCallBatch, CancelledByProxy) {
+  DBusProxy *proxy = DBusProxy::NewSessionProxy(kName, kPath, kInterface);
+  ASSERT(proxy);
+  DBusCallBatch batch;
+  BatchCallback callback;
+  int feed = batch.AddMethodCall(proxy, "Hello", 0, NULL);
+  EXPECT_TRUE(batch.Start(false, -1,
+                          NewSlot(&callback, &BatchCallback::Callback)));
+  EXPECT_TRUE(batch.IsPending());
+  // Deleting the proxy cancels its pending calls, which finishes the batch.
+  delete proxy;
+  EXPECT_EQ(1, callback.value());
+  EXPECT_FALSE(batch.IsPending());
+  EXPECT_FALSE(batch.IsSucceeded(feed));
+  EXPECT_EQ(0, batch.GetResultCount(feed));
+}
+
+TEST(DBusCallBatch, CancelledByBatch) {
+  DBusProxy *proxy = DBusProxy::NewSessionProxy(kName, kPath, kInterface);
+  ASSERT(proxy);
+  BatchCallback callback;
+  DBusCallBatch *batch = new DBusCallBatch();
+  batch->AddMethodCall(proxy, "Hello", 0, NULL);
+  EXPECT_TRUE(batch->Start(false, -1,
+                           NewSlot(&callback, &BatchCallback::Callback)));
+  // The callback isn't called if the batch cancels the calls itself.
+  delete batch;
+  EXPECT_EQ(0, callback.value());
+  delete proxy;
+}
+
+TEST(DBusCallBatch, Wait) {
+  DBusProxy *proxy = DBusProxy::NewSessionProxy(kName, kPath, kInterface);
+  ASSERT(proxy);
+  DBusCallBatch batch;
+  BatchCallback callback;
+  int feed = batch.AddMethodCall(proxy, "Hello", 0, NULL);
+  EXPECT_TRUE(batch.Start(false, -1,
+                          NewSlot(&callback, &BatchCallback::Callback)));
+  EXPECT_TRUE(batch.IsPending());
+  batch.Wait();
+  EXPECT_EQ(1, callback.value());
+  EXPECT_FALSE(batch.IsPending());
+  int value = 0;
+  EXPECT_TRUE(batch.GetResult(feed, 0).ConvertToInt(&value));
+  EXPECT_EQ(g_feed, value);
+  delete proxy;
+}
+
+class PropertiesValue {
+ public:
+  PropertiesValue() : count_(-1) {}
+  int count() const { return count_; }
+  bool Callback(int id, const Variant &value) {
+    EXPECT_EQ(0, id);
+    EXPECT_EQ(Variant::TYPE_SCRIPTABLE, value.type());
+    ScriptableInterface *dict = VariantValue<ScriptableInterface *>()(value);
+    if (dict)
+      dict->GetProperty("Count").v().ConvertToInt(&count_);
+    g_mainloop->Quit();
+    return true;
+  }
+ private:
+  int count_;
+};
+
+class StatsValue {
+ public:
+  StatsValue() : get_calls_(-1), get_all_calls_(-1) {}
+  int get_calls() const { return get_calls_; }
+  int get_all_calls() const { return get_all_calls_; }
+  bool Callback(int id, const Variant &value) {
+    if (id == 0)
+      value.ConvertToInt(&get_calls_);
+    else if (id == 1)
+      value.ConvertToInt(&get_all_calls_);
+    g_mainloop->Quit();
+    return true;
+  }
+  // Replies are received in order, so the replies of the calls sent before
+  // this one have been handled when it returns.
+  void Update(DBusProxy *proxy) {
+    EXPECT_TRUE(proxy->CallMethod("Stats", false, -1,
+                                  NewSlot(this, &StatsValue::Callback),
+                                  MESSAGE_TYPE_INVALID));
+    g_mainloop->Run();
+  }
+ private:
+  int get_calls_;
+  int get_all_calls_;
+};
+
+class PropertiesChangedCallback {
+ public:
+  void Callback(const std::string &name, int argc, const Variant *argv) {
+    EXPECT_STREQ("PropertiesChanged", name.c_str());
+    g_mainloop->Quit();
+  }
+};
+
+TEST(DBusProxy, GetAllProperties) {
+  DBusProxy *proxy = DBusProxy::NewSessionProxy(kName, kPropsPath,
+                                                kInterface);
+  ASSERT(proxy);
+  PropertiesValue sync_value;
+  EXPECT_LT(0, proxy->GetAllProperties(
+      true, -1, NewSlot(&sync_value, &PropertiesValue::Callback)));
+  EXPECT_EQ(g_count, sync_value.count());
+
+  PropertiesValue async_value;
+  EXPECT_LT(0, proxy->GetAllProperties(
+      false, -1, NewSlot(&async_value, &PropertiesValue::Callback)));
+  g_mainloop->Run();
+  EXPECT_EQ(g_count, async_value.count());
+  delete proxy;
+}
+
+TEST(DBusProxy, PropertyCache) {
+  DBusProxy *proxy = DBusProxy::NewSessionProxy(kName, kPropsPath,
+                                                kInterface);
+  ASSERT(proxy);
+  StatsValue stats;
+  stats.Update(proxy);
+  int get_calls = stats.get_calls();
+  int get_all_calls = stats.get_all_calls();
+
+  // The first call gets the property by itself, and fills the cache in
+  // background.
+  int count = -1;
+  EXPECT_TRUE(proxy->GetProperty("Count").v().ConvertToInt(&count));
+  stats.Update(proxy);
+  EXPECT_EQ(get_calls + 1, stats.get_calls());
+  EXPECT_EQ(get_all_calls + 1, stats.get_all_calls());
+
+  // Later calls are served by the cache.
+  EXPECT_TRUE(proxy->GetProperty("Count").v().ConvertToInt(&count));
+  stats.Update(proxy);
+  EXPECT_EQ(get_calls + 1, stats.get_calls());
+  EXPECT_EQ(get_all_calls + 1, stats.get_all_calls());
+
+  // The cache is updated by PropertiesChanged signal.
+  PropertiesChangedCallback changed;
+  Connection *connection = proxy->ConnectOnSignalEmit(
+      NewSlot(&changed, &PropertiesChangedCallback::Callback));
+  EXPECT_TRUE(proxy->CallMethod("Change", false, -1, NULL,
+                                MESSAGE_TYPE_INVALID));
+  g_mainloop->Run();
+  connection->Disconnect();
+  int new_count = -1;
+  EXPECT_TRUE(proxy->GetProperty("Count").v().ConvertToInt(&new_count));
+  EXPECT_EQ(count + 1, new_count);
+  stats.Update(proxy);
+  EXPECT_EQ(get_calls + 1, stats.get_calls());
+  EXPECT_EQ(get_all_calls + 1, stats.get_all_calls());
+  delete proxy;
+}
+
 int main(int argc, char **argv) {
   testing::ParseGTestFlags(&argc, argv);
   StartServer();
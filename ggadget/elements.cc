@@ -16,6 +16,7 @@
 
 #include <vector>
 #include <algorithm>
+#include <cmath>
 
 #include "basic_element.h"
 #include "element_factory.h"
@@ -23,11 +24,13 @@
 #include "event.h"
 #include "gadget_interface.h"
 #include "graphics_interface.h"
+#include "light_map.h"
 #include "logger.h"
 #include "math_utils.h"
 #include "scriptable_helper.h"
 #include "signals.h"
 #include "small_object.h"
+#include "string_utils.h"
 #include "view.h"
 #include "view_element.h"
 #include "xml_dom_interface.h"
@@ -36,12 +39,22 @@
 
 namespace ggadget {
 
+// Containers with fewer children are hit-tested by scanning all children.
+static const size_t kHitGridMinChildren = 32;
+// Maximum number of cells in each direction of the hit-testing grid.
+static const size_t kHitGridMaxCells = 32;
+
 class Elements::Impl : public SmallObject<> {
  public:
   Impl(ElementFactory *factory, BasicElement *owner, View *view)
       : width_(.0), height_(.0),
         factory_(factory), owner_(owner), view_(view),
-        scrollable_(false), element_removed_(false) {
+        hit_grid_left_(0), hit_grid_top_(0),
+        hit_grid_right_(0), hit_grid_bottom_(0),
+        hit_grid_cell_width_(0), hit_grid_cell_height_(0),
+        hit_grid_columns_(0), hit_grid_rows_(0),
+        scrollable_(false), element_removed_(false),
+        hit_grid_valid_(false), layout_all_(true) {
     ASSERT(view);
   }
 
@@ -105,6 +118,10 @@ class Elements::Impl : public SmallObject<> {
         element->SetIndex(children_.size());
         children_.push_back(element);
       }
+      hit_grid_valid_ = false;
+      // Default positions of the siblings may depend on their indexes.
+      layout_all_ = true;
+      AddName(element);
       ASSERT_ELEMENTS_INTEGRITY;
       if (on_element_added_.HasActiveConnections())
         on_element_added_(element);
@@ -123,6 +140,9 @@ class Elements::Impl : public SmallObject<> {
     children_.erase(children_.begin() + index);
     UpdateIndexes(index);
     element_removed_ = true;
+    hit_grid_valid_ = false;
+    layout_all_ = true;
+    RemoveName(element, index);
     ASSERT_ELEMENTS_INTEGRITY;
     if (on_element_removed_.HasActiveConnections())
         on_element_removed_(element);
@@ -200,7 +220,12 @@ class Elements::Impl : public SmallObject<> {
       }
       Children v;
       children_.swap(v);
+      names_.clear();
       element_removed_ = true;
+      hit_grid_valid_ = false;
+      // Let the next layout update the extents.
+      if (owner_)
+        owner_->QueueLayout();
     }
     // The caller should call QueueDraw() at proper time.
   }
@@ -230,12 +255,39 @@ class Elements::Impl : public SmallObject<> {
   BasicElement *GetItemByName(const char *name) {
     if (!name || !*name)
       return NULL;
-    for (Children::const_iterator ite = children_.begin();
-         ite != children_.end(); ++ite) {
-      if (GadgetStrCmp((*ite)->GetName().c_str(), name) == 0)
-        return *ite;
+    NameMap::const_iterator it = names_.find(name);
+    return it == names_.end() ? NULL : it->second;
+  }
+
+  // Called after element has been inserted and the indexes updated.
+  void AddName(BasicElement *element) {
+    std::string name = element->GetName();
+    if (name.empty())
+      return;
+    NameMap::iterator it = names_.find(name);
+    if (it == names_.end())
+      names_[name] = element;
+    else if (element->GetIndex() < it->second->GetIndex())
+      it->second = element;
+  }
+
+  // Called after element at index has been erased from children_.
+  void RemoveName(BasicElement *element, size_t index) {
+    std::string name = element->GetName();
+    if (name.empty())
+      return;
+    NameMap::iterator it = names_.find(name);
+    if (it == names_.end() || it->second != element)
+      return;
+    // The element was the lowest-indexed one with the name, so the next one
+    // with the same name, if any, is after it.
+    for (size_t i = index; i < children_.size(); i++) {
+      if (GadgetStrCmp(children_[i]->GetName().c_str(), name.c_str()) == 0) {
+        it->second = children_[i];
+        return;
+      }
     }
-    return NULL;
+    names_.erase(it);
   }
 
   void MapChildPositionEvent(const PositionEvent &org_event,
@@ -272,18 +324,23 @@ class Elements::Impl : public SmallObject<> {
     *fired_element = NULL;
     ViewInterface::HitTest in_hittest = *hittest;
     MouseEvent new_event(event);
+    const std::vector<size_t> *candidates = NULL;
+    bool indexed = GetHitCandidates(event.GetX(), event.GetY(), &candidates);
+    size_t count = !indexed ? children_.size() :
+                   candidates ? candidates->size() : 0;
     // Iterate in reverse since higher elements are listed last.
-    for (Children::reverse_iterator ite = children_.rbegin();
-         ite != children_.rend(); ++ite) {
-      BasicElement *child = *ite;
+    for (size_t i = count; i > 0; i--) {
+      size_t index = indexed ? (*candidates)[i - 1] : i - 1;
+      if (index >= children_.size())
+        continue;
+      BasicElement *child = children_[index];
       // Don't use child->IsReallyVisible() because here we don't need to check
       // visibility of ancestors.
       if (!child->IsVisible() || child->GetOpacity() == 0.0)
         continue;
       MapChildMouseEvent(event, child, &new_event);
       if (child->IsPointIn(new_event.GetX(), new_event.GetY())) {
-        BasicElement *child = *ite;
-        ElementHolder child_holder(*ite);
+        ElementHolder child_holder(child);
         BasicElement *descendant_in_element = NULL;
         ViewInterface::HitTest descendant_hittest = *hittest;
         EventResult result = child->OnMouseEvent(new_event, false,
@@ -319,18 +376,24 @@ class Elements::Impl : public SmallObject<> {
 
     *fired_element = NULL;
     DragEvent new_event(event);
+    const std::vector<size_t> *candidates = NULL;
+    bool indexed = GetHitCandidates(event.GetX(), event.GetY(), &candidates);
+    size_t count = !indexed ? children_.size() :
+                   candidates ? candidates->size() : 0;
     // Iterate in reverse since higher elements are listed last.
-    for (Children::reverse_iterator ite = children_.rbegin();
-         ite != children_.rend(); ++ite) {
-      BasicElement *child = (*ite);
+    for (size_t i = count; i > 0; i--) {
+      size_t index = indexed ? (*candidates)[i - 1] : i - 1;
+      if (index >= children_.size())
+        continue;
+      BasicElement *child = children_[index];
       if (!child->IsReallyVisible())
         continue;
 
       MapChildPositionEvent(event, child, &new_event);
       if (child->IsPointIn(new_event.GetX(), new_event.GetY())) {
         ElementHolder child_holder(child);
-        EventResult result = (*ite)->OnDragEvent(new_event, false,
-                                                 fired_element);
+        EventResult result = child->OnDragEvent(new_event, false,
+                                                fired_element);
         // The child has been removed by some event handler, can't continue.
         if (!child_holder.Get() || *fired_element)
           return result;
@@ -339,6 +402,128 @@ class Elements::Impl : public SmallObject<> {
     return EVENT_RESULT_UNHANDLED;
   }
 
+  // Converts a point in the coordinates of the owner into the coordinates
+  // in which the children are positioned, e.g. adds the scroll position of
+  // a scrolling owner. The mapping is done through a child, so that any
+  // override of SelfCoordToChildCoord() is honored.
+  void OwnerCoordToLayoutCoord(double x, double y,
+                               double *layout_x, double *layout_y) {
+    if (!owner_) {
+      *layout_x = x;
+      *layout_y = y;
+      return;
+    }
+    BasicElement *child = children_[0];
+    double child_x, child_y;
+    owner_->SelfCoordToChildCoord(child, x, y, &child_x, &child_y);
+    BasicElement::FlipMode flip = child->GetFlip();
+    if (flip & BasicElement::FLIP_HORIZONTAL)
+      child_x = child->GetPixelWidth() - child_x;
+    if (flip & BasicElement::FLIP_VERTICAL)
+      child_y = child->GetPixelHeight() - child_y;
+    ChildCoordToParentCoord(child_x, child_y,
+                            child->GetPixelX(), child->GetPixelY(),
+                            child->GetPixelPinX(), child->GetPixelPinY(),
+                            DegreesToRadians(child->GetRotation()),
+                            layout_x, layout_y);
+  }
+
+  // Builds a uniform grid over the axis-aligned extents of the children, so
+  // that hit-testing only needs to check the children around the point.
+  void BuildHitGrid() {
+    hit_grid_valid_ = true;
+    hit_grid_cells_.clear();
+    size_t count = children_.size();
+    if (count < kHitGridMinChildren)
+      return;
+
+    std::vector<Rectangle> extents(count);
+    double left = 0, top = 0, right = 0, bottom = 0;
+    for (size_t i = 0; i < count; i++) {
+      BasicElement *child = children_[i];
+      double extent_left, extent_top, extent_right, extent_bottom;
+      // IsPointIn() checks against the real size, which might be bigger
+      // than the overridden pixel size, e.g. of an expanded combobox.
+      GetChildRectExtentInParent(child->GetPixelX(), child->GetPixelY(),
+                                 child->GetPixelPinX(), child->GetPixelPinY(),
+                                 DegreesToRadians(child->GetRotation()), 0, 0,
+                                 child->BasicElement::GetPixelWidth(),
+                                 child->BasicElement::GetPixelHeight(),
+                                 &extent_left, &extent_top,
+                                 &extent_right, &extent_bottom);
+      extents[i] = Rectangle(extent_left, extent_top,
+                             extent_right - extent_left,
+                             extent_bottom - extent_top);
+      if (i == 0 || extent_left < left) left = extent_left;
+      if (i == 0 || extent_top < top) top = extent_top;
+      if (i == 0 || extent_right > right) right = extent_right;
+      if (i == 0 || extent_bottom > bottom) bottom = extent_bottom;
+    }
+
+    size_t cells = std::min(kHitGridMaxCells, static_cast<size_t>(
+        ceil(sqrt(static_cast<double>(count)))));
+    hit_grid_left_ = left;
+    hit_grid_top_ = top;
+    hit_grid_right_ = right;
+    hit_grid_bottom_ = bottom;
+    hit_grid_columns_ = right > left ? cells : 1;
+    hit_grid_rows_ = bottom > top ? cells : 1;
+    hit_grid_cell_width_ =
+        (right - left) / static_cast<double>(hit_grid_columns_);
+    hit_grid_cell_height_ =
+        (bottom - top) / static_cast<double>(hit_grid_rows_);
+    hit_grid_cells_.resize(hit_grid_columns_ * hit_grid_rows_);
+    for (size_t i = 0; i < count; i++) {
+      const Rectangle &r = extents[i];
+      size_t column0 = GetHitGridColumn(r.x);
+      size_t column1 = GetHitGridColumn(r.x + r.w);
+      size_t row0 = GetHitGridRow(r.y);
+      size_t row1 = GetHitGridRow(r.y + r.h);
+      for (size_t row = row0; row <= row1; row++) {
+        for (size_t column = column0; column <= column1; column++)
+          hit_grid_cells_[row * hit_grid_columns_ + column].push_back(i);
+      }
+    }
+  }
+
+  size_t GetHitGridColumn(double x) {
+    if (hit_grid_cell_width_ <= 0 || x <= hit_grid_left_)
+      return 0;
+    return std::min(hit_grid_columns_ - 1, static_cast<size_t>(
+        (x - hit_grid_left_) / hit_grid_cell_width_));
+  }
+
+  size_t GetHitGridRow(double y) {
+    if (hit_grid_cell_height_ <= 0 || y <= hit_grid_top_)
+      return 0;
+    return std::min(hit_grid_rows_ - 1, static_cast<size_t>(
+        (y - hit_grid_top_) / hit_grid_cell_height_));
+  }
+
+  // Returns false if all children should be hit-tested. Otherwise sets
+  // *candidates to the ascending indexes of the children whose extents
+  // might contain the point (x, y) in the coordinates of the owner, or to
+  // NULL if no child does.
+  bool GetHitCandidates(double x, double y,
+                        const std::vector<size_t> **candidates) {
+    if (!hit_grid_valid_)
+      BuildHitGrid();
+    if (hit_grid_cells_.empty())
+      return false;
+
+    double layout_x, layout_y;
+    OwnerCoordToLayoutCoord(x, y, &layout_x, &layout_y);
+    if (layout_x < hit_grid_left_ || layout_y < hit_grid_top_ ||
+        layout_x > hit_grid_right_ || layout_y > hit_grid_bottom_) {
+      *candidates = NULL;
+    } else {
+      *candidates = &hit_grid_cells_[GetHitGridRow(layout_y) *
+                                     hit_grid_columns_ +
+                                     GetHitGridColumn(layout_x)];
+    }
+    return true;
+  }
+
   // Update the maximum children extent.
   void UpdateChildExtent(BasicElement *child,
                          double *extent_width, double *extent_height) {
@@ -370,15 +555,22 @@ class Elements::Impl : public SmallObject<> {
   void CalculateSize() {
     Children::iterator it = children_.begin();
     Children::iterator end = children_.end();
-    for (; it != end; ++it)
-      (*it)->CalculateSize();
+    for (; it != end; ++it) {
+      if (layout_all_ || (*it)->IsLayoutQueued())
+        (*it)->CalculateSize();
+    }
   }
 
   void Layout() {
     Children::iterator it = children_.begin();
     Children::iterator end = children_.end();
     bool need_update_extents = element_removed_;
+    bool layout_all = layout_all_;
+    layout_all_ = false;
     for (; it != end; ++it) {
+      // Children without any queued change keep their last layout.
+      if (!layout_all && !(*it)->IsLayoutQueued())
+        continue;
       (*it)->RecursiveLayout();
       if ((*it)->IsPositionChanged() || (*it)->IsSizeChanged())
         need_update_extents = true;
@@ -388,6 +580,9 @@ class Elements::Impl : public SmallObject<> {
       (*it)->ClearSizeChanged();
     }
 
+    if (need_update_extents)
+      hit_grid_valid_ = false;
+
     if (scrollable_) {
       if (need_update_extents) {
         width_ = height_ = 0;
@@ -492,8 +687,29 @@ class Elements::Impl : public SmallObject<> {
   Signal1<void, BasicElement*> on_element_added_;
   Signal1<void, BasicElement*> on_element_removed_;
 
+  // Maps each name to the lowest-indexed child with the name, compared in
+  // the same way as GadgetStrCmp().
+  typedef LightMap<std::string, BasicElement *,
+                   GadgetStringComparator> NameMap;
+  NameMap names_;
+
+  // The hit-testing grid, in the coordinates in which the children are
+  // positioned. Each cell lists the indexes of the children overlapping it
+  // in ascending order. Empty if there are too few children.
+  std::vector<std::vector<size_t> > hit_grid_cells_;
+  double hit_grid_left_;
+  double hit_grid_top_;
+  double hit_grid_right_;
+  double hit_grid_bottom_;
+  double hit_grid_cell_width_;
+  double hit_grid_cell_height_;
+  size_t hit_grid_columns_;
+  size_t hit_grid_rows_;
+
   bool scrollable_      : 1;
   bool element_removed_ : 1;
+  bool hit_grid_valid_  : 1;
+  bool layout_all_      : 1;
 };
 
 Elements::Elements(ElementFactory *factory,
@@ -666,6 +882,14 @@ void Elements::Layout() {
   impl_->Layout();
 }
 
+void Elements::QueueLayout() {
+  impl_->layout_all_ = true;
+}
+
+void Elements::InvalidateHitGrid() {
+  impl_->hit_grid_valid_ = false;
+}
+
 void Elements::Draw(CanvasInterface *canvas) {
   impl_->Draw(canvas);
 }
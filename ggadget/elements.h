@@ -253,6 +253,18 @@ class Elements : public ScriptableHelperNativeOwnedDefault {
    */
   void Layout();
 
+  /**
+   * Lets the next @c CalculateSize() and @c Layout() visit all children.
+   * Otherwise only the children queued for layout are visited.
+   */
+  void QueueLayout();
+
+  /**
+   * Lets the next hit-test rebuild the grid of children extents. Must be
+   * called when the position or size of a child changes.
+   */
+  void InvalidateHitGrid();
+
   /**
    * Draw all the elements in this object onto a specified canvas.
    * The canvas shall already be prepared to be drawn directly without any
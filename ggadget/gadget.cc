@@ -14,6 +14,7 @@
   limitations under the License.
 */
 
+#include <algorithm>
 #include "gadget.h"
 #include "contentarea_element.h"
 #include "content_item.h"
@@ -24,6 +25,7 @@
 #include "file_manager_interface.h"
 #include "file_manager_factory.h"
 #include "file_manager_wrapper.h"
+#include "format_macros.h"
 #include "localized_file_manager.h"
 #include "gadget_consts.h"
 #include "logger.h"
@@ -31,8 +33,10 @@
 #include "menu_interface.h"
 #include "messages.h"
 #include "host_interface.h"
+#include "image_cache.h"
 #include "options_interface.h"
 #include "permissions.h"
+#include "prefetch_file_manager.h"
 #include "script_context_interface.h"
 #include "script_runtime_manager.h"
 #include "scriptable_array.h"
@@ -53,6 +57,17 @@
 
 namespace ggadget {
 
+// Extensions of the files referenced by main.xml to be prefetched.
+static const char *kPrefetchExtensions[] = {
+  ".js", ".png", ".jpg", ".jpeg", ".gif", ".bmp", ".ico", ".svg",
+};
+// Maximum number of files to prefetch for a gadget.
+static const size_t kMaxPrefetchFiles = 256;
+// Maximum number of prefetch threads.
+static const size_t kMaxPrefetchThreads = 4;
+// Number of prefetched files per thread.
+static const size_t kPrefetchFilesPerThread = 8;
+
 class Gadget::Impl : public ScriptableHelperNativeOwnedDefault {
  public:
   DEFINE_CLASS_ID(0x6a3c396b3a544148, ScriptableInterface);
@@ -228,12 +243,17 @@ class Gadget::Impl : public ScriptableHelperNativeOwnedDefault {
       return false;
     }
 
+    uint64_t start_time = GetLoadTime();
+    uint64_t phase_time = start_time;
+    load_timings_.clear();
+
     // Create gadget FileManager
     FileManagerInterface *fm = GadgetBase::CreateFileManager(
         kGadgetGManifest, base_path_.c_str(), NULL);
     if (fm == NULL)
       return false;
-    file_manager_->RegisterFileManager("", fm);
+    PrefetchFileManager *prefetch_fm = new PrefetchFileManager(fm);
+    file_manager_->RegisterFileManager("", prefetch_fm);
 
     // Create system FileManager
     fm = ::ggadget::CreateFileManager(kDirSeparatorStr);
@@ -257,6 +277,7 @@ class Gadget::Impl : public ScriptableHelperNativeOwnedDefault {
       return false;
     }
 
+    AddLoadTiming("manifest", &phase_time);
     main_view_->view()->SetCaption(GetManifestInfo(kManifestName));
 
     std::string min_version = GetManifestInfo(kManifestMinVersion);
@@ -369,6 +390,7 @@ class Gadget::Impl : public ScriptableHelperNativeOwnedDefault {
       global_manager->RegisterLoadedExtensions(&register_wrapper);
     if (extension_manager_)
       extension_manager_->RegisterLoadedExtensions(&register_wrapper);
+    AddLoadTiming("extensions", &phase_time);
 
     // Initialize main view.
     std::string main_xml;
@@ -378,10 +400,37 @@ class Gadget::Impl : public ScriptableHelperNativeOwnedDefault {
                                              base_path_.c_str()).c_str());
       return false;
     }
+    AddLoadTiming("main.xml", &phase_time);
+
+    // Read the scripts and decode the images referenced by main.xml in
+    // background while the main view is being set up.
+    ImageCache image_cache;
+    // The statistics are shared by all image caches in this thread, so only
+    // the changes during loading this gadget are reported.
+    ImageCache::Stats image_stats_start = image_cache.GetStats();
+    StartPrefetch(prefetch_fm, &image_cache, main_xml);
+    AddLoadTiming("prefetch", &phase_time);
 
     RegisterScriptExtensions(main_view_->context());
 
-    if (!main_view_->scriptable()->InitFromXML(main_xml, kMainXML)) {
+    bool view_initialized =
+        main_view_->scriptable()->InitFromXML(main_xml, kMainXML);
+    AddLoadTiming("view", &phase_time);
+    PrefetchFileManager::Stats stats = prefetch_fm->GetStats();
+    prefetch_fm->StopPrefetch();
+    ImageCache::Stats image_stats = image_cache.GetStats();
+    image_cache.StopPreload();
+    load_timings_ += StringPrintf(
+        "total=%" PRIu64 "ms prefetched=%" PRIuS "/%" PRIuS " hits=%" PRIuS
+        " bytes=%" PRIuS " wait=%" PRIu64 "ms images=%" PRIuS "/%" PRIuS,
+        GetLoadTime() - start_time,
+        stats.prefetched, stats.queued, stats.hits, stats.bytes,
+        stats.wait_time / 1000,
+        image_stats.preload_hits - image_stats_start.preload_hits,
+        image_stats.preloaded - image_stats_start.preloaded);
+    DLOG("Gadget load timings: %s", load_timings_.c_str());
+
+    if (!view_initialized) {
       LOG("Failed to setup the main view");
       main_view_->view()->Alert(StringPrintf(GM_("GADGET_LOAD_FAILURE"),
                                              base_path_.c_str()).c_str());
@@ -415,6 +464,100 @@ class Gadget::Impl : public ScriptableHelperNativeOwnedDefault {
     return true;
   }
 
+  static uint64_t GetLoadTime() {
+    MainLoopInterface *main_loop = GetGlobalMainLoop();
+    return main_loop ? main_loop->GetCurrentTime() : 0;
+  }
+
+  // Appends the time elapsed since *phase_time to the load timings, and
+  // starts the next phase.
+  void AddLoadTiming(const char *phase, uint64_t *phase_time) {
+    uint64_t now = GetLoadTime();
+    load_timings_ += StringPrintf("%s=%" PRIu64 "ms ", phase,
+                                  now - *phase_time);
+    *phase_time = now;
+  }
+
+  // Collects the relative file names of the scripts and images referenced by
+  // the attributes in an xml file. It's only a quick scan without parsing the
+  // xml, the names not actually used are harmless.
+  static void CollectReferencedFiles(const std::string &xml,
+                                     StringVector *files) {
+    size_t pos = 0;
+    while (files->size() < kMaxPrefetchFiles &&
+           (pos = xml.find('=', pos)) != std::string::npos) {
+      pos = xml.find_first_not_of(" \t\r\n", pos + 1);
+      if (pos == std::string::npos)
+        break;
+      char quote = xml[pos];
+      if (quote != '"' && quote != '\'')
+        continue;
+      size_t end = xml.find(quote, pos + 1);
+      if (end == std::string::npos)
+        break;
+      std::string value = xml.substr(pos + 1, end - pos - 1);
+      pos = end + 1;
+      if (value.empty() || value[0] == '/' || value[0] == '\\' ||
+          value.find(':') != std::string::npos ||
+          value.find_first_of("<>&\r\n") != std::string::npos)
+        continue;
+      for (size_t i = 0; i < arraysize(kPrefetchExtensions); ++i) {
+        if (EndWithNoCase(value.c_str(), kPrefetchExtensions[i])) {
+          if (std::find(files->begin(), files->end(), value) == files->end())
+            files->push_back(value);
+          break;
+        }
+      }
+    }
+  }
+
+  // Creates the FileManager instances used by the threads to prefetch some
+  // files. FileManager is not thread safe, so each thread has its own one.
+  void NewPrefetchReaders(size_t file_count,
+                          std::vector<FileManagerInterface *> *readers) {
+    size_t thread_count = std::min(
+        kMaxPrefetchThreads,
+        (file_count + kPrefetchFilesPerThread - 1) / kPrefetchFilesPerThread);
+    for (size_t i = 0; i < thread_count; ++i) {
+      FileManagerInterface *fm = GadgetBase::CreateFileManager(
+          kGadgetGManifest, base_path_.c_str(), NULL);
+      if (fm)
+        readers->push_back(fm);
+    }
+  }
+
+  // Starts to prefetch the files referenced by main.xml and the manifest.
+  // The scripts and the manifest icon are read by the prefetch file manager,
+  // and the images are read and decoded by the image cache.
+  void StartPrefetch(PrefetchFileManager *prefetch_fm, ImageCache *image_cache,
+                     const std::string &main_xml) {
+    StringVector referenced;
+    CollectReferencedFiles(main_xml, &referenced);
+    StringVector files, images;
+    std::string icon = GetManifestInfo(kManifestIcon);
+    if (!icon.empty())
+      files.push_back(icon);
+    for (StringVector::const_iterator it = referenced.begin();
+         it != referenced.end(); ++it) {
+      if (EndWithNoCase(it->c_str(), ".js"))
+        files.push_back(*it);
+      else
+        images.push_back(*it);
+    }
+
+    std::vector<FileManagerInterface *> readers;
+    if (!files.empty()) {
+      NewPrefetchReaders(files.size(), &readers);
+      prefetch_fm->Prefetch(files, readers);
+    }
+    if (!images.empty()) {
+      readers.clear();
+      NewPrefetchReaders(images.size(), &readers);
+      image_cache->PreloadImages(main_view_->view()->GetGraphics(),
+                                 file_manager_, images, readers);
+    }
+  }
+
   void OnDisplayStateChanged(int state) {
     ondisplaystatechange_signal_(state);
   }
@@ -996,6 +1139,8 @@ class Gadget::Impl : public ScriptableHelperNativeOwnedDefault {
   Permissions permissions_;
 
   std::string base_path_;
+  // The time spent in each phase of Initialize(), for profiling.
+  std::string load_timings_;
 
   int remove_me_timer_;
   int destroy_details_view_timer_;
@@ -1043,6 +1188,10 @@ int Gadget::GetPluginFlags() const {
   return impl_->plugin_flags_;
 }
 
+std::string Gadget::GetLoadTimings() const {
+  return impl_->load_timings_;
+}
+
 Gadget::DisplayTarget Gadget::GetDisplayTarget() const {
   return impl_->display_target_;
 }
@@ -159,6 +159,13 @@ class Gadget : public GadgetBase {
   /** Returns current plugin flags of the gadget. */
   int GetPluginFlags() const;
 
+  /**
+   * Returns the time spent in each phase of loading the gadget and the
+   * statistics of the resource prefetch, in the form of
+   * "phase=<ms>ms ... total=<ms>ms prefetched=<n>/<n> hits=<n> ...".
+   */
+  std::string GetLoadTimings() const;
+
   DisplayTarget GetDisplayTarget() const;
 
   void SetDisplayTarget(DisplayTarget target);
@@ -25,6 +25,7 @@
 #include "permissions.h"
 #include "script_context_interface.h"
 #include "small_object.h"
+#include "string_utils.h"
 #include "system_utils.h"
 #include "xml_http_request_interface.h"
 #include "xml_parser_interface.h"
@@ -58,11 +59,17 @@ class GadgetBase::Impl : public SmallObject<> {
     }
   }
 
-  int GetXMLHttpRequestSession() {
+  int GetXMLHttpRequestSession(const GadgetBase *owner) {
     if (!xml_http_request_session_) {
       XMLHttpRequestFactoryInterface *factory = GetXMLHttpRequestFactory();
-      if (factory)
+      if (factory) {
         xml_http_request_session_ = factory->CreateSession();
+        // Responses cached for other gadgets may depend on their cookies.
+        SetXMLHttpRequestCachePartition(
+            xml_http_request_session_,
+            StringPrintf("%d %s", instance_id_,
+                         owner->GetManifestInfo(kManifestId).c_str()).c_str());
+      }
     }
     return xml_http_request_session_;
   }
@@ -105,7 +112,7 @@ XMLHttpRequestInterface *GadgetBase::CreateXMLHttpRequest() {
 
   const Permissions *permissions = GetPermissions();
   if (permissions && permissions->IsRequiredAndGranted(Permissions::NETWORK)) {
-    return factory->CreateXMLHttpRequest(impl_->GetXMLHttpRequestSession(),
+    return factory->CreateXMLHttpRequest(impl_->GetXMLHttpRequestSession(this),
                                          GetXMLParser());
   }
 
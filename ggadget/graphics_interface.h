@@ -68,6 +68,19 @@ class GraphicsInterface {
                                    const std::string &data,
                                    bool is_mask) const = 0;
 
+  /**
+   * Checks if @c NewImage() can create the image from the data in a thread
+   * other than the main thread, so that it can be decoded in background.
+   * The image created in another thread may be used and destroyed in the
+   * main thread.
+   *
+   * The default implementation returns @c false.
+   */
+  virtual bool CanDecodeInThread(const std::string & /* data */,
+                                 bool /* is_mask */) const {
+    return false;
+  }
+
   /**
    * Create a new font. This font is used when rendering text to a canvas.
    */
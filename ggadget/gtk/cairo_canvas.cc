@@ -15,6 +15,9 @@
 */
 
 #include <cmath>
+#include <cstring>
+#include <list>
+#include <map>
 #include <vector>
 #include <string>
 #include <algorithm>
@@ -69,6 +72,135 @@ static void SetPangoLayoutAttrFromTextFlags(PangoLayout *layout,
   pango_attr_list_unref(attr_list);
 }
 
+static PangoLayout *CreatePangoLayout() {
+  // Pango layout must be created with a cairo context that isn't scaled at
+  // all. Otherwise, some text layout behavior will be wrong.
+  CairoCanvas canvas(1.0, 1, 1, CAIRO_FORMAT_ARGB32);
+  return pango_cairo_create_layout(canvas.GetContext());
+}
+
+// An LRU cache of laid out pango layouts, so that drawing or measuring the
+// same text again doesn't need to shape it again.
+// The cached layouts are shared, they must not be modified by the callers.
+class PangoLayoutCache {
+ public:
+  PangoLayoutCache() : hits_(0), misses_(0) { }
+
+  ~PangoLayoutCache() {
+    for (EntryList::iterator it = entries_.begin(); it != entries_.end(); ++it)
+      FreeEntry(*it);
+  }
+
+  PangoLayout *GetLayout(const char *text, const CairoFont *font,
+                         int text_flags, double width,
+                         CanvasInterface::Alignment align) {
+    const PangoFontDescription *font_desc = font->GetFontDescription();
+    // Width only takes effect when wordwrap is set.
+    int layout_width = (text_flags & CanvasInterface::TEXT_FLAGS_WORDWRAP) ?
+        static_cast<int>(width) : -1;
+
+    guint hash = g_str_hash(text);
+    hash = hash * 31 + pango_font_description_hash(font_desc);
+    hash = hash * 31 + static_cast<guint>(text_flags);
+    hash = hash * 31 + static_cast<guint>(layout_width);
+    hash = hash * 31 + static_cast<guint>(align);
+
+    std::pair<EntryIndex::iterator, EntryIndex::iterator> range =
+        index_.equal_range(hash);
+    for (EntryIndex::iterator it = range.first; it != range.second; ++it) {
+      const Entry &entry = *it->second;
+      if (entry.text_flags == text_flags && entry.width == layout_width &&
+          entry.align == align && entry.text == text &&
+          pango_font_description_equal(entry.font_desc, font_desc)) {
+        ++hits_;
+        // Move the entry to the front of the LRU list.
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return entry.layout;
+      }
+    }
+
+    ++misses_;
+    PangoLayout *layout = CreatePangoLayout();
+    pango_layout_set_text(layout, text, -1);
+    pango_layout_set_font_description(layout, font_desc);
+    SetPangoLayoutAttrFromTextFlags(layout, text_flags, width);
+    // Set alignment. This is only effective when wordwrap is set
+    // because when wordwrap is unset, the width has to be
+    // -1, thus the alignment is useless.
+    if (align == CanvasInterface::ALIGN_LEFT)
+      pango_layout_set_alignment(layout, PANGO_ALIGN_LEFT);
+    else if (align == CanvasInterface::ALIGN_CENTER)
+      pango_layout_set_alignment(layout, PANGO_ALIGN_CENTER);
+    else if (align == CanvasInterface::ALIGN_RIGHT)
+      pango_layout_set_alignment(layout, PANGO_ALIGN_RIGHT);
+    else if (align == CanvasInterface::ALIGN_JUSTIFY)
+      pango_layout_set_justify(layout, TRUE);
+
+    Entry entry;
+    entry.text = text;
+    entry.font_desc = pango_font_description_copy(font_desc);
+    entry.text_flags = text_flags;
+    entry.width = layout_width;
+    entry.align = align;
+    entry.hash = hash;
+    entry.layout = layout;
+    entries_.push_front(entry);
+    index_.insert(std::make_pair(hash, entries_.begin()));
+
+    if (index_.size() > kMaxCachedLayouts)
+      RemoveLast();
+    return layout;
+  }
+
+  size_t GetHits() const { return hits_; }
+  size_t GetMisses() const { return misses_; }
+
+ private:
+  struct Entry {
+    std::string text;
+    PangoFontDescription *font_desc;
+    int text_flags;
+    int width;
+    CanvasInterface::Alignment align;
+    guint hash;
+    PangoLayout *layout;
+  };
+  typedef std::list<Entry> EntryList;
+  typedef std::multimap<guint, EntryList::iterator> EntryIndex;
+
+  static void FreeEntry(const Entry &entry) {
+    g_object_unref(entry.layout);
+    pango_font_description_free(entry.font_desc);
+  }
+
+  void RemoveLast() {
+    EntryList::iterator last = entries_.end();
+    --last;
+    std::pair<EntryIndex::iterator, EntryIndex::iterator> range =
+        index_.equal_range(last->hash);
+    for (EntryIndex::iterator it = range.first; it != range.second; ++it) {
+      if (it->second == last) {
+        index_.erase(it);
+        break;
+      }
+    }
+    FreeEntry(*last);
+    entries_.erase(last);
+  }
+
+  static const size_t kMaxCachedLayouts = 256;
+
+  EntryList entries_;
+  EntryIndex index_;
+  size_t hits_;
+  size_t misses_;
+};
+
+static PangoLayoutCache *GetLayoutCache() {
+  static PangoLayoutCache cache;
+  return &cache;
+}
+
 class CairoCanvas::Impl : public SmallObject<> {
  public:
   Impl(const CairoGraphics *graphics, double w, double h, cairo_format_t fmt)
@@ -238,13 +370,6 @@ class CairoCanvas::Impl : public SmallObject<> {
     return NULL;
   }
 
-  PangoLayout *CreatePangoLayout() {
-    // Pango layout must be created with a cairo context that isn't scaled at
-    // all. Otherwise, some text layout behavior will be wrong.
-    CairoCanvas canvas(1.0, 1, 1, CAIRO_FORMAT_ARGB32);
-    return pango_cairo_create_layout(canvas.GetContext());
-  }
-
   bool DrawTextInternal(double x, double y, double width,
                         double height, const char *text,
                         const FontInterface *f,
@@ -261,27 +386,13 @@ class CairoCanvas::Impl : public SmallObject<> {
     cairo_clip(cr_);
 
     const CairoFont *font = down_cast<const CairoFont*>(f);
-    PangoLayout *layout = CreatePangoLayout();
-    pango_layout_set_text(layout, text, -1);
-    pango_layout_set_font_description(layout, font->GetFontDescription());
-    SetPangoLayoutAttrFromTextFlags(layout, text_flags, width);
+    PangoLayout *layout = GetLayoutCache()->GetLayout(text, font, text_flags,
+                                                      width, align);
     // Pos is used to get glyph extents in pango.
     PangoRectangle pos;
     // real_x and real_y represent the real position of the layout.
     double real_x = x, real_y = y;
 
-    // Set alignment. This is only effective when wordwrap is set
-    // because when wordwrap is unset, the width has to be
-    // -1, thus the alignment is useless.
-    if (align == ALIGN_LEFT)
-      pango_layout_set_alignment(layout, PANGO_ALIGN_LEFT);
-    else if (align == ALIGN_CENTER)
-      pango_layout_set_alignment(layout, PANGO_ALIGN_CENTER);
-    else if (align == ALIGN_RIGHT)
-      pango_layout_set_alignment(layout, PANGO_ALIGN_RIGHT);
-    else if (align == ALIGN_JUSTIFY)
-      pango_layout_set_justify(layout, TRUE);
-
     // Get the pixel extents(logical extents) of the layout.
     pango_layout_get_pixel_extents(layout, NULL, &pos);
     // Calculate number of all lines.
@@ -317,6 +428,9 @@ class CairoCanvas::Impl : public SmallObject<> {
       pango_cairo_show_layout(cr_, layout);
 
     } else {
+      // The cached layout is shared, so do the trimming on a copy of it.
+      layout = pango_layout_copy(layout);
+
       // We will use newtext as the content of the layout,
       // because we have to display the trimmed text.
       std::string newtext;
@@ -444,9 +558,9 @@ class CairoCanvas::Impl : public SmallObject<> {
       // Show the trimmed text.
       cairo_move_to(cr_, real_x, real_y);
       pango_cairo_show_layout(cr_, layout);
+      g_object_unref(layout);
     }
 
-    g_object_unref(layout);
     cairo_restore(cr_);
 
     return true;
@@ -795,26 +909,32 @@ bool CairoCanvas::GetTextExtents(const char *text, const FontInterface *f,
     return true;
   }
 
-  const CairoFont *font = down_cast<const CairoFont*>(f);
-  PangoLayout *layout = impl_->CreatePangoLayout();
-  pango_layout_set_text(layout, text, -1);
-  pango_layout_set_font_description(layout, font->GetFontDescription());
-
   if (in_width <= 0) {
     text_flags &= ~TEXT_FLAGS_WORDWRAP;
   }
-  SetPangoLayoutAttrFromTextFlags(layout, text_flags, in_width);
+
+  // Left alignment is pango's default, so that the layout can be shared with
+  // DrawText() for left aligned text.
+  const CairoFont *font = down_cast<const CairoFont*>(f);
+  PangoLayout *layout = GetLayoutCache()->GetLayout(text, font, text_flags,
+                                                    in_width, ALIGN_LEFT);
 
   // Get the pixel extents(logical extents) of the layout.
   int w, h;
   pango_layout_get_pixel_size(layout, &w, &h);
   *width = w;
   *height = h;
-
-  g_object_unref(layout);
   return true;
 }
 
+void CairoCanvas::GetTextLayoutCacheStats(size_t *hits, size_t *misses) {
+  PangoLayoutCache *cache = GetLayoutCache();
+  if (hits)
+    *hits = cache->GetHits();
+  if (misses)
+    *misses = cache->GetMisses();
+}
+
 bool CairoCanvas::GetPointValue(double x, double y,
                                 Color *color, double *opacity) const {
 #if CAIRO_VERSION >= CAIRO_VERSION_ENCODE(1,2,0)
@@ -149,6 +149,12 @@ class CairoCanvas : public CanvasInterface {
   /** Get the zoom factor. */
   double GetZoom() const;
 
+  /**
+   * Gets the hit and miss counts of the text layout cache shared by all
+   * CairoCanvas objects, for performance tuning.
+   */
+  static void GetTextLayoutCacheStats(size_t *hits, size_t *misses);
+
  private:
   class Impl;
   Impl *impl_;
@@ -121,6 +121,19 @@ ImageInterface *CairoGraphics::NewImage(const std::string &tag,
   return img;
 }
 
+bool CairoGraphics::CanDecodeInThread(const std::string &data,
+                                      bool is_mask) const {
+#ifdef HAVE_RSVG_LIBRARY
+  // librsvg is not thread safe, while PixbufImage only uses its own pixbuf
+  // loader and cairo image surface.
+  return !IsSvg(data) || is_mask;
+#else
+  GGL_UNUSED(data);
+  GGL_UNUSED(is_mask);
+  return true;
+#endif
+}
+
 FontInterface *CairoGraphics::NewFont(const std::string &family,
                                       double pt_size,
                                       FontInterface::Style style,
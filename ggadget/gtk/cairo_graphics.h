@@ -56,6 +56,8 @@ class CairoGraphics : public GraphicsInterface {
                                    const std::string &data,
                                    bool is_mask) const;
 
+  virtual bool CanDecodeInThread(const std::string &data, bool is_mask) const;
+
   virtual FontInterface *NewFont(const std::string &family,
                                  double pt_size,
                                  FontInterface::Style style,
@@ -510,6 +510,10 @@ void NPAPIPluginElement::Layout() {
   impl_->Layout();
 }
 
+bool NPAPIPluginElement::IsLayoutVolatile() const {
+  return true;
+}
+
 void NPAPIPluginElement::DoDraw(CanvasInterface *canvas) {
   impl_->DoDraw(canvas);
 }
@@ -58,6 +58,7 @@ class NPAPIPluginElement : public BasicElement {
   virtual void DoClassRegister();
   virtual void DoRegister();
   virtual void Layout();
+  virtual bool IsLayoutVolatile() const;
   virtual void DoDraw(CanvasInterface *canvas);
   virtual EventResult HandleMouseEvent(const MouseEvent &event);
   virtual EventResult HandleKeyEvent(const KeyboardEvent &event);
@@ -14,8 +14,11 @@
   limitations under the License.
 */
 
+#include <algorithm>
 #include <cmath>
+#include <list>
 #include <string>
+#include <vector>
 #include <librsvg/rsvg.h>
 #include <librsvg/rsvg-cairo.h>
 #include <ggadget/color.h>
@@ -29,8 +32,31 @@
 namespace ggadget {
 namespace gtk {
 
+// Maximum bytes of a stretched rasterization to be cached.
+static const size_t kMaxRasterBytes = 4 * 1024 * 1024;
+// Maximum bytes of the stretched rasterizations cached for all images.
+static const size_t kMaxRasterCacheBytes = 16 * 1024 * 1024;
+// Maximum number of the stretched rasterizations cached for an image.
+static const size_t kMaxRasterCacheCount = 8;
+
 class RsvgImage::Impl : public SmallObject<> {
  public:
+  // A rasterization of an image in a stretched size.
+  struct Raster {
+    Impl *owner;
+    double width;
+    double height;
+    double zoom;
+    size_t bytes;
+    CairoCanvas *canvas;
+  };
+  // The rasterizations of all images, the most recently used first, so that
+  // the least recently used ones are evicted when the total size is over
+  // kMaxRasterCacheBytes.
+  typedef std::list<Raster> RasterList;
+  // The rasterizations of an image, the most recently used first.
+  typedef std::vector<RasterList::iterator> RasterRefs;
+
   Impl(const CairoGraphics *graphics, const std::string &data)
       : width_(0), height_(0), rsvg_(NULL), canvas_(NULL),
         zoom_(graphics->GetZoom()), on_zoom_connection_(NULL) {
@@ -55,6 +81,80 @@ class RsvgImage::Impl : public SmallObject<> {
     if (on_zoom_connection_)
       on_zoom_connection_->Disconnect();
     DestroyCanvas(canvas_);
+    ClearRasters();
+  }
+
+  // Intentionally leaked, so that it's usable in the destructors of static
+  // objects.
+  static RasterList *GetAllRasters() {
+    static RasterList *rasters = new RasterList();
+    return rasters;
+  }
+
+  void RemoveRaster(RasterList::iterator raster) {
+    RasterRefs::iterator it =
+        std::find(rasters_.begin(), rasters_.end(), raster);
+    ASSERT(it != rasters_.end());
+    rasters_.erase(it);
+    all_raster_bytes_ -= raster->bytes;
+    DestroyCanvas(raster->canvas);
+    GetAllRasters()->erase(raster);
+  }
+
+  void ClearRasters() {
+    while (!rasters_.empty())
+      RemoveRaster(rasters_.back());
+  }
+
+  // Gets the rasterization of the image stretched to the size at the zoom
+  // level, rendering it if it's not cached. Returns NULL if it's too large to
+  // be cached.
+  CairoCanvas *GetRaster(double width, double height, double zoom) {
+    RasterList *all_rasters = GetAllRasters();
+    for (RasterRefs::iterator it = rasters_.begin();
+         it != rasters_.end(); ++it) {
+      RasterList::iterator raster = *it;
+      if (raster->width == width && raster->height == height &&
+          raster->zoom == zoom) {
+        all_rasters->splice(all_rasters->begin(), *all_rasters, raster);
+        rasters_.erase(it);
+        rasters_.insert(rasters_.begin(), raster);
+        return raster->canvas;
+      }
+    }
+
+    size_t bytes = static_cast<size_t>(ceil(width * zoom)) *
+                   static_cast<size_t>(ceil(height * zoom)) * 4;
+    if (bytes > kMaxRasterBytes)
+      return NULL;
+
+    Raster raster;
+    raster.owner = this;
+    raster.width = width;
+    raster.height = height;
+    raster.zoom = zoom;
+    raster.bytes = bytes;
+    raster.canvas = new CairoCanvas(zoom, width, height, CAIRO_FORMAT_ARGB32);
+    cairo_t *cr = raster.canvas->GetContext();
+    cairo_save(cr);
+    cairo_scale(cr, width / width_, height / height_);
+    rsvg_handle_render_cairo(rsvg_, cr);
+    cairo_restore(cr);
+
+    all_rasters->push_front(raster);
+    rasters_.insert(rasters_.begin(), all_rasters->begin());
+    all_raster_bytes_ += bytes;
+    // Evicts the least recently used ones, of this image and then of all
+    // images, but keeps the new one.
+    if (rasters_.size() > kMaxRasterCacheCount)
+      RemoveRaster(rasters_.back());
+    while (all_rasters->size() > 1 &&
+           all_raster_bytes_ > kMaxRasterCacheBytes) {
+      RasterList::iterator lru = all_rasters->end();
+      --lru;
+      lru->owner->RemoveRaster(lru);
+    }
+    return raster.canvas;
   }
 
   void OnZoom(double zoom) {
@@ -64,6 +164,7 @@ class RsvgImage::Impl : public SmallObject<> {
       // factor when calling GetCanvas().
       DestroyCanvas(canvas_);
       canvas_ = NULL;
+      ClearRasters();
     } else if (zoom < 0) {
       // if zoom < 0 then means the graphics has been destroyed, then change
       // the zoom level back to 1 and remove the connection to graphics.
@@ -80,10 +181,16 @@ class RsvgImage::Impl : public SmallObject<> {
   double height_;
   RsvgHandle *rsvg_;
   CairoCanvas *canvas_;
+  RasterRefs rasters_;
   double zoom_;
   Connection *on_zoom_connection_;
+
+  // Total bytes of the rasterizations of all images.
+  static size_t all_raster_bytes_;
 };
 
+size_t RsvgImage::Impl::all_raster_bytes_ = 0;
+
 RsvgImage::RsvgImage(const CairoGraphics *graphics, const std::string &tag,
                      const std::string &data, bool is_mask)
     : CairoImageBase(tag, is_mask),
@@ -119,20 +226,26 @@ void RsvgImage::StretchDraw(CanvasInterface *canvas,
   ASSERT(canvas);
   if (canvas && impl_->rsvg_) {
     // If no stretch, use cached canvas to improve performance.
-    // Otherwise draw rsvg directly onto the canvas to get better effect.
-    if (width == impl_->width_ && height == impl_->height_) {
-      const CanvasInterface *image = GetCanvas();
-      ASSERT(image);
-      if (image)
-        canvas->DrawCanvas(x, y, image);
-    } else {
+    // Otherwise use the cached rasterization of the stretched size at the
+    // zoom level of the target canvas, or draw rsvg directly onto the canvas
+    // if the size is too large to be cached.
+    CairoCanvas *cc = down_cast<CairoCanvas*>(canvas);
+    const CanvasInterface *image = NULL;
+    if (width == impl_->width_ && height == impl_->height_)
+      image = GetCanvas();
+    else if (width > 0 && height > 0 && impl_->width_ > 0 &&
+             impl_->height_ > 0)
+      image = impl_->GetRaster(width, height, cc->GetZoom());
+
+    if (image) {
+      canvas->DrawCanvas(x, y, image);
+    } else if (width > 0 && height > 0) {
       double cx = width / impl_->width_;
       double cy = height / impl_->height_;
       canvas->PushState();
       canvas->IntersectRectClipRegion(x, y, width, height);
       canvas->TranslateCoordinates(x, y);
       canvas->ScaleCoordinates(cx, cy);
-      CairoCanvas *cc = down_cast<CairoCanvas*>(canvas);
       rsvg_handle_render_cairo(impl_->rsvg_, cc->GetContext());
       canvas->PopState();
     }
@@ -21,6 +21,7 @@
 #include "ggadget/common.h"
 #include "ggadget/color.h"
 #include "ggadget/canvas_interface.h"
+#include "ggadget/font_interface.h"
 #include "ggadget/gtk/cairo_canvas.h"
 #include "ggadget/gtk/cairo_graphics.h"
 #include "unittest/gtest.h"
@@ -162,6 +163,44 @@ TEST_F(CairoCanvasTest, FillRectAndClipping) {
   EXPECT_TRUE(canvas_->DrawFilledRect(110., 40., 90., 70., Color(0., 0., 1.)));
 }
 
+TEST_F(CairoCanvasTest, TextLayoutCache) {
+  FontInterface *font = gfx_.NewFont("Serif", 14,
+      FontInterface::STYLE_NORMAL, FontInterface::WEIGHT_NORMAL);
+  ASSERT_TRUE(font != NULL);
+
+  size_t hits, misses, hits2, misses2;
+  double w1, h1, w2, h2;
+  CairoCanvas::GetTextLayoutCacheStats(&hits, &misses);
+  EXPECT_TRUE(canvas_->GetTextExtents("layout cache", font, 0, 0, &w1, &h1));
+  CairoCanvas::GetTextLayoutCacheStats(&hits2, &misses2);
+  EXPECT_EQ(hits, hits2);
+  EXPECT_EQ(misses + 1, misses2);
+
+  // Measuring and drawing the same left aligned text reuses the layout.
+  EXPECT_TRUE(canvas_->GetTextExtents("layout cache", font, 0, 0, &w2, &h2));
+  EXPECT_DOUBLE_EQ(w1, w2);
+  EXPECT_DOUBLE_EQ(h1, h2);
+  EXPECT_TRUE(canvas_->DrawText(0, 0, 100, 30, "layout cache", font,
+              Color(1, 0, 0), CanvasInterface::ALIGN_LEFT,
+              CanvasInterface::VALIGN_TOP,
+              CanvasInterface::TRIMMING_NONE, 0));
+  CairoCanvas::GetTextLayoutCacheStats(&hits, &misses);
+  EXPECT_EQ(hits2 + 2, hits);
+  EXPECT_EQ(misses2, misses);
+
+  // Different alignment or flags need another layout.
+  EXPECT_TRUE(canvas_->DrawText(0, 0, 100, 30, "layout cache", font,
+              Color(1, 0, 0), CanvasInterface::ALIGN_RIGHT,
+              CanvasInterface::VALIGN_TOP,
+              CanvasInterface::TRIMMING_NONE,
+              CanvasInterface::TEXT_FLAGS_UNDERLINE));
+  CairoCanvas::GetTextLayoutCacheStats(&hits2, &misses2);
+  EXPECT_EQ(hits, hits2);
+  EXPECT_EQ(misses + 1, misses2);
+
+  font->Destroy();
+}
+
 #if CAIRO_VERSION >= CAIRO_VERSION_ENCODE(1,2,0)
 TEST_F(CairoCanvasTest, GetPointValue) {
   Color color;
@@ -58,11 +58,89 @@ static const uint64_t kFPSCountDuration = 5000;
 // Update input shape mask once per second.
 static const uint64_t kUpdateMaskInterval = 1000;
 
-// Minimal interval between self draws.
-static const unsigned int kSelfDrawInterval = 40;
+// Default maximum frame rate of all views.
+static const int kDefaultMaxFrameRate = 25;
 
 class ViewWidgetBinder::Impl : public SmallObject<> {
  public:
+  /**
+   * Paces the self draws of all views with a single frame clock.
+   *
+   * Draw requests queued by the views are collected and rendered together in
+   * one pass per frame, at most at the maximum frame rate. If the main loop is
+   * too busy to render every frame, the missed frames are dropped instead of
+   * being rendered late in a burst. There is no timer when no view needs
+   * drawing.
+   */
+  class FrameScheduler {
+   public:
+    static FrameScheduler *Get() {
+      static FrameScheduler scheduler;
+      return &scheduler;
+    }
+
+    void SetMaxFrameRate(int fps) {
+      frame_interval_ = 1000 / std::max(1, std::min(fps, 1000));
+    }
+
+    uint64_t GetFrameInterval() const {
+      return frame_interval_;
+    }
+
+    uint64_t GetLastFrameTime() const {
+      return last_frame_time_;
+    }
+
+    bool IsQueued(Impl *client) const {
+      return std::find(queued_.begin(), queued_.end(), client) !=
+             queued_.end();
+    }
+
+    void Queue(Impl *client) {
+      if (!IsQueued(client))
+        queued_.push_back(client);
+      if (source_)
+        return;
+      uint64_t elapsed = GetCurrentTime() - last_frame_time_;
+      if (elapsed >= frame_interval_) {
+        // The clock was idle, so draw as soon as possible.
+        source_ = g_idle_add_full(GDK_PRIORITY_REDRAW, FrameHandler, this,
+                                  NULL);
+      } else {
+        source_ = g_timeout_add_full(
+            GDK_PRIORITY_REDRAW, static_cast<guint>(frame_interval_ - elapsed),
+            FrameHandler, this, NULL);
+      }
+    }
+
+    void Cancel(Impl *client) {
+      queued_.erase(std::remove(queued_.begin(), queued_.end(), client),
+                    queued_.end());
+      // The client may be destroyed during a frame.
+      std::replace(drawing_.begin(), drawing_.end(), client,
+                   static_cast<Impl *>(NULL));
+      if (queued_.empty() && source_) {
+        g_source_remove(source_);
+        source_ = 0;
+      }
+    }
+
+   private:
+    FrameScheduler()
+        : frame_interval_(1000 / kDefaultMaxFrameRate),
+          last_frame_time_(0),
+          source_(0) {
+    }
+
+    static gboolean FrameHandler(gpointer user_data);
+
+    std::vector<Impl *> queued_;
+    std::vector<Impl *> drawing_;
+    uint64_t frame_interval_;
+    uint64_t last_frame_time_;
+    guint source_;
+  };
+
   Impl(ViewInterface *view,
        ViewHostInterface *host, GtkWidget *widget,
        bool no_background)
@@ -95,8 +173,9 @@ class ViewWidgetBinder::Impl : public SmallObject<> {
       mouse_down_y_(-1),
       mouse_down_hittest_(ViewInterface::HT_CLIENT),
       self_draw_(false),
-      self_draw_timer_(0),
-      last_self_draw_time_(0),
+      draw_queued_time_(0),
+      frames_rendered_(0),
+      frames_dropped_(0),
       sys_clip_region_(NULL) {
     ASSERT(view);
     ASSERT(host);
@@ -151,10 +230,7 @@ class ViewWidgetBinder::Impl : public SmallObject<> {
   ~Impl() {
     view_ = NULL;
 
-    if (self_draw_timer_) {
-      g_source_remove(self_draw_timer_);
-      self_draw_timer_ = 0;
-    }
+    FrameScheduler::Get()->Cancel(this);
 
     if (sys_clip_region_) {
       gdk_region_destroy(sys_clip_region_);
@@ -322,6 +398,26 @@ class ViewWidgetBinder::Impl : public SmallObject<> {
     return region;
   }
 
+  void QueueDraw() {
+    FrameScheduler *scheduler = FrameScheduler::Get();
+    if (!scheduler->IsQueued(this))
+      draw_queued_time_ = GetCurrentTime();
+    scheduler->Queue(this);
+  }
+
+  // Draws the view in a frame of FrameScheduler, started at frame_time.
+  void DrawFrame(uint64_t frame_time) {
+    FrameScheduler *scheduler = FrameScheduler::Get();
+    uint64_t interval = scheduler->GetFrameInterval();
+    // The frame should have been drawn at the first frame after the
+    // request. Count the frames missed since then.
+    uint64_t expected_time = std::max(draw_queued_time_,
+        scheduler->GetLastFrameTime() + interval);
+    if (frame_time > expected_time)
+      frames_dropped_ += (frame_time - expected_time) / interval;
+    SelfDraw();
+  }
+
   void SelfDraw() {
     if (!widget_->window || !gdk_window_is_visible(widget_->window))
       return;
@@ -331,9 +427,9 @@ class ViewWidgetBinder::Impl : public SmallObject<> {
     if (!gdk_region_empty(region)) {
       gdk_window_invalidate_region(widget_->window, region, TRUE);
       gdk_window_process_updates(widget_->window, TRUE);
+      ++frames_rendered_;
     }
     gdk_region_destroy(region);
-    last_self_draw_time_ = GetCurrentTime();
     self_draw_ = false;
   }
 
@@ -532,11 +628,7 @@ class ViewWidgetBinder::Impl : public SmallObject<> {
       gdk_region_subtract(invalidate_region, event->region);
       if (!gdk_region_empty(invalidate_region)) {
         impl->AddGdkRegionToSystemClipRegion(invalidate_region);
-        if (!impl->self_draw_timer_) {
-          impl->self_draw_timer_ =
-              g_idle_add_full(GDK_PRIORITY_REDRAW, Impl::SelfDrawHandler,
-                              impl, NULL);
-        }
+        impl->QueueDraw();
       }
       gdk_region_destroy(invalidate_region);
     }
@@ -978,13 +1070,6 @@ class ViewWidgetBinder::Impl : public SmallObject<> {
     return FALSE;
   }
 
-  static gboolean SelfDrawHandler(gpointer user_data) {
-    Impl *impl = reinterpret_cast<Impl *>(user_data);
-    impl->self_draw_timer_ = 0;
-    impl->SelfDraw();
-    return FALSE;
-  }
-
   ViewInterface *view_;
   ViewHostInterface *host_;
   GtkWidget *widget_;
@@ -1015,8 +1100,9 @@ class ViewWidgetBinder::Impl : public SmallObject<> {
   ViewInterface::HitTest mouse_down_hittest_;
 
   bool self_draw_;
-  guint self_draw_timer_;
-  uint64_t last_self_draw_time_;
+  uint64_t draw_queued_time_;
+  uint64_t frames_rendered_;
+  uint64_t frames_dropped_;
   GdkRegion *sys_clip_region_;
 
   struct EventHandlerInfo {
@@ -1057,6 +1143,32 @@ ViewWidgetBinder::Impl::kEventHandlers[] = {
 const size_t ViewWidgetBinder::Impl::kEventHandlersNum =
   arraysize(ViewWidgetBinder::Impl::kEventHandlers);
 
+gboolean ViewWidgetBinder::Impl::FrameScheduler::FrameHandler(
+    gpointer user_data) {
+  FrameScheduler *self = reinterpret_cast<FrameScheduler *>(user_data);
+  self->source_ = 0;
+  uint64_t frame_time = GetCurrentTime();
+
+  // Draws queued during this frame, e.g. by animations, go to the next one.
+  ASSERT(self->drawing_.empty());
+  self->drawing_.swap(self->queued_);
+  for (size_t i = 0; i < self->drawing_.size(); ++i) {
+    if (self->drawing_[i])
+      self->drawing_[i]->DrawFrame(frame_time);
+  }
+  self->drawing_.clear();
+
+  // If drawing took longer than a frame, the next frame is scheduled a full
+  // interval later, dropping the frames in between.
+  self->last_frame_time_ = GetCurrentTime();
+  if (!self->queued_.empty() && !self->source_) {
+    self->source_ = g_timeout_add_full(
+        GDK_PRIORITY_REDRAW, static_cast<guint>(self->frame_interval_),
+        FrameHandler, self, NULL);
+  }
+  return FALSE;
+}
+
 ViewWidgetBinder::ViewWidgetBinder(ViewInterface *view,
                                    ViewHostInterface *host, GtkWidget *widget,
                                    bool no_background)
@@ -1088,32 +1200,27 @@ ViewWidgetBinder::~ViewWidgetBinder() {
 }
 
 void ViewWidgetBinder::QueueDraw() {
-  if (!impl_->self_draw_timer_) {
-    uint64_t current_time = GetCurrentTime();
-    if (current_time - impl_->last_self_draw_time_ >= kSelfDrawInterval) {
-      impl_->self_draw_timer_ =
-          g_idle_add_full(GDK_PRIORITY_REDRAW, Impl::SelfDrawHandler,
-                          impl_, NULL);
-    } else {
-      impl_->self_draw_timer_ =
-          g_timeout_add(kSelfDrawInterval -
-                        (current_time - impl_->last_self_draw_time_),
-                        Impl::SelfDrawHandler, impl_);
-    }
-  }
+  impl_->QueueDraw();
 }
 
 void ViewWidgetBinder::DrawImmediately() {
   // Remove pending queue draw, as we don't need it anymore.
-  if (impl_->self_draw_timer_) {
-    g_source_remove(impl_->self_draw_timer_);
-    impl_->self_draw_timer_ = 0;
-  }
+  Impl::FrameScheduler::Get()->Cancel(impl_);
   impl_->SelfDraw();
 }
 
 bool ViewWidgetBinder::DrawQueued() {
-  return impl_->self_draw_timer_ != 0;
+  return Impl::FrameScheduler::Get()->IsQueued(impl_);
+}
+
+void ViewWidgetBinder::GetFrameStats(uint64_t *rendered,
+                                     uint64_t *dropped) const {
+  if (rendered) *rendered = impl_->frames_rendered_;
+  if (dropped) *dropped = impl_->frames_dropped_;
+}
+
+void ViewWidgetBinder::SetMaxFrameRate(int fps) {
+  Impl::FrameScheduler::Get()->SetMaxFrameRate(fps);
 }
 
 } // namespace gtk
@@ -63,6 +63,21 @@ class ViewWidgetBinder {
   /** Redraws the gadget immediately. */
   void DrawImmediately();
 
+  /**
+   * Gets the frame statistics of the view, for performance tuning.
+   *
+   * @param[out] rendered number of frames rendered.
+   * @param[out] dropped number of frames skipped because the main loop was
+   *     too busy to render them in time.
+   */
+  void GetFrameStats(uint64_t *rendered, uint64_t *dropped) const;
+
+  /**
+   * Sets the maximum frame rate of all views. Draw requests of all views are
+   * rendered together once per frame. The default is 25 frames per second.
+   */
+  static void SetMaxFrameRate(int fps);
+
  private:
   DISALLOW_EVIL_CONSTRUCTORS(ViewWidgetBinder);
   class Impl;
@@ -0,0 +1,471 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <map>
+
+#include "http_cache.h"
+#include "digest_utils.h"
+#include "file_manager_factory.h"
+#include "file_manager_interface.h"
+#include "format_macros.h"
+#include "logger.h"
+#include "slot.h"
+#include "small_object.h"
+#include "string_utils.h"
+#include "system_file_functions.h"
+#include "xml_http_request_utils.h"
+
+namespace ggadget {
+
+// Directory in the file manager to store cached responses.
+static const char kCacheDir[] = "profile://http_cache/";
+// Upper limit of the total size of responses cached in memory.
+static const size_t kMaxMemoryBytes = 4 * 1024 * 1024;
+// Responses bigger than this are not cached.
+static const size_t kMaxResponseBytes = 1024 * 1024;
+// Upper limit of the number of responses persisted in the file manager.
+static const size_t kMaxDiskEntries = 512;
+// Upper limit of the total size of responses persisted in the file manager.
+static const size_t kMaxDiskBytes = 16 * 1024 * 1024;
+// Persisted responses that haven't been used for this long are removed.
+static const uint64_t kMaxDiskIdleTime = 7 * 86400 * 1000ULL;
+// Version tag of the persisted response format.
+static const char kDiskFormatVersion[] = "GGLHTTPCACHE1";
+
+class HttpCache::Impl : public SmallObject<> {
+ public:
+  struct Entry {
+    Entry() : expires(0) { }
+    Response response;
+    std::string etag;
+    std::string last_modified;
+    // When the response becomes stale, in milliseconds.
+    uint64_t expires;
+  };
+
+  typedef std::list<std::string> LRUList;
+  struct MemoryEntry {
+    Entry entry;
+    LRUList::iterator lru;
+  };
+  typedef std::map<std::string, MemoryEntry> EntryMap;
+
+  Impl(FileManagerInterface *file_manager)
+      : file_manager_(file_manager),
+        memory_bytes_(0),
+        disk_entries_(0),
+        disk_bytes_(0),
+        lookups_(0),
+        hits_(0),
+        revalidations_(0),
+        disk_pruned_(false) {
+  }
+
+  static size_t GetEntrySize(const Entry &entry) {
+    return entry.response.headers.size() + entry.response.body.size() +
+           entry.response.effective_url.size();
+  }
+
+  static std::string GetHeader(const CaseInsensitiveStringMap &headers,
+                               const char *name) {
+    CaseInsensitiveStringMap::const_iterator it = headers.find(name);
+    return it == headers.end() ? std::string() : it->second;
+  }
+
+  // Checks if a comma separated header value contains a directive, and
+  // returns the value of the directive if any.
+  static bool FindDirective(const std::string &header, const char *name,
+                            std::string *value) {
+    StringVector directives;
+    SplitStringList(header, ",", &directives);
+    for (StringVector::const_iterator it = directives.begin();
+         it != directives.end(); ++it) {
+      std::string directive = TrimString(*it);
+      std::string::size_type eq = directive.find('=');
+      std::string directive_name = TrimString(directive.substr(0, eq));
+      if (strcasecmp(directive_name.c_str(), name) == 0) {
+        if (value) {
+          *value = eq == std::string::npos ? std::string() :
+                   TrimString(directive.substr(eq + 1));
+        }
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Updates the freshness and validators of an entry from the response
+  // headers. Returns false if the headers forbid caching. has_freshness
+  // tells if the headers specify the freshness lifetime.
+  static bool UpdateEntryFromHeaders(const std::string &raw_headers,
+                                     uint64_t now, Entry *entry,
+                                     bool *has_freshness) {
+    CaseInsensitiveStringMap headers;
+    std::string content_type, encoding;
+    ParseResponseHeaders(raw_headers, &headers, &content_type, &encoding);
+
+    std::string cache_control = GetHeader(headers, "Cache-Control");
+    if (FindDirective(cache_control, "no-store", NULL))
+      return false;
+    std::string vary = GetHeader(headers, "Vary");
+    if (!vary.empty() && strcasecmp(vary.c_str(), "Accept-Encoding") != 0)
+      return false;
+
+    std::string etag = GetHeader(headers, "ETag");
+    std::string last_modified = GetHeader(headers, "Last-Modified");
+    if (!etag.empty())
+      entry->etag = etag;
+    if (!last_modified.empty())
+      entry->last_modified = last_modified;
+
+    *has_freshness = false;
+    int64_t lifetime = 0;
+    std::string max_age;
+    if (FindDirective(cache_control, "no-cache", NULL) ||
+        FindDirective(GetHeader(headers, "Pragma"), "no-cache", NULL)) {
+      // Must be revalidated on every use.
+      *has_freshness = true;
+    } else if (FindDirective(cache_control, "max-age", &max_age)) {
+      *has_freshness = true;
+      lifetime = strtol(max_age.c_str(), NULL, 10) * 1000LL;
+    } else if (headers.find("Expires") != headers.end()) {
+      // An invalid Expires header, e.g. "0", means already expired.
+      *has_freshness = true;
+      uint64_t expires = 0, date = 0;
+      if (ParseHTTPDate(GetHeader(headers, "Expires").c_str(), &expires)) {
+        if (!ParseHTTPDate(GetHeader(headers, "Date").c_str(), &date))
+          date = now;
+        lifetime = static_cast<int64_t>(expires) - static_cast<int64_t>(date);
+      }
+    }
+    if (*has_freshness) {
+      std::string age = GetHeader(headers, "Age");
+      if (!age.empty())
+        lifetime -= strtol(age.c_str(), NULL, 10) * 1000LL;
+      entry->expires = lifetime > 0 ? now + lifetime : 0;
+    }
+    return true;
+  }
+
+  // Checks if an entry is worth storing, i.e. it's fresh or can be
+  // revalidated.
+  static bool IsUseful(const Entry &entry, uint64_t now) {
+    return entry.expires > now || !entry.etag.empty() ||
+           !entry.last_modified.empty();
+  }
+
+  static std::string GetFileName(const std::string &url) {
+    std::string digest, name;
+    GenerateSHA1(url, &digest);
+    WebSafeEncodeBase64(digest, false, &name);
+    return kCacheDir + name;
+  }
+
+  static void AppendField(const std::string &field, std::string *data) {
+    StringAppendPrintf(data, "%" PRIuS "\n", field.size());
+    data->append(field);
+  }
+
+  static bool ReadField(const std::string &data, size_t *pos,
+                        std::string *field) {
+    std::string::size_type eol = data.find('\n', *pos);
+    if (eol == std::string::npos)
+      return false;
+    size_t size = static_cast<size_t>(strtoul(data.c_str() + *pos, NULL, 10));
+    if (eol + 1 + size > data.size())
+      return false;
+    field->assign(data, eol + 1, size);
+    *pos = eol + 1 + size;
+    return true;
+  }
+
+  static std::string SerializeEntry(const std::string &url,
+                                    const Entry &entry) {
+    std::string data;
+    AppendField(kDiskFormatVersion, &data);
+    AppendField(url, &data);
+    AppendField(StringPrintf("%u", entry.response.status), &data);
+    AppendField(StringPrintf("%" PRIu64, entry.expires), &data);
+    AppendField(entry.etag, &data);
+    AppendField(entry.last_modified, &data);
+    AppendField(entry.response.status_text, &data);
+    AppendField(entry.response.effective_url, &data);
+    AppendField(entry.response.headers, &data);
+    AppendField(entry.response.body, &data);
+    return data;
+  }
+
+  static bool DeserializeEntry(const std::string &url, const std::string &data,
+                               Entry *entry) {
+    size_t pos = 0;
+    std::string version, stored_url, status, expires;
+    if (!ReadField(data, &pos, &version) || version != kDiskFormatVersion ||
+        !ReadField(data, &pos, &stored_url) || stored_url != url ||
+        !ReadField(data, &pos, &status) ||
+        !ReadField(data, &pos, &expires) ||
+        !ReadField(data, &pos, &entry->etag) ||
+        !ReadField(data, &pos, &entry->last_modified) ||
+        !ReadField(data, &pos, &entry->response.status_text) ||
+        !ReadField(data, &pos, &entry->response.effective_url) ||
+        !ReadField(data, &pos, &entry->response.headers) ||
+        !ReadField(data, &pos, &entry->response.body))
+      return false;
+    entry->response.status =
+        static_cast<unsigned short>(strtoul(status.c_str(), NULL, 10));
+    entry->expires = strtoull(expires.c_str(), NULL, 10);
+    return true;
+  }
+
+  bool CollectDiskFile(const char *name, std::vector<std::string> *files) {
+    files->push_back(std::string(kCacheDir) + name);
+    return true;
+  }
+
+  size_t GetDiskFileSize(const std::string &file) {
+    std::string path, data;
+    StatStruct stat_value;
+    if (file_manager_->IsDirectlyAccessible(file.c_str(), &path) &&
+        ggadget::stat(path.c_str(), &stat_value) == 0)
+      return static_cast<size_t>(stat_value.st_size);
+    file_manager_->ReadFile(file.c_str(), &data);
+    return data.size();
+  }
+
+  // Removes persisted responses that haven't been used for a long time, and
+  // the least recently used ones if there are too many or they are too big.
+  void PruneDisk(uint64_t now) {
+    disk_pruned_ = true;
+    std::vector<std::string> files;
+    file_manager_->EnumerateFiles(
+        kCacheDir, NewSlot(this, &Impl::CollectDiskFile, &files));
+
+    typedef std::multimap<uint64_t, std::pair<std::string, size_t> >
+        FileTimeMap;
+    FileTimeMap files_by_time;
+    disk_bytes_ = 0;
+    for (size_t i = 0; i < files.size(); ++i) {
+      uint64_t time = file_manager_->GetLastModifiedTime(files[i].c_str());
+      if (time + kMaxDiskIdleTime < now) {
+        file_manager_->RemoveFile(files[i].c_str());
+      } else {
+        size_t size = GetDiskFileSize(files[i]);
+        files_by_time.insert(
+            std::make_pair(time, std::make_pair(files[i], size)));
+        disk_bytes_ += size;
+      }
+    }
+    while (files_by_time.size() > kMaxDiskEntries ||
+           disk_bytes_ > kMaxDiskBytes) {
+      FileTimeMap::iterator oldest = files_by_time.begin();
+      file_manager_->RemoveFile(oldest->second.first.c_str());
+      disk_bytes_ -= oldest->second.second;
+      files_by_time.erase(oldest);
+    }
+    disk_entries_ = files_by_time.size();
+  }
+
+  void WriteDiskEntry(const std::string &url, const Entry &entry,
+                      uint64_t now) {
+    if (!disk_pruned_)
+      PruneDisk(now);
+    std::string data = SerializeEntry(url, entry);
+    if (!file_manager_->WriteFile(GetFileName(url).c_str(), data, true))
+      return;
+    // Overwritten files are counted twice, so the budget is checked
+    // conservatively until the next pruning recounts.
+    disk_entries_++;
+    disk_bytes_ += data.size();
+    if (disk_entries_ > kMaxDiskEntries || disk_bytes_ > kMaxDiskBytes)
+      PruneDisk(now);
+  }
+
+  void EvictMemory() {
+    while (memory_bytes_ > kMaxMemoryBytes && !lru_.empty()) {
+      EntryMap::iterator it = entries_.find(lru_.back());
+      ASSERT(it != entries_.end());
+      memory_bytes_ -= GetEntrySize(it->second.entry);
+      entries_.erase(it);
+      lru_.pop_back();
+    }
+  }
+
+  void RemoveFromMemory(const std::string &url) {
+    EntryMap::iterator it = entries_.find(url);
+    if (it != entries_.end()) {
+      memory_bytes_ -= GetEntrySize(it->second.entry);
+      lru_.erase(it->second.lru);
+      entries_.erase(it);
+    }
+  }
+
+  void PutEntry(const std::string &url, const Entry &entry, bool persist,
+                uint64_t now) {
+    RemoveFromMemory(url);
+    lru_.push_front(url);
+    MemoryEntry *memory_entry = &entries_[url];
+    memory_entry->entry = entry;
+    memory_entry->lru = lru_.begin();
+    memory_bytes_ += GetEntrySize(entry);
+    EvictMemory();
+
+    if (persist && file_manager_)
+      WriteDiskEntry(url, entry, now);
+  }
+
+  // Finds an entry in memory, or loads it from the file manager.
+  Entry *GetEntry(const std::string &url, uint64_t now) {
+    EntryMap::iterator it = entries_.find(url);
+    if (it != entries_.end()) {
+      lru_.splice(lru_.begin(), lru_, it->second.lru);
+      return &it->second.entry;
+    }
+
+    if (!file_manager_)
+      return NULL;
+    if (!disk_pruned_)
+      PruneDisk(now);
+
+    std::string data;
+    Entry entry;
+    if (!file_manager_->ReadFile(GetFileName(url).c_str(), &data) ||
+        !DeserializeEntry(url, data, &entry))
+      return NULL;
+    PutEntry(url, entry, false, now);
+    it = entries_.find(url);
+    return it == entries_.end() ? NULL : &it->second.entry;
+  }
+
+  FileManagerInterface *file_manager_;
+  EntryMap entries_;
+  LRUList lru_;
+  size_t memory_bytes_;
+  size_t disk_entries_;
+  size_t disk_bytes_;
+  size_t lookups_;
+  size_t hits_;
+  size_t revalidations_;
+  bool disk_pruned_;
+};
+
+HttpCache::HttpCache(FileManagerInterface *file_manager)
+    : impl_(new Impl(file_manager)) {
+}
+
+HttpCache::~HttpCache() {
+  delete impl_;
+  impl_ = NULL;
+}
+
+HttpCache::LookupResult HttpCache::Lookup(const std::string &url,
+                                          uint64_t now, Response *response,
+                                          std::string *etag,
+                                          std::string *last_modified) {
+  ASSERT(response && etag && last_modified);
+  impl_->lookups_++;
+  etag->clear();
+  last_modified->clear();
+  Impl::Entry *entry = impl_->GetEntry(url, now);
+  if (!entry)
+    return MISS;
+
+  *response = entry->response;
+  if (now < entry->expires) {
+    impl_->hits_++;
+    return FRESH;
+  }
+  if (entry->etag.empty() && entry->last_modified.empty()) {
+    Remove(url);
+    return MISS;
+  }
+  *etag = entry->etag;
+  *last_modified = entry->last_modified;
+  return STALE;
+}
+
+bool HttpCache::Store(const std::string &url, const Response &response,
+                      uint64_t now) {
+  Impl::Entry entry;
+  entry.response = response;
+  bool has_freshness = false;
+  if (response.status != 200 ||
+      Impl::GetEntrySize(entry) > kMaxResponseBytes ||
+      !Impl::UpdateEntryFromHeaders(response.headers, now, &entry,
+                                    &has_freshness) ||
+      !Impl::IsUseful(entry, now)) {
+    Remove(url);
+    return false;
+  }
+  impl_->PutEntry(url, entry, true, now);
+  return true;
+}
+
+bool HttpCache::Refresh(const std::string &url, const std::string &headers,
+                        uint64_t now, Response *response) {
+  ASSERT(response);
+  Impl::Entry *entry = impl_->GetEntry(url, now);
+  if (!entry)
+    return false;
+
+  Impl::Entry refreshed = *entry;
+  bool has_freshness = false;
+  if (!Impl::UpdateEntryFromHeaders(headers, now, &refreshed,
+                                    &has_freshness)) {
+    // The server doesn't allow the response to be cached any longer, but
+    // it's still valid for this request.
+    *response = refreshed.response;
+    Remove(url);
+    impl_->revalidations_++;
+    return true;
+  }
+  if (!has_freshness) {
+    // The 304 response omitted the freshness information, so the original
+    // one applies again from now. Keep the validators of the 304 response.
+    std::string etag = refreshed.etag, last_modified = refreshed.last_modified;
+    Impl::UpdateEntryFromHeaders(entry->response.headers, now, &refreshed,
+                                 &has_freshness);
+    refreshed.etag = etag;
+    refreshed.last_modified = last_modified;
+  }
+  impl_->revalidations_++;
+  *response = refreshed.response;
+  impl_->PutEntry(url, refreshed, true, now);
+  return true;
+}
+
+void HttpCache::Remove(const std::string &url) {
+  impl_->RemoveFromMemory(url);
+  if (impl_->file_manager_)
+    impl_->file_manager_->RemoveFile(Impl::GetFileName(url).c_str());
+}
+
+void HttpCache::GetStats(size_t *lookups, size_t *hits,
+                         size_t *revalidations) const {
+  if (lookups) *lookups = impl_->lookups_;
+  if (hits) *hits = impl_->hits_;
+  if (revalidations) *revalidations = impl_->revalidations_;
+}
+
+HttpCache *GetGlobalHttpCache() {
+  static HttpCache *cache = NULL;
+  if (!cache)
+    cache = new HttpCache(GetGlobalFileManager());
+  return cache;
+}
+
+} // namespace ggadget
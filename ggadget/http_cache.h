@@ -0,0 +1,132 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#ifndef GGADGET_HTTP_CACHE_H__
+#define GGADGET_HTTP_CACHE_H__
+
+#include <string>
+#include <ggadget/common.h>
+
+namespace ggadget {
+
+class FileManagerInterface;
+
+/**
+ * @ingroup Utilities
+ *
+ * A cache of HTTP GET responses shared by all XMLHttpRequest objects.
+ *
+ * Responses are kept in memory with a byte budget, and are also saved into
+ * the file manager, if specified, so that they survive restarts.
+ *
+ * Only responses with explicit freshness information (Cache-Control: max-age
+ * or Expires) or validators (ETag or Last-Modified) are stored. Stale
+ * responses with validators can be revalidated with conditional requests.
+ */
+class HttpCache {
+ public:
+  /** A cached response. */
+  struct Response {
+    Response() : status(0) { }
+    unsigned short status;
+    std::string status_text;
+    /** All response headers, without the status line. */
+    std::string headers;
+    std::string body;
+    std::string effective_url;
+  };
+
+  enum LookupResult {
+    /** No cached response. */
+    MISS,
+    /** The cached response can be used directly. */
+    FRESH,
+    /** The cached response must be revalidated before being used. */
+    STALE,
+  };
+
+  /**
+   * @param file_manager the file manager used to persist responses, e.g. the
+   *     global file manager with "profile://" prefix support. If it's @c NULL,
+   *     responses are only cached in memory.
+   */
+  explicit HttpCache(FileManagerInterface *file_manager);
+  ~HttpCache();
+
+  /**
+   * Looks up the cached response of a url.
+   *
+   * @param url the request url.
+   * @param now current time in milliseconds.
+   * @param[out] response the cached response, if any.
+   * @param[out] etag the ETag validator of a STALE response, or empty.
+   * @param[out] last_modified the Last-Modified validator of a STALE
+   *     response, or empty.
+   */
+  LookupResult Lookup(const std::string &url, uint64_t now,
+                      Response *response, std::string *etag,
+                      std::string *last_modified);
+
+  /**
+   * Stores a successful response of a GET request, if its headers allow it
+   * to be cached. Otherwise any old response of the url is removed.
+   *
+   * @return @c true if the response is stored.
+   */
+  bool Store(const std::string &url, const Response &response, uint64_t now);
+
+  /**
+   * Refreshes a stale response after the server answered a conditional
+   * request with 304 Not Modified.
+   *
+   * @param url the request url.
+   * @param headers headers of the 304 response, which may update the
+   *     freshness and validators of the cached response.
+   * @param now current time in milliseconds.
+   * @param[out] response the refreshed response.
+   * @return @c false if there is no cached response for the url.
+   */
+  bool Refresh(const std::string &url, const std::string &headers,
+               uint64_t now, Response *response);
+
+  /** Removes the cached response of a url. */
+  void Remove(const std::string &url);
+
+  /**
+   * Gets the statistics of the cache.
+   *
+   * @param[out] lookups number of calls of Lookup().
+   * @param[out] hits number of lookups returned FRESH.
+   * @param[out] revalidations number of stale responses that were refreshed
+   *     by 304 responses.
+   */
+  void GetStats(size_t *lookups, size_t *hits, size_t *revalidations) const;
+
+ private:
+  class Impl;
+  Impl *impl_;
+  DISALLOW_EVIL_CONSTRUCTORS(HttpCache);
+};
+
+/**
+ * Gets the HttpCache shared by all XMLHttpRequest objects. It's created on
+ * first use, with the global file manager.
+ */
+HttpCache *GetGlobalHttpCache();
+
+} // namespace ggadget
+
+#endif // GGADGET_HTTP_CACHE_H__
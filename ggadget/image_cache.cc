@@ -14,16 +14,23 @@
   limitations under the License.
 */
 
+#include <cstring>
 #include <string>
+#include <list>
 #include <map>
+#include <vector>
 #include <algorithm>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
 #include "common.h"
 #include "file_manager_factory.h"
 #include "format_macros.h"
 #include "graphics_interface.h"
 #include "image_cache.h"
 #include "logger.h"
-#include "main_loop_interface.h"
 #include "small_object.h"
 #include "system_utils.h"
 
@@ -37,16 +44,59 @@
 
 namespace {
 
-const int kPurgeTrashInterval = 60000;  // 60 seconds
+// Default capacity of the unused images kept for reuse, in bytes.
+const size_t kDefaultCapacity = 16 * 1024 * 1024;
+// Estimated bytes of an image besides its pixels.
+const size_t kImageOverheadBytes = 256;
 
 }  // namespace
 
 namespace ggadget {
 
-class ImageCache::Impl : public WatchCallbackInterface {
+class ImageCache::Impl {
   class SharedImage;
   typedef LightMap<std::string, SharedImage *> ImageMap;
-  typedef LightMap<std::string, ImageInterface *> TrashImageMap;
+
+  // An unused image kept for reuse.
+  struct TrashEntry {
+    std::string key;
+    ImageInterface *image;
+    size_t bytes;
+    bool is_mask;
+  };
+  // Trashed images, the least recently trashed first.
+  typedef std::list<TrashEntry> TrashList;
+  typedef LightMap<std::string, TrashList::iterator> TrashImageMap;
+
+  enum PreloadState {
+    // Queued but not picked by any thread yet.
+    PRELOAD_PENDING,
+    // Being read and decoded by a background thread.
+    PRELOAD_LOADING,
+    // Read by a background thread, and decoded if the graphics allows.
+    PRELOAD_DONE
+  };
+
+  // An image being loaded in background.
+  struct PreloadEntry {
+    PreloadEntry() : state(PRELOAD_PENDING), read(false), image(NULL) { }
+    std::string filename;
+    PreloadState state;
+    bool read;
+    // The decoded image, or NULL if it should be decoded in the main thread.
+    ImageInterface *image;
+    // The image data if the image is not decoded yet.
+    std::string data;
+  };
+  typedef std::map<std::string, PreloadEntry> PreloadMap;
+
+  struct PreloadThread {
+    Impl *owner;
+    FileManagerInterface *reader;
+#ifdef HAVE_PTHREAD
+    pthread_t thread;
+#endif
+  };
 
   class SharedImage : public ImageInterface {
    public:
@@ -137,7 +187,9 @@ class ImageCache::Impl : public WatchCallbackInterface {
   };
 
  public:
-  Impl() : ref_(0), watch_id_(-1) {
+  Impl()
+      : ref_(0), trash_bytes_(0), capacity_(kDefaultCapacity),
+        preload_gfx_(NULL), next_preload_(0), stopping_(false) {
 #ifdef DEBUG_IMAGE_CACHE
     DLOG("Create ImageCache: %p", this);
     num_new_local_images_ = 0;
@@ -147,15 +199,15 @@ class ImageCache::Impl : public WatchCallbackInterface {
     num_trashed_images_ = 0;
     num_untrashed_images_ = 0;
 #endif
-    MainLoopInterface *main_loop = GetGlobalMainLoop();
-    if (main_loop)
-      watch_id_ = main_loop->AddTimeoutWatch(kPurgeTrashInterval, this);
+    memset(&stats_, 0, sizeof(stats_));
+#ifdef HAVE_PTHREAD
+    pthread_mutex_init(&mutex_, NULL);
+    pthread_cond_init(&cond_, NULL);
+#endif
   }
 
   ~Impl() {
-    MainLoopInterface *main_loop = GetGlobalMainLoop();
-    if (main_loop)
-      main_loop->RemoveWatch(watch_id_);
+    StopPreload();
 
 #ifdef DEBUG_IMAGE_CACHE
     DLOG("Delete ImageCache: %p", this);
@@ -181,19 +233,22 @@ class ImageCache::Impl : public WatchCallbackInterface {
     }
 
     PurgeTrashCan();
+#ifdef HAVE_PTHREAD
+    pthread_cond_destroy(&cond_);
+    pthread_mutex_destroy(&mutex_);
+#endif
   }
 
-  // Overridden from WatchCallbackInterface:
-  virtual bool Call(MainLoopInterface *main_loop, int watch_id) {
-    GGL_UNUSED(main_loop);
-    GGL_UNUSED(watch_id);
-    PurgeTrashCan();
-    return true;
+  void Lock() {
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock(&mutex_);
+#endif
   }
 
-  virtual void OnRemove(MainLoopInterface *main_loop, int watch_id) {
-    GGL_UNUSED(main_loop);
-    GGL_UNUSED(watch_id);
+  void Unlock() {
+#ifdef HAVE_PTHREAD
+    pthread_mutex_unlock(&mutex_);
+#endif
   }
 
   ImageInterface *LoadImage(GraphicsInterface *gfx, FileManagerInterface *fm,
@@ -216,6 +271,7 @@ class ImageCache::Impl : public WatchCallbackInterface {
         num_shared_local_images_++;
         DLOG("Local image %s found in cache.", local_key.c_str());
 #endif
+        stats_.hits++;
         it->second->Ref();
         return it->second;
       }
@@ -229,6 +285,7 @@ class ImageCache::Impl : public WatchCallbackInterface {
         num_shared_global_images_++;
         DLOG("Global image %s found in cache.", global_key.c_str());
 #endif
+        stats_.hits++;
         it->second->Ref();
         return it->second;
       }
@@ -240,15 +297,26 @@ class ImageCache::Impl : public WatchCallbackInterface {
     // Find the image in trash can first.
     if (fm) {
       img = Untrash(local_key, is_mask);
-      if (img)
+      if (img) {
+        stats_.hits++;
         return NewSharedImage(local_key, filename, img, is_mask);
+      }
     }
     if (global_fm) {
       img = Untrash(global_key, is_mask);
-      if (img)
+      if (img) {
+        stats_.hits++;
         return NewSharedImage(global_key, filename, img, is_mask);
+      }
+    }
+
+    // Then the images being loaded in background.
+    if (fm && !is_mask && TakePreloadedImage(gfx, local_key, &img)) {
+      stats_.preload_hits++;
+      return NewSharedImage(local_key, filename, img, is_mask);
     }
 
+    stats_.misses++;
     std::string data;
     std::string key;
     if (fm && fm->ReadFile(filename.c_str(), &data)) {
@@ -294,6 +362,12 @@ class ImageCache::Impl : public WatchCallbackInterface {
     return shared_img;
   }
 
+  static size_t GetImageBytes(ImageInterface *image, bool is_mask) {
+    double pixels = image->GetWidth() * image->GetHeight();
+    return static_cast<size_t>(pixels) * (is_mask ? 1 : 4) +
+           kImageOverheadBytes;
+  }
+
   void Trash(const std::string &key, ImageInterface *image, bool is_mask) {
     ImageMap *images = is_mask ? &mask_images_ : &images_;
     images->erase(key);
@@ -307,7 +381,14 @@ class ImageCache::Impl : public WatchCallbackInterface {
 #endif
     TrashImageMap *trash = is_mask ? &trashed_mask_images_ : &trashed_images_;
     ASSERT(!trash->count(key));
-    (*trash)[key] = image;
+    TrashEntry entry;
+    entry.key = key;
+    entry.image = image;
+    entry.bytes = GetImageBytes(image, is_mask);
+    entry.is_mask = is_mask;
+    (*trash)[key] = trash_list_.insert(trash_list_.end(), entry);
+    trash_bytes_ += entry.bytes;
+    EvictTrash();
   }
 
   ImageInterface* Untrash(const std::string &key, bool is_mask) {
@@ -318,31 +399,218 @@ class ImageCache::Impl : public WatchCallbackInterface {
       DLOG("Untrash image: %s", key.c_str());
       num_untrashed_images_++;
 #endif
-      ImageInterface *image = i->second;
+      ImageInterface *image = i->second->image;
+      trash_bytes_ -= i->second->bytes;
+      trash_list_.erase(i->second);
       trash->erase(i);
       return image;
     }
     return NULL;
   }
 
+  // Destroys the least recently trashed images until the trashed images fit
+  // in the capacity.
+  void EvictTrash() {
+    while (trash_bytes_ > capacity_ && !trash_list_.empty()) {
+      TrashEntry &entry = trash_list_.front();
+#ifdef DEBUG_IMAGE_CACHE
+      DLOG("Evict image: %s", entry.key.c_str());
+#endif
+      TrashImageMap *trash =
+          entry.is_mask ? &trashed_mask_images_ : &trashed_images_;
+      trash->erase(entry.key);
+      trash_bytes_ -= entry.bytes;
+      entry.image->Destroy();
+      trash_list_.pop_front();
+      stats_.evictions++;
+    }
+  }
+
   void PurgeTrashCan() {
 #ifdef DEBUG_IMAGE_CACHE
-    DLOG("Purge trashed images: %"PRIuS,
-         trashed_images_.size() + trashed_mask_images_.size());
+    DLOG("Purge trashed images: %"PRIuS, trash_list_.size());
 #endif
-    for (TrashImageMap::const_iterator it = trashed_images_.begin();
-         it != trashed_images_.end(); ++it) {
-      if (it->second)
-        it->second->Destroy();
+    for (TrashList::const_iterator it = trash_list_.begin();
+         it != trash_list_.end(); ++it) {
+      it->image->Destroy();
     }
+    trash_list_.clear();
     trashed_images_.clear();
+    trashed_mask_images_.clear();
+    trash_bytes_ = 0;
+  }
+
+  void SetCapacity(size_t capacity) {
+    capacity_ = capacity;
+    EvictTrash();
+  }
 
-    for (TrashImageMap::const_iterator it = trashed_mask_images_.begin();
-         it != trashed_mask_images_.end(); ++it) {
-      if (it->second)
-        it->second->Destroy();
+  void GetStats(Stats *stats) {
+    Lock();
+    *stats = stats_;
+    Unlock();
+    stats->bytes = trash_bytes_;
+    stats->capacity = capacity_;
+  }
+
+  void PreloadImages(GraphicsInterface *gfx, FileManagerInterface *fm,
+                     const std::vector<std::string> &files,
+                     const std::vector<FileManagerInterface *> &readers) {
+    StopPreload();
+#ifdef HAVE_PTHREAD
+    if (gfx && fm) {
+      preload_gfx_ = gfx;
+      for (std::vector<std::string>::const_iterator it = files.begin();
+           it != files.end(); ++it) {
+        if (it->empty() || IsAbsolutePath(it->c_str()))
+          continue;
+        std::string key = fm->GetFullPath(it->c_str());
+        if (images_.count(key) || trashed_images_.count(key))
+          continue;
+        PreloadEntry &entry = preloads_[key];
+        if (entry.filename.empty()) {
+          entry.filename = *it;
+          preload_queue_.push_back(key);
+        }
+      }
     }
-    trashed_mask_images_.clear();
+
+    for (size_t i = 0; i < readers.size(); ++i) {
+      if (!readers[i])
+        continue;
+      if (preload_queue_.empty()) {
+        delete readers[i];
+        continue;
+      }
+      PreloadThread *thread = new PreloadThread;
+      thread->owner = this;
+      thread->reader = readers[i];
+      if (pthread_create(&thread->thread, NULL, PreloadThreadMain,
+                         thread) == 0) {
+        preload_threads_.push_back(thread);
+      } else {
+        LOG("Failed to start the image preload thread.");
+        delete readers[i];
+        delete thread;
+      }
+    }
+#else
+    GGL_UNUSED(gfx);
+    GGL_UNUSED(fm);
+    GGL_UNUSED(files);
+    for (size_t i = 0; i < readers.size(); ++i)
+      delete readers[i];
+#endif
+  }
+
+  void StopPreload() {
+#ifdef HAVE_PTHREAD
+    Lock();
+    stopping_ = true;
+    Unlock();
+    for (size_t i = 0; i < preload_threads_.size(); ++i) {
+      pthread_join(preload_threads_[i]->thread, NULL);
+      delete preload_threads_[i]->reader;
+      delete preload_threads_[i];
+    }
+    preload_threads_.clear();
+#endif
+    // Keeps the decoded images which have not been requested yet for reuse.
+    for (PreloadMap::iterator it = preloads_.begin();
+         it != preloads_.end(); ++it) {
+      ImageInterface *image = it->second.image;
+      if (!image)
+        continue;
+      if (images_.count(it->first) || trashed_images_.count(it->first))
+        image->Destroy();
+      else
+        Trash(it->first, image, false);
+    }
+    preloads_.clear();
+    preload_queue_.clear();
+    next_preload_ = 0;
+    stopping_ = false;
+    preload_gfx_ = NULL;
+  }
+
+#ifdef HAVE_PTHREAD
+  static void *PreloadThreadMain(void *arg) {
+    PreloadThread *thread = static_cast<PreloadThread *>(arg);
+    thread->owner->LoadQueuedImages(thread->reader);
+    return NULL;
+  }
+#endif
+
+  void LoadQueuedImages(FileManagerInterface *reader) {
+    Lock();
+    while (!stopping_ && next_preload_ < preload_queue_.size()) {
+      PreloadMap::iterator it =
+          preloads_.find(preload_queue_[next_preload_++]);
+      if (it == preloads_.end() || it->second.state != PRELOAD_PENDING)
+        continue;
+      // Entries are only erased by the main thread when they are not being
+      // loaded, so the iterator remains valid after the lock is released.
+      it->second.state = PRELOAD_LOADING;
+      Unlock();
+
+      std::string data;
+      ImageInterface *image = NULL;
+      bool read = reader->ReadFile(it->second.filename.c_str(), &data);
+      if (read && preload_gfx_->CanDecodeInThread(data, false)) {
+        image = preload_gfx_->NewImage(it->second.filename, data, false);
+        data.clear();
+      }
+
+      Lock();
+      it->second.state = PRELOAD_DONE;
+      it->second.read = read;
+      it->second.image = image;
+      it->second.data.swap(data);
+      if (image)
+        stats_.preloaded++;
+#ifdef HAVE_PTHREAD
+      pthread_cond_broadcast(&cond_);
+#endif
+    }
+    Unlock();
+  }
+
+  // Takes the image loaded in background. Returns false if the image is not
+  // preloaded, then it should be loaded as usual.
+  bool TakePreloadedImage(GraphicsInterface *gfx, const std::string &key,
+                          ImageInterface **image) {
+    if (preloads_.empty())
+      return false;
+
+    Lock();
+    PreloadMap::iterator it = preloads_.find(key);
+    if (it == preloads_.end()) {
+      Unlock();
+      return false;
+    }
+#ifdef HAVE_PTHREAD
+    while (it->second.state == PRELOAD_LOADING)
+      pthread_cond_wait(&cond_, &mutex_);
+#endif
+    bool read = it->second.read;
+    ImageInterface *preloaded = it->second.image;
+    std::string filename, data;
+    filename.swap(it->second.filename);
+    data.swap(it->second.data);
+    preloads_.erase(it);
+    Unlock();
+
+    if (preloaded) {
+      *image = preloaded;
+      return true;
+    }
+    if (read) {
+      *image = gfx->NewImage(filename, data, false);
+      return true;
+    }
+    // A pending file is loaded directly rather than waiting for its turn,
+    // and a failed read is redone as usual, which may report the error.
+    return false;
   }
 
   void Ref() {
@@ -391,11 +659,25 @@ class ImageCache::Impl : public WatchCallbackInterface {
   ImageMap images_;
   ImageMap mask_images_;
 
+  TrashList trash_list_;
   TrashImageMap trashed_images_;
   TrashImageMap trashed_mask_images_;
 
   int ref_;
-  int watch_id_;
+  size_t trash_bytes_;
+  size_t capacity_;
+  Stats stats_;
+
+  GraphicsInterface *preload_gfx_;
+  std::vector<PreloadThread *> preload_threads_;
+  PreloadMap preloads_;
+  std::vector<std::string> preload_queue_;
+  size_t next_preload_;
+  bool stopping_;
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t mutex_;
+  pthread_cond_t cond_;
+#endif
 
 #ifdef DEBUG_IMAGE_CACHE
   int num_new_local_images_;
@@ -430,4 +712,25 @@ ImageInterface *ImageCache::LoadImage(GraphicsInterface *gfx,
   return impl_->LoadImage(gfx, fm, filename, is_mask);
 }
 
+void ImageCache::PreloadImages(
+    GraphicsInterface *gfx, FileManagerInterface *fm,
+    const std::vector<std::string> &files,
+    const std::vector<FileManagerInterface *> &readers) {
+  impl_->PreloadImages(gfx, fm, files, readers);
+}
+
+void ImageCache::StopPreload() {
+  impl_->StopPreload();
+}
+
+void ImageCache::SetCapacity(size_t capacity) {
+  impl_->SetCapacity(capacity);
+}
+
+ImageCache::Stats ImageCache::GetStats() const {
+  Stats stats;
+  impl_->GetStats(&stats);
+  return stats;
+}
+
 } // namespace ggadget
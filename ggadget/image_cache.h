@@ -17,6 +17,8 @@
 #ifndef GGADGET_IMAGE_CACHE_H__
 #define GGADGET_IMAGE_CACHE_H__
 
+#include <string>
+#include <vector>
 #include <ggadget/graphics_interface.h>
 #include <ggadget/image_interface.h>
 #include <ggadget/file_manager_interface.h>
@@ -35,6 +37,11 @@ namespace ggadget {
  * used as normal image without any difference.
  *
  * Each View shall have its own ImageCache object.
+ *
+ * Images which are no longer used are kept for reuse, until their estimated
+ * size exceeds the capacity of the cache, then the least recently released
+ * ones are destroyed. All ImageCache objects in a thread share the same
+ * images, capacity and statistics.
  */
 class ImageCache {
  public:
@@ -54,6 +61,56 @@ class ImageCache {
   ImageInterface *LoadImage(GraphicsInterface *gfx, FileManagerInterface *fm,
                             const std::string &filename, bool is_mask);
 
+  /**
+   * Starts to read and decode images in background threads ahead of their
+   * use. A later @c LoadImage() call of a preloaded image takes the decoded
+   * image, or waits for it if it's being decoded. Images are only decoded in
+   * background if @c GraphicsInterface::CanDecodeInThread() allows, otherwise
+   * only their data is read in background. Mask images are not preloaded.
+   *
+   * @param gfx Graphics object used to create the images. It must remain
+   *     valid until the preload is stopped.
+   * @param fm FileManager object which will be passed to @c LoadImage().
+   * @param files File names of the images, relative to @c fm.
+   * @param readers FileManager objects to read the images in background, one
+   *     for each thread. They must refer to the same files as @c fm, and will
+   *     be destroyed when the preload is stopped.
+   */
+  void PreloadImages(GraphicsInterface *gfx, FileManagerInterface *fm,
+                     const std::vector<std::string> &files,
+                     const std::vector<FileManagerInterface *> &readers);
+
+  /**
+   * Stops the background threads. The decoded images which have not been
+   * loaded yet are kept in the cache as unused images.
+   */
+  void StopPreload();
+
+  /**
+   * Sets the capacity of the unused images kept for reuse, in bytes. The
+   * size of an image is estimated from its width and height.
+   */
+  void SetCapacity(size_t capacity);
+
+  /** Statistics of the cache, for profiling. */
+  struct Stats {
+    /** Number of @c LoadImage() calls served by cached images. */
+    size_t hits;
+    /** Number of @c LoadImage() calls served by preloaded images. */
+    size_t preload_hits;
+    /** Number of @c LoadImage() calls which read and decoded the image. */
+    size_t misses;
+    /** Number of images decoded in background threads. */
+    size_t preloaded;
+    /** Number of unused images destroyed to fit in the capacity. */
+    size_t evictions;
+    /** Estimated bytes of the unused images kept for reuse. */
+    size_t bytes;
+    /** Capacity of the unused images, in bytes. */
+    size_t capacity;
+  };
+  Stats GetStats() const;
+
  private:
   class Impl;
   Impl *impl_;
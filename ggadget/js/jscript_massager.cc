@@ -16,9 +16,15 @@
   limitations under the License.
 */
 
+#include <stdarg.h>
+#include <algorithm>
 #include <string>
 #include <vector>
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
 // The following includes are used in flex generated source. Because we use
 // namespaces, include them first to avoid namespace errors when these files
 // are included from flex generated source.
@@ -29,6 +35,7 @@
 #include <inttypes.h>
 
 #include <ggadget/logger.h>
+#include <ggadget/string_utils.h>
 
 // These macros make the '{' and '}' paired in flex source code.
 #define BEGIN_NS(ns) namespace ns {
@@ -40,7 +47,7 @@ BEGIN_NS(js)
 
 
 
-#line 44 "jscript_massager.cc"
+#line 49 "jscript_massager.cc"
 
 #define  YY_INT_ALIGNED short int
 
@@ -8649,29 +8656,35 @@ static int yy_more_len = 0;
 char *yytext;
 #line 1 "jscript_massager.l"
 
-#line 47 "jscript_massager.l"
+#line 52 "jscript_massager.l"
 
 #undef YY_INPUT
 #define YY_INPUT(a,b,c) (b = ScriptInput(a,c))
 
 static const char *input_script_pos = NULL;
+static const char *input_script_end = NULL;
 static bool new_line_appended = false;
 
+// Feeds the scanner with the script with '\r's removed. Characters between
+// '\r's are copied in blocks.
 static int ScriptInput(char *buf, int max_size) {
   int result = 0;
-  while (*input_script_pos && max_size > 0) {
-    if (*input_script_pos != '\r') {
-      max_size--;
-      result++;
-      *buf++ = *input_script_pos;
-    }
-    input_script_pos++;
+  while (input_script_pos < input_script_end && result < max_size) {
+    size_t size = std::min(static_cast<size_t>(max_size - result),
+                           static_cast<size_t>(input_script_end -
+                                               input_script_pos));
+    const char *cr = static_cast<const char *>(
+        memchr(input_script_pos, '\r', size));
+    if (cr)
+      size = cr - input_script_pos;
+    memcpy(buf + result, input_script_pos, size);
+    result += static_cast<int>(size);
+    input_script_pos += cr ? size + 1 : size;
   }
   // Append a '\n' if the file is not ended with a '\n'.
-  if (!new_line_appended && max_size > 0 &&
-      !*input_script_pos && input_script_pos[-1] != '\n') {
-    result++;
-    *buf++ = '\n';
+  if (!new_line_appended && result < max_size &&
+      input_script_pos == input_script_end && input_script_end[-1] != '\n') {
+    buf[result++] = '\n';
     new_line_appended = true;
   }
   return result;
@@ -8704,8 +8717,22 @@ struct StackEntry {
 static std::vector<StackEntry> stack;
 static const char *input_filename = NULL;
 static std::string output;
+static std::string warnings;
 static bool give_up = false;
 
+// Logs a warning about the script, and records it in warnings, so that the
+// cache can log it again when the massaged script is reused.
+static void Warn(const char *format, ...) PRINTF_ATTRIBUTE(1, 2);
+static void Warn(const char *format, ...) {
+  va_list ap;
+  va_start(ap, format);
+  std::string message = StringVPrintf(format, ap);
+  va_end(ap);
+  LOG("%s", message.c_str());
+  warnings += message;
+  warnings += '\n';
+}
+
 static StackEntry &GetStackTop() {
   ASSERT(!stack.empty());
   return *(stack.end() - 1);
@@ -8800,10 +8827,11 @@ static void PopState() {
         break;
     }
   }
-  std::string buffer = GetStackTop().buffer;
+  std::string buffer;
+  buffer.swap(GetStackTop().buffer);
   std::string left_functions = GetStackTop().function_decls;
   if (!left_functions.empty()) {
-    LOG("%s: File contains unpaired '(', '[' or '{'s.", input_filename);
+    Warn("%s: File contains unpaired '(', '[' or '{'s.", input_filename);
     buffer += left_functions;
   }
 
@@ -8815,8 +8843,8 @@ static void PopState() {
   if (state == FUNCTION_DECL && !stack.empty() && GetParenCount() > 1) {
     // This function is declared in inner block of another function.
     GetStackTop().function_decls += buffer;
-    LOG("%s:%d: Non-standard JScript grammar (function declared in"
-        " inner blocks): %s", input_filename, yylineno, buffer.c_str());
+    Warn("%s:%d: Non-standard JScript grammar (function declared in"
+         " inner blocks): %s", input_filename, yylineno, buffer.c_str());
   } else {
     ScriptOutput(buffer.c_str());
   }
@@ -8837,7 +8865,7 @@ static void CloseParen();
 
 
 
-#line 8841 "jscript_massager.cc"
+#line 8853 "jscript_massager.cc"
 
 #define INITIAL 0
 #define OPTIONS 1
@@ -9052,10 +9080,10 @@ YY_DECL
 	register int yy_act;
     
 /* %% [7.0] user's declarations go here */
-#line 245 "jscript_massager.l"
+#line 257 "jscript_massager.l"
 
 
-#line 9059 "jscript_massager.cc"
+#line 9071 "jscript_massager.cc"
 
 	if ( !(yy_init) )
 		{
@@ -9187,36 +9215,36 @@ do_action:	/* This label is used only to access EOF actions. */
 
 case 1:
 YY_RULE_SETUP
-#line 247 "jscript_massager.l"
+#line 259 "jscript_massager.l"
 ECHO;
 	YY_BREAK
 case 2:
 YY_RULE_SETUP
-#line 248 "jscript_massager.l"
+#line 260 "jscript_massager.l"
 ScriptOutput("  ");
 	YY_BREAK
 case 3:
 /* rule 3 can match eol */
 YY_RULE_SETUP
-#line 250 "jscript_massager.l"
+#line 262 "jscript_massager.l"
 ECHO;
 	YY_BREAK
 case 4:
 /* rule 4 can match eol */
 YY_RULE_SETUP
-#line 251 "jscript_massager.l"
+#line 263 "jscript_massager.l"
 ECHO;
 	YY_BREAK
 case 5:
 /* rule 5 can match eol */
 YY_RULE_SETUP
-#line 252 "jscript_massager.l"
+#line 264 "jscript_massager.l"
 ECHO;
 	YY_BREAK
 case 6:
 /* rule 6 can match eol */
 YY_RULE_SETUP
-#line 254 "jscript_massager.l"
+#line 266 "jscript_massager.l"
 {
   ECHO;
   if (strchr("([{", yytext[0]))
@@ -9225,10 +9253,10 @@ YY_RULE_SETUP
 	YY_BREAK
 case 7:
 YY_RULE_SETUP
-#line 260 "jscript_massager.l"
+#line 272 "jscript_massager.l"
 {
-  LOG("%s:%d: Can't massage JS containing E4X grammar",
-      input_filename, yylineno);
+  Warn("%s:%d: Can't massage JS containing E4X grammar",
+       input_filename, yylineno);
   give_up = true;
   PopAllStates();
   YY_FLUSH_BUFFER;
@@ -9237,14 +9265,14 @@ YY_RULE_SETUP
 	YY_BREAK
 case 8:
 YY_RULE_SETUP
-#line 269 "jscript_massager.l"
+#line 281 "jscript_massager.l"
 ECHO;
 	YY_BREAK
 case 9:
-#line 272 "jscript_massager.l"
+#line 284 "jscript_massager.l"
 case 10:
 YY_RULE_SETUP
-#line 272 "jscript_massager.l"
+#line 284 "jscript_massager.l"
 {
   // options or detailsViewData
   BEGIN(OPTIONS);
@@ -9254,7 +9282,7 @@ YY_RULE_SETUP
 case 11:
 /* rule 11 can match eol */
 YY_RULE_SETUP
-#line 278 "jscript_massager.l"
+#line 290 "jscript_massager.l"
 {
   BEGIN(INITIAL);
   PushState(OPTIONS_ONLY);
@@ -9265,7 +9293,7 @@ YY_RULE_SETUP
 case 12:
 /* rule 12 can match eol */
 YY_RULE_SETUP
-#line 285 "jscript_massager.l"
+#line 297 "jscript_massager.l"
 {
   // options.item or detailsViewData.item
   BEGIN(INITIAL);
@@ -9277,7 +9305,7 @@ YY_RULE_SETUP
 case 13:
 /* rule 13 can match eol */
 YY_RULE_SETUP
-#line 293 "jscript_massager.l"
+#line 305 "jscript_massager.l"
 {
   // options.defaultValue or detailsViewData.defaultValue
   BEGIN(INITIAL);
@@ -9289,7 +9317,7 @@ YY_RULE_SETUP
 case 14:
 /* rule 14 can match eol */
 YY_RULE_SETUP
-#line 301 "jscript_massager.l"
+#line 313 "jscript_massager.l"
 {
   BEGIN(INITIAL);
   // In <OPTIONS> state, yytext contains the last matched string because
@@ -9301,7 +9329,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 15:
 YY_RULE_SETUP
-#line 310 "jscript_massager.l"
+#line 322 "jscript_massager.l"
 {
   ECHO;
   IncreaseParenCount();
@@ -9309,7 +9337,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 16:
 YY_RULE_SETUP
-#line 315 "jscript_massager.l"
+#line 327 "jscript_massager.l"
 {
   PopAllPairedStates();
   ECHO;
@@ -9322,13 +9350,14 @@ case 17:
 (yy_c_buf_p) = yy_cp -= 1;
 YY_DO_BEFORE_ACTION; /* set up yytext again */
 YY_RULE_SETUP
-#line 321 "jscript_massager.l"
+#line 333 "jscript_massager.l"
 {
   // Mathes ...= but not ...==.
   ECHO;
-  LOG("%s:%d: Old JScript grammar: %s... Converted to %s",
-      input_filename, yylineno, GetStackTop().buffer.c_str(),
-      GetState() == OPTIONS_DEFAULT_VALUE ? "putDefaultValue()" : "putValue()");
+  Warn("%s:%d: Old JScript grammar: %s... Converted to %s",
+       input_filename, yylineno, GetStackTop().buffer.c_str(),
+       GetState() == OPTIONS_DEFAULT_VALUE ? "putDefaultValue()" :
+                                              "putValue()");
   ReplaceLast(")", ",");
   ReplaceLast("=", "");
   SetAssigned();
@@ -9338,7 +9367,7 @@ YY_RULE_SETUP
 case 18:
 /* rule 18 can match eol */
 YY_RULE_SETUP
-#line 333 "jscript_massager.l"
+#line 345 "jscript_massager.l"
 {
   BEGIN(INITIAL);
   PopState();
@@ -9348,7 +9377,7 @@ YY_RULE_SETUP
 case 19:
 /* rule 19 can match eol */
 YY_RULE_SETUP
-#line 339 "jscript_massager.l"
+#line 351 "jscript_massager.l"
 {
   // Avoid [,\n] rule in this case.
   ECHO;
@@ -9357,7 +9386,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 20:
 YY_RULE_SETUP
-#line 345 "jscript_massager.l"
+#line 357 "jscript_massager.l"
 {
   BEGIN(INITIAL);
   unput(yytext[0]);
@@ -9365,11 +9394,11 @@ YY_RULE_SETUP
 	YY_BREAK
 case 21:
 /* rule 21 can match eol */
-#line 351 "jscript_massager.l"
+#line 363 "jscript_massager.l"
 case 22:
 /* rule 22 can match eol */
 YY_RULE_SETUP
-#line 351 "jscript_massager.l"
+#line 363 "jscript_massager.l"
 {
   PushState(FUNCTION_EXPR);
   ECHO;
@@ -9379,7 +9408,7 @@ YY_RULE_SETUP
 case 23:
 /* rule 23 can match eol */
 YY_RULE_SETUP
-#line 357 "jscript_massager.l"
+#line 369 "jscript_massager.l"
 {
   PopAllPairedStates();
   PushState(FUNCTION_DECL);
@@ -9390,25 +9419,25 @@ YY_RULE_SETUP
 case 24:
 /* rule 24 can match eol */
 YY_RULE_SETUP
-#line 364 "jscript_massager.l"
+#line 376 "jscript_massager.l"
 ECHO; // Statement should continue.
 	YY_BREAK
 case 25:
 /* rule 25 can match eol */
 YY_RULE_SETUP
-#line 365 "jscript_massager.l"
+#line 377 "jscript_massager.l"
 ECHO; // BINARY_OP doesn't include '/' which is specially treated.
 	YY_BREAK
 case 26:
 /* rule 26 can match eol */
 YY_RULE_SETUP
-#line 366 "jscript_massager.l"
+#line 378 "jscript_massager.l"
 ECHO;  // Distinguish comments from the '/' operator.
 	YY_BREAK
 case 27:
 /* rule 27 can match eol */
 YY_RULE_SETUP
-#line 367 "jscript_massager.l"
+#line 379 "jscript_massager.l"
 ECHO; // Statement should continue.
 	YY_BREAK
 case 28:
@@ -9417,13 +9446,13 @@ case 28:
 (yy_c_buf_p) = yy_cp -= 1;
 YY_DO_BEFORE_ACTION; /* set up yytext again */
 YY_RULE_SETUP
-#line 368 "jscript_massager.l"
+#line 380 "jscript_massager.l"
 ECHO; // Distinguish comments from the '/' operator.
 	YY_BREAK
 case 29:
 /* rule 29 can match eol */
 YY_RULE_SETUP
-#line 370 "jscript_massager.l"
+#line 382 "jscript_massager.l"
 {
   // JavaScript allow lines not ended with ';'.
   PopAllPairedStates();
@@ -9433,12 +9462,12 @@ YY_RULE_SETUP
 case 30:
 /* rule 30 can match eol */
 YY_RULE_SETUP
-#line 376 "jscript_massager.l"
+#line 388 "jscript_massager.l"
 {
   PopAllPairedStates();
   CloseParen();
   // JScript allows ';' between '}' and 'else', which is invalid in standard JS.
-  LOG("%s:%d: Old JScript grammar: %s...", input_filename, yylineno, yytext);
+  Warn("%s:%d: Old JScript grammar: %s...", input_filename, yylineno, yytext);
   std::string text(yytext);
   text[text.find(';')] = ' ';
   ScriptOutput(text.c_str());
@@ -9450,11 +9479,11 @@ case YY_STATE_EOF(INITIAL):
 case YY_STATE_EOF(OPTIONS):
 case YY_STATE_EOF(AFTER_OPTIONS_PARAM):
 case YY_STATE_EOF(ASSIGN_RIGHT):
-#line 388 "jscript_massager.l"
+#line 400 "jscript_massager.l"
 {
   PopAllPairedStates();
   if (stack.size() != 1) {
-    LOG("%s: File contains unpaired '(', '[' or '{'s.", input_filename);
+    Warn("%s: File contains unpaired '(', '[' or '{'s.", input_filename);
   }
   PopAllStates();
   YY_FLUSH_BUFFER;
@@ -9464,15 +9493,15 @@ case YY_STATE_EOF(ASSIGN_RIGHT):
 case 31:
 /* rule 31 can match eol */
 YY_RULE_SETUP
-#line 398 "jscript_massager.l"
+#line 410 "jscript_massager.l"
 ECHO;
 	YY_BREAK
 case 32:
 YY_RULE_SETUP
-#line 400 "jscript_massager.l"
+#line 412 "jscript_massager.l"
 ECHO;
 	YY_BREAK
-#line 9476 "jscript_massager.cc"
+#line 9488 "jscript_massager.cc"
 
 	case YY_END_OF_BUFFER:
 		{
@@ -10616,7 +10645,7 @@ void yyfree (void * ptr )
 
 /* %ok-for-header */
 
-#line 400 "jscript_massager.l"
+#line 412 "jscript_massager.l"
 
 
 
@@ -10637,8 +10666,24 @@ static void CloseParen() {
   }
 }
 
-std::string MassageJScript(const char *input, bool debug,
-                           const char *filename, int lineno) {
+#ifdef HAVE_PTHREAD
+// The scanner keeps its state in globals, so scripts are massaged one by one.
+static pthread_mutex_t massager_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+void MassageJScriptUncached(const char *input, bool debug,
+                            const char *filename, int lineno,
+                            std::string *result, std::string *warnings_out) {
+  ASSERT(result);
+  result->clear();
+  if (warnings_out)
+    warnings_out->clear();
+  if (!input || !*input)
+    return;
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock(&massager_mutex);
+#endif
   give_up = false;
   yy_flex_debug = debug;
 #ifdef _DEBUG
@@ -10649,14 +10694,15 @@ std::string MassageJScript(const char *input, bool debug,
   }
 #endif
 
-  if (!input || !*input)
-    return std::string();
-
+  size_t input_size = strlen(input);
   input_script_pos = input;
+  input_script_end = input + input_size;
   input_filename = filename;
   new_line_appended = false;
   yyset_lineno(lineno);
   output.clear();
+  output.reserve(input_size + 1);
+  warnings.clear();
   stack.clear();
 
   BEGIN(INITIAL);
@@ -10673,7 +10719,24 @@ std::string MassageJScript(const char *input, bool debug,
   }
 #endif
 
-  return give_up ? std::string(input) : output;
+  if (give_up)
+    result->assign(input, input_size);
+  else
+    result->swap(output);
+  if (warnings_out)
+    warnings_out->swap(warnings);
+  // Don't hold the memory of the last script.
+  std::string().swap(output);
+  std::string().swap(warnings);
+#ifdef HAVE_PTHREAD
+  pthread_mutex_unlock(&massager_mutex);
+#endif
+}
+
+void MassageJScriptUncached(const char *input, bool debug,
+                            const char *filename, int lineno,
+                            std::string *result) {
+  MassageJScriptUncached(input, debug, filename, lineno, result, NULL);
 }
 
 END_NS // namespace js
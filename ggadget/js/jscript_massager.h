@@ -26,9 +26,58 @@ namespace js {
  * @{
  */
 
+/**
+ * Converts old JScript grammar, which SpiderMonkey and WebKit don't accept,
+ * into standard JavaScript.
+ *
+ * The results are memoized by the digest of the input, the file name and the
+ * line number. Big scripts are also persisted in the global file manager when
+ * massaged in the main thread, so unchanged scripts needn't be massaged again
+ * in later sessions. The warnings about the script are logged again when a
+ * memoized result is used.
+ *
+ * This function is thread safe.
+ *
+ * @param input the script to be massaged.
+ * @param debug whether to print the debug information of the scanner. The
+ *     cache is not used in debug mode.
+ * @param filename the file name of the script, used in log messages.
+ * @param lineno the line number of the first line of the script.
+ * @return the massaged script.
+ */
 std::string MassageJScript(const char *input, bool debug,
                            const char *filename, int lineno);
 
+/**
+ * Same as @c MassageJScript() above, but the massaged script is stored in
+ * @a output to avoid copying the result.
+ */
+void MassageJScript(const char *input, bool debug,
+                    const char *filename, int lineno, std::string *output);
+
+/**
+ * Massages a script without looking up or updating the cache.
+ * This function is thread safe.
+ */
+void MassageJScriptUncached(const char *input, bool debug,
+                            const char *filename, int lineno,
+                            std::string *output);
+
+/**
+ * Same as @c MassageJScriptUncached() above, and also stores the warnings
+ * logged while massaging the script in @a warnings, one per line.
+ */
+void MassageJScriptUncached(const char *input, bool debug,
+                            const char *filename, int lineno,
+                            std::string *output, std::string *warnings);
+
+/**
+ * Gets the statistics of the massager cache.
+ * @param[out] lookups the number of scripts looked up in the cache.
+ * @param[out] hits the number of scripts found in the cache.
+ */
+void GetJScriptMassagerCacheStats(size_t *lookups, size_t *hits);
+
 /** @} */
 
 } // namespace js
@@ -0,0 +1,288 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include "jscript_massager.h"
+#include <ggadget/common.h>
+#include <ggadget/digest_utils.h>
+#include <ggadget/file_manager_factory.h>
+#include <ggadget/file_manager_interface.h>
+#include <ggadget/logger.h>
+#include <ggadget/main_loop_interface.h>
+#include <ggadget/slot.h>
+#include <ggadget/string_utils.h>
+
+namespace ggadget {
+namespace js {
+
+// Directory in the file manager to store massaged scripts.
+static const char kCacheDir[] = "profile://massager_cache/";
+// Scripts shorter than this are cheaper to massage than to look up.
+static const size_t kMinCachedScriptSize = 256;
+// Scripts shorter than this are only cached in memory.
+static const size_t kMinPersistedScriptSize = 4096;
+// Upper limit of the total size of massaged scripts cached in memory.
+static const size_t kMaxMemoryBytes = 4 * 1024 * 1024;
+// Upper limit of the number of massaged scripts persisted.
+static const size_t kMaxDiskEntries = 1024;
+// Persisted scripts that haven't been written for this long are removed.
+static const uint64_t kMaxDiskIdleTime = 30 * 86400 * 1000ULL;
+// Version tag of the massager, must be changed when the massager changes.
+static const char kMassagerVersion[] = "GGLMASSAGER2\n";
+
+class MassagerCache {
+ public:
+  typedef std::list<std::string> LRUList;
+  struct Entry {
+    std::string output;
+    // Warnings logged when the script was massaged, one per line.
+    std::string warnings;
+    LRUList::iterator lru;
+  };
+  typedef std::map<std::string, Entry> EntryMap;
+
+  MassagerCache()
+      : memory_bytes_(0), lookups_(0), hits_(0), disk_pruned_(false) {
+#ifdef HAVE_PTHREAD
+    pthread_mutex_init(&mutex_, NULL);
+#endif
+  }
+
+  void Lock() {
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock(&mutex_);
+#endif
+  }
+
+  void Unlock() {
+#ifdef HAVE_PTHREAD
+    pthread_mutex_unlock(&mutex_);
+#endif
+  }
+
+  // The file name and line number are part of the key, because they are
+  // contained in the warnings which are logged again on hits.
+  static std::string GetKey(const char *input, size_t size,
+                            const char *filename, int lineno) {
+    std::string data(kMassagerVersion);
+    StringAppendPrintf(&data, "%s\n%d\n", filename ? filename : "", lineno);
+    data.append(input, size);
+    std::string digest, key;
+    GenerateSHA1(data, &digest);
+    WebSafeEncodeBase64(digest, false, &key);
+    return key;
+  }
+
+  // The file manager is not thread safe, so it's only used in the main
+  // thread.
+  static FileManagerInterface *GetFileManager() {
+    MainLoopInterface *main_loop = GetGlobalMainLoop();
+    return main_loop && main_loop->IsMainThread() ?
+           GetGlobalFileManager() : NULL;
+  }
+
+  bool CollectDiskFile(const char *name, std::vector<std::string> *files) {
+    files->push_back(std::string(kCacheDir) + name);
+    return true;
+  }
+
+  // Removes persisted scripts that haven't been written for a long time, and
+  // the oldest ones if there are too many.
+  void PruneDisk(FileManagerInterface *file_manager) {
+    disk_pruned_ = true;
+    uint64_t now = static_cast<uint64_t>(time(NULL)) * 1000;
+    std::vector<std::string> files;
+    file_manager->EnumerateFiles(
+        kCacheDir, NewSlot(this, &MassagerCache::CollectDiskFile, &files));
+
+    std::multimap<uint64_t, std::string> files_by_time;
+    for (size_t i = 0; i < files.size(); ++i) {
+      uint64_t time = file_manager->GetLastModifiedTime(files[i].c_str());
+      if (time + kMaxDiskIdleTime < now)
+        file_manager->RemoveFile(files[i].c_str());
+      else
+        files_by_time.insert(std::make_pair(time, files[i]));
+    }
+    while (files_by_time.size() > kMaxDiskEntries) {
+      file_manager->RemoveFile(files_by_time.begin()->second.c_str());
+      files_by_time.erase(files_by_time.begin());
+    }
+  }
+
+  // A persisted script is the size of the warnings in a line, followed by
+  // the warnings and the massaged script.
+  static std::string Encode(const std::string &output,
+                            const std::string &warnings) {
+    std::string data = StringPrintf("%d\n", static_cast<int>(warnings.size()));
+    data += warnings;
+    data += output;
+    return data;
+  }
+
+  static bool Decode(const std::string &data, std::string *output,
+                     std::string *warnings) {
+    size_t pos = data.find('\n');
+    if (pos == std::string::npos)
+      return false;
+    size_t size = static_cast<size_t>(strtoul(data.c_str(), NULL, 10));
+    if (size > data.size() - pos - 1)
+      return false;
+    warnings->assign(data, pos + 1, size);
+    output->assign(data, pos + 1 + size, std::string::npos);
+    return true;
+  }
+
+  void Put(const std::string &key, const std::string &output,
+           const std::string &warnings) {
+    if (entries_.find(key) != entries_.end())
+      return;
+    lru_.push_front(key);
+    Entry *entry = &entries_[key];
+    entry->output = output;
+    entry->warnings = warnings;
+    entry->lru = lru_.begin();
+    memory_bytes_ += output.size() + warnings.size();
+    while (memory_bytes_ > kMaxMemoryBytes && !lru_.empty()) {
+      EntryMap::iterator it = entries_.find(lru_.back());
+      ASSERT(it != entries_.end());
+      memory_bytes_ -= it->second.output.size() +
+                       it->second.warnings.size();
+      entries_.erase(it);
+      lru_.pop_back();
+    }
+  }
+
+  bool Get(const std::string &key, size_t input_size,
+           FileManagerInterface *file_manager, std::string *output,
+           std::string *warnings) {
+    EntryMap::iterator it = entries_.find(key);
+    if (it != entries_.end()) {
+      lru_.splice(lru_.begin(), lru_, it->second.lru);
+      *output = it->second.output;
+      *warnings = it->second.warnings;
+      return true;
+    }
+    if (!file_manager || input_size < kMinPersistedScriptSize)
+      return false;
+    if (!disk_pruned_)
+      PruneDisk(file_manager);
+    std::string data;
+    if (!file_manager->ReadFile((kCacheDir + key).c_str(), &data) ||
+        !Decode(data, output, warnings))
+      return false;
+    Put(key, *output, *warnings);
+    return true;
+  }
+
+  // Logs the warnings of a massaged script again, as if it were massaged.
+  static void LogWarnings(const std::string &warnings) {
+    size_t start = 0;
+    while (start < warnings.size()) {
+      size_t end = warnings.find('\n', start);
+      if (end == std::string::npos)
+        end = warnings.size();
+      LOG("%s", warnings.substr(start, end - start).c_str());
+      start = end + 1;
+    }
+  }
+
+  void Massage(const char *input, const char *filename, int lineno,
+               std::string *output) {
+    size_t input_size = strlen(input);
+    if (input_size < kMinCachedScriptSize) {
+      MassageJScriptUncached(input, false, filename, lineno, output);
+      return;
+    }
+
+    std::string key = GetKey(input, input_size, filename, lineno);
+    FileManagerInterface *file_manager = GetFileManager();
+    std::string warnings;
+    Lock();
+    lookups_++;
+    bool hit = Get(key, input_size, file_manager, output, &warnings);
+    if (hit)
+      hits_++;
+    Unlock();
+    if (hit) {
+      LogWarnings(warnings);
+      return;
+    }
+
+    MassageJScriptUncached(input, false, filename, lineno, output, &warnings);
+    Lock();
+    Put(key, *output, warnings);
+    Unlock();
+    if (file_manager && input_size >= kMinPersistedScriptSize) {
+      file_manager->WriteFile((kCacheDir + key).c_str(),
+                              Encode(*output, warnings), true);
+    }
+  }
+
+  EntryMap entries_;
+  LRUList lru_;
+  size_t memory_bytes_;
+  size_t lookups_;
+  size_t hits_;
+  bool disk_pruned_;
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t mutex_;
+#endif
+};
+
+static MassagerCache *GetMassagerCache() {
+  // Intentionally leaked, so that it's usable in the destructors of static
+  // objects.
+  static MassagerCache *cache = new MassagerCache();
+  return cache;
+}
+
+void MassageJScript(const char *input, bool debug,
+                    const char *filename, int lineno, std::string *output) {
+  ASSERT(output);
+  if (debug || !input || !*input)
+    MassageJScriptUncached(input, debug, filename, lineno, output);
+  else
+    GetMassagerCache()->Massage(input, filename, lineno, output);
+}
+
+std::string MassageJScript(const char *input, bool debug,
+                           const char *filename, int lineno) {
+  std::string output;
+  MassageJScript(input, debug, filename, lineno, &output);
+  return output;
+}
+
+void GetJScriptMassagerCacheStats(size_t *lookups, size_t *hits) {
+  MassagerCache *cache = GetMassagerCache();
+  cache->Lock();
+  if (lookups) *lookups = cache->lookups_;
+  if (hits) *hits = cache->hits_;
+  cache->Unlock();
+}
+
+} // namespace js
+} // namespace ggadget
@@ -0,0 +1,94 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+// Measures the throughput of the JScript massager on the scripts in
+// ggadget/js/test_scripts, or on the files given in the command line.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/time.h>
+#include <ggadget/common.h>
+#include <ggadget/system_utils.h>
+#include "../jscript_massager.h"
+
+#ifndef TEST_SCRIPTS_DIR
+#define TEST_SCRIPTS_DIR "../test_scripts"
+#endif
+
+static const char *kDefaultScripts[] = {
+  "dbus_object_test.js",
+  "dom1_test.js",
+  "json_test.js",
+  "wrapper_test.js",
+};
+
+static double GetTime() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+typedef void (*MassageFunc)(const char *input, bool debug,
+                            const char *filename, int lineno,
+                            std::string *output);
+
+static void Run(const char *name, MassageFunc func,
+                const std::vector<std::string> &scripts, int rounds) {
+  size_t bytes = 0;
+  std::string output;
+  double start = GetTime();
+  for (int i = 0; i < rounds; ++i) {
+    for (size_t j = 0; j < scripts.size(); ++j) {
+      func(scripts[j].c_str(), false, "benchmark", 1, &output);
+      bytes += scripts[j].size();
+    }
+  }
+  double seconds = GetTime() - start;
+  printf("%-10s %8.2f MB in %6.3f s: %8.2f MB/s\n", name,
+         bytes / 1048576.0, seconds, bytes / 1048576.0 / seconds);
+}
+
+int main(int argc, char **argv) {
+  int rounds = 20;
+  std::vector<std::string> files;
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], "--rounds=", 9) == 0)
+      rounds = atoi(argv[i] + 9);
+    else
+      files.push_back(argv[i]);
+  }
+  if (files.empty()) {
+    for (size_t i = 0; i < arraysize(kDefaultScripts); ++i)
+      files.push_back(std::string(TEST_SCRIPTS_DIR "/") + kDefaultScripts[i]);
+  }
+
+  std::vector<std::string> scripts;
+  for (size_t i = 0; i < files.size(); ++i) {
+    std::string script;
+    if (!ggadget::ReadFileContents(files[i].c_str(), &script)) {
+      fprintf(stderr, "Failed to read %s\n", files[i].c_str());
+      return 1;
+    }
+    scripts.push_back(script);
+  }
+
+  Run("uncached", ggadget::js::MassageJScriptUncached, scripts, rounds);
+  Run("cached", ggadget::js::MassageJScript, scripts, rounds);
+  return 0;
+}
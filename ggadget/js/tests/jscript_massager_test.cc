@@ -14,9 +14,14 @@
   limitations under the License.
 */
 
+#include <pthread.h>
 #include <unittest/gtest.h>
+#include <ggadget/logger.h>
+#include <ggadget/signals.h>
+#include <ggadget/slot.h>
 #include "../jscript_massager.h"
 
+using namespace ggadget;
 using namespace ggadget::js;
 
 const char *input =
@@ -282,6 +287,101 @@ TEST(JScriptMassager, InnerFunctions) {
   ASSERT_STREQ(function_output, result.c_str());
 }
 
+TEST(JScriptMassager, CarriageReturns) {
+  std::string result = MassageJScript("a\r\nb\r", false, "filename", 1);
+  ASSERT_STREQ("a\nb\n", result.c_str());
+
+  // The input spans several buffers of the scanner.
+  std::string long_input, long_output;
+  for (int i = 0; i < 1000; ++i) {
+    long_input += "var a = b(c,\r\n d);\r\n\r";
+    long_output += "var a = b(c,\n d);\n";
+  }
+  // The trailing '\r' is not a new line.
+  long_output += "\n";
+  MassageJScriptUncached(long_input.c_str(), false, "filename", 1, &result);
+  ASSERT_EQ(long_output, result);
+}
+
+TEST(JScriptMassager, Memoized) {
+  size_t lookups = 0, hits = 0;
+  GetJScriptMassagerCacheStats(&lookups, &hits);
+  std::string result1, result2;
+  MassageJScript(function_input, false, "filename", 1, &result1);
+  MassageJScript(function_input, false, "filename", 1, &result2);
+  ASSERT_STREQ(function_output, result1.c_str());
+  ASSERT_STREQ(function_output, result2.c_str());
+
+  size_t new_lookups = 0, new_hits = 0;
+  GetJScriptMassagerCacheStats(&new_lookups, &new_hits);
+  EXPECT_EQ(lookups + 2, new_lookups);
+  EXPECT_LT(hits, new_hits);
+
+  // Short scripts are not cached.
+  MassageJScript("a = b;", false, "filename", 1, &result1);
+  GetJScriptMassagerCacheStats(&lookups, NULL);
+  EXPECT_EQ(new_lookups, lookups);
+}
+
+static std::string g_logs;
+static std::string CollectLog(LogLevel level, const char *filename,
+                              int lineno, const std::string &message) {
+  g_logs += message + "\n";
+  return message;
+}
+
+TEST(JScriptMassager, MemoizedWarnings) {
+  // An old JScript grammar which is warned about, padded to be cached.
+  std::string warned_input(300, ' ');
+  warned_input += "options.item(a) = b;\n";
+  std::string warnings;
+  std::string result;
+  MassageJScriptUncached(warned_input.c_str(), false, "warned.js", 1,
+                         &result, &warnings);
+  ASSERT_NE(std::string::npos, warnings.find("warned.js:1: Old JScript"));
+
+  Connection *connection = ConnectGlobalLogListener(NewSlot(CollectLog));
+  // The warnings are logged again when the cached result is used.
+  for (int i = 0; i < 2; ++i) {
+    g_logs.clear();
+    MassageJScript(warned_input.c_str(), false, "warned.js", 1, &result);
+    EXPECT_NE(std::string::npos, g_logs.find(warnings)) << g_logs;
+  }
+  // The file name and line number in the warnings are not reused.
+  g_logs.clear();
+  MassageJScript(warned_input.c_str(), false, "other.js", 10, &result);
+  EXPECT_NE(std::string::npos, g_logs.find("other.js:10: Old JScript"))
+      << g_logs;
+  connection->Disconnect();
+}
+
+static void *MassageThread(void *arg) {
+  bool *succeeded = static_cast<bool *>(arg);
+  std::string result;
+  for (int i = 0; i < 50 && *succeeded; ++i) {
+    MassageJScriptUncached(input, false, "filename", 1, &result);
+    *succeeded = (result == output);
+    MassageJScript(function_input, false, "filename", 1, &result);
+    *succeeded = *succeeded && (result == function_output);
+  }
+  return NULL;
+}
+
+TEST(JScriptMassager, Threads) {
+  static const int kThreads = 4;
+  pthread_t threads[kThreads];
+  bool succeeded[kThreads];
+  for (int i = 0; i < kThreads; ++i) {
+    succeeded[i] = true;
+    ASSERT_EQ(0, pthread_create(&threads[i], NULL, MassageThread,
+                                &succeeded[i]));
+  }
+  for (int i = 0; i < kThreads; ++i) {
+    pthread_join(threads[i], NULL);
+    EXPECT_TRUE(succeeded[i]);
+  }
+}
+
 int main(int argc, char **argv) {
   testing::ParseGTestFlags(&argc, argv);
   return RUN_ALL_TESTS();
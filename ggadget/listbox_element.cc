@@ -14,7 +14,10 @@
   limitations under the License.
 */
 
+#include <algorithm>
 #include <cmath>
+#include <set>
+#include <vector>
 
 #include "listbox_element.h"
 #include "color.h"
@@ -23,6 +26,7 @@
 #include "item_element.h"
 #include "logger.h"
 #include "scriptable_event.h"
+#include "scriptable_interface.h"
 #include "string_utils.h"
 #include "texture.h"
 #include "view.h"
@@ -40,6 +44,23 @@ static const Color kDefaultItemSelectedColor(0xC6/255.0,
                                              0xF7/255.0);
 static const Color kDefaultItemSepColor(0xF7/255.0, 0xF3/255.0, 0xF7/255.0);
 
+// Number of rows materialized above and below the visible area in virtual
+// mode, so that small scrolls don't need to relabel any row.
+static const int kVirtualOverscanRows = 4;
+
+// Item model used by the setVirtualStrings() script method.
+class StringItemModel : public ListBoxElement::ItemModel {
+ public:
+  virtual size_t GetItemCount() const {
+    return items_.size();
+  }
+  virtual std::string GetItemText(size_t index) const {
+    return index < items_.size() ? items_[index] : std::string();
+  }
+
+  std::vector<std::string> items_;
+};
+
 class ListBoxElement::Impl : public SmallObject<> {
  public:
   Impl(ListBoxElement *owner, View *view) :
@@ -56,11 +77,19 @@ class ListBoxElement::Impl : public SmallObject<> {
     item_width_relative_(true),
     item_height_relative_(false),
     multiselect_(false),
-    item_separator_(false) {
+    item_separator_(false),
+    model_(NULL),
+    string_model_(NULL) {
     GGL_UNUSED(view);
+    // Forget about the rows removed by the script or by ResetVirtualMode().
+    child_removed_connection_ = owner->GetChildren()->ConnectOnElementRemoved(
+        NewSlot(this, &Impl::OnChildRemoved));
   }
 
   ~Impl() {
+    child_removed_connection_->Disconnect();
+    delete model_;
+    model_ = NULL;
     delete item_over_color_;
     item_over_color_ = NULL;
     delete item_selected_color_;
@@ -125,6 +154,20 @@ class ListBoxElement::Impl : public SmallObject<> {
 
   // Returns true if anything was cleared.
   bool ClearSelection(ItemElement *avoid) {
+    if (model_) {
+      int keep = GetRowIndex(avoid);
+      bool result = !selection_.empty() &&
+          (keep < 0 || selection_.size() > 1 || *selection_.begin() != keep);
+      selection_.clear();
+      if (keep >= 0)
+        selection_.insert(keep);
+      if (result) {
+        pending_scroll_ = 0;
+        SyncRowSelection();
+      }
+      return result;
+    }
+
     bool result = false;
     Elements *elements = owner_->GetChildren();
     size_t childcount = elements->GetCount();
@@ -172,6 +215,9 @@ class ListBoxElement::Impl : public SmallObject<> {
   }
 
   int GetSelectedIndex() {
+    if (model_)
+      return selection_.empty() ? -1 : *selection_.begin();
+
     const Elements *elements = owner_->GetChildren();
     size_t childcount = elements->GetCount();
     for (size_t i = 0; i < childcount; i++) {
@@ -189,6 +235,12 @@ class ListBoxElement::Impl : public SmallObject<> {
   }
 
   void SetSelectedIndex(int index) {
+    if (model_) {
+      if (index < static_cast<int>(model_->GetItemCount()))
+        SetVirtualSelection(index);
+      return;
+    }
+
     if (index == -1) {
       selected_index_ = -1;
       SetSelectedItem(NULL);
@@ -215,6 +267,17 @@ class ListBoxElement::Impl : public SmallObject<> {
   }
 
   ItemElement *GetSelectedItem() {
+    if (model_) {
+      // The first selected item is always materialized, see
+      // UpdateVirtualRows().
+      int index = GetSelectedIndex();
+      for (size_t i = 0; index >= 0 && i < rows_.size(); i++) {
+        if (row_indices_[i] == index)
+          return rows_[i];
+      }
+      return NULL;
+    }
+
     Elements *elements = owner_->GetChildren();
     size_t childcount = elements->GetCount();
     for (size_t i = 0; i < childcount; i++) {
@@ -232,6 +295,11 @@ class ListBoxElement::Impl : public SmallObject<> {
   }
 
   void SetSelectedItem(ItemElement *item) {
+    if (model_) {
+      SetVirtualSelection(GetRowIndex(item));
+      return;
+    }
+
     bool changed = ClearSelection(item);
     if (item && !item->IsSelected()) {
       item->SetSelected(true);
@@ -244,7 +312,7 @@ class ListBoxElement::Impl : public SmallObject<> {
   }
 
   void ShiftSelection(int distance, bool wrap) {
-    int count = static_cast<int>(owner_->GetChildren()->GetCount());
+    int count = static_cast<int>(owner_->GetItemCount());
     if (count == 0)
       return;
 
@@ -303,6 +371,184 @@ class ListBoxElement::Impl : public SmallObject<> {
     return false;
   }
 
+  // Returns the model index shown by a row in virtual mode, or -1 if item
+  // is not a row of this listbox.
+  int GetRowIndex(const ItemElement *item) const {
+    for (size_t i = 0; item && i < rows_.size(); i++) {
+      if (rows_[i] == item)
+        return row_indices_[i];
+    }
+    return -1;
+  }
+
+  // Selects only the item at index in virtual mode, or clears the selection
+  // if index is negative.
+  void SetVirtualSelection(int index) {
+    bool changed;
+    if (index < 0) {
+      changed = !selection_.empty();
+      selection_.clear();
+      pending_scroll_ = 0;
+    } else {
+      changed = selection_.size() != 1 || *selection_.begin() != index;
+      selection_.clear();
+      selection_.insert(index);
+      if (changed)
+        pending_scroll_ = 2;
+    }
+
+    if (changed) {
+      // Materialize the selected item at once, so that GetSelectedItem()
+      // works in the onchange handlers.
+      UpdateVirtualRows();
+      FireOnChangeEvent();
+    }
+  }
+
+  // Selects the item at index in addition to the current selection.
+  // Returns true if the selection changed.
+  bool AddVirtualSelection(int index) {
+    if (index >= 0 && selection_.insert(index).second) {
+      SyncRowSelection();
+      return true;
+    }
+    return false;
+  }
+
+  void SyncRowSelection() {
+    for (size_t i = 0; i < rows_.size(); i++) {
+      rows_[i]->SetSelected(row_indices_[i] >= 0 &&
+                            selection_.count(row_indices_[i]));
+    }
+  }
+
+  void ResetVirtualMode() {
+    // In virtual mode all children are rows.
+    if (model_ || !rows_.empty())
+      owner_->GetChildren()->RemoveAllElements();
+    rows_.clear();
+    row_indices_.clear();
+    selection_.clear();
+    delete model_;
+    model_ = NULL;
+    string_model_ = NULL;
+  }
+
+  void OnChildRemoved(BasicElement *element) {
+    for (size_t i = 0; i < rows_.size(); i++) {
+      if (rows_[i] == element) {
+        rows_.erase(rows_.begin() + i);
+        row_indices_.erase(row_indices_.begin() + i);
+        break;
+      }
+    }
+  }
+
+  void InvalidateRows() {
+    row_indices_.assign(rows_.size(), -1);
+  }
+
+  // Returns the position of a free row in rows_, creating a new one if all
+  // rows are in use.
+  size_t GetFreeRow(size_t from) {
+    while (from < rows_.size() && row_indices_[from] >= 0)
+      from++;
+    if (from == rows_.size()) {
+      BasicElement *child = owner_->GetChildren()->AppendElement("item", "");
+      ASSERT(child && child->IsInstanceOf(ItemElement::CLASS_ID));
+      ItemElement *row = down_cast<ItemElement *>(child);
+      row->AddLabelWithText("");
+      rows_.push_back(row);
+      row_indices_.push_back(-1);
+    }
+    return from;
+  }
+
+  void AssignRow(size_t row, int index, double item_height) {
+    ItemElement *item = rows_[row];
+    row_indices_[row] = index;
+    item->SetLabelText(
+        model_->GetItemText(static_cast<size_t>(index)).c_str());
+    item->SetPixelY(index * item_height);
+    item->SetVisible(true);
+    // Newly created rows have missed the size calculation of this frame.
+    item->CalculateSize();
+  }
+
+  // Materializes the rows in the visible area plus the overscan, and the
+  // first selected item. Rows keep their items while they stay in range, so
+  // only the rows scrolled into view are relabeled.
+  void UpdateVirtualRows() {
+    if (!model_)
+      return;
+
+    int count = static_cast<int>(model_->GetItemCount());
+    double item_height = owner_->GetItemPixelHeight();
+    int first = 0, last = 0;
+    if (item_height > 0 && count > 0) {
+      double top = owner_->GetScrollYPosition();
+      double bottom = top + owner_->GetClientHeight();
+      first = std::max(0, static_cast<int>(top / item_height) -
+                          kVirtualOverscanRows);
+      last = std::min(count, static_cast<int>(ceil(bottom / item_height)) +
+                             kVirtualOverscanRows);
+      last = std::max(first, last);
+    }
+    int pinned = GetSelectedIndex();
+    if (pinned >= count || (pinned >= first && pinned < last))
+      pinned = -1;
+
+    std::vector<bool> shown(last - first, false);
+    bool pinned_shown = false;
+    for (size_t i = 0; i < rows_.size(); i++) {
+      int index = row_indices_[i];
+      if (index >= first && index < last) {
+        shown[index - first] = true;
+      } else if (index >= 0 && index == pinned) {
+        pinned_shown = true;
+      } else {
+        row_indices_[i] = -1;
+      }
+    }
+
+    size_t row = 0;
+    for (int index = first; index < last; index++) {
+      if (!shown[index - first]) {
+        row = GetFreeRow(row);
+        AssignRow(row, index, item_height);
+      }
+    }
+    if (pinned >= 0 && !pinned_shown) {
+      row = GetFreeRow(row);
+      AssignRow(row, pinned, item_height);
+    }
+    for (size_t i = 0; i < rows_.size(); i++) {
+      if (row_indices_[i] < 0)
+        rows_[i]->SetVisible(false);
+    }
+    SyncRowSelection();
+  }
+
+  void ScriptSetVirtualStrings(ScriptableInterface *array) {
+    if (!array) {
+      owner_->SetItemModel(NULL);
+      return;
+    }
+
+    StringItemModel *model = new StringItemModel();
+    Variant length_v = array->GetProperty("length").v();
+    int length;
+    if (length_v.ConvertToInt(&length)) {
+      model->items_.resize(std::max(length, 0));
+      for (int i = 0; i < length; i++) {
+        ResultVariant v = array->GetPropertyByIndex(i);
+        v.v().ConvertToString(&model->items_[i]); // ignore return
+      }
+    }
+    owner_->SetItemModel(model);
+    string_model_ = model;
+  }
+
   ListBoxElement *owner_;
   Texture *item_over_color_;
   Texture *item_selected_color_;
@@ -329,6 +575,16 @@ class ListBoxElement::Impl : public SmallObject<> {
   bool item_height_relative_   : 1;
   bool multiselect_            : 1;
   bool item_separator_         : 1;
+
+  // Virtual mode states. model_ is NULL if not in virtual mode.
+  ItemModel *model_;
+  // Equals to model_ if the model was set by setVirtualStrings().
+  StringItemModel *string_model_;
+  // The materialized rows and the model index each row shows, -1 if free.
+  std::vector<ItemElement *> rows_;
+  std::vector<int> row_indices_;
+  std::set<int> selection_;
+  Connection *child_removed_connection_;
 };
 
 ListBoxElement::ListBoxElement(View *view,
@@ -380,6 +636,11 @@ void ListBoxElement::DoClassRegister() {
   RegisterMethod("removeString",
                  NewSlot(&ListBoxElement::RemoveString));
 
+  // Extension: virtual mode backed by an array of strings.
+  RegisterMethod("setVirtualStrings",
+                 NewSlot(&Impl::ScriptSetVirtualStrings,
+                         &ListBoxElement::impl_));
+
   RegisterClassSignal(kOnChangeEvent, &Impl::onchange_event_,
                       &ListBoxElement::impl_);
 }
@@ -419,7 +680,7 @@ EventResult ListBoxElement::HandleKeyEvent(const KeyboardEvent &event) {
         SetSelectedIndex(0);
         break;
       case KeyboardEvent::KEY_END:
-        SetSelectedIndex(static_cast<int>(GetChildren()->GetCount()) - 1);
+        SetSelectedIndex(static_cast<int>(GetItemCount()) - 1);
         break;
       default:
         result = EVENT_RESULT_UNHANDLED;
@@ -638,6 +899,12 @@ void ListBoxElement::AppendSelection(ItemElement *item) {
     return;
   }
 
+  if (impl_->model_) {
+    if (impl_->AddVirtualSelection(impl_->GetRowIndex(item)))
+      impl_->FireOnChangeEvent();
+    return;
+  }
+
   if (!item->IsSelected()) {
     item->SetSelected(true);
     impl_->FireOnChangeEvent();
@@ -653,6 +920,22 @@ void ListBoxElement::SelectRange(ItemElement *endpoint) {
   }
 
   bool changed = false;
+  if (impl_->model_) {
+    int end = impl_->GetRowIndex(endpoint);
+    int start = GetSelectedIndex();
+    if (start < 0)
+      start = end;
+    for (int i = std::min(start, end); end >= 0 && i <= std::max(start, end);
+         i++) {
+      changed = impl_->selection_.insert(i).second || changed;
+    }
+    if (changed) {
+      impl_->SyncRowSelection();
+      impl_->FireOnChangeEvent();
+    }
+    return;
+  }
+
   ItemElement *endpoint2 = GetSelectedItem();
   if (endpoint2 == NULL || endpoint == endpoint2) {
     if (!endpoint->IsSelected()) {
@@ -694,6 +977,14 @@ void ListBoxElement::SelectRange(ItemElement *endpoint) {
 }
 
 bool ListBoxElement::AppendString(const char *str) {
+  if (impl_->model_) {
+    if (!impl_->string_model_)
+      return false;
+    impl_->string_model_->items_.push_back(str ? str : "");
+    OnItemModelChanged();
+    return true;
+  }
+
   Elements *elements = GetChildren();
   BasicElement *child = elements->AppendElement("item", "");
   if (!child) {
@@ -711,6 +1002,22 @@ bool ListBoxElement::AppendString(const char *str) {
 }
 
 bool ListBoxElement::InsertStringAt(const char *str, size_t index) {
+  if (impl_->model_) {
+    if (!impl_->string_model_ || index > impl_->string_model_->items_.size())
+      return false;
+    std::vector<std::string> *items = &impl_->string_model_->items_;
+    items->insert(items->begin() + index, str ? str : "");
+    // Keep the selection on the same items.
+    std::set<int> selection;
+    for (std::set<int>::const_iterator it = impl_->selection_.begin();
+         it != impl_->selection_.end(); ++it) {
+      selection.insert(*it >= static_cast<int>(index) ? *it + 1 : *it);
+    }
+    impl_->selection_.swap(selection);
+    OnItemModelChanged();
+    return true;
+  }
+
   Elements *elements = GetChildren();
   if (elements->GetCount() == index) {
     return AppendString(str);
@@ -737,23 +1044,79 @@ bool ListBoxElement::InsertStringAt(const char *str, size_t index) {
 }
 
 void ListBoxElement::RemoveString(const char *str) {
+  if (impl_->model_) {
+    if (!impl_->string_model_)
+      return;
+
+    std::vector<std::string> *items = &impl_->string_model_->items_;
+    std::vector<std::string>::iterator it =
+        std::find(items->begin(), items->end(), std::string(str ? str : ""));
+    if (it != items->end()) {
+      int index = static_cast<int>(it - items->begin());
+      items->erase(it);
+      std::set<int> selection;
+      for (std::set<int>::const_iterator sel = impl_->selection_.begin();
+           sel != impl_->selection_.end(); ++sel) {
+        if (*sel != index)
+          selection.insert(*sel > index ? *sel - 1 : *sel);
+      }
+      impl_->selection_.swap(selection);
+      OnItemModelChanged();
+    }
+    return;
+  }
+
   ItemElement *item = FindItemByString(str);
   if (item) {
     GetChildren()->RemoveElement(item);
   }
 }
 
-void ListBoxElement::Layout() {
-  impl_->SetPendingSelection();
-  // This field is no longer used after the first layout.
-  impl_->selected_index_ = -1;
+bool ListBoxElement::LayoutVirtualRows() {
+  // The scroll range is known from the item count, so the rows can be
+  // placed before the children are laid out.
+  int y_range = static_cast<int>(ceil(
+      static_cast<double>(impl_->model_->GetItemCount()) *
+      GetItemPixelHeight() - GetClientHeight()));
+  bool scrollbar_changed = UpdateScrollBar(0, std::max(y_range, 0));
+  impl_->HandlePendingScroll();
+  impl_->UpdateVirtualRows();
+  return scrollbar_changed;
+}
 
-  // Call parent Layout() after SetIndex().
-  DivElement::Layout();
+void ListBoxElement::BeforeChildrenLayout() {
+  DivElement::BeforeChildrenLayout();
+  if (impl_->model_)
+    LayoutVirtualRows();
+}
 
-  if (impl_->HandlePendingScroll()) {
-    // Call Layout() again to let the scrollbar layout.
+void ListBoxElement::Layout() {
+  if (impl_->model_) {
+    impl_->selected_index_ = -1;
+    ScrollingElement::Layout();
+    // Layout() may be called without BeforeChildrenLayout(), e.g. by
+    // combobox, or the scroll position may have changed since then.
+    if (LayoutVirtualRows()) {
+      // The client width changed with the visibility of the scroll bar,
+      // after the rows were laid out.
+      Elements *children = GetChildren();
+      children->QueueLayout();
+      children->CalculateSize();
+      children->Layout();
+    }
+    SetXPageStep(static_cast<int>(round(GetClientWidth())));
+  } else {
+    impl_->SetPendingSelection();
+    // This field is no longer used after the first layout.
+    impl_->selected_index_ = -1;
+
+    // Call parent Layout() after SetIndex().
     DivElement::Layout();
+
+    if (impl_->HandlePendingScroll()) {
+      // Call Layout() again to let the scrollbar layout.
+      DivElement::Layout();
+    }
   }
 
   // Set appropriate scrolling step distance.
@@ -772,6 +1135,42 @@ const ItemElement *ListBoxElement::FindItemByString(const char *str) const {
   return impl_->FindItemByString(str);
 }
 
+void ListBoxElement::SetItemModel(ItemModel *model) {
+  if (model == impl_->model_)
+    return;
+
+  bool had_selection = GetSelectedIndex() >= 0;
+  impl_->ResetVirtualMode();
+  if (model) {
+    GetChildren()->RemoveAllElements();
+    impl_->model_ = model;
+  }
+  QueueDraw();
+  if (had_selection)
+    impl_->FireOnChangeEvent();
+}
+
+ListBoxElement::ItemModel *ListBoxElement::GetItemModel() const {
+  return impl_->model_;
+}
+
+void ListBoxElement::OnItemModelChanged() {
+  if (!impl_->model_)
+    return;
+
+  int count = static_cast<int>(impl_->model_->GetItemCount());
+  impl_->selection_.erase(impl_->selection_.lower_bound(count),
+                          impl_->selection_.end());
+  impl_->InvalidateRows();
+  impl_->UpdateVirtualRows();
+  QueueDraw();
+}
+
+size_t ListBoxElement::GetItemCount() const {
+  return impl_->model_ ? impl_->model_->GetItemCount() :
+         GetChildren()->GetCount();
+}
+
 BasicElement *ListBoxElement::CreateInstance(View *view, const char *name) {
   return new ListBoxElement(view, "listbox", name);
 }
@@ -17,6 +17,7 @@
 #ifndef GGADGET_LISTBOX_ELEMENT_H__
 #define GGADGET_LISTBOX_ELEMENT_H__
 
+#include <string>
 #include <ggadget/div_element.h>
 
 namespace ggadget {
@@ -34,11 +35,27 @@ class ListBoxElement : public DivElement {
  public:
   DEFINE_CLASS_ID(0x7ed919e76c7e400a, DivElement);
 
+  /**
+   * Data model of a listbox in virtual mode.
+   * In virtual mode only the items in the visible area (plus a few rows of
+   * overscan) are materialized as Item elements, which are recycled when
+   * the listbox scrolls. Selection is tracked by item index.
+   */
+  class ItemModel {
+   public:
+    virtual ~ItemModel() { }
+    /** Gets the number of items in the model. */
+    virtual size_t GetItemCount() const = 0;
+    /** Gets the label text of the item at the specified index. */
+    virtual std::string GetItemText(size_t index) const = 0;
+  };
+
   ListBoxElement(View *view, const char *tag_name, const char *name);
   virtual ~ListBoxElement();
 
  protected:
   virtual void DoClassRegister();
+  virtual void BeforeChildrenLayout();
 
  public:
   /** Connects a slot to onchange event signal. */
@@ -157,10 +174,31 @@ class ListBoxElement : public DivElement {
   const ItemElement *FindItemByString(const char *str) const;
   //@}
 
+  /**
+   * Switches the listbox into virtual mode backed by @a model, or back to
+   * normal mode if @a model is @c NULL. All existing items are removed.
+   * The listbox takes the ownership of the model.
+   */
+  void SetItemModel(ItemModel *model);
+  /** Gets the item model, or @c NULL if the listbox is not in virtual mode. */
+  ItemModel *GetItemModel() const;
+  /** Must be called after the content of the item model has changed. */
+  void OnItemModelChanged();
+
+  /** Gets the number of items, either in the item model or as children. */
+  size_t GetItemCount() const;
+
  public:
   static BasicElement *CreateInstance(View *view, const char *name);
 
  private:
+  /**
+   * Updates the scroll bar from the item count of the model and places the
+   * rows in the visible area.
+   * @return @c true if the visibility of the scroll bar changed.
+   */
+  bool LayoutVirtualRows();
+
   DISALLOW_EVIL_CONSTRUCTORS(ListBoxElement);
 
   class Impl;
@@ -0,0 +1,807 @@
+/*
+  Copyright 2011 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+#include "native_main_loop.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+#include "common.h"
+#include "small_object.h"
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#else
+#include <sys/select.h>
+#endif
+
+#ifdef HAVE_EVENTFD
+#include <sys/eventfd.h>
+#endif
+
+namespace ggadget {
+
+// Maximum number of events returned by one wait. Remaining events are
+// returned by the next iteration.
+static const int kMaxEpollEvents = 64;
+
+#ifdef HAVE_EPOLL
+static const uint32_t kEventIn = EPOLLIN;
+static const uint32_t kEventOut = EPOLLOUT;
+static const uint32_t kEventErr = EPOLLERR;
+static const uint32_t kEventHup = EPOLLHUP;
+#else
+// Without epoll, select() is used, which only reports readiness.
+static const uint32_t kEventIn = 1;
+static const uint32_t kEventOut = 2;
+static const uint32_t kEventErr = 0;
+static const uint32_t kEventHup = 0;
+#endif
+
+// Stale entries of removed timeout watches are left in the timer heap until
+// they reach the top. The heap is rebuilt if there are more stale entries
+// than this number plus the number of live timeout watches.
+static const size_t kMaxStaleTimers = 64;
+
+// This class implements all functionalities of class NativeMainLoop.
+// By using this class, all implementation details of class NativeMainLoop can
+// be hidden from outside.
+class NativeMainLoop::Impl : public SmallObject<> {
+  struct WatchNode {
+    MainLoopInterface::WatchType type;
+
+    // Indicates if the watch is being called, thus can't be removed.
+    bool calling;
+
+    // Indicates if the watch has been scheduled to be removed.
+    bool removing;
+
+    // For IO watch, it's fd, for timeout watch, it's interval.
+    int data;
+
+    // Only for timeout watch.
+    uint64_t next_time;
+    WatchCallbackInterface *callback;
+
+    WatchNode()
+      : type(MainLoopInterface::INVALID_WATCH),
+        calling(false),
+        removing(false),
+        data(-1),
+        next_time(0),
+        callback(NULL) {
+    }
+  };
+
+  // All IO watches of a file descriptor, which is registered into epoll
+  // with the union of their events.
+  // Without epoll, the events are passed to select() in each iteration.
+  struct FdNode {
+    FdNode() : events(0), registered(false), always_ready(false) { }
+    std::vector<int> watches;
+    uint32_t events;
+    bool registered;
+    // epoll doesn't support regular files, which are always ready for
+    // reading and writing, as select() reports.
+    bool always_ready;
+  };
+
+  // An event reported by WaitEvents().
+  struct ReadyEvent {
+    int fd;
+    uint32_t events;
+  };
+
+  struct TimerEntry {
+    TimerEntry(uint64_t a_time, int a_watch_id)
+        : time(a_time), watch_id(a_watch_id) { }
+    uint64_t time;
+    int watch_id;
+  };
+
+  // Makes std heap functions keep the earliest timer on top.
+  struct TimerLater {
+    bool operator()(const TimerEntry &a, const TimerEntry &b) const {
+      return a.time > b.time;
+    }
+  };
+
+  typedef std::map<int, WatchNode> WatchMap;
+  typedef std::map<int, FdNode> FdMap;
+  typedef std::vector<TimerEntry> TimerHeap;
+
+ public:
+  Impl(MainLoopInterface *main_loop)
+    : main_loop_(main_loop),
+#ifdef HAVE_EPOLL
+      epoll_fd_(epoll_create1(EPOLL_CLOEXEC)),
+#endif
+      wakeup_fd_(-1),
+      wakeup_write_fd_(-1),
+#ifdef HAVE_PTHREAD
+      main_loop_thread_(pthread_self()),
+#endif
+      // serial_ starts from 1, because 0 is an invalid watch id.
+      serial_(1),
+      depth_(0),
+      timer_count_(0),
+      always_ready_count_(0) {
+#ifdef HAVE_EPOLL
+    ASSERT(epoll_fd_ >= 0);
+#endif
+#ifdef HAVE_PTHREAD
+    VERIFY(pthread_mutex_init(&mutex_, NULL) == 0);
+    // Add an eventfd or a pipe for waking up the main loop. Only useful in
+    // multi threads environment. If it fails, the main loop can still work
+    // in single thread environment.
+    OpenWakeUpFds();
+#endif
+  }
+
+  ~Impl() {
+    RemoveAllWatches();
+    if (wakeup_write_fd_ >= 0 && wakeup_write_fd_ != wakeup_fd_)
+      close(wakeup_write_fd_);
+    if (wakeup_fd_ >= 0) close(wakeup_fd_);
+#ifdef HAVE_EPOLL
+    if (epoll_fd_ >= 0) close(epoll_fd_);
+#endif
+#ifdef HAVE_PTHREAD
+    VERIFY(pthread_mutex_destroy(&mutex_) == 0);
+#endif
+  }
+
+  // Add an IO read or write watch for a specified file descriptor into main
+  // loop.
+  // type can be IO_READ_WATCH or IO_WRITE_WATCH.
+  // callback points to an object to be called back when the required condition
+  // occurs on fd.
+  // This function returns an unique id of the new watch.
+  int AddIOWatch(MainLoopInterface::WatchType type, int fd,
+                 WatchCallbackInterface *callback) {
+    if (fd < 0 || !callback || !CanWatchFd(fd)) return -1;
+    Lock();
+    WatchNode node;
+    int watch_id = serial_;
+    node.type = type;
+    node.data = fd;
+    node.callback = callback;
+    watches_[watch_id] = node;
+    IncreaseSerial();
+    fds_[fd].watches.push_back(watch_id);
+    UpdateFd(fd);
+    WakeUpUnLocked();
+    Unlock();
+    return watch_id;
+  }
+
+  // Add a timeout watch with a specified interval into the main loop.
+  // interval is number of milliseconds to wait before calling callback.
+  // This function returns an unique id of the new watch.
+  int AddTimeoutWatch(int interval, WatchCallbackInterface *callback) {
+    if (interval < 0 || !callback) return -1;
+    Lock();
+    WatchNode node;
+    int watch_id = serial_;
+    node.type = TIMEOUT_WATCH;
+    node.data = interval;
+    node.next_time = GetCurrentTime() + static_cast<uint64_t>(interval);
+    node.callback = callback;
+    watches_[watch_id] = node;
+    IncreaseSerial();
+    timer_count_++;
+    PushTimer(TimerEntry(node.next_time, watch_id));
+    WakeUpUnLocked();
+    Unlock();
+    return watch_id;
+  }
+
+  // Return the type of a watch.
+  // It could be IO_READ_WATCH, IO_WRITE_WATCH or TIMEOUT_WATCH.
+  // If it returns INVALID_WATCH, then means there is no watch
+  // associated to specified watch_id.
+  MainLoopInterface::WatchType GetWatchType(int watch_id) {
+    Lock();
+    MainLoopInterface::WatchType type = INVALID_WATCH;
+    WatchMap::iterator iter = watches_.find(watch_id);
+    if (iter != watches_.end())
+      type = iter->second.type;
+    Unlock();
+    return type;
+  }
+
+  // Return the data of a watch.
+  // For IO read or write watch, it returns the file descriptor.
+  // For timeout watch, it returns the interval.
+  // If the watch_id is invalid, then returns -1.
+  int GetWatchData(int watch_id) {
+    Lock();
+    int data = -1;
+    WatchMap::iterator iter = watches_.find(watch_id);
+    if (iter != watches_.end())
+      data = iter->second.data;
+    Unlock();
+    return data;
+  }
+
+  // Remove a watch by a specified watch_id.
+  // OnRemove() method of associated watch callback object will be called
+  // before removing the watch.
+  void RemoveWatch(int watch_id) {
+    Lock();
+    WatchMap::iterator iter = watches_.find(watch_id);
+    if (iter != watches_.end() && !iter->second.removing) {
+      iter->second.removing = true;
+      // Only do real remove when it's not being called.
+      // If the watch is being called, it will be removed just after calling
+      // by DoIteration method.
+      if (!iter->second.calling) {
+        WatchCallbackInterface *callback = iter->second.callback;
+        Unlock();
+        callback->OnRemove(main_loop_, watch_id);
+        Lock();
+        // It's safe to erase the watch node here. Because the removing flag
+        // has been set to true, then this callback won't be called anymore
+        // in DoIteration method and it won't be removed again.
+        EraseWatch(watch_id);
+        WakeUpUnLocked();
+      }
+    }
+    Unlock();
+  }
+
+  // Runs a single iteration of the main loop.
+  // It'll check to see if any event watches are ready to be processed.
+  // If no event watches are ready and may_block is true, then waits
+  // for watches to become ready, then dispatches the watches that are
+  // ready. Note that even when may_block is true, it is still possible
+  // to return false, since the wait may be interrupted for other reasons
+  // than an event watch becoming ready.
+  // if may_block is false, then returns immediately if no event watches
+  // are ready.
+  // Return true if one or more watch has been dispatched during this
+  // iteration.
+  bool DoIteration(bool may_block) {
+    Lock();
+#ifdef HAVE_PTHREAD
+    main_loop_thread_ = pthread_self();
+#endif
+
+    // Record some states.
+    int original_depth = depth_;
+
+    // The wait timeout is determined by the earliest timeout watch.
+    uint64_t now = GetCurrentTime();
+    int timeout = (may_block && !always_ready_count_ ? -1 : 0);
+    const TimerEntry *first_timer = PeekTimer();
+    if (first_timer) {
+      if (first_timer->time <= now) {
+        timeout = 0;
+      } else if (timeout == -1 ||
+                 first_timer->time - now < static_cast<uint64_t>(timeout)) {
+        timeout = static_cast<int>(
+            std::min(first_timer->time - now,
+                     static_cast<uint64_t>(INT_MAX)));
+      }
+    }
+
+    // Unlock mutex_ before waiting, so that others can call main loop
+    // methods during waiting.
+    ReadyEvent events[kMaxEpollEvents];
+    int count = WaitEvents(events, timeout);
+    if (count < 0) return false;
+
+    // Collect the watches to be called. Watches are called by ids, because
+    // the callbacks may add or remove watches.
+    std::vector<int> ready;
+    for (int i = 0; i < count; ++i) {
+      int fd = events[i].fd;
+      if (fd == wakeup_fd_) {
+        uint64_t value;
+        // Just clear the counter of the eventfd, or drain the pipe.
+        while (read(wakeup_fd_, &value, sizeof(value)) > 0);
+        continue;
+      }
+      FdMap::iterator fd_iter = fds_.find(fd);
+      if (fd_iter != fds_.end())
+        CollectIOWatches(fd_iter->second, events[i].events, &ready);
+    }
+    if (always_ready_count_) {
+      for (FdMap::iterator it = fds_.begin(); it != fds_.end(); ++it) {
+        if (it->second.always_ready)
+          CollectIOWatches(it->second, kEventIn | kEventOut, &ready);
+      }
+    }
+
+    now = GetCurrentTime();
+    std::vector<TimerEntry> expired;
+    while ((first_timer = PeekTimer()) != NULL && first_timer->time <= now) {
+      expired.push_back(*first_timer);
+      std::pop_heap(timers_.begin(), timers_.end(), TimerLater());
+      timers_.pop_back();
+    }
+    // Reschedule expired watches after the loop above, otherwise watches
+    // with 0 interval would expire again and again.
+    for (size_t i = 0; i < expired.size(); ++i) {
+      WatchNode *node = &watches_[expired[i].watch_id];
+      node->next_time += static_cast<uint64_t>(node->data);
+      PushTimer(TimerEntry(node->next_time, expired[i].watch_id));
+      ready.push_back(expired[i].watch_id);
+    }
+
+    // Check and call callbacks of available events.
+    bool ret = false;
+    for (size_t i = 0; i < ready.size(); ++i) {
+      int watch_id = ready[i];
+      WatchMap::iterator iter = watches_.find(watch_id);
+      // Don't call the watch if it's currently being called or removed,
+      // to prevent it from being called recursively. Such situation is only
+      // possible when the main loop is being run recursively.
+      if (iter == watches_.end() || iter->second.calling ||
+          iter->second.removing)
+        continue;
+
+      ret = true;
+      WatchCallbackInterface *callback = iter->second.callback;
+      // Set calling flag to prevent the watch from being removed during the
+      // call.
+      iter->second.calling = true;
+      Unlock();
+      bool keep = callback->Call(main_loop_, watch_id);
+      Lock();
+      iter = watches_.find(watch_id);
+      // The watch shouldn't be removed. Otherwise something wrong must be
+      // happened.
+      ASSERT(iter != watches_.end());
+
+      if (iter != watches_.end()) {
+        iter->second.calling = false;
+        if (!keep || iter->second.removing) {
+          iter->second.removing = true;
+          callback = iter->second.callback;
+          Unlock();
+          callback->OnRemove(main_loop_, watch_id);
+          Lock();
+          EraseWatch(watch_id);
+        }
+      }
+
+      // If Quit() has been called, then quit current iteration directly.
+      // Remained events will be handled in the next iteration.
+      if (original_depth != depth_)
+        break;
+    }
+    Unlock();
+    return ret;
+  }
+
+  void Run() {
+    Lock();
+    ASSERT(depth_ >= 0);
+
+#ifdef HAVE_PTHREAD
+    // If the main loop is already running in another thread,
+    // then just return.
+    if (depth_ > 0 && pthread_equal(pthread_self(), main_loop_thread_) == 0) {
+      ASSERT_M(false, ("Main loop can't be run in more than one threads!"));
+      Unlock();
+      return;
+    }
+    main_loop_thread_ = pthread_self();
+#endif
+
+    int exit_depth = depth_;
+    depth_++;
+
+    while (depth_ != exit_depth) {
+      Unlock();
+      DoIteration(true);
+      Lock();
+    }
+    Unlock();
+  }
+
+  void Quit() {
+    Lock();
+    ASSERT(depth_ >= 0);
+    if (depth_ > 0) {
+      WakeUpUnLocked();
+      --depth_;
+    }
+    Unlock();
+  }
+
+  // check whether the main loop is running or not.
+  bool IsRunning() {
+    return depth_ > 0;
+  }
+
+  uint64_t GetCurrentTime() const {
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return static_cast<uint64_t>(tv.tv_sec)*1000 + tv.tv_usec/1000;
+  }
+
+  bool IsMainThread() const {
+#ifdef HAVE_PTHREAD
+    return pthread_equal(pthread_self(), main_loop_thread_) != 0;
+#else
+    return true;
+#endif
+  }
+
+  void WakeUp() {
+    if (!IsMainThread()) {
+      Lock();
+      WakeUpUnLocked();
+      Unlock();
+    }
+  }
+
+ private:
+  void Lock() {
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock(&mutex_);
+#endif
+  }
+
+  void Unlock() {
+#ifdef HAVE_PTHREAD
+    pthread_mutex_unlock(&mutex_);
+#endif
+  }
+
+  void WakeUpUnLocked() {
+    if (!IsRunning()) return;
+    // Wakeup the main loop by signaling the eventfd or the pipe.
+    // This function can only be called in another thread.
+    if (wakeup_write_fd_ >= 0 && !IsMainThread()) {
+      uint64_t value = 1;
+      write(wakeup_write_fd_, &value, sizeof(value));
+    }
+  }
+
+  void OpenWakeUpFds() {
+#ifdef HAVE_EVENTFD
+    wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    wakeup_write_fd_ = wakeup_fd_;
+#else
+    int fds[2];
+    if (pipe(fds) != 0)
+      return;
+    for (int i = 0; i < 2; ++i) {
+      fcntl(fds[i], F_SETFL, O_NONBLOCK);
+      fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    wakeup_fd_ = fds[0];
+    wakeup_write_fd_ = fds[1];
+#endif
+#ifdef HAVE_EPOLL
+    if (wakeup_fd_ >= 0 && epoll_fd_ >= 0) {
+      struct epoll_event event;
+      event.events = EPOLLIN;
+      event.data.fd = wakeup_fd_;
+      epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wakeup_fd_, &event);
+    }
+#endif
+  }
+
+  bool CanWatchFd(int fd) const {
+#ifdef HAVE_EPOLL
+    return epoll_fd_ >= 0;
+#else
+    // Due to the limitation of select() function, fd must be less than
+    // FD_SETSIZE.
+    return fd < FD_SETSIZE;
+#endif
+  }
+
+  // Waits for events of the registered fds and the wakeup fd, at most
+  // timeout milliseconds, or forever if timeout is -1. Must be called with
+  // mutex_ locked, which is unlocked during waiting, so that others can
+  // call main loop methods. Returns the number of events, or -1 on error,
+  // in which case mutex_ is left unlocked.
+  int WaitEvents(ReadyEvent *ready, int timeout) {
+#ifdef HAVE_EPOLL
+    Unlock();
+    struct epoll_event events[kMaxEpollEvents];
+    int count = epoll_wait(epoll_fd_, events, kMaxEpollEvents, timeout);
+    if (count < 0) return -1;
+    Lock();
+    for (int i = 0; i < count; ++i) {
+      ready[i].fd = events[i].data.fd;
+      ready[i].events = events[i].events;
+    }
+    return count;
+#else
+    fd_set read_fds, write_fds;
+    FD_ZERO(&read_fds);
+    FD_ZERO(&write_fds);
+    int max_fd = -1;
+    if (wakeup_fd_ >= 0) {
+      FD_SET(wakeup_fd_, &read_fds);
+      max_fd = wakeup_fd_;
+    }
+    for (FdMap::iterator it = fds_.begin(); it != fds_.end(); ++it) {
+      if (it->second.events & kEventIn)
+        FD_SET(it->first, &read_fds);
+      if (it->second.events & kEventOut)
+        FD_SET(it->first, &write_fds);
+      max_fd = std::max(max_fd, it->first);
+    }
+
+    struct timeval wait_tv;
+    if (timeout >= 0) {
+      wait_tv.tv_sec = timeout / 1000;
+      wait_tv.tv_usec = (timeout % 1000) * 1000;
+    }
+    Unlock();
+    int result = select(max_fd + 1, &read_fds, &write_fds, NULL,
+                        (timeout >= 0 ? &wait_tv : NULL));
+    if (result < 0) return -1;
+    Lock();
+
+    int count = 0;
+    for (int fd = 0; fd <= max_fd && count < kMaxEpollEvents; ++fd) {
+      uint32_t events = (FD_ISSET(fd, &read_fds) ? kEventIn : 0) |
+                        (FD_ISSET(fd, &write_fds) ? kEventOut : 0);
+      if (events) {
+        ready[count].fd = fd;
+        ready[count].events = events;
+        ++count;
+      }
+    }
+    return count;
+#endif
+  }
+
+  // Registers the union of events of all watches of fd into epoll, or
+  // unregisters fd if it has no watch.
+  void UpdateFd(int fd) {
+    FdMap::iterator iter = fds_.find(fd);
+    if (iter == fds_.end())
+      return;
+    FdNode *node = &iter->second;
+    uint32_t events = 0;
+    for (size_t i = 0; i < node->watches.size(); ++i) {
+      events |= (watches_[node->watches[i]].type == IO_READ_WATCH ?
+                 kEventIn : kEventOut);
+    }
+
+    if (!events) {
+#ifdef HAVE_EPOLL
+      // The fd may have been closed, which removed it from epoll already.
+      if (node->registered)
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, NULL);
+#endif
+      if (node->always_ready)
+        always_ready_count_--;
+      fds_.erase(iter);
+      return;
+    }
+    if (events == node->events && (node->registered || node->always_ready))
+      return;
+
+    node->events = events;
+#ifdef HAVE_EPOLL
+    struct epoll_event event;
+    event.events = events;
+    event.data.fd = fd;
+    if (node->registered &&
+        epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &event) == 0)
+      return;
+    // Either fd is new, or it was closed and reopened before being
+    // modified.
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) == 0) {
+      node->registered = true;
+    } else {
+      node->registered = false;
+      if (errno == EPERM && !node->always_ready) {
+        node->always_ready = true;
+        always_ready_count_++;
+      }
+    }
+#else
+    node->registered = true;
+#endif
+  }
+
+  void CollectIOWatches(const FdNode &node, uint32_t events,
+                        std::vector<int> *ready) {
+    // Errors and hang-ups are reported to both read and write watches,
+    // so that they can find out the errors by reading or writing.
+    bool readable = (events & (kEventIn | kEventErr | kEventHup)) != 0;
+    bool writable = (events & (kEventOut | kEventErr | kEventHup)) != 0;
+    for (size_t i = 0; i < node.watches.size(); ++i) {
+      MainLoopInterface::WatchType type = watches_[node.watches[i]].type;
+      if ((type == IO_READ_WATCH && readable) ||
+          (type == IO_WRITE_WATCH && writable))
+        ready->push_back(node.watches[i]);
+    }
+  }
+
+  // Returns the earliest valid timer entry, discarding stale entries of
+  // removed watches on the way.
+  const TimerEntry *PeekTimer() {
+    while (!timers_.empty()) {
+      if (IsTimerValid(timers_.front()))
+        return &timers_.front();
+      std::pop_heap(timers_.begin(), timers_.end(), TimerLater());
+      timers_.pop_back();
+    }
+    return NULL;
+  }
+
+  bool IsTimerValid(const TimerEntry &entry) {
+    WatchMap::const_iterator iter = watches_.find(entry.watch_id);
+    return iter != watches_.end() && iter->second.type == TIMEOUT_WATCH &&
+           !iter->second.removing && iter->second.next_time == entry.time;
+  }
+
+  void PushTimer(const TimerEntry &entry) {
+    if (timers_.size() >= timer_count_ + kMaxStaleTimers) {
+      // Too many stale entries, rebuild the heap with valid ones.
+      TimerHeap valid;
+      valid.reserve(timer_count_ + 1);
+      for (TimerHeap::iterator it = timers_.begin();
+           it != timers_.end(); ++it) {
+        if (IsTimerValid(*it))
+          valid.push_back(*it);
+      }
+      std::make_heap(valid.begin(), valid.end(), TimerLater());
+      timers_.swap(valid);
+    }
+    timers_.push_back(entry);
+    std::push_heap(timers_.begin(), timers_.end(), TimerLater());
+  }
+
+  // Erases the node of a watch whose callback's OnRemove() has been called.
+  void EraseWatch(int watch_id) {
+    WatchMap::iterator iter = watches_.find(watch_id);
+    if (iter == watches_.end())
+      return;
+    MainLoopInterface::WatchType type = iter->second.type;
+    int data = iter->second.data;
+    if (type == TIMEOUT_WATCH) {
+      // The entry in the heap becomes stale.
+      timer_count_--;
+      watches_.erase(iter);
+    } else {
+      FdMap::iterator fd_iter = fds_.find(data);
+      if (fd_iter != fds_.end()) {
+        std::vector<int> *ids = &fd_iter->second.watches;
+        ids->erase(std::remove(ids->begin(), ids->end(), watch_id),
+                   ids->end());
+      }
+      watches_.erase(iter);
+      UpdateFd(data);
+    }
+  }
+
+  void RemoveAllWatches() {
+    Lock();
+    WatchMap::iterator iter = watches_.begin();
+    while (iter != watches_.end()) {
+      int watch_id = iter->first;
+      WatchCallbackInterface *callback = iter->second.callback;
+      iter->second.removing = true;
+      Unlock();
+      callback->OnRemove(main_loop_, watch_id);
+      Lock();
+      EraseWatch(watch_id);
+      iter = watches_.begin();
+    }
+    Unlock();
+  }
+
+  // Increase serial_ by one, taking care of overflow and overlap issue.
+  // It's almost impossible that 2 ** 31 space are all occupied, so the while
+  // won't be a dead loop.
+  void IncreaseSerial() {
+    if (serial_ == INT_MAX) {
+      // serial_ starts from 1, because 0 is an invalid watch id.
+      serial_ = 1;
+    } else {
+      ++serial_;
+    }
+    while (watches_.find(serial_) != watches_.end())
+      ++serial_;
+  }
+
+  MainLoopInterface *main_loop_;
+#ifdef HAVE_EPOLL
+  int epoll_fd_;
+#endif
+  // eventfd, or read end of a pipe, for waking up main loop, which is added
+  // into epoll directly.
+  int wakeup_fd_;
+  // The fd to be written to wake up main loop, which is wakeup_fd_ itself
+  // if it's an eventfd.
+  int wakeup_write_fd_;
+
+#ifdef HAVE_PTHREAD
+  pthread_t main_loop_thread_;
+  pthread_mutex_t mutex_;
+#endif
+
+  WatchMap watches_;
+  FdMap fds_;
+  TimerHeap timers_;
+  int serial_;
+  int depth_;
+  // Number of live timeout watches.
+  size_t timer_count_;
+  // Number of fds in fds_ which can't be added into epoll.
+  int always_ready_count_;
+};
+
+NativeMainLoop::NativeMainLoop()
+  : impl_(new Impl(this)) {
+}
+NativeMainLoop::~NativeMainLoop() {
+  delete impl_;
+}
+int NativeMainLoop::AddIOReadWatch(int fd, WatchCallbackInterface *callback) {
+  return impl_->AddIOWatch(IO_READ_WATCH, fd, callback);
+}
+int NativeMainLoop::AddIOWriteWatch(int fd, WatchCallbackInterface *callback) {
+  return impl_->AddIOWatch(IO_WRITE_WATCH, fd, callback);
+}
+int NativeMainLoop::AddTimeoutWatch(int interval,
+                                    WatchCallbackInterface *callback) {
+  return impl_->AddTimeoutWatch(interval, callback);
+}
+MainLoopInterface::WatchType NativeMainLoop::GetWatchType(int watch_id) {
+  return impl_->GetWatchType(watch_id);
+}
+int NativeMainLoop::GetWatchData(int watch_id) {
+  return impl_->GetWatchData(watch_id);
+}
+void NativeMainLoop::RemoveWatch(int watch_id) {
+  impl_->RemoveWatch(watch_id);
+}
+void NativeMainLoop::Run() {
+  impl_->Run();
+}
+bool NativeMainLoop::DoIteration(bool may_block) {
+  return impl_->DoIteration(may_block);
+}
+void NativeMainLoop::Quit() {
+  impl_->Quit();
+}
+bool NativeMainLoop::IsRunning() const {
+  return impl_->IsRunning();
+}
+uint64_t NativeMainLoop::GetCurrentTime() const {
+  return impl_->GetCurrentTime();
+}
+bool NativeMainLoop::IsMainThread() const {
+  return impl_->IsMainThread();
+}
+void NativeMainLoop::WakeUp() {
+  impl_->WakeUp();
+}
+
+} // namespace ggadget
@@ -14,16 +14,25 @@
   limitations under the License.
 */
 
-#ifndef GGADGET_TESTS_NATIVE_MAIN_LOOP_H__
-#define GGADGET_TESTS_NATIVE_MAIN_LOOP_H__
+#ifndef GGADGET_NATIVE_MAIN_LOOP_H__
+#define GGADGET_NATIVE_MAIN_LOOP_H__
 
 #include <ggadget/common.h>
 #include <ggadget/main_loop_interface.h>
 
 namespace ggadget {
 
-// Native implementation of MainLoopInterface.
-// This implementation uses select() to watch over the file descriptors.
+/**
+ * @ingroup MainLoop
+ *
+ * Native implementation of MainLoopInterface, which doesn't depend on any
+ * toolkit. It's suitable for hosts without a GUI toolkit main loop, and for
+ * tests.
+ *
+ * IO watches are monitored with epoll, so there is no limit on the values of
+ * file descriptors, and only ready watches are visited in each iteration.
+ * Timeout watches are kept in a binary heap ordered by their next fire time.
+ */
 class NativeMainLoop : public MainLoopInterface {
  public:
   NativeMainLoop();
@@ -45,8 +54,9 @@ class NativeMainLoop : public MainLoopInterface {
  private:
   class Impl;
   Impl *impl_;
+  DISALLOW_EVIL_CONSTRUCTORS(NativeMainLoop);
 };
 
 } // namespace ggadget
 
-#endif  // GGADGET_TESTS_NATIVE_MAIN_LOOP_H__
+#endif  // GGADGET_NATIVE_MAIN_LOOP_H__
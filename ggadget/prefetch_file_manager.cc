@@ -0,0 +1,349 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include <map>
+#include <string>
+#include <vector>
+#include <sys/time.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include "prefetch_file_manager.h"
+#include "logger.h"
+#include "slot.h"
+#include "small_object.h"
+
+namespace ggadget {
+
+class PrefetchFileManager::Impl : public SmallObject<> {
+ public:
+  enum State {
+    // Queued but not picked by any thread yet.
+    PENDING,
+    // Being read by a background thread.
+    READING,
+    // Read by a background thread, ok_ tells if the read succeeded.
+    DONE,
+    // Written or removed while being read, the result will be dropped.
+    DISCARDED
+  };
+
+  struct Entry {
+    Entry() : state(PENDING), ok(false) { }
+    State state;
+    bool ok;
+    std::string data;
+  };
+  typedef std::map<std::string, Entry> EntryMap;
+
+  struct Worker {
+    Impl *owner;
+    FileManagerInterface *file_manager;
+#ifdef HAVE_PTHREAD
+    pthread_t thread;
+#endif
+  };
+
+  Impl(FileManagerInterface *file_manager)
+      : file_manager_(file_manager), next_(0), stopping_(false) {
+    stats_.queued = 0;
+    stats_.prefetched = 0;
+    stats_.hits = 0;
+    stats_.bytes = 0;
+    stats_.wait_time = 0;
+#ifdef HAVE_PTHREAD
+    pthread_mutex_init(&mutex_, NULL);
+    pthread_cond_init(&cond_, NULL);
+#endif
+  }
+
+  ~Impl() {
+    Stop();
+    delete file_manager_;
+    file_manager_ = NULL;
+#ifdef HAVE_PTHREAD
+    pthread_cond_destroy(&cond_);
+    pthread_mutex_destroy(&mutex_);
+#endif
+  }
+
+  void Lock() {
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock(&mutex_);
+#endif
+  }
+
+  void Unlock() {
+#ifdef HAVE_PTHREAD
+    pthread_mutex_unlock(&mutex_);
+#endif
+  }
+
+  static uint64_t GetMicroseconds() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+  }
+
+  bool Prefetch(const std::vector<std::string> &files,
+                const std::vector<FileManagerInterface *> &workers) {
+    Stop();
+#ifdef HAVE_PTHREAD
+    Lock();
+    for (std::vector<std::string>::const_iterator it = files.begin();
+         it != files.end(); ++it) {
+      if (!it->empty() &&
+          entries_.insert(std::make_pair(*it, Entry())).second) {
+        queue_.push_back(*it);
+      }
+    }
+    stats_.queued += queue_.size();
+    Unlock();
+
+    for (size_t i = 0; i < workers.size(); ++i) {
+      if (!workers[i])
+        continue;
+      Worker *worker = new Worker;
+      worker->owner = this;
+      worker->file_manager = workers[i];
+      if (pthread_create(&worker->thread, NULL, WorkerThread, worker) == 0) {
+        workers_.push_back(worker);
+      } else {
+        LOG("Failed to start the prefetch thread.");
+        delete workers[i];
+        delete worker;
+      }
+    }
+    return !workers_.empty();
+#else
+    for (size_t i = 0; i < workers.size(); ++i)
+      delete workers[i];
+    return false;
+#endif
+  }
+
+  void Stop() {
+#ifdef HAVE_PTHREAD
+    Lock();
+    stopping_ = true;
+    Unlock();
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      pthread_join(workers_[i]->thread, NULL);
+      delete workers_[i]->file_manager;
+      delete workers_[i];
+    }
+#endif
+    workers_.clear();
+    entries_.clear();
+    queue_.clear();
+    next_ = 0;
+    stopping_ = false;
+  }
+
+#ifdef HAVE_PTHREAD
+  static void *WorkerThread(void *arg) {
+    Worker *worker = static_cast<Worker *>(arg);
+    worker->owner->ReadQueuedFiles(worker->file_manager);
+    return NULL;
+  }
+#endif
+
+  void ReadQueuedFiles(FileManagerInterface *file_manager) {
+    Lock();
+    while (!stopping_ && next_ < queue_.size()) {
+      EntryMap::iterator it = entries_.find(queue_[next_++]);
+      if (it == entries_.end() || it->second.state != PENDING)
+        continue;
+      // The entry won't be erased by others while it's being read, so the
+      // iterator remains valid after the lock is released.
+      it->second.state = READING;
+      Unlock();
+
+      std::string data;
+      bool ok = file_manager->ReadFile(it->first.c_str(), &data);
+
+      Lock();
+      if (it->second.state == READING) {
+        it->second.state = DONE;
+        it->second.ok = ok;
+        it->second.data.swap(data);
+        stats_.prefetched++;
+        stats_.bytes += it->second.data.size();
+      } else {
+        entries_.erase(it);
+      }
+#ifdef HAVE_PTHREAD
+      pthread_cond_broadcast(&cond_);
+#endif
+    }
+    Unlock();
+  }
+
+  // Takes the prefetched contents of a file. Returns false if the file is not
+  // prefetched, then it should be read directly.
+  bool TakeFile(const char *file, std::string *data) {
+    bool result = false;
+    Lock();
+    EntryMap::iterator it = entries_.find(file);
+    if (it != entries_.end()) {
+      if (it->second.state == READING) {
+        uint64_t start = GetMicroseconds();
+#ifdef HAVE_PTHREAD
+        while (it->second.state == READING)
+          pthread_cond_wait(&cond_, &mutex_);
+#endif
+        stats_.wait_time += GetMicroseconds() - start;
+      }
+      // A failed read is redone directly, which may report the error.
+      if (it->second.state == DONE && it->second.ok) {
+        data->swap(it->second.data);
+        stats_.hits++;
+        result = true;
+      }
+      // A pending file is read directly rather than waiting for its turn.
+      if (it->second.state != DISCARDED)
+        entries_.erase(it);
+    }
+    Unlock();
+    return result;
+  }
+
+  // Drops the prefetched contents of a file which is being changed.
+  void DiscardFile(const char *file) {
+    Lock();
+    EntryMap::iterator it = entries_.find(file);
+    if (it != entries_.end()) {
+      if (it->second.state == READING)
+        it->second.state = DISCARDED;
+      else if (it->second.state != DISCARDED)
+        entries_.erase(it);
+    }
+    Unlock();
+  }
+
+  Stats GetStats() {
+    Lock();
+    Stats stats = stats_;
+    Unlock();
+    return stats;
+  }
+
+  FileManagerInterface *file_manager_;
+  std::vector<Worker *> workers_;
+  EntryMap entries_;
+  std::vector<std::string> queue_;
+  size_t next_;
+  bool stopping_;
+  Stats stats_;
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t mutex_;
+  pthread_cond_t cond_;
+#endif
+};
+
+PrefetchFileManager::PrefetchFileManager(FileManagerInterface *file_manager)
+    : impl_(new Impl(file_manager)) {
+}
+
+PrefetchFileManager::~PrefetchFileManager() {
+  delete impl_;
+}
+
+bool PrefetchFileManager::Prefetch(
+    const std::vector<std::string> &files,
+    const std::vector<FileManagerInterface *> &workers) {
+  return impl_->Prefetch(files, workers);
+}
+
+void PrefetchFileManager::StopPrefetch() {
+  impl_->Stop();
+}
+
+PrefetchFileManager::Stats PrefetchFileManager::GetStats() const {
+  return impl_->GetStats();
+}
+
+bool PrefetchFileManager::IsValid() {
+  return impl_->file_manager_ && impl_->file_manager_->IsValid();
+}
+
+bool PrefetchFileManager::Init(const char *base_path, bool create) {
+  impl_->Stop();
+  return impl_->file_manager_ &&
+         impl_->file_manager_->Init(base_path, create);
+}
+
+bool PrefetchFileManager::ReadFile(const char *file, std::string *data) {
+  ASSERT(file && data);
+  if (!file || !*file || !data || !impl_->file_manager_)
+    return false;
+  return impl_->TakeFile(file, data) ||
+         impl_->file_manager_->ReadFile(file, data);
+}
+
+bool PrefetchFileManager::WriteFile(const char *file, const std::string &data,
+                                    bool overwrite) {
+  if (!file || !impl_->file_manager_)
+    return false;
+  impl_->DiscardFile(file);
+  return impl_->file_manager_->WriteFile(file, data, overwrite);
+}
+
+bool PrefetchFileManager::RemoveFile(const char *file) {
+  if (!file || !impl_->file_manager_)
+    return false;
+  impl_->DiscardFile(file);
+  return impl_->file_manager_->RemoveFile(file);
+}
+
+bool PrefetchFileManager::ExtractFile(const char *file,
+                                      std::string *into_file) {
+  return impl_->file_manager_ &&
+         impl_->file_manager_->ExtractFile(file, into_file);
+}
+
+bool PrefetchFileManager::FileExists(const char *file, std::string *path) {
+  return impl_->file_manager_ &&
+         impl_->file_manager_->FileExists(file, path);
+}
+
+bool PrefetchFileManager::IsDirectlyAccessible(const char *file,
+                                               std::string *path) {
+  return impl_->file_manager_ &&
+         impl_->file_manager_->IsDirectlyAccessible(file, path);
+}
+
+std::string PrefetchFileManager::GetFullPath(const char *file) {
+  return impl_->file_manager_ ?
+         impl_->file_manager_->GetFullPath(file) : std::string();
+}
+
+uint64_t PrefetchFileManager::GetLastModifiedTime(const char *file) {
+  return impl_->file_manager_ ?
+         impl_->file_manager_->GetLastModifiedTime(file) : 0;
+}
+
+bool PrefetchFileManager::EnumerateFiles(const char *dir,
+                                         Slot1<bool, const char *> *callback) {
+  if (impl_->file_manager_)
+    return impl_->file_manager_->EnumerateFiles(dir, callback);
+  delete callback;
+  return false;
+}
+
+} // namespace ggadget
@@ -0,0 +1,110 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#ifndef GGADGET_PREFETCH_FILE_MANAGER_H__
+#define GGADGET_PREFETCH_FILE_MANAGER_H__
+
+#include <string>
+#include <vector>
+#include <ggadget/common.h>
+#include <ggadget/file_manager_interface.h>
+
+namespace ggadget {
+
+/**
+ * @ingroup FileManager
+ * A wrapper FileManager which reads a list of files in background threads
+ * ahead of their use.
+ *
+ * All requests are dispatched to a real FileManager implementation, except
+ * that @c ReadFile() returns the prefetched contents of a file if it's
+ * available, or waits for the background read of the file to finish. Each
+ * background thread reads files through its own FileManager instance,
+ * because the FileManager implementations are not thread safe.
+ *
+ * The prefetched contents of a file is consumed by the first @c ReadFile()
+ * call of the file, so the wrapper only keeps the files which have not been
+ * requested yet. The wrapper itself must only be used in one thread.
+ */
+class PrefetchFileManager : public FileManagerInterface {
+ public:
+  /**
+   * Constructor.
+   *
+   * @param file_manager a FileManager instance to do the real task, it'll be
+   *        destroyed when this PrefetchFileManager instance is destroyed.
+   */
+  explicit PrefetchFileManager(FileManagerInterface *file_manager);
+  virtual ~PrefetchFileManager();
+
+  /**
+   * Starts to read the files in background threads.
+   *
+   * @param files the names of the files to read, relative to the base path.
+   * @param workers the FileManager instances used by the background threads,
+   *        one thread for each instance. They must refer to the same base path
+   *        as the wrapped FileManager, and will be destroyed when the prefetch
+   *        is stopped.
+   * @return true if the background threads are started. Prefetch is not
+   *        supported if the library is built without pthread.
+   */
+  bool Prefetch(const std::vector<std::string> &files,
+                const std::vector<FileManagerInterface *> &workers);
+
+  /**
+   * Stops the background threads, and discards the prefetched contents which
+   * have not been requested yet. It's called automatically on destruction.
+   */
+  void StopPrefetch();
+
+  /** The statistics of the prefetch, for profiling. */
+  struct Stats {
+    /** The number of files which were queued to prefetch. */
+    size_t queued;
+    /** The number of files which were read in background threads. */
+    size_t prefetched;
+    /** The number of @c ReadFile() calls served by prefetched contents. */
+    size_t hits;
+    /** The total bytes read in background threads. */
+    size_t bytes;
+    /** The time spent by @c ReadFile() waiting for background reads, in us. */
+    uint64_t wait_time;
+  };
+  Stats GetStats() const;
+
+  virtual bool IsValid();
+  virtual bool Init(const char *base_path, bool create);
+  virtual bool ReadFile(const char *file, std::string *data);
+  virtual bool WriteFile(const char *file, const std::string &data,
+                         bool overwrite);
+  virtual bool RemoveFile(const char *file);
+  virtual bool ExtractFile(const char *file, std::string *into_file);
+  virtual bool FileExists(const char *file, std::string *path);
+  virtual bool IsDirectlyAccessible(const char *file, std::string *path);
+  virtual std::string GetFullPath(const char *file);
+  virtual uint64_t GetLastModifiedTime(const char *file);
+  virtual bool EnumerateFiles(const char *dir,
+                              Slot1<bool, const char *> *callback);
+
+ private:
+  class Impl;
+  Impl *impl_;
+  DISALLOW_EVIL_CONSTRUCTORS(PrefetchFileManager);
+};
+
+} // namespace ggadget
+
+#endif // GGADGET_PREFETCH_FILE_MANAGER_H__
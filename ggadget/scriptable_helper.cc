@@ -18,11 +18,13 @@
 #include <map>
 #include <vector>
 #include "scriptable_helper.h"
+#include "atom_table.h"
 #include "logger.h"
 #include "scriptable_holder.h"
 #include "scriptable_interface.h"
 #include "signals.h"
 #include "slot.h"
+#include "small_object.h"
 #include "string_utils.h"
 
 namespace ggadget {
@@ -88,8 +90,10 @@ class ScriptableHelperImpl : public ScriptableHelperImplInterface {
                        const Variant &prototype,
                        Slot *getter, Slot *setter);
 
-  struct PropertyInfo {
-    PropertyInfo() : type(PROPERTY_NOT_EXIST) {
+  // Allocated separately and never moved, because OnRefChange() is bound to
+  // the address.
+  struct PropertyInfo : public SmallObject<> {
+    PropertyInfo(Atom a) : atom(a), type(PROPERTY_NOT_EXIST) {
       memset(&u, 0, sizeof(u));
     }
 
@@ -108,6 +112,7 @@ class ScriptableHelperImpl : public ScriptableHelperImplInterface {
       }
     }
 
+    Atom atom;
     PropertyType type;
     Variant prototype;
     union {
@@ -127,8 +132,96 @@ class ScriptableHelperImpl : public ScriptableHelperImplInterface {
     } u;
   };
 
-  // Because PropertyInfo is a copy-able struct, we must deallocate the
-  // resource outside of the struct instead of in ~PropertyInfo().
+  // A flat hash table of properties keyed by atoms, with linear probing.
+  // The atoms are sequential integers, so a multiplicative hash spreads them
+  // well enough.
+  class PropertyTable {
+   public:
+    PropertyTable() { }
+    // The owner must have called DestroyPropertyInfo() on all properties.
+    ~PropertyTable() {
+      for (size_t i = 0; i < entries_.size(); ++i)
+        delete entries_[i];
+    }
+
+    size_t size() const { return entries_.size(); }
+    PropertyInfo *at(size_t i) const { return entries_[i]; }
+
+    PropertyInfo *Find(Atom atom) const {
+      if (buckets_.empty())
+        return NULL;
+      size_t mask = buckets_.size() - 1;
+      for (size_t i = Hash(atom) & mask; buckets_[i]; i = (i + 1) & mask) {
+        PropertyInfo *info = entries_[buckets_[i] - 1];
+        if (info->atom == atom)
+          return info;
+      }
+      return NULL;
+    }
+
+    // Returns the existing property of the atom, or adds a new one.
+    PropertyInfo *Add(Atom atom) {
+      PropertyInfo *info = Find(atom);
+      if (!info) {
+        info = new PropertyInfo(atom);
+        entries_.push_back(info);
+        if (entries_.size() * 2 > buckets_.size())
+          Rehash();
+        else
+          Insert(entries_.size() - 1);
+      }
+      return info;
+    }
+
+    // Removes the property from the table, and returns it.
+    PropertyInfo *Remove(Atom atom) {
+      for (size_t i = 0; i < entries_.size(); ++i) {
+        if (entries_[i]->atom == atom) {
+          PropertyInfo *info = entries_[i];
+          entries_.erase(entries_.begin() + i);
+          Rehash();
+          return info;
+        }
+      }
+      return NULL;
+    }
+
+   private:
+    static size_t Hash(Atom atom) {
+      return static_cast<uint32_t>(atom) * 2654435761U;
+    }
+
+    void Insert(size_t index) {
+      size_t mask = buckets_.size() - 1;
+      size_t i = Hash(entries_[index]->atom) & mask;
+      while (buckets_[i])
+        i = (i + 1) & mask;
+      buckets_[i] = static_cast<uint32_t>(index + 1);
+    }
+
+    void Rehash() {
+      size_t size = 8;
+      while (size < entries_.size() * 2)
+        size *= 2;
+      buckets_.assign(entries_.empty() ? 0 : size, 0);
+      for (size_t i = 0; i < entries_.size(); ++i)
+        Insert(i);
+    }
+
+    std::vector<PropertyInfo *> entries_;
+    // Indexes into entries_ plus 1, 0 for empty buckets.
+    std::vector<uint32_t> buckets_;
+    DISALLOW_EVIL_CONSTRUCTORS(PropertyTable);
+  };
+
+  // Properties of a table sorted by their names.
+  typedef std::map<const char *, const PropertyInfo *,
+                   GadgetCharPtrComparator> SortedProperties;
+  static void SortProperties(const PropertyTable &table,
+                             SortedProperties *result);
+
+  // The resources are deallocated outside of the struct instead of in
+  // ~PropertyInfo(), because the class properties are intentionally leaked.
   static void DestroyPropertyInfo(PropertyInfo *info);
   const PropertyInfo *GetPropertyInfoInternal(const char *name);
 
@@ -136,31 +229,16 @@ class ScriptableHelperImpl : public ScriptableHelperImplInterface {
   mutable int ref_count_;
   bool registering_class_;
 
-  typedef LightMap<const char *, PropertyInfo,
-                   GadgetCharPtrComparator> PropertyInfoMap;
-
-  class ClassInfoMap : public LightMap<uint64_t, PropertyInfoMap> {
-   public:
-    ~ClassInfoMap() {
-      ClassInfoMap::iterator it = this->begin();
-      ClassInfoMap::iterator end = this->end();
-      for (; it != end; ++it) {
-        PropertyInfoMap::iterator prop_it = it->second.begin();
-        PropertyInfoMap::iterator prop_end = it->second.end();
-        for (; prop_it != prop_end; ++prop_it)
-          ScriptableHelperImpl::DestroyPropertyInfo(&prop_it->second);
-      }
-    }
-  };
+  typedef LightMap<uint64_t, PropertyTable *> ClassInfoMap;
 
   // Stores information of all properties of this object.
-  PropertyInfoMap property_info_;
+  PropertyTable property_info_;
   // Stores class-based property information for all classes.
   static ClassInfoMap *all_class_info_;
   // If a class has no class-based property_info, let class_property_info_
-  // point to this map to save duplicated blank maps.
-  static PropertyInfoMap *blank_property_info_;
-  PropertyInfoMap *class_property_info_;
+  // point to this table to save duplicated blank tables.
+  static PropertyTable *blank_property_info_;
+  PropertyTable *class_property_info_;
 
 #ifdef _DEBUG
   struct ClassStatInfo {
@@ -213,9 +291,9 @@ class ScriptableHelperImpl : public ScriptableHelperImplInterface {
 // exiting.
 ScriptableHelperImpl::ClassInfoMap *ScriptableHelperImpl::all_class_info_ =
   new ScriptableHelperImpl::ClassInfoMap;
-ScriptableHelperImpl::PropertyInfoMap
+ScriptableHelperImpl::PropertyTable
   *ScriptableHelperImpl::blank_property_info_ =
-    new ScriptableHelperImpl::PropertyInfoMap;
+    new ScriptableHelperImpl::PropertyTable;
 
 #ifdef _DEBUG
 ScriptableHelperImpl::ClassStat ScriptableHelperImpl::class_stat_;
@@ -246,10 +324,8 @@ ScriptableHelperImpl::~ScriptableHelperImpl() {
   ASSERT(ref_count_ == 0);
 
   // Free all owned slots.
-  for (PropertyInfoMap::iterator it = property_info_.begin();
-       it != property_info_.end(); ++it) {
-    DestroyPropertyInfo(&it->second);
-  }
+  for (size_t i = 0; i < property_info_.size(); ++i)
+    DestroyPropertyInfo(property_info_.at(i));
 
   delete array_getter_;
   delete array_setter_;
@@ -270,10 +346,10 @@ void ScriptableHelperImpl::EnsureRegistered() {
         // This class's DoClassRegister() did nothing.
         class_property_info_ = blank_property_info_;
       } else {
-        class_property_info_ = &it->second;
+        class_property_info_ = it->second;
       }
     } else {
-      class_property_info_ = &it->second;
+      class_property_info_ = it->second;
     }
     owner_->DoRegister();
 #ifdef _DEBUG
@@ -306,9 +382,14 @@ void ScriptableHelperImpl::AddPropertyInfo(const char *name, PropertyType type,
                                            const Variant &prototype,
                                            Slot *getter, Slot *setter) {
   uint64_t class_id = owner_->GetScriptable()->GetClassId();
-  PropertyInfo *info =
-      registering_class_ ? &(*all_class_info_)[class_id][name] :
-      &property_info_[name];
+  PropertyTable *table = &property_info_;
+  if (registering_class_) {
+    PropertyTable *&class_table = (*all_class_info_)[class_id];
+    if (!class_table)
+      class_table = new PropertyTable;
+    table = class_table;
+  }
+  PropertyInfo *info = table->Add(InternAtom(name));
   if (info->type != PROPERTY_NOT_EXIST) {
     // A previously registered property is overriden.
     DestroyPropertyInfo(info);
@@ -585,13 +666,12 @@ const ScriptableHelperImpl::PropertyInfo *
 ScriptableHelperImpl::GetPropertyInfoInternal(const char *name) {
   EnsureRegistered();
   ASSERT(class_property_info_);
-  PropertyInfoMap::const_iterator it = property_info_.find(name);
-  bool found = it != property_info_.end();
-  if (!found) {
-    it = class_property_info_->find(name);
-    found = it != class_property_info_->end();
-  }
-  return found ? &it->second : NULL;
+  // All registered names have been interned.
+  Atom atom = FindAtom(name);
+  if (atom == kInvalidAtom)
+    return NULL;
+  const PropertyInfo *info = property_info_.Find(atom);
+  return info ? info : class_property_info_->Find(atom);
 }
 
 ScriptableInterface::PropertyType ScriptableHelperImpl::GetPropertyInfo(
@@ -738,10 +818,7 @@ class ScriptableHelperImpl::InheritedPropertiesCallback {
   }
 
   bool Callback(const char *name, PropertyType type, const Variant &value) {
-    if (owner_->property_info_.find(name) ==
-            owner_->property_info_.end() &&
-        owner_->class_property_info_->find(name) ==
-            owner_->class_property_info_->end()) {
+    if (!owner_->GetPropertyInfoInternal(name)) {
       // Only emunerate inherited properties which are not overriden by this
       // scriptable object.
       return (*callback_)(name, type, value);
@@ -769,20 +846,25 @@ bool ScriptableHelperImpl::EnumerateProperties(
       return false;
     }
   }
-  for (PropertyInfoMap::const_iterator it = class_property_info_->begin();
-       it != class_property_info_->end(); ++it) {
-    if (property_info_.find(it->first) == property_info_.end()) {
+  // Properties of each table are enumerated in the order of their names,
+  // not in the order they were registered.
+  SortedProperties properties;
+  SortProperties(*class_property_info_, &properties);
+  for (SortedProperties::const_iterator it = properties.begin();
+       it != properties.end(); ++it) {
+    if (!property_info_.Find(it->second->atom)) {
       ResultVariant value = GetProperty(it->first);
-      if (!(*callback)(it->first, it->second.type, value.v())) {
+      if (!(*callback)(it->first, it->second->type, value.v())) {
         delete callback;
         return false;
       }
     }
   }
-  for (PropertyInfoMap::const_iterator it = property_info_.begin();
-       it != property_info_.end(); ++it) {
+  SortProperties(property_info_, &properties);
+  for (SortedProperties::const_iterator it = properties.begin();
+       it != properties.end(); ++it) {
     ResultVariant value = GetProperty(it->first);
-    if (!(*callback)(it->first, it->second.type, value.v())) {
+    if (!(*callback)(it->first, it->second->type, value.v())) {
       delete callback;
       return false;
     }
@@ -791,6 +873,15 @@ bool ScriptableHelperImpl::EnumerateProperties(
   return true;
 }
 
+void ScriptableHelperImpl::SortProperties(const PropertyTable &table,
+                                          SortedProperties *result) {
+  result->clear();
+  for (size_t i = 0; i < table.size(); ++i) {
+    const PropertyInfo *info = table.at(i);
+    (*result)[GetAtomName(info->atom)] = info;
+  }
+}
+
 bool ScriptableHelperImpl::EnumerateElements(
     EnumerateElementsCallback *callback) {
   // This helper does nothing.
@@ -805,11 +896,11 @@ bool ScriptableHelperImpl::RemoveProperty(const char *name) {
   EnsureRegistered();
   ASSERT(class_property_info_);
 
-  PropertyInfoMap::iterator it = property_info_.find(name);
-  if (it == property_info_.end())
+  PropertyInfo *info = property_info_.Remove(FindAtom(name));
+  if (!info)
     return false;
-  DestroyPropertyInfo(&it->second);
-  property_info_.erase(it);
+  DestroyPropertyInfo(info);
+  delete info;
   return true;
 }
 
@@ -17,7 +17,7 @@
 #include "signals.h"
 
 #include <algorithm>
-#include <vector>
+#include <new>
 #include "logger.h"
 #include "small_object.h"
 
@@ -60,20 +60,97 @@ bool Connection::Reconnect(Slot *slot) {
 class Signal::Impl : public SmallObject<> {
  public:
   Impl()
-      : default_connection_(NULL),
+      : list_(inline_list_),
+        size_(0),
+        capacity_(kInlineConnections),
+        inline_used_(0),
+        default_connection_(NULL),
         death_flag_ptr_(NULL) {
 #ifdef DEBUG_SIGNALS
     max_connection_length_ = 0;
 #endif
   }
 
+  ~Impl() {
+    for (size_t i = 0; i < size_; ++i) {
+      if (list_[i])
+        DestroyConnection(list_[i]);
+    }
+    if (list_ != inline_list_)
+      delete [] list_;
+  }
+
   static void EnsureImpl(Signal *signal) {
     if (!signal->impl_)
       signal->impl_ = new Impl;
   }
 
-  typedef std::vector<Connection *> Connections;
-  Connections connections_;
+  // Most signals have only a few connections, which are stored in the Impl
+  // itself instead of being allocated separately.
+  Connection *NewConnection(Signal *signal, Slot *slot) {
+    for (size_t i = 0; i < kInlineConnections; ++i) {
+      if (!(inline_used_ & (1U << i))) {
+        inline_used_ |= 1U << i;
+        return ::new (inline_storage_[i].bytes) Connection(signal, slot);
+      }
+    }
+    return new Connection(signal, slot);
+  }
+
+  void DestroyConnection(Connection *connection) {
+    for (size_t i = 0; i < kInlineConnections; ++i) {
+      if (connection ==
+          reinterpret_cast<Connection *>(inline_storage_[i].bytes)) {
+        connection->~Connection();
+        inline_used_ &= ~(1U << i);
+        return;
+      }
+    }
+    delete connection;
+  }
+
+  void Append(Connection *connection) {
+    if (size_ == capacity_) {
+      capacity_ *= 2;
+      Connection **list = new Connection *[capacity_];
+      std::copy(list_, list_ + size_, list);
+      if (list_ != inline_list_)
+        delete [] list_;
+      list_ = list;
+    }
+    list_[size_++] = connection;
+  }
+
+  size_t Find(Connection *connection) const {
+    return std::find(list_, list_ + size_, connection) - list_;
+  }
+
+  void Erase(size_t index) {
+    std::copy(list_ + index + 1, list_ + size_, list_ + index);
+    --size_;
+  }
+
+  // Erases the NULL entries left by Disconnect() during Emit().
+  void Compact() {
+    size_ = std::remove(list_, list_ + size_,
+                        static_cast<Connection *>(NULL)) - list_;
+  }
+
+  static const size_t kInlineConnections = 2;
+  union ConnectionStorage {
+    char bytes[sizeof(Connection)];
+    void *align;
+  };
+
+  // The connections in the order they were connected. It's a contiguous
+  // array so that Emit() can iterate it by index even if new connections
+  // are added in the slots. The first ones are stored in inline_list_.
+  Connection **list_;
+  size_t size_;
+  size_t capacity_;
+  Connection *inline_list_[kInlineConnections];
+  ConnectionStorage inline_storage_[kInlineConnections];
+  unsigned int inline_used_;
   Connection *default_connection_;
 
   // During an Emit() call, this Signal object may be deleted in some slot.
@@ -109,11 +186,6 @@ Signal::~Signal() {
   if (!impl_)
     return;
 
-  for (Impl::Connections::iterator it = impl_->connections_.begin();
-       it != impl_->connections_.end(); ++it) {
-    delete *it;
-  }
-
   // Set *death_flag_ to true to let Emit() know this Signal is to be deleted.
   if (impl_->death_flag_ptr_)
     *impl_->death_flag_ptr_ = true;
@@ -129,6 +201,7 @@ Signal::~Signal() {
   }
 #endif
 
+  // Deletes the connections.
   delete impl_;
 }
 
@@ -173,11 +246,9 @@ bool Signal::CheckCompatibility(const Slot *slot) const {
 bool Signal::HasActiveConnections() const {
   if (!impl_)
     return false;
-  if (impl_->connections_.empty())
-    return false;
-  for (Impl::Connections::const_iterator it = impl_->connections_.begin();
-       it != impl_->connections_.end(); ++it) {
-    if (*it && (*it)->slot_)
+  for (size_t i = 0; i < impl_->size_; ++i) {
+    Connection *connection = impl_->list_[i];
+    if (connection && connection->slot_)
       return true;
   }
   return false;
@@ -204,9 +275,9 @@ ResultVariant Signal::Emit(int argc, const Variant argv[]) const {
 
   // Can't use iterator here, because new connection might be added during the
   // loop, which may invalidate the iterator.
-  size_t n_connections = impl_->connections_.size();
+  size_t n_connections = impl_->size_;
   for (size_t i = 0; i < n_connections && !*death_flag_ptr; ++i) {
-    Connection *connection = impl_->connections_[i];
+    Connection *connection = impl_->list_[i];
     if (connection && connection->slot_) {
       result = connection->slot_->Call(NULL, argc, argv);
     }
@@ -217,46 +288,38 @@ ResultVariant Signal::Emit(int argc, const Variant argv[]) const {
     // The outer most Emit() should erase all NULL slots in the connection
     // list to save memory. The NULL slots is created by Disconnect() called
     // during this Emit() call.
-    Impl::Connections::iterator it = impl_->connections_.begin();
-    while (it != impl_->connections_.end()) {
-      if (!*it)
-        it = impl_->connections_.erase(it);
-      else
-        ++it;
-    }
+    impl_->Compact();
   }
   return result;
 }
 
 Connection *Signal::Connect(Slot *slot) {
   Impl::EnsureImpl(this);
-  Connection *connection = new Connection(this, slot);
-  impl_->connections_.push_back(connection);
+  Connection *connection = impl_->NewConnection(this, slot);
+  impl_->Append(connection);
 #ifdef DEBUG_SIGNALS
-  if (impl_->connections_.size() > impl_->max_connection_length_)
-    impl_->max_connection_length_ = impl_->connections_.size();
+  if (impl_->size_ > impl_->max_connection_length_)
+    impl_->max_connection_length_ = impl_->size_;
 #endif
   return connection;
 }
 
 bool Signal::Disconnect(Connection *connection) {
   ASSERT(impl_);
-  Impl::Connections::iterator it = std::find(impl_->connections_.begin(),
-                                             impl_->connections_.end(),
-                                             connection);
-  if (it == impl_->connections_.end())
+  size_t index = impl_->Find(connection);
+  if (index == impl_->size_)
     return false;
 
   if (impl_->death_flag_ptr_) {
-    // Emit() is executing, so the vector can't be changed here.
-    *it = NULL;
+    // Emit() is executing, so the list can't be changed here.
+    impl_->list_[index] = NULL;
 #ifdef DEBUG_SIGNALS
     DLOG("Signal::Disconnect() called indirectly by Signal::Emit()");
 #endif
   } else {
-    impl_->connections_.erase(it);
+    impl_->Erase(index);
   }
-  delete connection;
+  impl_->DestroyConnection(connection);
   return true;
 }
 
@@ -277,7 +340,7 @@ Connection *Signal::SetDefaultSlot(Slot *slot) {
 size_t Signal::GetConnectionCount() const {
   if (!impl_)
     return 0;
-  return impl_->connections_.size();
+  return impl_->size_;
 }
 
 } // namespace ggadget
@@ -38,6 +38,10 @@
 #include <valgrind/valgrind.h>
 #endif
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
 namespace ggadget
 {
 
@@ -1088,11 +1092,184 @@ void DefaultDeallocator( void * p )
 #endif
 }
 
+// ThreadCacheDepot -----------------------------------------------------------
+
+/// Upper limit of # of bytes moved between a thread cache and the shared pool
+/// at a time.
+static const std::size_t kMagazineBytes = 2048;
+/// Upper limit of # of blocks moved between a thread cache and the shared
+/// pool at a time.
+static const std::size_t kMaxMagazineBlocks = 32;
+
+/** @struct Magazine
+    @ingroup SmallObjectGroupInternal
+ Free blocks of one size class cached by a thread.  The blocks are linked
+ through their first bytes.
+ */
+struct Magazine
+{
+    void * head;
+    std::size_t count;
+};
+
+/** @class ThreadCache
+    @ingroup SmallObjectGroupInternal
+ Per-thread magazines of free blocks, one per size class, so that most
+ allocations and deallocations needn't lock the shared FixedAllocators.
+ Blocks move between a magazine and the shared pool in batches.
+ ThreadCaches are allocated with malloc, because they are part of the
+ allocator.
+ */
+class ThreadCache
+{
+public:
+    static ThreadCache * Create( SmallObjAllocator * owner, std::size_t count )
+    {
+        ThreadCache * cache = static_cast< ThreadCache * >(
+            ::std::calloc( 1, sizeof( ThreadCache ) +
+                           count * sizeof( Magazine ) ) );
+        if ( NULL != cache )
+        {
+            cache->owner_ = owner;
+            cache->magazines_ = reinterpret_cast< Magazine * >( cache + 1 );
+        }
+        return cache;
+    }
+
+    /// Returns all cached blocks to the shared pool and frees the cache.
+    /// The depot must be locked.
+    static void Destroy( ThreadCache * cache );
+
+#ifdef HAVE_PTHREAD
+    /// Called when a thread having a cache exits.
+    static void OnThreadExit( void * cache );
+#endif
+
+    SmallObjAllocator * owner_;
+    Magazine * magazines_;
+    ThreadCache * prev_;
+    ThreadCache * next_;
+};
+
+/** @class ThreadCacheDepot
+    @ingroup SmallObjectGroupInternal
+ The shared state of SmallObjAllocator besides the FixedAllocators: the lock
+ protecting them, the registry of the thread caches and the statistics.
+ */
+class ThreadCacheDepot
+{
+public:
+    ThreadCacheDepot( std::size_t count )
+        : caches_( NULL )
+        , outBlocks_( count, 0 )
+        , peakBlocks_( count, 0 )
+    {
+#ifdef HAVE_PTHREAD
+        pthread_mutex_init( &mutex_, NULL );
+        pthread_key_create( &key_, ThreadCache::OnThreadExit );
+#else
+        cache_ = NULL;
+#endif
+    }
+
+    void Lock( void )
+    {
+#ifdef HAVE_PTHREAD
+        pthread_mutex_lock( &mutex_ );
+#endif
+    }
+
+    void Unlock( void )
+    {
+#ifdef HAVE_PTHREAD
+        pthread_mutex_unlock( &mutex_ );
+#endif
+    }
+
+    ThreadCache * GetCache( void ) const
+    {
+#ifdef HAVE_PTHREAD
+        return static_cast< ThreadCache * >( pthread_getspecific( key_ ) );
+#else
+        return cache_;
+#endif
+    }
+
+    void SetCache( ThreadCache * cache )
+    {
+#ifdef HAVE_PTHREAD
+        pthread_setspecific( key_, cache );
+#else
+        cache_ = cache;
+#endif
+    }
+
+    /// List of the thread caches, for the statistics.
+    ThreadCache * caches_;
+    /// # of blocks of each size class allocated from the FixedAllocators.
+    std::vector< std::size_t > outBlocks_;
+    /// High-water marks of outBlocks_.
+    std::vector< std::size_t > peakBlocks_;
+#ifdef HAVE_PTHREAD
+    pthread_mutex_t mutex_;
+    pthread_key_t key_;
+#else
+    ThreadCache * cache_;
+#endif
+};
+
+void ThreadCache::Destroy( ThreadCache * cache )
+{
+    SmallObjAllocator * owner = cache->owner_;
+    const std::size_t count = owner->GetSizeClassCount();
+    for ( std::size_t i = 0; i < count; ++i )
+    {
+        Magazine & magazine = cache->magazines_[ i ];
+        while ( NULL != magazine.head )
+        {
+            void * p = magazine.head;
+            magazine.head = *static_cast< void ** >( p );
+            owner->DoDeallocate( p, i );
+        }
+    }
+    ThreadCacheDepot * depot = owner->depot_;
+    if ( NULL != cache->prev_ )
+        cache->prev_->next_ = cache->next_;
+    else
+        depot->caches_ = cache->next_;
+    if ( NULL != cache->next_ )
+        cache->next_->prev_ = cache->prev_;
+    ::std::free( cache );
+}
+
+#ifdef HAVE_PTHREAD
+void ThreadCache::OnThreadExit( void * p )
+{
+    ThreadCache * cache = static_cast< ThreadCache * >( p );
+    ThreadCacheDepot * depot = cache->owner_->depot_;
+    depot->Lock();
+    Destroy( cache );
+    depot->Unlock();
+}
+#endif
+
+/// Returns # of blocks moved between a thread cache and the shared pool at a
+/// time, or 0 if blocks of the size can't be cached.
+inline std::size_t GetMagazineSize( std::size_t blockSize )
+{
+    if ( blockSize < sizeof( void * ) )
+        return 0;
+    const std::size_t blocks = kMagazineBytes / blockSize;
+    return blocks > kMaxMagazineBlocks ? kMaxMagazineBlocks :
+        ( blocks > 0 ? blocks : 1 );
+}
+
 // SmallObjAllocator::SmallObjAllocator ---------------------------------------
 
 SmallObjAllocator::SmallObjAllocator( std::size_t pageSize,
     std::size_t maxObjectSize, std::size_t objectAlignSize ) :
     pool_( NULL ),
+    depot_( NULL ),
     maxSmallObjectSize_( maxObjectSize ),
     objectAlignSize_( objectAlignSize )
 {
@@ -1101,13 +1278,19 @@ SmallObjAllocator::SmallObjAllocator( std::size_t pageSize,
     pool_ = new FixedAllocator[ allocCount ];
     for ( std::size_t i = 0; i < allocCount; ++i )
         pool_[ i ].Initialize( ( i+1 ) * objectAlignSize, pageSize );
+    depot_ = new ThreadCacheDepot( allocCount );
 }
 
 // SmallObjAllocator::~SmallObjAllocator --------------------------------------
 
 SmallObjAllocator::~SmallObjAllocator( void )
 {
+    depot_->Lock();
+    while ( NULL != depot_->caches_ )
+        ThreadCache::Destroy( depot_->caches_ );
+    depot_->Unlock();
     delete [] pool_;
+    // The depot is intentionally leaked, in case any thread still exits.
 }
 
 SmallObjAllocator & SmallObjAllocator::Instance( std::size_t pageSize,
@@ -1136,9 +1319,38 @@ SmallObjAllocator & SmallObjAllocator::Instance( std::size_t pageSize,
     return *instance;
 }
 
+// SmallObjAllocator::GetThreadCache ------------------------------------------
+
+ThreadCache * SmallObjAllocator::GetThreadCache( void )
+{
+    ThreadCache * cache = depot_->GetCache();
+    if ( NULL == cache )
+    {
+        cache = ThreadCache::Create( this, GetSizeClassCount() );
+        if ( NULL == cache )
+            return NULL;
+        depot_->Lock();
+        cache->next_ = depot_->caches_;
+        if ( NULL != depot_->caches_ )
+            depot_->caches_->prev_ = cache;
+        depot_->caches_ = cache;
+        depot_->Unlock();
+        depot_->SetCache( cache );
+    }
+    return cache;
+}
+
 // SmallObjAllocator::TrimExcessMemory ----------------------------------------
 
 bool SmallObjAllocator::TrimExcessMemory( void )
+{
+    depot_->Lock();
+    const bool found = DoTrimExcessMemory();
+    depot_->Unlock();
+    return found;
+}
+
+bool SmallObjAllocator::DoTrimExcessMemory( void )
 {
     bool found = false;
     const std::size_t allocCount = GetOffset( GetMaxObjectSize(), GetAlignment() );
@@ -1157,6 +1369,35 @@ bool SmallObjAllocator::TrimExcessMemory( void )
     return found;
 }
 
+// SmallObjAllocator::DoAllocate ----------------------------------------------
+
+void * SmallObjAllocator::DoAllocate( std::size_t index )
+{
+    FixedAllocator & allocator = pool_[ index ];
+    void * place = allocator.Allocate();
+
+    if ( ( NULL == place ) && DoTrimExcessMemory() )
+        place = allocator.Allocate();
+
+    if ( NULL != place )
+    {
+        std::size_t out = ++depot_->outBlocks_[ index ];
+        if ( out > depot_->peakBlocks_[ index ] )
+            depot_->peakBlocks_[ index ] = out;
+    }
+    return place;
+}
+
+// SmallObjAllocator::DoDeallocate --------------------------------------------
+
+void SmallObjAllocator::DoDeallocate( void * p, std::size_t index )
+{
+    const bool found = pool_[ index ].Deallocate( p, NULL );
+    (void) found;
+    assert( found );
+    --depot_->outBlocks_[ index ];
+}
+
 // SmallObjAllocator::Allocate ------------------------------------------------
 
 void * SmallObjAllocator::Allocate( std::size_t numBytes, bool doThrow )
@@ -1170,14 +1411,35 @@ void * SmallObjAllocator::Allocate( std::size_t numBytes, bool doThrow )
     const std::size_t allocCount = GetOffset( GetMaxObjectSize(), GetAlignment() );
     (void) allocCount;
     assert( index < allocCount );
+    assert( pool_[ index ].BlockSize() >= numBytes );
+    assert( pool_[ index ].BlockSize() < numBytes + GetAlignment() );
 
-    FixedAllocator & allocator = pool_[ index ];
-    assert( allocator.BlockSize() >= numBytes );
-    assert( allocator.BlockSize() < numBytes + GetAlignment() );
-    void * place = allocator.Allocate();
+    void * place = NULL;
+    ThreadCache * cache = GetThreadCache();
+    Magazine * magazine = cache ? &cache->magazines_[ index ] : NULL;
+    if ( NULL != magazine && NULL != magazine->head )
+    {
+        place = magazine->head;
+        magazine->head = *static_cast< void ** >( place );
+        --magazine->count;
+        return place;
+    }
 
-    if ( ( NULL == place ) && TrimExcessMemory() )
-        place = allocator.Allocate();
+    const std::size_t magazineSize = NULL == magazine ? 0 :
+        GetMagazineSize( pool_[ index ].BlockSize() );
+    depot_->Lock();
+    place = DoAllocate( index );
+    // Refill the magazine, so that the next allocations needn't lock.
+    for ( std::size_t i = 1; NULL != place && i < magazineSize; ++i )
+    {
+        void * block = DoAllocate( index );
+        if ( NULL == block )
+            break;
+        *static_cast< void ** >( block ) = magazine->head;
+        magazine->head = block;
+        ++magazine->count;
+    }
+    depot_->Unlock();
 
     if ( ( NULL == place ) && doThrow )
     {
@@ -1208,12 +1470,38 @@ void SmallObjAllocator::Deallocate( void * p, std::size_t numBytes )
     const std::size_t allocCount = GetOffset( GetMaxObjectSize(), GetAlignment() );
     (void) allocCount;
     assert( index < allocCount );
-    FixedAllocator & allocator = pool_[ index ];
-    assert( allocator.BlockSize() >= numBytes );
-    assert( allocator.BlockSize() < numBytes + GetAlignment() );
-    const bool found = allocator.Deallocate( p, NULL );
-    (void) found;
-    assert( found );
+    assert( pool_[ index ].BlockSize() >= numBytes );
+    assert( pool_[ index ].BlockSize() < numBytes + GetAlignment() );
+
+    const std::size_t magazineSize =
+        GetMagazineSize( pool_[ index ].BlockSize() );
+    ThreadCache * cache = magazineSize ? GetThreadCache() : NULL;
+    if ( NULL == cache )
+    {
+        depot_->Lock();
+        DoDeallocate( p, index );
+        depot_->Unlock();
+        return;
+    }
+
+    Magazine & magazine = cache->magazines_[ index ];
+    *static_cast< void ** >( p ) = magazine.head;
+    magazine.head = p;
+    ++magazine.count;
+    if ( magazine.count > 2 * magazineSize )
+    {
+        // Return a batch of blocks to the shared pool, so that blocks freed
+        // by other threads don't pile up in this thread.
+        depot_->Lock();
+        for ( std::size_t i = 0; i < magazineSize; ++i )
+        {
+            void * block = magazine.head;
+            magazine.head = *static_cast< void ** >( block );
+            DoDeallocate( block, index );
+        }
+        depot_->Unlock();
+        magazine.count -= magazineSize;
+    }
 }
 
 // SmallObjAllocator::Deallocate ----------------------------------------------
@@ -1222,29 +1510,29 @@ void SmallObjAllocator::Deallocate( void * p )
 {
     if ( NULL == p ) return;
     assert( NULL != pool_ );
-    FixedAllocator * pAllocator = NULL;
     const std::size_t allocCount = GetOffset( GetMaxObjectSize(), GetAlignment() );
     Chunk * chunk = NULL;
 
-    for ( std::size_t ii = 0; ii < allocCount; ++ii )
+    depot_->Lock();
+    std::size_t ii = 0;
+    for ( ; ii < allocCount; ++ii )
     {
         chunk = pool_[ ii ].HasBlock( p );
         if ( NULL != chunk )
-        {
-            pAllocator = &pool_[ ii ];
             break;
-        }
     }
-    if ( NULL == pAllocator )
+    if ( NULL == chunk )
     {
+        depot_->Unlock();
         DefaultDeallocator( p );
         return;
     }
 
-    assert( NULL != chunk );
-    const bool found = pAllocator->Deallocate( p, chunk );
+    const bool found = pool_[ ii ].Deallocate( p, chunk );
     (void) found;
     assert( found );
+    --depot_->outBlocks_[ ii ];
+    depot_->Unlock();
 }
 
 // SmallObjAllocator::IsCorrupt -----------------------------------------------
@@ -1267,12 +1555,36 @@ bool SmallObjAllocator::IsCorrupt( void ) const
         return true;
     }
     const std::size_t allocCount = GetOffset( GetMaxObjectSize(), GetAlignment() );
-    for ( std::size_t ii = 0; ii < allocCount; ++ii )
-    {
-        if ( pool_[ ii ].IsCorrupt() )
-            return true;
-    }
-    return false;
+    bool corrupt = false;
+    depot_->Lock();
+    for ( std::size_t ii = 0; ii < allocCount && !corrupt; ++ii )
+        corrupt = pool_[ ii ].IsCorrupt();
+    depot_->Unlock();
+    return corrupt;
+}
+
+// SmallObjAllocator::GetSizeClassCount ---------------------------------------
+
+std::size_t SmallObjAllocator::GetSizeClassCount( void ) const
+{
+    return GetOffset( GetMaxObjectSize(), GetAlignment() );
+}
+
+// SmallObjAllocator::GetStats ------------------------------------------------
+
+void SmallObjAllocator::GetStats( std::size_t sizeClass,
+    SmallObjStats & stats ) const
+{
+    assert( sizeClass < GetSizeClassCount() );
+    stats.blockSize = pool_[ sizeClass ].BlockSize();
+    stats.cachedBlocks = 0;
+    depot_->Lock();
+    for ( ThreadCache * cache = depot_->caches_; NULL != cache;
+          cache = cache->next_ )
+        stats.cachedBlocks += cache->magazines_[ sizeClass ].count;
+    stats.liveBlocks = depot_->outBlocks_[ sizeClass ] - stats.cachedBlocks;
+    stats.peakBlocks = depot_->peakBlocks_[ sizeClass ];
+    depot_->Unlock();
 }
 
 } // end namespace ggadget
@@ -53,6 +53,24 @@ namespace ggadget
 
 #if !defined(OS_WIN)
     class FixedAllocator;
+    class ThreadCache;
+    class ThreadCacheDepot;
+
+    /** @struct SmallObjStats
+        @ingroup SmallObjectGroup
+     Allocation statistics of one size class of SmallObjAllocator.
+     */
+    struct SmallObjStats
+    {
+        /// # of bytes of each block in the size class.
+        std::size_t blockSize;
+        /// # of blocks allocated and not yet deallocated.
+        std::size_t liveBlocks;
+        /// # of free blocks held in the per-thread caches.
+        std::size_t cachedBlocks;
+        /// High-water mark of liveBlocks + cachedBlocks.
+        std::size_t peakBlocks;
+    };
 
     /** @class SmallObjAllocator
         @ingroup SmallObjectGroupInternal
@@ -155,7 +173,33 @@ namespace ggadget
          */
         bool IsCorrupt( void ) const;
 
+        /// Returns # of size classes, the i-th of which holds blocks of
+        /// (i + 1) * GetAlignment() bytes.
+        std::size_t GetSizeClassCount( void ) const;
+
+        /** Gets the allocation statistics of a size class.  This is meant for
+         debugging.  The statistics are exact only if no other thread is
+         allocating or deallocating at the same time.
+         @param sizeClass index of the size class.
+         @param stats Receives the statistics.
+         */
+        void GetStats( std::size_t sizeClass, SmallObjStats & stats ) const;
+
     private:
+        friend class ThreadCache;
+
+        /// Returns the cache of the calling thread, creating it if needed.
+        ThreadCache * GetThreadCache( void );
+
+        /// TrimExcessMemory without locking.
+        bool DoTrimExcessMemory( void );
+
+        /// Allocates from the shared pool with the lock held.
+        void * DoAllocate( std::size_t index );
+
+        /// Deallocates to the shared pool with the lock held.
+        void DoDeallocate( void * p, std::size_t index );
+
         /// Default-constructor is not implemented.
         SmallObjAllocator( void );
         /// Copy-constructor is not implemented.
@@ -166,6 +210,9 @@ namespace ggadget
         /// Pointer to array of fixed-size allocators.
         FixedAllocator * pool_;
 
+        /// The lock of pool_ and the registry of the per-thread caches.
+        ThreadCacheDepot * depot_;
+
         /// Largest object size supported by allocators.
         const std::size_t maxSmallObjectSize_;
 
@@ -0,0 +1,75 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include "ggadget/atom_table.h"
+#include "ggadget/string_utils.h"
+#include "unittest/gtest.h"
+
+using namespace ggadget;
+
+TEST(AtomTable, Intern) {
+  size_t count = GetAtomCount();
+  ASSERT_EQ(kInvalidAtom, FindAtom("atom_table_test_a"));
+  ASSERT_EQ(kInvalidAtom, FindAtom(NULL));
+  ASSERT_EQ(NULL, GetAtomName(kInvalidAtom));
+
+  std::string name("atom_table_test_a");
+  Atom a = InternAtom(name.c_str());
+  ASSERT_NE(kInvalidAtom, a);
+  ASSERT_EQ(count + 1, GetAtomCount());
+  ASSERT_EQ(a, InternAtom("atom_table_test_a"));
+  ASSERT_EQ(a, FindAtom("atom_table_test_a"));
+  ASSERT_EQ(count + 1, GetAtomCount());
+
+  // The name is copied.
+  const char *interned = GetAtomName(a);
+  ASSERT_NE(name.c_str(), interned);
+  ASSERT_STREQ("atom_table_test_a", interned);
+
+  Atom b = InternAtom("atom_table_test_b");
+  ASSERT_NE(a, b);
+  ASSERT_STREQ("atom_table_test_b", GetAtomName(b));
+  Atom empty = InternAtom("");
+  ASSERT_NE(kInvalidAtom, empty);
+  ASSERT_STREQ("", GetAtomName(empty));
+  ASSERT_EQ(NULL, GetAtomName(static_cast<Atom>(GetAtomCount() + 1)));
+}
+
+TEST(AtomTable, Grow) {
+  std::vector<Atom> atoms;
+  for (int i = 0; i < 10000; ++i)
+    atoms.push_back(InternAtom(StringPrintf("grow%d", i).c_str()));
+  // A name longer than the blocks the names are stored in.
+  std::string long_name(10000, 'x');
+  Atom long_atom = InternAtom(long_name.c_str());
+
+  for (int i = 0; i < 10000; ++i) {
+    std::string name = StringPrintf("grow%d", i);
+    ASSERT_EQ(atoms[i], FindAtom(name.c_str()));
+    ASSERT_STREQ(name.c_str(), GetAtomName(atoms[i]));
+  }
+  ASSERT_EQ(long_atom, FindAtom(long_name.c_str()));
+  ASSERT_EQ(long_name, GetAtomName(long_atom));
+}
+
+int main(int argc, char **argv) {
+  testing::ParseGTestFlags(&argc, argv);
+  return RUN_ALL_TESTS();
+}
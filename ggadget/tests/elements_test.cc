@@ -18,6 +18,7 @@
 #include "unittest/gtest.h"
 #include "ggadget/basic_element.h"
 #include "ggadget/elements.h"
+#include "ggadget/event.h"
 #include "ggadget/view.h"
 #include "ggadget/element_factory.h"
 #include "ggadget/slot.h"
@@ -262,6 +263,32 @@ TEST_F(ElementsTest, TestGetByName) {
   ASSERT_TRUE(NULL == elements_->GetItemByName(""));
 }
 
+TEST_F(ElementsTest, TestGetByDuplicateName) {
+  ggadget::BasicElement *e1 = elements_->AppendElement("pie", "pie1");
+  ggadget::BasicElement *e2 = elements_->AppendElement("pie", "pie1");
+  ggadget::BasicElement *e3 = elements_->AppendElement("muffin", "muffin3");
+  // The lowest-indexed element is returned.
+  ASSERT_TRUE(e1 == elements_->GetItemByName("pie1"));
+  ggadget::BasicElement *e4 = elements_->InsertElement("pie", e1, "pie1");
+  ASSERT_TRUE(e4 == elements_->GetItemByName("pie1"));
+  ASSERT_TRUE(elements_->RemoveElement(e4));
+  ASSERT_TRUE(e1 == elements_->GetItemByName("pie1"));
+  ASSERT_TRUE(elements_->RemoveElement(e1));
+  ASSERT_TRUE(e2 == elements_->GetItemByName("pie1"));
+
+  // Moving elements updates the indexes of both containers.
+  ggadget::BasicElement *e5 =
+      another_elements_->AppendElement("muffin", "muffin3");
+  ASSERT_TRUE(another_elements_->InsertElement(e3, NULL));
+  ASSERT_TRUE(NULL == elements_->GetItemByName("muffin3"));
+  ASSERT_TRUE(e5 == another_elements_->GetItemByName("muffin3"));
+  ASSERT_TRUE(another_elements_->InsertElement(e3, e5));
+  ASSERT_TRUE(e3 == another_elements_->GetItemByName("muffin3"));
+
+  elements_->RemoveAllElements();
+  ASSERT_TRUE(NULL == elements_->GetItemByName("pie1"));
+}
+
 TEST_F(ElementsTest, TestInsert) {
   ggadget::BasicElement *e1 = elements_->InsertElement("muffin", NULL, NULL);
   ggadget::BasicElement *e2 = elements_->InsertElement("pie", e1, NULL);
@@ -389,6 +416,58 @@ TEST_F(ElementsTest, OnElementAddedRemovedSignal) {
   ASSERT_EQ(e1, element_just_removed_);
 }
 
+// Returns the child of elements under the point (x, y).
+static ggadget::BasicElement *HitTest(ggadget::Elements *elements,
+                                      double x, double y) {
+  ggadget::MouseEvent event(ggadget::Event::EVENT_MOUSE_MOVE, x, y, 0, 0,
+                            ggadget::MouseEvent::BUTTON_NONE, 0);
+  ggadget::BasicElement *fired = NULL, *in = NULL;
+  ggadget::ViewInterface::HitTest hittest = ggadget::ViewInterface::HT_CLIENT;
+  elements->OnMouseEvent(event, &fired, &in, &hittest);
+  return in;
+}
+
+TEST_F(ElementsTest, TestHitGrid) {
+  // Enough children to hit-test with the grid, in rows of 10x10 elements.
+  ggadget::BasicElement *children[100];
+  for (int i = 0; i < 100; i++) {
+    children[i] = elements_->AppendElement("muffin", NULL);
+    children[i]->SetPixelX(i % 10 * 10);
+    children[i]->SetPixelY(i / 10 * 10);
+    children[i]->SetPixelWidth(10);
+    children[i]->SetPixelHeight(10);
+  }
+  ASSERT_TRUE(children[0] == HitTest(elements_, 5, 5));
+  ASSERT_TRUE(children[37] == HitTest(elements_, 75, 35));
+  ASSERT_TRUE(NULL == HitTest(elements_, 150, 35));
+
+  // Higher elements are hit first.
+  ggadget::BasicElement *top = elements_->AppendElement("muffin", NULL);
+  top->SetPixelX(70);
+  top->SetPixelY(30);
+  top->SetPixelWidth(20);
+  top->SetPixelHeight(20);
+  ASSERT_TRUE(top == HitTest(elements_, 75, 35));
+  ASSERT_TRUE(children[59] == HitTest(elements_, 95, 55));
+
+  // Moving a child by script takes effect before the next layout.
+  top->SetPixelX(0);
+  top->SetPixelY(0);
+  ASSERT_TRUE(top == HitTest(elements_, 5, 5));
+  ASSERT_TRUE(children[37] == HitTest(elements_, 75, 35));
+  top->SetPixelWidth(40);
+  ASSERT_TRUE(top == HitTest(elements_, 35, 5));
+
+  // The grid is rebuilt after layout.
+  top->SetPixelX(120);
+  top->SetRotation(90);
+  elements_->Layout();
+  ASSERT_TRUE(children[37] == HitTest(elements_, 75, 35));
+  ASSERT_TRUE(top == HitTest(elements_, 105, 35));
+  elements_->RemoveElement(top);
+  ASSERT_TRUE(NULL == HitTest(elements_, 105, 35));
+}
+
 int main(int argc, char *argv[]) {
   ggadget::SetGlobalMainLoop(&main_loop);
   testing::ParseGTestFlags(&argc, argv);
@@ -17,6 +17,7 @@
 #include <iostream>
 #include <clocale>
 #include <cstdlib>
+#include <cstring>
 
 #include "ggadget/common.h"
 #include "ggadget/dir_file_manager.h"
@@ -29,15 +30,16 @@
 #include "ggadget/logger.h"
 #include "ggadget/scoped_ptr.h"
 #include "ggadget/slot.h"
+#include "ggadget/string_utils.h"
 #include "ggadget/system_file_functions.h"
 #include "ggadget/system_utils.h"
 #include "ggadget/zip_file_manager.h"
+#include "third_party/unzip/zip.h"
 #include "unittest/gtest.h"
 
 #if defined(OS_WIN)
 #include <time.h>
 #include <sys/stat.h>
-#include "third_party/unzip/zip.h"
 #endif
 
 using namespace ggadget;
@@ -477,6 +479,64 @@ TEST(FileManager, FileManagerWrapper) {
   ggadget::unlink(base_new_gg_path);
 }
 
+TEST(FileManager, ZipIndex) {
+  const char *kZipPackageName = "zip_index_test.zip";
+  const int kFileCount = 500;
+  std::string path = BuildFilePath(GetCurrentDirectory().c_str(),
+                                   kZipPackageName, NULL);
+  ggadget::unlink(path.c_str());
+  zipFile zip_handle = ::zipOpen(path.c_str(), APPEND_STATUS_CREATE);
+  ASSERT_TRUE(zip_handle);
+  zip_fileinfo info;
+  memset(&info, 0, sizeof(info));
+  info.tmz_date.tm_mday = 1;
+  info.tmz_date.tm_year = 2008;
+  for (int i = 0; i < kFileCount; ++i) {
+    std::string name = StringPrintf("dir%d/File%d", i % 10, i);
+    std::string content(static_cast<size_t>(i * 7), static_cast<char>(i));
+    // Both stored and deflated files are read from the mapped archive.
+    ASSERT_EQ(ZIP_OK, ::zipOpenNewFileInZip(zip_handle, name.c_str(), &info,
+                                            NULL, 0, NULL, 0, NULL,
+                                            i % 2 ? Z_DEFLATED : 0,
+                                            Z_DEFAULT_COMPRESSION));
+    ASSERT_EQ(ZIP_OK, ::zipWriteInFileInZip(zip_handle, content.c_str(),
+                                            static_cast<unsigned>(
+                                                content.size())));
+    ::zipCloseFileInZip(zip_handle);
+  }
+  ::zipClose(zip_handle, NULL);
+
+  scoped_ptr<FileManagerInterface> fm(new ZipFileManager);
+  ASSERT_TRUE(fm->Init(path.c_str(), false));
+  std::string data;
+  for (int i = kFileCount - 1; i >= 0; --i) {
+    std::string name = StringPrintf("dir%d"SEP"File%d", i % 10, i);
+    ASSERT_TRUE(fm->ReadFile(name.c_str(), &data));
+    EXPECT_EQ(std::string(static_cast<size_t>(i * 7), static_cast<char>(i)),
+              data);
+    EXPECT_TRUE(fm->FileExists(name.c_str(), NULL));
+    EXPECT_NE(0U, fm->GetLastModifiedTime(name.c_str()));
+  }
+#ifndef GADGET_CASE_SENSITIVE
+  EXPECT_TRUE(fm->ReadFile("DIR3"SEP"file13", &data));
+  EXPECT_EQ(std::string(91, static_cast<char>(13)), data);
+#endif
+  EXPECT_FALSE(fm->ReadFile("dir3"SEP"File14", &data));
+  EXPECT_FALSE(fm->FileExists("dir3", NULL));
+  EXPECT_EQ(0U, fm->GetLastModifiedTime("dir3"SEP"File14"));
+
+  // The index is rebuilt after the archive is modified.
+  EXPECT_TRUE(fm->WriteFile("new_file", "new file", false));
+  EXPECT_TRUE(fm->ReadFile("new_file", &data));
+  EXPECT_EQ("new file", data);
+  EXPECT_TRUE(fm->RemoveFile("dir0"SEP"File0"));
+  EXPECT_FALSE(fm->FileExists("dir0"SEP"File0", NULL));
+  EXPECT_TRUE(fm->ReadFile("dir1"SEP"File1", &data));
+  EXPECT_EQ(std::string(7, '\1'), data);
+  fm.reset();
+  ggadget::unlink(path.c_str());
+}
+
 #if defined(OS_WIN)
 TEST(FileManager, OpenZipWithFileNameIncludingSlash) {
   const char* kZipPackageName = "zip_with_file_name_including_slash.zip";
@@ -0,0 +1,182 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "ggadget/http_cache.h"
+#include "ggadget/xml_http_request_utils.h"
+#include "unittest/gtest.h"
+
+using namespace ggadget;
+
+static const char kURL[] = "http://www.example.com/feed.xml";
+// Sun, 06 Nov 1994 08:49:37 GMT.
+static const uint64_t kNow = UINT64_C(784111777000);
+
+static HttpCache::Response MakeResponse(const char *headers) {
+  HttpCache::Response response;
+  response.status = 200;
+  response.status_text = "OK";
+  response.headers = headers;
+  response.body = "<feed/>";
+  response.effective_url = kURL;
+  return response;
+}
+
+TEST(HttpCache, ParseHTTPDate) {
+  uint64_t time = 0;
+  ASSERT_TRUE(ParseHTTPDate("Sun, 06 Nov 1994 08:49:37 GMT", &time));
+  EXPECT_EQ(kNow, time);
+  ASSERT_TRUE(ParseHTTPDate("Sunday, 06-Nov-94 08:49:37 GMT", &time));
+  EXPECT_EQ(kNow, time);
+  ASSERT_TRUE(ParseHTTPDate("Sun Nov  6 08:49:37 1994", &time));
+  EXPECT_EQ(kNow, time);
+  EXPECT_FALSE(ParseHTTPDate("0", &time));
+  EXPECT_FALSE(ParseHTTPDate("", &time));
+  EXPECT_FALSE(ParseHTTPDate("Sun, 06 Foo 1994 08:49:37 GMT", &time));
+}
+
+TEST(HttpCache, MaxAge) {
+  HttpCache cache(NULL);
+  HttpCache::Response response;
+  std::string etag, last_modified;
+  EXPECT_EQ(HttpCache::MISS,
+            cache.Lookup(kURL, kNow, &response, &etag, &last_modified));
+
+  ASSERT_TRUE(cache.Store(kURL, MakeResponse(
+      "Content-Type: text/xml\r\nCache-Control: max-age=60\r\n"), kNow));
+  EXPECT_EQ(HttpCache::FRESH,
+            cache.Lookup(kURL, kNow + 59000, &response, &etag,
+                         &last_modified));
+  EXPECT_EQ(200, response.status);
+  EXPECT_EQ("<feed/>", response.body);
+  EXPECT_EQ(kURL, response.effective_url);
+
+  // Expired without validators.
+  EXPECT_EQ(HttpCache::MISS,
+            cache.Lookup(kURL, kNow + 60000, &response, &etag,
+                         &last_modified));
+  EXPECT_EQ(HttpCache::MISS,
+            cache.Lookup(kURL, kNow, &response, &etag, &last_modified));
+
+  size_t lookups = 0, hits = 0, revalidations = 0;
+  cache.GetStats(&lookups, &hits, &revalidations);
+  EXPECT_EQ(4U, lookups);
+  EXPECT_EQ(1U, hits);
+  EXPECT_EQ(0U, revalidations);
+}
+
+TEST(HttpCache, Expires) {
+  HttpCache cache(NULL);
+  HttpCache::Response response;
+  std::string etag, last_modified;
+  ASSERT_TRUE(cache.Store(kURL, MakeResponse(
+      "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+      "Expires: Sun, 06 Nov 1994 08:59:37 GMT\r\n"
+      "Age: 100\r\n"), kNow));
+  EXPECT_EQ(HttpCache::FRESH,
+            cache.Lookup(kURL, kNow + 499000, &response, &etag,
+                         &last_modified));
+  EXPECT_EQ(HttpCache::MISS,
+            cache.Lookup(kURL, kNow + 500000, &response, &etag,
+                         &last_modified));
+}
+
+TEST(HttpCache, NotCacheable) {
+  HttpCache cache(NULL);
+  EXPECT_FALSE(cache.Store(kURL, MakeResponse(
+      "Cache-Control: no-store, max-age=60\r\n"), kNow));
+  EXPECT_FALSE(cache.Store(kURL, MakeResponse(
+      "Cache-Control: max-age=60\r\nVary: Cookie\r\n"), kNow));
+  // No freshness information nor validators.
+  EXPECT_FALSE(cache.Store(kURL, MakeResponse("Content-Type: text/xml\r\n"),
+                           kNow));
+  HttpCache::Response response = MakeResponse("ETag: \"1\"\r\n");
+  response.status = 206;
+  EXPECT_FALSE(cache.Store(kURL, response, kNow));
+
+  // A non-cacheable response replaces the old one.
+  ASSERT_TRUE(cache.Store(kURL, MakeResponse(
+      "Cache-Control: max-age=60\r\n"), kNow));
+  EXPECT_FALSE(cache.Store(kURL, MakeResponse(
+      "Cache-Control: no-store\r\n"), kNow));
+  std::string etag, last_modified;
+  EXPECT_EQ(HttpCache::MISS,
+            cache.Lookup(kURL, kNow, &response, &etag, &last_modified));
+}
+
+TEST(HttpCache, Revalidate) {
+  HttpCache cache(NULL);
+  HttpCache::Response response;
+  std::string etag, last_modified;
+  ASSERT_TRUE(cache.Store(kURL, MakeResponse(
+      "Cache-Control: no-cache\r\nETag: \"v1\"\r\n"
+      "Last-Modified: Sun, 06 Nov 1994 08:00:00 GMT\r\n"), kNow));
+  EXPECT_EQ(HttpCache::STALE,
+            cache.Lookup(kURL, kNow, &response, &etag, &last_modified));
+  EXPECT_EQ("\"v1\"", etag);
+  EXPECT_EQ("Sun, 06 Nov 1994 08:00:00 GMT", last_modified);
+  EXPECT_EQ("<feed/>", response.body);
+
+  // The 304 response grants a new lifetime.
+  response = HttpCache::Response();
+  ASSERT_TRUE(cache.Refresh(kURL, "Cache-Control: max-age=10\r\n"
+                            "ETag: \"v2\"\r\n", kNow, &response));
+  EXPECT_EQ(200, response.status);
+  EXPECT_EQ("<feed/>", response.body);
+  EXPECT_EQ(HttpCache::FRESH,
+            cache.Lookup(kURL, kNow + 5000, &response, &etag,
+                         &last_modified));
+  EXPECT_EQ(HttpCache::STALE,
+            cache.Lookup(kURL, kNow + 10000, &response, &etag,
+                         &last_modified));
+  EXPECT_EQ("\"v2\"", etag);
+
+  // The 304 response without freshness information: the original no-cache
+  // applies again.
+  ASSERT_TRUE(cache.Refresh(kURL, "Server: test\r\n", kNow + 10000,
+                            &response));
+  EXPECT_EQ(HttpCache::STALE,
+            cache.Lookup(kURL, kNow + 10000, &response, &etag,
+                         &last_modified));
+  EXPECT_EQ("\"v2\"", etag);
+
+  // The 304 response forbids caching. It's still valid for the request.
+  ASSERT_TRUE(cache.Refresh(kURL, "Cache-Control: no-store\r\n", kNow,
+                            &response));
+  EXPECT_EQ("<feed/>", response.body);
+  EXPECT_EQ(HttpCache::MISS,
+            cache.Lookup(kURL, kNow, &response, &etag, &last_modified));
+  EXPECT_FALSE(cache.Refresh(kURL, "", kNow, &response));
+
+  size_t revalidations = 0;
+  cache.GetStats(NULL, NULL, &revalidations);
+  EXPECT_EQ(3U, revalidations);
+}
+
+TEST(HttpCache, Remove) {
+  HttpCache cache(NULL);
+  HttpCache::Response response;
+  std::string etag, last_modified;
+  ASSERT_TRUE(cache.Store(kURL, MakeResponse(
+      "Cache-Control: max-age=60\r\n"), kNow));
+  cache.Remove(kURL);
+  EXPECT_EQ(HttpCache::MISS,
+            cache.Lookup(kURL, kNow, &response, &etag, &last_modified));
+}
+
+int main(int argc, char **argv) {
+  testing::ParseGTestFlags(&argc, argv);
+  return RUN_ALL_TESTS();
+}
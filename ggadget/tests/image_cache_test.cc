@@ -16,6 +16,8 @@
 
 #include <string>
 #include <map>
+#include <vector>
+#include <unistd.h>
 #include "unittest/gtest.h"
 #include "mocked_file_manager.h"
 #include "ggadget/file_manager_wrapper.h"
@@ -25,6 +27,7 @@
 #include "ggadget/image_cache.h"
 #include "ggadget/logger.h"
 #include "ggadget/gadget_consts.h"
+#include "ggadget/string_utils.h"
 
 using namespace ggadget;
 
@@ -37,8 +40,8 @@ class MockedGraphics : public ggadget::GraphicsInterface {
   class MockedImage : public ggadget::ImageInterface {
    public:
     MockedImage(MockedGraphics *gfx, const std::string &tag,
-                bool share, bool is_mask)
-      : gfx_(gfx), tag_(tag), is_mask_(is_mask) {
+                bool share, bool is_mask, double width)
+      : gfx_(gfx), tag_(tag), is_mask_(is_mask), width_(width) {
       if (share) {
         if (is_mask) {
           EXPECT_TRUE(gfx->mask_images_.find(tag_) == gfx->mask_images_.end());
@@ -61,10 +64,10 @@ class MockedGraphics : public ggadget::GraphicsInterface {
     virtual void StretchDraw(CanvasInterface *canvas,
                              double x, double y,
                              double width, double height) const { }
-    virtual double GetWidth() const { return 0; }
-    virtual double GetHeight() const { return 0; }
+    virtual double GetWidth() const { return width_; }
+    virtual double GetHeight() const { return 1; }
     virtual ImageInterface *MultiplyColor(const Color &color) const {
-      return new MockedImage(gfx_, tag_.c_str(), false, is_mask_);
+      return new MockedImage(gfx_, tag_.c_str(), false, is_mask_, width_);
     }
     virtual bool GetPointValue(double x, double y,
                                Color *color, double *opacity) const {
@@ -76,16 +79,23 @@ class MockedGraphics : public ggadget::GraphicsInterface {
     MockedGraphics *gfx_;
     std::string tag_;
     bool is_mask_;
+    double width_;
   };
  public:
+  MockedGraphics() : threaded_(false) { }
   virtual ggadget::CanvasInterface *NewCanvas(double w, double h) const {
     return NULL;
   }
   virtual ggadget::ImageInterface *NewImage(const std::string &tag,
                                             const std::string &data,
                                             bool is_mask) const {
+    // The width of an image is the size of its data, and the height is 1.
     return new MockedImage(const_cast<MockedGraphics*>(this), tag, true,
-                           is_mask);
+                           is_mask, static_cast<double>(data.size()));
+  }
+  virtual bool CanDecodeInThread(const std::string &data,
+                                 bool is_mask) const {
+    return threaded_;
   }
   virtual ggadget::FontInterface *NewFont(
       const std::string &family, double pt_size,
@@ -102,6 +112,7 @@ class MockedGraphics : public ggadget::GraphicsInterface {
  public:
   std::map<std::string, MockedImage *> images_;
   std::map<std::string, MockedImage *> mask_images_;
+  bool threaded_;
 };
 
 
@@ -182,6 +193,87 @@ TEST(ImageCache, LoadImage) {
   ASSERT_FALSE(img_cache.LoadImage(&gfx, NULL, "", false));
 }
 
+TEST(ImageCache, Capacity) {
+  MockedGraphics gfx;
+  ImageCache img_cache;
+  local->should_fail_ = false;
+  local->data_["a.png"] = std::string(100, 'a');
+  local->data_["b.png"] = std::string(100, 'b');
+  local->data_["c.png"] = std::string(100, 'c');
+
+  ImageInterface *a = img_cache.LoadImage(&gfx, &g_local_fm, "a.png", false);
+  ImageInterface *b = img_cache.LoadImage(&gfx, &g_local_fm, "b.png", false);
+  ImageInterface *c = img_cache.LoadImage(&gfx, &g_local_fm, "c.png", false);
+  ImageCache::Stats stats = img_cache.GetStats();
+  EXPECT_EQ(3U, stats.misses);
+  EXPECT_EQ(0U, stats.bytes);
+
+  // Keeps two of the released images.
+  size_t image_bytes = 100 * 4 + 256;
+  img_cache.SetCapacity(image_bytes * 2);
+  a->Destroy();
+  b->Destroy();
+  c->Destroy();
+  stats = img_cache.GetStats();
+  EXPECT_EQ(1U, stats.evictions);
+  EXPECT_EQ(image_bytes * 2, stats.bytes);
+  EXPECT_TRUE(gfx.images_.find("a.png") == gfx.images_.end());
+  EXPECT_TRUE(gfx.images_.find("b.png") != gfx.images_.end());
+  EXPECT_TRUE(gfx.images_.find("c.png") != gfx.images_.end());
+
+  local->requested_file_.clear();
+  b = img_cache.LoadImage(&gfx, &g_local_fm, "b.png", false);
+  EXPECT_TRUE(local->requested_file_.empty());
+  EXPECT_EQ(1U, img_cache.GetStats().hits);
+  EXPECT_EQ(image_bytes, img_cache.GetStats().bytes);
+
+  // Shrinking the capacity evicts the unused images at once.
+  img_cache.SetCapacity(0);
+  EXPECT_TRUE(gfx.images_.find("c.png") == gfx.images_.end());
+  EXPECT_EQ(0U, img_cache.GetStats().bytes);
+  b->Destroy();
+  EXPECT_TRUE(gfx.images_.find("b.png") == gfx.images_.end());
+}
+
+TEST(ImageCache, Preload) {
+  MockedGraphics gfx;
+  gfx.threaded_ = true;
+  ImageCache img_cache;
+  local->should_fail_ = false;
+  MockedFileManager *reader = new MockedFileManager(*local);
+  std::vector<std::string> files;
+  for (int i = 0; i < 10; i++) {
+    std::string name = StringPrintf("p%d.png", i);
+    local->data_[name] = std::string(10, 'p');
+    reader->data_[name] = std::string(10, 'p');
+    files.push_back(name);
+  }
+  std::vector<FileManagerInterface *> readers;
+  readers.push_back(reader);
+  img_cache.PreloadImages(&gfx, &g_local_fm, files, readers);
+  for (int i = 0; i < 1000 && img_cache.GetStats().preloaded < 10; i++)
+    usleep(1000);
+  ASSERT_EQ(10U, img_cache.GetStats().preloaded);
+
+  local->requested_file_.clear();
+  ImageInterface *img = img_cache.LoadImage(&gfx, &g_local_fm, "p3.png",
+                                            false);
+  ASSERT_TRUE(img);
+  EXPECT_STREQ("p3.png", img->GetTag().c_str());
+  EXPECT_EQ(10, img->GetWidth());
+  EXPECT_TRUE(local->requested_file_.empty());
+  EXPECT_EQ(1U, img_cache.GetStats().preload_hits);
+
+  // The images not requested yet are kept for reuse.
+  img_cache.StopPreload();
+  ImageInterface *img2 = img_cache.LoadImage(&gfx, &g_local_fm, "p5.png",
+                                             false);
+  EXPECT_TRUE(local->requested_file_.empty());
+  EXPECT_EQ(1U, img_cache.GetStats().hits);
+  img->Destroy();
+  img2->Destroy();
+}
+
 int main(int argc, char *argv[]) {
   testing::ParseGTestFlags(&argc, argv);
 
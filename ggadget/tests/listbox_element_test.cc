@@ -0,0 +1,252 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "ggadget/listbox_element.h"
+#include "ggadget/element_factory.h"
+#include "ggadget/elements.h"
+#include "ggadget/format_macros.h"
+#include "ggadget/item_element.h"
+#include "ggadget/scriptable_array.h"
+#include "ggadget/scrollbar_element.h"
+#include "ggadget/slot.h"
+#include "ggadget/string_utils.h"
+#include "ggadget/view.h"
+#include "unittest/gtest.h"
+#include "mocked_timer_main_loop.h"
+#include "mocked_view_host.h"
+
+MockedTimerMainLoop main_loop(0);
+
+using namespace ggadget;
+
+// Labels need a font to measure their text.
+class MockedFont : public FontInterface {
+ public:
+  virtual Style GetStyle() const { return STYLE_NORMAL; }
+  virtual Weight GetWeight() const { return WEIGHT_NORMAL; }
+  virtual double GetPointSize() const { return 10; }
+  virtual void Destroy() { delete this; }
+};
+
+class FontGraphics : public MockedGraphics {
+ public:
+  virtual FontInterface *NewFont(const std::string &family, double pt_size,
+                                 FontInterface::Style style,
+                                 FontInterface::Weight weight) const {
+    return new MockedFont;
+  }
+};
+
+class FontViewHost : public MockedViewHost {
+ public:
+  FontViewHost() : MockedViewHost(ViewHostInterface::VIEW_HOST_MAIN) { }
+  virtual GraphicsInterface *NewGraphics() const {
+    return new FontGraphics;
+  }
+};
+
+class TestItemModel : public ListBoxElement::ItemModel {
+ public:
+  TestItemModel(size_t count) : count_(count), fetched_(0) { }
+  virtual size_t GetItemCount() const {
+    return count_;
+  }
+  virtual std::string GetItemText(size_t index) const {
+    fetched_++;
+    return StringPrintf("item%" PRIuS, index);
+  }
+
+  size_t count_;
+  mutable size_t fetched_;
+};
+
+class ListBoxElementTest : public testing::Test {
+ protected:
+  virtual void SetUp() {
+    element_factory_ = new ElementFactory();
+    view_ = new View(new FontViewHost(), NULL, element_factory_, NULL);
+    view_->SetWidth(100);
+    view_->SetHeight(100);
+    listbox_ = down_cast<ListBoxElement *>(
+        view_->GetChildren()->AppendElement("listbox", NULL));
+    listbox_->SetPixelWidth(100);
+    listbox_->SetPixelHeight(100);
+    listbox_->SetItemHeight(Variant(10));
+    listbox_->SetAutoscroll(true);
+  }
+
+  virtual void TearDown() {
+    delete view_;
+    delete element_factory_;
+  }
+
+  // Returns the visible item showing index, or NULL.
+  ItemElement *FindRow(int index) {
+    Elements *children = listbox_->GetChildren();
+    for (size_t i = 0; i < children->GetCount(); i++) {
+      ItemElement *item = down_cast<ItemElement *>(children->GetItemByIndex(i));
+      if (item->IsVisible() &&
+          item->GetPixelY() == index * listbox_->GetItemPixelHeight())
+        return item;
+    }
+    return NULL;
+  }
+
+  ElementFactory *element_factory_;
+  View *view_;
+  ListBoxElement *listbox_;
+};
+
+TEST_F(ListBoxElementTest, VirtualRows) {
+  TestItemModel *model = new TestItemModel(5000);
+  listbox_->SetItemModel(model);
+  view_->Layout();
+  EXPECT_EQ(5000U, listbox_->GetItemCount());
+  // 10 visible rows plus the overscan below them.
+  size_t rows = listbox_->GetChildren()->GetCount();
+  EXPECT_GE(rows, 10U);
+  EXPECT_LE(rows, 20U);
+  ASSERT_TRUE(FindRow(0));
+  EXPECT_EQ("item0", FindRow(0)->GetLabelText());
+  EXPECT_TRUE(FindRow(9));
+  EXPECT_FALSE(FindRow(100));
+
+  // Rows are recycled on scroll.
+  listbox_->SetScrollYPosition(10000);
+  view_->Layout();
+  EXPECT_LE(listbox_->GetChildren()->GetCount(), 24U);
+  ASSERT_TRUE(FindRow(1000));
+  EXPECT_EQ("item1000", FindRow(1000)->GetLabelText());
+  EXPECT_FALSE(FindRow(0));
+
+  // Small scrolls only relabel the rows scrolled into view.
+  model->fetched_ = 0;
+  listbox_->SetScrollYPosition(10010);
+  view_->Layout();
+  EXPECT_EQ(1U, model->fetched_);
+}
+
+TEST_F(ListBoxElementTest, VirtualSelection) {
+  listbox_->SetItemModel(new TestItemModel(5000));
+  view_->Layout();
+  listbox_->SetSelectedIndex(4000);
+  EXPECT_EQ(4000, listbox_->GetSelectedIndex());
+  // The selected item is materialized even if out of the visible area.
+  ItemElement *selected = listbox_->GetSelectedItem();
+  ASSERT_TRUE(selected);
+  EXPECT_EQ("item4000", selected->GetLabelText());
+  EXPECT_TRUE(selected->IsSelected());
+
+  // Layout scrolls the selected item into view.
+  view_->Layout();
+  EXPECT_EQ(39910, listbox_->GetScrollYPosition());
+  EXPECT_TRUE(FindRow(3995));
+
+  listbox_->SetMultiSelect(true);
+  listbox_->SelectRange(FindRow(3995));
+  EXPECT_EQ(3995, listbox_->GetSelectedIndex());
+  EXPECT_TRUE(FindRow(3998)->IsSelected());
+  EXPECT_FALSE(FindRow(3994)->IsSelected());
+
+  listbox_->ClearSelection();
+  EXPECT_EQ(-1, listbox_->GetSelectedIndex());
+  EXPECT_FALSE(FindRow(3998)->IsSelected());
+}
+
+TEST_F(ListBoxElementTest, VirtualStrings) {
+  listbox_->AppendString("a");
+  EXPECT_FALSE(listbox_->GetItemModel());
+  EXPECT_EQ(1U, listbox_->GetItemCount());
+
+  listbox_->SetItemModel(new TestItemModel(3));
+  EXPECT_EQ(3U, listbox_->GetItemCount());
+  // Only the model set by setVirtualStrings() can be edited by strings.
+  EXPECT_FALSE(listbox_->AppendString("b"));
+  listbox_->SetItemModel(NULL);
+  EXPECT_EQ(0U, listbox_->GetItemCount());
+}
+
+TEST_F(ListBoxElementTest, VirtualStringsSelection) {
+  static const char *kStrings[] = { "a", "b", "c", "d", "e", NULL };
+  ScriptableArray *array = ScriptableArray::Create(kStrings);
+  array->Ref();
+  ResultVariant method = listbox_->GetProperty("setVirtualStrings");
+  ASSERT_EQ(Variant::TYPE_SLOT, method.v().type());
+  Variant arg(array);
+  VariantValue<Slot *>()(method.v())->Call(listbox_, 1, &arg);
+  array->Unref();
+  ASSERT_TRUE(listbox_->GetItemModel());
+  EXPECT_EQ(5U, listbox_->GetItemCount());
+
+  view_->Layout();
+  listbox_->SetMultiSelect(true);
+  listbox_->SetSelectedIndex(1);
+  listbox_->AppendSelection(FindRow(3));
+  EXPECT_TRUE(FindRow(3)->IsSelected());
+
+  // The selection follows the items after an insertion before them.
+  EXPECT_TRUE(listbox_->InsertStringAt("x", 0));
+  EXPECT_FALSE(listbox_->InsertStringAt("y", 100));
+  view_->Layout();
+  EXPECT_EQ(6U, listbox_->GetItemCount());
+  EXPECT_EQ(2, listbox_->GetSelectedIndex());
+  EXPECT_EQ("b", FindRow(2)->GetLabelText());
+  EXPECT_TRUE(FindRow(2)->IsSelected());
+  EXPECT_EQ("d", FindRow(4)->GetLabelText());
+  EXPECT_TRUE(FindRow(4)->IsSelected());
+  EXPECT_FALSE(FindRow(1)->IsSelected());
+  EXPECT_FALSE(FindRow(3)->IsSelected());
+
+  // A removed item leaves the selection, the items after it move up.
+  listbox_->RemoveString("b");
+  view_->Layout();
+  EXPECT_EQ(5U, listbox_->GetItemCount());
+  EXPECT_EQ(3, listbox_->GetSelectedIndex());
+  EXPECT_EQ("d", FindRow(3)->GetLabelText());
+  EXPECT_TRUE(FindRow(3)->IsSelected());
+  EXPECT_FALSE(FindRow(2)->IsSelected());
+
+  listbox_->RemoveString("d");
+  view_->Layout();
+  EXPECT_EQ(-1, listbox_->GetSelectedIndex());
+  for (int i = 0; i < 4; i++)
+    EXPECT_FALSE(FindRow(i)->IsSelected());
+}
+
+TEST_F(ListBoxElementTest, VirtualScrollBar) {
+  TestItemModel *model = new TestItemModel(5);
+  listbox_->SetItemModel(model);
+  view_->Layout();
+  EXPECT_FALSE(listbox_->GetScrollBar()->IsVisible());
+  EXPECT_EQ(100, FindRow(0)->GetPixelWidth());
+
+  // The rows are laid out again to the client width, when the scroll bar
+  // is shown by a layout of the list box alone.
+  model->count_ = 50;
+  listbox_->OnItemModelChanged();
+  listbox_->Layout();
+  ASSERT_TRUE(listbox_->GetScrollBar()->IsVisible());
+  EXPECT_GT(listbox_->GetScrollBar()->GetPixelWidth(), 0);
+  EXPECT_EQ(listbox_->GetClientWidth(), FindRow(0)->GetPixelWidth());
+  EXPECT_EQ(100 - listbox_->GetScrollBar()->GetPixelWidth(),
+            FindRow(0)->GetPixelWidth());
+}
+
+int main(int argc, char *argv[]) {
+  SetGlobalMainLoop(&main_loop);
+  testing::ParseGTestFlags(&argc, argv);
+  return RUN_ALL_TESTS();
+}
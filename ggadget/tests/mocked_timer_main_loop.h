@@ -113,9 +113,13 @@ class MockedTimerMainLoop : public ggadget::MainLoopInterface {
       if (info->interval != -1) {
         info->remaining -= time;
         if (info->remaining <= 0) {
-          LOG("MockedTimerMainLoop fire timer: %d id=%d", info->interval, i);
-          if (!info->callback->Call(this, i))
-            RemoveWatch(i);
+          LOG("MockedTimerMainLoop fire timer: %d id=%d", info->interval,
+              i + 1);
+          bool keep = info->callback->Call(this, i + 1);
+          // The callback may have added timers and reallocated timers_.
+          info = &timers_[i];
+          if (!keep)
+            RemoveWatch(i + 1);
           else
             info->remaining = info->interval;
         }
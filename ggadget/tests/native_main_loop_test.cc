@@ -14,13 +14,16 @@
   limitations under the License.
 */
 
+#include <sys/resource.h>
+#include <sys/select.h>
+#include <unistd.h>
 #include <cstring>
 #include <vector>
 #include <string>
 
 #include "ggadget/common.h"
 #include "ggadget/logger.h"
-#include "native_main_loop.h"
+#include "ggadget/native_main_loop.h"
 #include "main_loop_test.h"
 #include "unittest/gtest.h"
 
@@ -36,6 +39,93 @@ TEST(GtkMainLoopTest, TimeoutWatch) {
   TimeoutWatchTest(&main_loop);
 }
 
+// Records the order in which the timeout watches are called.
+class OrderWatchCallback : public WatchCallbackInterface {
+ public:
+  OrderWatchCallback(std::vector<int> *order, int quit_after)
+      : order_(order), quit_after_(quit_after) { }
+  virtual bool Call(MainLoopInterface *main_loop, int watch_id) {
+    order_->push_back(main_loop->GetWatchData(watch_id));
+    if (static_cast<int>(order_->size()) == quit_after_)
+      main_loop->Quit();
+    return false;
+  }
+  virtual void OnRemove(MainLoopInterface *main_loop, int watch_id) {
+    delete this;
+  }
+
+ private:
+  std::vector<int> *order_;
+  int quit_after_;
+};
+
+TEST(NativeMainLoopTest, TimeoutOrder) {
+  NativeMainLoop main_loop;
+  std::vector<int> order;
+  static const int kIntervals[] = { 50, 10, 40, 20, 30 };
+  int removed = 0;
+  for (size_t i = 0; i < arraysize(kIntervals); ++i) {
+    int id = main_loop.AddTimeoutWatch(
+        kIntervals[i], new OrderWatchCallback(&order, 4));
+    if (kIntervals[i] == 20)
+      removed = id;
+  }
+  // Many watches added and removed before firing shouldn't be called.
+  for (int i = 0; i < 1000; ++i) {
+    main_loop.RemoveWatch(main_loop.AddTimeoutWatch(
+        5, new OrderWatchCallback(&order, 4)));
+  }
+  main_loop.RemoveWatch(removed);
+  main_loop.Run();
+  ASSERT_EQ(4U, order.size());
+  EXPECT_EQ(10, order[0]);
+  EXPECT_EQ(30, order[1]);
+  EXPECT_EQ(40, order[2]);
+  EXPECT_EQ(50, order[3]);
+}
+
+// Reads one byte and quits the main loop.
+class ReadOnceCallback : public WatchCallbackInterface {
+ public:
+  virtual bool Call(MainLoopInterface *main_loop, int watch_id) {
+    char c;
+    EXPECT_EQ(1, read(main_loop->GetWatchData(watch_id), &c, 1));
+    main_loop->Quit();
+    return false;
+  }
+  virtual void OnRemove(MainLoopInterface *main_loop, int watch_id) {
+    delete this;
+  }
+};
+
+// File descriptors beyond FD_SETSIZE must be supported.
+#ifdef HAVE_EPOLL
+// select() can't watch fds not less than FD_SETSIZE.
+TEST(NativeMainLoopTest, LargeFd) {
+  struct rlimit limit;
+  int fds[2];
+  int high_fd = FD_SETSIZE + 10;
+  if (getrlimit(RLIMIT_NOFILE, &limit) != 0 ||
+      static_cast<rlim_t>(high_fd) >= limit.rlim_cur) {
+    LOG("Skipped because of the limit of file descriptors.");
+    return;
+  }
+  ASSERT_EQ(0, pipe(fds));
+  ASSERT_EQ(high_fd, dup2(fds[0], high_fd));
+
+  NativeMainLoop main_loop;
+  int watch_id = main_loop.AddIOReadWatch(high_fd, new ReadOnceCallback());
+  ASSERT_GT(watch_id, 0);
+  ASSERT_EQ(1, write(fds[1], "x", 1));
+  main_loop.Run();
+  EXPECT_EQ(MainLoopInterface::INVALID_WATCH,
+            main_loop.GetWatchType(watch_id));
+  close(high_fd);
+  close(fds[0]);
+  close(fds[1]);
+}
+#endif
+
 int main(int argc, char **argv) {
   testing::ParseGTestFlags(&argc, argv);
   return RUN_ALL_TESTS();
@@ -0,0 +1,124 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "ggadget/prefetch_file_manager.h"
+#include "ggadget/string_utils.h"
+#include "mocked_file_manager.h"
+#include "unittest/gtest.h"
+
+using namespace ggadget;
+
+static const int kFileCount = 50;
+
+static MockedFileManager *NewFileManager() {
+  MockedFileManager *fm = new MockedFileManager();
+  for (int i = 0; i < kFileCount; i++)
+    fm->data_[StringPrintf("file%d.png", i)] = StringPrintf("data%d", i);
+  return fm;
+}
+
+static std::vector<std::string> GetFileNames() {
+  std::vector<std::string> files;
+  for (int i = 0; i < kFileCount; i++)
+    files.push_back(StringPrintf("file%d.png", i));
+  // Duplicated names are only read once.
+  files.push_back("file0.png");
+  return files;
+}
+
+static void WaitForPrefetch(PrefetchFileManager *fm) {
+  for (int i = 0; i < 1000; i++) {
+    PrefetchFileManager::Stats stats = fm->GetStats();
+    if (stats.prefetched == stats.queued)
+      return;
+    usleep(1000);
+  }
+}
+
+TEST(PrefetchFileManager, ReadFile) {
+  PrefetchFileManager fm(NewFileManager());
+  std::vector<FileManagerInterface *> workers;
+  workers.push_back(NewFileManager());
+  workers.push_back(NewFileManager());
+  ASSERT_TRUE(fm.Prefetch(GetFileNames(), workers));
+  WaitForPrefetch(&fm);
+
+  std::string data;
+  for (int i = kFileCount - 1; i >= 0; i--) {
+    ASSERT_TRUE(fm.ReadFile(StringPrintf("file%d.png", i).c_str(), &data));
+    EXPECT_EQ(StringPrintf("data%d", i), data);
+  }
+  PrefetchFileManager::Stats stats = fm.GetStats();
+  EXPECT_EQ(static_cast<size_t>(kFileCount), stats.queued);
+  EXPECT_EQ(static_cast<size_t>(kFileCount), stats.prefetched);
+  EXPECT_EQ(static_cast<size_t>(kFileCount), stats.hits);
+
+  // The prefetched contents are consumed by the first read.
+  ASSERT_TRUE(fm.ReadFile("file0.png", &data));
+  EXPECT_EQ("data0", data);
+  EXPECT_EQ(static_cast<size_t>(kFileCount), fm.GetStats().hits);
+  fm.StopPrefetch();
+}
+
+TEST(PrefetchFileManager, WriteAndRemove) {
+  PrefetchFileManager fm(NewFileManager());
+  std::vector<FileManagerInterface *> workers;
+  workers.push_back(NewFileManager());
+  ASSERT_TRUE(fm.Prefetch(GetFileNames(), workers));
+  WaitForPrefetch(&fm);
+
+  std::string data;
+  ASSERT_TRUE(fm.WriteFile("file1.png", "new data", true));
+  ASSERT_TRUE(fm.ReadFile("file1.png", &data));
+  EXPECT_EQ("new data", data);
+  ASSERT_TRUE(fm.RemoveFile("file2.png"));
+  EXPECT_FALSE(fm.FileExists("file2.png", NULL));
+  ASSERT_TRUE(fm.ReadFile("file3.png", &data));
+  EXPECT_EQ("data3", data);
+  EXPECT_EQ(1U, fm.GetStats().hits);
+}
+
+TEST(PrefetchFileManager, FailedRead) {
+  MockedFileManager *main_fm = NewFileManager();
+  PrefetchFileManager fm(main_fm);
+  MockedFileManager *worker = NewFileManager();
+  worker->should_fail_ = true;
+  std::vector<FileManagerInterface *> workers;
+  workers.push_back(worker);
+  ASSERT_TRUE(fm.Prefetch(GetFileNames(), workers));
+  WaitForPrefetch(&fm);
+
+  // A file failed to prefetch is read by the wrapped file manager again.
+  std::string data;
+  ASSERT_TRUE(fm.ReadFile("file4.png", &data));
+  EXPECT_EQ("data4", data);
+  EXPECT_EQ("file4.png", main_fm->requested_file_);
+  EXPECT_EQ(0U, fm.GetStats().hits);
+
+  // Reads without prefetch after the prefetch is stopped.
+  fm.StopPrefetch();
+  ASSERT_TRUE(fm.ReadFile("file5.png", &data));
+  EXPECT_EQ("data5", data);
+  EXPECT_EQ("file5.png", main_fm->requested_file_);
+}
+
+int main(int argc, char **argv) {
+  testing::ParseGTestFlags(&argc, argv);
+  return RUN_ALL_TESTS();
+}
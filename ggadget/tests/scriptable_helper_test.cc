@@ -411,6 +411,31 @@ TEST(ScriptableHelperTest, TestEnumerateProperties) {
   CheckEnumerateProperties(false);
 }
 
+class OrderScriptable : public ScriptableHelperNativeOwnedDefault {
+ public:
+  DEFINE_CLASS_ID(0x6b1f3a2e9c7d4085, ScriptableInterface);
+  OrderScriptable() {
+    RegisterConstant("b", 2);
+    RegisterConstant("c", 3);
+    RegisterConstant("a", 1);
+  }
+};
+
+static bool AppendName(const char *name, ScriptableInterface::PropertyType,
+                       const Variant &, std::string *names) {
+  names->append(name);
+  return true;
+}
+
+TEST(ScriptableHelperTest, TestEnumeratePropertiesOrder) {
+  OrderScriptable scriptable;
+  std::string names;
+  ASSERT_TRUE(scriptable.EnumerateProperties(
+      NewSlot(AppendName, &names)));
+  // Properties are enumerated in the order of names.
+  EXPECT_EQ("abc", names);
+}
+
 // We need a new scriptable class to prevent interferring from other tests.
 class RemovePropertyScriptable : public BaseScriptable {
  public:
@@ -434,6 +459,12 @@ TEST(ScriptableHelperTest, TestRemoveProperty) {
   ASSERT_EQ(ScriptableInterface::PROPERTY_NOT_EXIST,
             scriptable->GetPropertyInfo("my_ondelete", NULL));
   ASSERT_FALSE(scriptable->RemoveProperty("not_exist"));
+  ASSERT_FALSE(scriptable->RemoveProperty("ClearBuffer"));
+  // The other properties are still available.
+  ASSERT_EQ(ScriptableInterface::PROPERTY_NORMAL,
+            scriptable->GetPropertyInfo("BufferReadOnly", NULL));
+  ASSERT_EQ(ScriptableInterface::PROPERTY_NORMAL,
+            scriptable->GetPropertyInfo("EnumString", NULL));
 
   delete scriptable;
   scriptable = new RemovePropertyScriptable(true);
@@ -0,0 +1,69 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+// Measures the cost of emitting signals with various number of connections.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/time.h>
+#include <ggadget/common.h>
+#include <ggadget/signals.h>
+#include <ggadget/slot.h>
+
+using namespace ggadget;
+
+static const int kConnectionCounts[] = { 0, 1, 2, 8, 64 };
+
+class Counter {
+ public:
+  Counter() : count(0) { }
+  void Increase() { count++; }
+  int count;
+};
+
+static double GetTime() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return static_cast<double>(tv.tv_sec) +
+         static_cast<double>(tv.tv_usec) / 1e6;
+}
+
+int main(int argc, char **argv) {
+  int emits = 1000000;
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], "--emits=", 8) == 0)
+      emits = atoi(argv[i] + 8);
+  }
+
+  for (size_t i = 0; i < arraysize(kConnectionCounts); ++i) {
+    Signal0<void> signal;
+    Counter counter;
+    for (int j = 0; j < kConnectionCounts[i]; ++j)
+      signal.Connect(NewSlot(&counter, &Counter::Increase));
+    double start = GetTime();
+    for (int j = 0; j < emits; ++j)
+      signal();
+    double seconds = GetTime() - start;
+    if (counter.count != kConnectionCounts[i] * emits) {
+      fprintf(stderr, "Wrong number of calls: %d\n", counter.count);
+      return 1;
+    }
+    printf("%3d connections: %8.1f ns per emit\n", kConnectionCounts[i],
+           seconds * 1e9 / emits);
+  }
+  return 0;
+}
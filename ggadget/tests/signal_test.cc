@@ -149,6 +149,61 @@ TEST(signal, SignalSlotCompatibility) {
   ASSERT_TRUE(signal9.ConnectGeneral(meta_signal(8)) == NULL);
 }
 
+class Counter {
+ public:
+  Counter() : count(0), to_disconnect(NULL) { }
+  void Increase() {
+    count++;
+    if (to_disconnect) {
+      to_disconnect->Disconnect();
+      to_disconnect = NULL;
+    }
+  }
+  int count;
+  Connection *to_disconnect;
+};
+
+TEST(signal, SignalManyConnections) {
+  Signal0Void signal;
+  Counter counters[10];
+  Connection *connections[10];
+  for (int i = 0; i < 10; i++)
+    connections[i] = signal.Connect(NewSlot(&counters[i], &Counter::Increase));
+  ASSERT_EQ(10U, signal.GetConnectionCount());
+  signal();
+  for (int i = 0; i < 10; i++)
+    ASSERT_EQ(1, counters[i].count);
+
+  // Disconnect some connections, including the first ones, then reuse their
+  // storage.
+  connections[0]->Disconnect();
+  connections[1]->Disconnect();
+  connections[5]->Disconnect();
+  ASSERT_EQ(7U, signal.GetConnectionCount());
+  Counter counter;
+  Connection *connection =
+      signal.Connect(NewSlot(&counter, &Counter::Increase));
+  ASSERT_EQ(8U, signal.GetConnectionCount());
+  signal();
+  ASSERT_EQ(1, counters[0].count);
+  ASSERT_EQ(1, counters[1].count);
+  ASSERT_EQ(2, counters[2].count);
+  ASSERT_EQ(1, counters[5].count);
+  ASSERT_EQ(2, counters[9].count);
+  ASSERT_EQ(1, counter.count);
+
+  // Disconnect a later connection during the emission.
+  counters[2].to_disconnect = connections[9];
+  signal();
+  ASSERT_EQ(3, counters[2].count);
+  ASSERT_EQ(2, counters[9].count);
+  ASSERT_EQ(2, counter.count);
+  ASSERT_EQ(7U, signal.GetConnectionCount());
+
+  connection->Reconnect(NULL);
+  ASSERT_TRUE(signal.HasActiveConnections());
+}
+
 int main(int argc, char **argv) {
   testing::ParseGTestFlags(&argc, argv);
   return RUN_ALL_TESTS();
@@ -0,0 +1,104 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include <pthread.h>
+#include <vector>
+#include "ggadget/small_object.h"
+#include "unittest/gtest.h"
+
+using namespace ggadget;
+
+struct Small : public SmallObject<> {
+  char data[24];
+};
+
+static SmallObjStats GetSmallStats() {
+  SmallObjAllocator &allocator = AllocatorSingleton<>::Instance();
+  size_t size_class = (sizeof(Small) - 1) / allocator.GetAlignment();
+  SmallObjStats stats;
+  allocator.GetStats(size_class, stats);
+  EXPECT_LE(sizeof(Small), stats.blockSize);
+  return stats;
+}
+
+TEST(SmallObject, Stats) {
+  SmallObjAllocator &allocator = AllocatorSingleton<>::Instance();
+  EXPECT_EQ(allocator.GetMaxObjectSize() / allocator.GetAlignment(),
+            allocator.GetSizeClassCount());
+
+  SmallObjStats before = GetSmallStats();
+  std::vector<Small *> objects;
+  for (int i = 0; i < 1000; i++)
+    objects.push_back(new Small);
+  SmallObjStats during = GetSmallStats();
+  EXPECT_EQ(before.liveBlocks + 1000, during.liveBlocks);
+  EXPECT_LE(during.liveBlocks, during.peakBlocks);
+
+  for (size_t i = 0; i < objects.size(); i++)
+    delete objects[i];
+  SmallObjStats after = GetSmallStats();
+  EXPECT_EQ(before.liveBlocks, after.liveBlocks);
+  EXPECT_EQ(during.peakBlocks, after.peakBlocks);
+  EXPECT_FALSE(allocator.IsCorrupt());
+}
+
+static const int kThreadCount = 8;
+static const int kRounds = 200;
+
+static void *AllocateInThread(void *arg) {
+  std::vector<Small *> *objects = static_cast<std::vector<Small *> *>(arg);
+  for (int round = 0; round < kRounds; round++) {
+    for (int i = 0; i < 100; i++) {
+      Small *small = new Small;
+      small->data[0] = static_cast<char>(i);
+      objects->push_back(small);
+    }
+    // Keep a part of the objects to be freed by the main thread.
+    while (objects->size() > 50) {
+      delete objects->back();
+      objects->pop_back();
+    }
+  }
+  return NULL;
+}
+
+TEST(SmallObject, Threads) {
+  SmallObjStats before = GetSmallStats();
+  pthread_t threads[kThreadCount];
+  std::vector<Small *> objects[kThreadCount];
+  for (int i = 0; i < kThreadCount; i++)
+    pthread_create(&threads[i], NULL, AllocateInThread, &objects[i]);
+  for (int i = 0; i < kThreadCount; i++)
+    pthread_join(threads[i], NULL);
+
+  SmallObjStats during = GetSmallStats();
+  EXPECT_EQ(before.liveBlocks + kThreadCount * 50, during.liveBlocks);
+  // The caches of the exited threads have been returned to the shared pool.
+  EXPECT_GE(before.cachedBlocks + 64, during.cachedBlocks);
+
+  for (int i = 0; i < kThreadCount; i++) {
+    for (size_t j = 0; j < objects[i].size(); j++)
+      delete objects[i][j];
+  }
+  SmallObjStats after = GetSmallStats();
+  EXPECT_EQ(before.liveBlocks, after.liveBlocks);
+  EXPECT_FALSE(AllocatorSingleton<>::Instance().IsCorrupt());
+}
+
+int main(int argc, char **argv) {
+  testing::ParseGTestFlags(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -276,6 +276,34 @@ TEST(Variant, TestAny) {
   CheckVariant<const void *, Variant::TYPE_CONST_ANY>(NULL, NULL);
 }
 
+TEST(Variant, TestVariantArgs) {
+  VariantArgs args;
+  ASSERT_TRUE(args.get() == NULL);
+  ASSERT_TRUE(args.Resize(0) == NULL);
+
+  // Short argument lists are stored inline.
+  Variant *inline_args = args.Resize(2);
+  ASSERT_TRUE(inline_args != NULL);
+  ASSERT_EQ(2U, args.size());
+  args[0] = Variant("abc");
+  args[1] = Variant(1.5);
+  ASSERT_EQ(Variant("abc"), inline_args[0]);
+  ASSERT_EQ(inline_args, args.Resize(3));
+  // The previous arguments are discarded.
+  for (size_t i = 0; i < args.size(); ++i)
+    ASSERT_EQ(Variant::TYPE_VOID, args[i].type());
+
+  Variant *heap_args = args.Resize(10);
+  ASSERT_NE(inline_args, heap_args);
+  ASSERT_EQ(10U, args.size());
+  args[9] = Variant(std::string("def"));
+  ASSERT_EQ(Variant("def"), heap_args[9]);
+
+  args.Reset();
+  ASSERT_TRUE(args.get() == NULL);
+  ASSERT_EQ(0U, args.size());
+}
+
 int main(int argc, char **argv) {
   testing::ParseGTestFlags(&argc, argv);
   return RUN_ALL_TESTS();
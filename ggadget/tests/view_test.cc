@@ -36,6 +36,7 @@
 
 ggadget::ElementFactory *g_factory = NULL;
 MockedTimerMainLoop main_loop(0);
+using ggadget::BasicElement;
 using ggadget::View;
 using ggadget::ViewInterface;
 using ggadget::ViewHostInterface;
@@ -167,6 +168,201 @@ TEST(ViewTest, MinSize) {
   ASSERT_DOUBLE_EQ(200.0, view.GetHeight());
 }
 
+TEST(ViewTest, ScratchCanvasPool) {
+  MockedViewHost *host = new MockedViewHost(ViewHostInterface::VIEW_HOST_MAIN);
+  View view(host, NULL, g_factory, NULL);
+
+  ggadget::CanvasInterface *canvas = view.AcquireScratchCanvas(10, 40);
+  ASSERT_TRUE(canvas != NULL);
+  ASSERT_DOUBLE_EQ(32.0, canvas->GetWidth());
+  ASSERT_DOUBLE_EQ(64.0, canvas->GetHeight());
+  view.ReleaseScratchCanvas(canvas);
+
+  // Canvases in the same size bucket are reused.
+  ASSERT_EQ(canvas, view.AcquireScratchCanvas(30, 50));
+  ggadget::CanvasInterface *canvas2 = view.AcquireScratchCanvas(30, 50);
+  ASSERT_NE(canvas, canvas2);
+  view.ReleaseScratchCanvas(canvas);
+  view.ReleaseScratchCanvas(canvas2);
+
+  ggadget::CanvasInterface *canvas3 = view.AcquireScratchCanvas(100, 50);
+  ASSERT_NE(canvas, canvas3);
+  ASSERT_NE(canvas2, canvas3);
+  view.ReleaseScratchCanvas(canvas3);
+}
+
+// Counts the draws of its own content, which are skipped while the element
+// is drawn from a cached layer.
+class LayerElement : public BasicElement {
+ public:
+  LayerElement(View *view, double size)
+      : BasicElement(view, "layer", NULL, true), draw_count_(0) {
+    SetPixelWidth(size);
+    SetPixelHeight(size);
+    GetChildren()->AppendElement("muffin", NULL);
+    view->GetChildren()->AppendElement(this);
+  }
+  virtual void DoDraw(ggadget::CanvasInterface *canvas) {
+    ++draw_count_;
+    DrawChildren(canvas);
+  }
+  // Draws the element and returns whether its content was drawn.
+  bool DrawContent(ggadget::CanvasInterface *canvas) {
+    int count = draw_count_;
+    GetView()->Layout();
+    Draw(canvas);
+    return draw_count_ != count;
+  }
+  int draw_count_;
+};
+
+TEST(ViewTest, LayerCacheBudget) {
+  MockedViewHost *host = new MockedViewHost(ViewHostInterface::VIEW_HOST_MAIN);
+  View view(host, NULL, g_factory, NULL);
+  MockedCanvas canvas(1000, 1000);
+
+  // Each layer takes 1.44MB, so only two of them fit in the budget.
+  LayerElement *e1 = new LayerElement(&view, 600);
+  LayerElement *e2 = new LayerElement(&view, 600);
+  LayerElement *e3 = new LayerElement(&view, 600);
+  for (int i = 0; i < 20; i++) {
+    e1->DrawContent(&canvas);
+    e2->DrawContent(&canvas);
+  }
+  ASSERT_FALSE(e1->DrawContent(&canvas));
+  ASSERT_FALSE(e2->DrawContent(&canvas));
+  ASSERT_FALSE(e1->DrawContent(&canvas));
+
+  // Promoting the third layer demotes the least recently used one.
+  for (int i = 0; i < 20; i++)
+    e3->DrawContent(&canvas);
+  ASSERT_FALSE(e3->DrawContent(&canvas));
+  ASSERT_FALSE(e1->DrawContent(&canvas));
+  ASSERT_TRUE(e2->DrawContent(&canvas));
+  ASSERT_TRUE(e2->DrawContent(&canvas));
+
+  // Layers larger than the whole budget are never promoted.
+  LayerElement *big = new LayerElement(&view, 1100);
+  for (int i = 0; i < 20; i++)
+    ASSERT_TRUE(big->DrawContent(&canvas));
+  ASSERT_FALSE(e1->DrawContent(&canvas));
+  ASSERT_FALSE(e3->DrawContent(&canvas));
+}
+
+TEST(ViewTest, IncrementalLayout) {
+  MockedViewHost *host = new MockedViewHost(ViewHostInterface::VIEW_HOST_MAIN);
+  View view(host, NULL, g_factory, NULL);
+  view.SetSize(100, 100);
+
+  ggadget::BasicElement *m1 =
+      view.GetChildren()->AppendElement("muffin", NULL);
+  ggadget::BasicElement *m2 = m1->GetChildren()->AppendElement("muffin", NULL);
+  ggadget::BasicElement *p1 = m2->GetChildren()->AppendElement("pie", NULL);
+  ggadget::BasicElement *p2 = m1->GetChildren()->AppendElement("pie", NULL);
+  m1->SetPixelWidth(80);
+  m1->SetPixelHeight(80);
+  m2->SetPixelWidth(40);
+  m2->SetPixelHeight(40);
+  view.Layout();
+  ASSERT_EQ(4, view.GetLayoutCount());
+  view.Layout();
+  ASSERT_EQ(0, view.GetLayoutCount());
+
+  // Only the path down to the changed element is visited.
+  p1->SetPixelX(10);
+  view.Layout();
+  ASSERT_EQ(3, view.GetLayoutCount());
+  view.Layout();
+  ASSERT_EQ(0, view.GetLayoutCount());
+
+  // A changed element visits its direct children, and the children whose
+  // client size is not changed don't visit theirs.
+  m1->SetPixelWidth(60);
+  view.Layout();
+  ASSERT_EQ(3, view.GetLayoutCount());
+
+  // Relative children follow the size of their parent.
+  p2->SetRelativeWidth(0.5);
+  view.Layout();
+  ASSERT_DOUBLE_EQ(30.0, p2->GetPixelWidth());
+  m1->SetPixelWidth(80);
+  view.Layout();
+  ASSERT_DOUBLE_EQ(40.0, p2->GetPixelWidth());
+
+  // Top level elements follow the size of the view.
+  m1->SetRelativeWidth(0.5);
+  view.Layout();
+  view.SetSize(200, 200);
+  view.Layout();
+  ASSERT_DOUBLE_EQ(100.0, m1->GetPixelWidth());
+  ASSERT_DOUBLE_EQ(50.0, p2->GetPixelWidth());
+
+  m1->GetChildren()->RemoveElement(p2);
+  view.Layout();
+  ASSERT_EQ(2, view.GetLayoutCount());
+}
+
+// Records the times when a timer is fired.
+class TimerRecorder {
+ public:
+  void OnTimer() { times_.push_back(main_loop.GetCurrentTime()); }
+  std::vector<uint64_t> times_;
+};
+
+static int CountActiveWatches() {
+  int count = 0;
+  for (size_t i = 0; i < main_loop.timers_.size(); ++i) {
+    if (main_loop.timers_[i].interval != -1)
+      count++;
+  }
+  return count;
+}
+
+TEST(ViewTest, CoalescedTimers) {
+  MockedViewHost *host1 = new MockedViewHost(ViewHostInterface::VIEW_HOST_MAIN);
+  MockedViewHost *host2 = new MockedViewHost(ViewHostInterface::VIEW_HOST_MAIN);
+  View view1(host1, NULL, g_factory, NULL);
+  View view2(host2, NULL, g_factory, NULL);
+  TimerRecorder anim1, anim2, timeout1, interval2;
+  int watches = CountActiveWatches();
+
+  main_loop.AdvanceTime(1005);
+  uint64_t start = main_loop.GetCurrentTime();
+  int token1 = view1.BeginAnimation(
+      ggadget::NewSlot(&anim1, &TimerRecorder::OnTimer), 0, 100, 200);
+  main_loop.AdvanceTime(13);
+  view2.BeginAnimation(
+      ggadget::NewSlot(&anim2, &TimerRecorder::OnTimer), 0, 100, 200);
+  view1.SetTimeout(ggadget::NewSlot(&timeout1, &TimerRecorder::OnTimer), 60);
+  int token2 = view2.SetInterval(
+      ggadget::NewSlot(&interval2, &TimerRecorder::OnTimer), 100);
+  ASSERT_NE(token1, token2);
+  // All timers of all views share one main loop watch.
+  ASSERT_EQ(watches + 1, CountActiveWatches());
+
+  while (main_loop.GetCurrentTime() < start + 400)
+    main_loop.DoIteration(true);
+
+  // Animations of both views are fired on the same ticks, though they
+  // were started at different times.
+  ASSERT_LT(0U, anim1.times_.size());
+  ASSERT_EQ(anim1.times_.size(), anim2.times_.size());
+  for (size_t i = 0; i < anim1.times_.size(); ++i)
+    EXPECT_EQ(anim1.times_[i], anim2.times_[i]);
+  // Other timers are delayed to the animation ticks shortly after they are
+  // due, but never fired before.
+  ASSERT_EQ(1U, timeout1.times_.size());
+  EXPECT_EQ(start + 13 + 60 + 2, timeout1.times_[0]);
+  ASSERT_LE(3U, interval2.times_.size());
+  EXPECT_EQ(start + 13 + 100 + 2, interval2.times_[0]);
+  // The animations are finished by then.
+  EXPECT_EQ(start + 13 + 200, interval2.times_[1]);
+
+  // Animations are finished, only the interval timer remains.
+  view2.ClearInterval(token2);
+  EXPECT_EQ(watches, CountActiveWatches());
+}
+
 int main(int argc, char *argv[]) {
   ggadget::SetGlobalMainLoop(&main_loop);
   testing::ParseGTestFlags(&argc, argv);
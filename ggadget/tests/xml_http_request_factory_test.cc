@@ -0,0 +1,342 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include <string>
+
+#include "ggadget/common.h"
+#include "ggadget/logger.h"
+#include "ggadget/native_main_loop.h"
+#include "ggadget/scriptable_helper.h"
+#include "ggadget/signals.h"
+#include "ggadget/slot.h"
+#include "ggadget/xml_http_request_interface.h"
+#include "ggadget/xml_parser_interface.h"
+#include "unittest/gtest.h"
+#include "init_extensions.h"
+
+using namespace ggadget;
+
+static NativeMainLoop g_main_loop;
+
+// The response of the requests sent through the network.
+static unsigned short g_status = 0;
+static std::string g_headers;
+static std::string g_body;
+// Records the requests sent through the network since SetResponse().
+static int g_send_count = 0;
+static std::string g_request_headers;
+
+static void SetResponse(unsigned short status, const char *headers,
+                        const char *body) {
+  g_status = status;
+  g_headers = headers;
+  g_body = body;
+  g_send_count = 0;
+  g_request_headers.clear();
+}
+
+// A backend request which completes synchronously with the response above.
+class ScriptedXMLHttpRequest
+    : public ScriptableHelper<XMLHttpRequestInterface> {
+ public:
+  DEFINE_CLASS_ID(0x7d0e5a4c9b2f4e61, XMLHttpRequestInterface);
+
+  ScriptedXMLHttpRequest() : state_(UNSENT), status_(0) { }
+
+  virtual Connection *ConnectOnReadyStateChange(Slot0<void> *handler) {
+    return statechange_signal_.Connect(handler);
+  }
+  virtual State GetReadyState() { return state_; }
+  virtual ExceptionCode Open(const char *method, const char *url, bool async,
+                             const char *user, const char *password) {
+    url_ = url;
+    status_ = 0;
+    headers_.clear();
+    body_.clear();
+    ChangeState(OPENED);
+    return NO_ERR;
+  }
+  virtual ExceptionCode SetRequestHeader(const char *header,
+                                         const char *value) {
+    g_request_headers += std::string(header) + ": " + value + "\r\n";
+    return NO_ERR;
+  }
+  virtual ExceptionCode Send(const std::string &data) {
+    if (state_ != OPENED)
+      return INVALID_STATE_ERR;
+    g_send_count++;
+    status_ = g_status;
+    headers_ = g_headers;
+    body_ = g_body;
+    ChangeState(HEADERS_RECEIVED);
+    ChangeState(LOADING);
+    ChangeState(DONE);
+    return NO_ERR;
+  }
+  virtual ExceptionCode Send(const DOMDocumentInterface *data) {
+    return Send(std::string());
+  }
+  virtual void Abort() {
+    if (state_ == HEADERS_RECEIVED || state_ == LOADING)
+      ChangeState(DONE);
+    state_ = UNSENT;
+  }
+  virtual ExceptionCode GetAllResponseHeaders(const std::string **result) {
+    *result = state_ >= HEADERS_RECEIVED ? &headers_ : NULL;
+    return *result ? NO_ERR : INVALID_STATE_ERR;
+  }
+  virtual ExceptionCode GetResponseHeader(const char *header,
+                                          const std::string **result) {
+    *result = NULL;
+    return NO_ERR;
+  }
+  virtual ExceptionCode GetResponseText(std::string *result) {
+    *result = body_;
+    return NO_ERR;
+  }
+  virtual ExceptionCode GetResponseXML(DOMDocumentInterface **result) {
+    *result = NULL;
+    return NO_ERR;
+  }
+  virtual ExceptionCode GetStatus(unsigned short *result) {
+    *result = status_;
+    return NO_ERR;
+  }
+  virtual ExceptionCode GetStatusText(const std::string **result) {
+    *result = &status_text_;
+    return NO_ERR;
+  }
+  virtual ExceptionCode GetResponseBody(std::string *result) {
+    *result = body_;
+    return NO_ERR;
+  }
+  virtual bool IsSuccessful() { return state_ == DONE; }
+  virtual std::string GetEffectiveUrl() { return url_; }
+  virtual std::string GetResponseContentType() { return "text/xml"; }
+  virtual Connection *ConnectOnDataReceived(
+      Slot2<size_t, const void *, size_t> *receiver) {
+    delete receiver;
+    return NULL;
+  }
+
+ private:
+  void ChangeState(State new_state) {
+    state_ = new_state;
+    statechange_signal_();
+  }
+
+  State state_;
+  unsigned short status_;
+  std::string url_;
+  std::string status_text_;
+  std::string headers_;
+  std::string body_;
+  Signal0<void> statechange_signal_;
+};
+
+class ScriptedXMLHttpRequestFactory : public XMLHttpRequestFactoryInterface {
+ public:
+  ScriptedXMLHttpRequestFactory() : sessions_(0) { }
+  virtual int CreateSession() { return ++sessions_; }
+  virtual void DestroySession(int session_id) { }
+  virtual XMLHttpRequestInterface *CreateXMLHttpRequest(
+      int session_id, XMLParserInterface *parser) {
+    return new ScriptedXMLHttpRequest();
+  }
+  virtual void SetDefaultUserAgent(const char *user_agent) { }
+
+ private:
+  int sessions_;
+};
+
+// Records the ready states reported to the caller as a string of digits.
+class StateRecorder {
+ public:
+  explicit StateRecorder(int session_id) {
+    request_ = GetXMLHttpRequestFactory()->CreateXMLHttpRequest(
+        session_id, GetXMLParser());
+    request_->Ref();
+    request_->ConnectOnReadyStateChange(
+        NewSlot(this, &StateRecorder::OnStateChange));
+  }
+  ~StateRecorder() {
+    request_->Unref();
+  }
+  void OnStateChange() {
+    states_ += static_cast<char>('0' + request_->GetReadyState());
+  }
+  void Get(const char *url, bool async) {
+    ASSERT_EQ(XMLHttpRequestInterface::NO_ERR,
+              request_->Open("GET", url, async, NULL, NULL));
+    ASSERT_EQ(XMLHttpRequestInterface::NO_ERR,
+              request_->Send(std::string()));
+  }
+  std::string GetResponseBody() {
+    std::string body;
+    EXPECT_EQ(XMLHttpRequestInterface::NO_ERR,
+              request_->GetResponseBody(&body));
+    return body;
+  }
+  unsigned short GetStatus() {
+    unsigned short status = 0;
+    EXPECT_EQ(XMLHttpRequestInterface::NO_ERR, request_->GetStatus(&status));
+    return status;
+  }
+
+  XMLHttpRequestInterface *request_;
+  std::string states_;
+};
+
+TEST(CachedXMLHttpRequest, ServeFromCache) {
+  static const char kURL[] = "http://www.example.com/fresh.xml";
+  SetResponse(200, "Content-Type: text/xml\r\nCache-Control: max-age=60\r\n",
+              "<fresh/>");
+  {
+    StateRecorder recorder(0);
+    recorder.Get(kURL, false);
+    EXPECT_EQ(1, g_send_count);
+    EXPECT_EQ("1234", recorder.states_);
+  }
+
+  SetResponse(500, "", "");
+  {
+    StateRecorder recorder(0);
+    recorder.Get(kURL, false);
+    EXPECT_EQ(0, g_send_count);
+    EXPECT_EQ("1234", recorder.states_);
+    EXPECT_EQ(200, recorder.GetStatus());
+    EXPECT_EQ("<fresh/>", recorder.GetResponseBody());
+    std::string text;
+    EXPECT_EQ(XMLHttpRequestInterface::NO_ERR,
+              recorder.request_->GetResponseText(&text));
+    EXPECT_EQ("<fresh/>", text);
+    const std::string *header = NULL;
+    EXPECT_EQ(XMLHttpRequestInterface::NO_ERR,
+              recorder.request_->GetResponseHeader("cache-control", &header));
+    ASSERT_TRUE(header);
+    EXPECT_EQ("max-age=60", *header);
+  }
+
+  // Requests with cookies bypass the cache.
+  {
+    StateRecorder recorder(0);
+    ASSERT_EQ(XMLHttpRequestInterface::NO_ERR,
+              recorder.request_->Open("GET", kURL, false, NULL, NULL));
+    recorder.request_->SetRequestHeader("Cookie", "id=1");
+    recorder.request_->Send(std::string());
+    EXPECT_EQ(1, g_send_count);
+    EXPECT_EQ(500, recorder.GetStatus());
+  }
+
+  // Responses cached in other partitions are not shared.
+  int session = GetXMLHttpRequestFactory()->CreateSession();
+  SetXMLHttpRequestCachePartition(session, "gadget");
+  SetResponse(500, "", "");
+  {
+    StateRecorder recorder(session);
+    recorder.Get(kURL, false);
+    EXPECT_EQ(1, g_send_count);
+    EXPECT_EQ(500, recorder.GetStatus());
+  }
+  GetXMLHttpRequestFactory()->DestroySession(session);
+}
+
+TEST(CachedXMLHttpRequest, Revalidate) {
+  static const char kURL[] = "http://www.example.com/stale.xml";
+  SetResponse(200, "ETag: \"v1\"\r\nCache-Control: no-cache\r\n", "<v1/>");
+  {
+    StateRecorder recorder(0);
+    recorder.Get(kURL, false);
+    EXPECT_EQ(1, g_send_count);
+    EXPECT_EQ("", g_request_headers);
+  }
+
+  // The cached response is delivered if the server answers 304.
+  SetResponse(304, "ETag: \"v1\"\r\n", "");
+  {
+    StateRecorder recorder(0);
+    recorder.Get(kURL, false);
+    EXPECT_EQ(1, g_send_count);
+    EXPECT_EQ("If-None-Match: \"v1\"\r\n", g_request_headers);
+    EXPECT_EQ("1234", recorder.states_);
+    EXPECT_EQ(200, recorder.GetStatus());
+    EXPECT_EQ("<v1/>", recorder.GetResponseBody());
+  }
+
+  // A modified response replaces the cached one.
+  SetResponse(200, "ETag: \"v2\"\r\nCache-Control: no-cache\r\n", "<v2/>");
+  {
+    StateRecorder recorder(0);
+    recorder.Get(kURL, false);
+    EXPECT_EQ(1, g_send_count);
+    EXPECT_EQ("If-None-Match: \"v1\"\r\n", g_request_headers);
+    EXPECT_EQ("1234", recorder.states_);
+    EXPECT_EQ("<v2/>", recorder.GetResponseBody());
+  }
+  SetResponse(304, "", "");
+  {
+    StateRecorder recorder(0);
+    recorder.Get(kURL, false);
+    EXPECT_EQ("If-None-Match: \"v2\"\r\n", g_request_headers);
+    EXPECT_EQ("<v2/>", recorder.GetResponseBody());
+  }
+}
+
+TEST(CachedXMLHttpRequest, Abort) {
+  static const char kURL[] = "http://www.example.com/abort.xml";
+  SetResponse(200, "Cache-Control: max-age=60\r\n", "<abort/>");
+  {
+    StateRecorder recorder(0);
+    recorder.Get(kURL, false);
+    EXPECT_EQ(1, g_send_count);
+  }
+
+  SetResponse(500, "", "");
+  StateRecorder recorder(0);
+  // Async responses from the cache are delivered in the main loop.
+  recorder.Get(kURL, true);
+  EXPECT_EQ("1", recorder.states_);
+  recorder.request_->Abort();
+  EXPECT_EQ("14", recorder.states_);
+  EXPECT_EQ(XMLHttpRequestInterface::UNSENT,
+            recorder.request_->GetReadyState());
+  for (int i = 0; i < 3; i++)
+    g_main_loop.DoIteration(false);
+  EXPECT_EQ("14", recorder.states_);
+
+  // The request can be reused after being aborted.
+  recorder.states_.clear();
+  recorder.Get(kURL, true);
+  for (int i = 0; i < 3 && recorder.states_.size() < 4; i++)
+    g_main_loop.DoIteration(false);
+  EXPECT_EQ("1234", recorder.states_);
+  EXPECT_EQ("<abort/>", recorder.GetResponseBody());
+  EXPECT_EQ(0, g_send_count);
+}
+
+int main(int argc, char **argv) {
+  SetGlobalMainLoop(&g_main_loop);
+  testing::ParseGTestFlags(&argc, argv);
+
+  static const char *kExtensions[] = {
+    "libxml2_xml_parser/libxml2-xml-parser",
+  };
+  INIT_EXTENSIONS(argc, argv, kExtensions);
+
+  static ScriptedXMLHttpRequestFactory factory;
+  SetXMLHttpRequestFactory(&factory);
+  return RUN_ALL_TESTS();
+}
@@ -29,7 +29,7 @@
 #include "ggadget/xml_http_request_interface.h"
 #include "ggadget/xml_parser_interface.h"
 #include "ggadget/memory_options.h"
-#include "native_main_loop.h"
+#include "ggadget/native_main_loop.h"
 #include "unittest/gtest.h"
 #include "init_extensions.h"
 
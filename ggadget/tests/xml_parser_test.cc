@@ -258,6 +258,79 @@ TEST(XMLParser, ParseXMLIntoDOM_InvalidXML) {
   domdoc->Unref();
 }
 
+TEST(XMLParser, ParseXMLIntoDOM_EntityMarkup) {
+  const char *entity_xml =
+    "<!DOCTYPE root [\n"
+    "  <!ENTITY m \"<b>bold</b> &amp; text\">\n"
+    "]>\n"
+    "<root a=\"x&amp;y\">\n"
+    "  <e>&m;&m;</e>\n"
+    "  <e2/>\n"
+    "</root>";
+
+  XMLParserInterface *xml_parser = GetXMLParser();
+  DOMDocumentInterface *domdoc = xml_parser->CreateDOMDocument();
+  domdoc->Ref();
+  ASSERT_TRUE(xml_parser->ParseContentIntoDOM(entity_xml, NULL, "Entity",
+                                              NULL, NULL, NULL,
+                                              domdoc, NULL, NULL));
+  DOMElementInterface *doc_ele = domdoc->GetDocumentElement();
+  ASSERT_TRUE(doc_ele);
+  EXPECT_STREQ("x&y", doc_ele->GetAttribute("a").c_str());
+  EXPECT_EQ(4, doc_ele->GetRow());
+  DOMNodeInterface *e = doc_ele->GetFirstChild();
+  ASSERT_TRUE(e);
+  EXPECT_STREQ("e", e->GetNodeName().c_str());
+  EXPECT_EQ(5, e->GetRow());
+  // Markup in entities is flattened into text.
+  EXPECT_STREQ("bold & textbold & text", e->GetTextContent().c_str());
+  ASSERT_TRUE(e->GetNextSibling());
+  EXPECT_STREQ("e2", e->GetNextSibling()->GetNodeName().c_str());
+  EXPECT_EQ(6, e->GetNextSibling()->GetRow());
+  EXPECT_FALSE(e->GetNextSibling()->GetNextSibling());
+  ASSERT_EQ(1, domdoc->GetRefCount());
+  domdoc->Unref();
+}
+
+TEST(XMLParser, ParseXMLIntoDOM_NestedEntity) {
+  const char *entity_xml =
+    "<!DOCTYPE r [\n"
+    "  <!ENTITY a \"x\">\n"
+    "  <!ENTITY b \"&a;y\">\n"
+    "  <!ENTITY c \"<i>&b;</i>&a;\">\n"
+    "]>\n"
+    "<r><e>&b;</e><e>&c;&b;</e></r>";
+
+  XMLParserInterface *xml_parser = GetXMLParser();
+  DOMDocumentInterface *domdoc = xml_parser->CreateDOMDocument();
+  domdoc->Ref();
+  ASSERT_TRUE(xml_parser->ParseContentIntoDOM(entity_xml, NULL, "Nested",
+                                              NULL, NULL, NULL,
+                                              domdoc, NULL, NULL));
+  DOMElementInterface *doc_ele = domdoc->GetDocumentElement();
+  ASSERT_TRUE(doc_ele);
+  DOMNodeInterface *e = doc_ele->GetFirstChild();
+  ASSERT_TRUE(e);
+  EXPECT_STREQ("xy", e->GetTextContent().c_str());
+  ASSERT_TRUE(e->GetNextSibling());
+  EXPECT_STREQ("xyxxy", e->GetNextSibling()->GetTextContent().c_str());
+  ASSERT_EQ(1, domdoc->GetRefCount());
+  domdoc->Unref();
+}
+
+TEST(XMLParser, ParseXMLIntoDOM_Truncated) {
+  XMLParserInterface *xml_parser = GetXMLParser();
+  DOMDocumentInterface *domdoc = xml_parser->CreateDOMDocument();
+  domdoc->Ref();
+  // Nothing is left in the document if the parsing fails halfway.
+  ASSERT_FALSE(xml_parser->ParseContentIntoDOM("<a><b>text</b><c>", NULL,
+                                               "Truncated", NULL, NULL, NULL,
+                                               domdoc, NULL, NULL));
+  ASSERT_FALSE(domdoc->HasChildNodes());
+  ASSERT_EQ(1, domdoc->GetRefCount());
+  domdoc->Unref();
+}
+
 TEST(XMLParser, ConvertStringToUTF8) {
   XMLParserInterface *xml_parser = GetXMLParser();
   const char *src = "ASCII string, no BOM";
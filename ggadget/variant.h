@@ -865,6 +865,57 @@ class ResultVariant {
   Variant v_;
 };
 
+/**
+ * Holds the arguments converted from script values to call a @c Slot.
+ * Short argument lists, which are most of the calls, are kept in the object
+ * itself, so that calling native slots from scripts needn't allocate memory.
+ */
+class VariantArgs {
+ public:
+  VariantArgs() : args_(NULL), size_(0) { }
+  ~VariantArgs() { Reset(); }
+
+  /**
+   * Allocates @a size void arguments, discarding the previous ones.
+   * @return the arguments, or @c NULL if @a size is 0.
+   */
+  Variant *Resize(size_t size) {
+    Reset();
+    if (size > kInlineSize)
+      args_ = new Variant[size];
+    else if (size > 0)
+      args_ = inline_;
+    size_ = size;
+    return args_;
+  }
+
+  /** Discards all arguments. */
+  void Reset() {
+    if (args_ == inline_) {
+      for (size_t i = 0; i < size_; ++i)
+        inline_[i] = Variant();
+    } else {
+      delete [] args_;
+    }
+    args_ = NULL;
+    size_ = 0;
+  }
+
+  Variant *get() const { return args_; }
+  size_t size() const { return size_; }
+  Variant &operator[](size_t i) const {
+    ASSERT(i < size_);
+    return args_[i];
+  }
+
+ private:
+  static const size_t kInlineSize = 4;
+  Variant inline_[kInlineSize];
+  Variant *args_;
+  size_t size_;
+  DISALLOW_EVIL_CONSTRUCTORS(VariantArgs);
+};
+
 #undef SPECIALIZE_VARIANT_TYPE
 #undef SPECIALIZE_VARIANT_VALUE
 
@@ -18,6 +18,11 @@
 // #define VIEW_VERBOSE_DEBUG
 // #define EVENT_VERBOSE_DEBUG
 
+#include <climits>
+#include <cmath>
+#include <list>
+#include <map>
+#include <set>
 #include <vector>
 #include <algorithm>
 
@@ -66,6 +71,187 @@ DECLARE_VARIANT_PTR_TYPE(CanvasInterface);
 static const char *kResizableNames[] = { "false", "true", "zoom" };
 static const Variant kConfirmDefaultArgs[] = { Variant(), Variant(false) };
 
+// A timer may be delayed by up to this many milliseconds, to be fired in the
+// same batch as the timers of all views due shortly after it.
+static const uint64_t kTimerSlack = 10;
+
+/**
+ * Multiplexes the timers of all views onto a single main loop watch.
+ *
+ * Timers due in the same slice are fired in one batch when the last of them
+ * is due, so that the changes they make are drawn together. Timers are never
+ * fired before they are due. Aligned timers, i.e. animation timers, are
+ * always due at multiples of their interval, so all animations of all views
+ * advance on the same frame ticks.
+ *
+ * Timers are identified by tokens allocated by the scheduler, which are
+ * passed to the Call() and OnRemove() methods of their callbacks as watch
+ * ids.
+ */
+class TimerScheduler : public WatchCallbackInterface {
+ public:
+  static TimerScheduler *Get(MainLoopInterface *main_loop) {
+    static TimerScheduler *scheduler = NULL;
+    if (!scheduler)
+      scheduler = new TimerScheduler(main_loop);
+    ASSERT(scheduler->main_loop_ == main_loop);
+    return scheduler;
+  }
+
+  int AddTimer(int interval, bool aligned, WatchCallbackInterface *callback) {
+    ASSERT(interval > 0 && callback);
+    int token = serial_;
+    do {
+      serial_ = (serial_ == INT_MAX ? 1 : serial_ + 1);
+    } while (timers_.find(serial_) != timers_.end());
+
+    Timer *timer = &timers_[token];
+    timer->callback = callback;
+    timer->interval = interval;
+    timer->aligned = aligned;
+    timer->due = GetFirstDue(interval, aligned, main_loop_->GetCurrentTime());
+    queue_.insert(std::make_pair(timer->due, token));
+    Arm();
+    return token;
+  }
+
+  void RemoveTimer(int token) {
+    TimerMap::iterator it = timers_.find(token);
+    if (it == timers_.end() || it->second.removing)
+      return;
+    it->second.removing = true;
+    // The timer being called will be removed after the call.
+    if (!it->second.calling)
+      EraseTimer(it);
+  }
+
+  virtual bool Call(MainLoopInterface *main_loop, int watch_id) {
+    GGL_UNUSED(main_loop);
+    if (watch_id != watch_id_)
+      return false;
+    // This watch is done. Arm() below adds a new one if needed, so that
+    // timers keep working in nested main loops run by the callbacks.
+    watch_id_ = 0;
+
+    uint64_t now = main_loop_->GetCurrentTime();
+    std::vector<int> batch;
+    while (!queue_.empty() && queue_.begin()->first <= now) {
+      int token = queue_.begin()->second;
+      queue_.erase(queue_.begin());
+      Timer *timer = &timers_[token];
+      // Reschedule before calling, in case the callback runs a nested main
+      // loop.
+      timer->due = GetNextDue(*timer, now);
+      queue_.insert(std::make_pair(timer->due, token));
+      batch.push_back(token);
+    }
+    Arm();
+
+    for (std::vector<int>::iterator it = batch.begin();
+         it != batch.end(); ++it) {
+      TimerMap::iterator timer_it = timers_.find(*it);
+      if (timer_it == timers_.end() || timer_it->second.calling ||
+          timer_it->second.removing)
+        continue;
+      timer_it->second.calling = true;
+      bool keep = timer_it->second.callback->Call(main_loop_, *it);
+      timer_it = timers_.find(*it);
+      ASSERT(timer_it != timers_.end());
+      timer_it->second.calling = false;
+      if (!keep || timer_it->second.removing) {
+        timer_it->second.removing = true;
+        EraseTimer(timer_it);
+      }
+    }
+    return false;
+  }
+
+  virtual void OnRemove(MainLoopInterface *main_loop, int watch_id) {
+    GGL_UNUSED(main_loop);
+    // The scheduler lives as long as the process.
+    if (watch_id == watch_id_)
+      watch_id_ = 0;
+  }
+
+ private:
+  struct Timer {
+    Timer()
+        : callback(NULL), due(0), interval(0),
+          aligned(false), calling(false), removing(false) { }
+    WatchCallbackInterface *callback;
+    uint64_t due;
+    int interval;
+    bool aligned  : 1;
+    bool calling  : 1;
+    bool removing : 1;
+  };
+
+  typedef std::map<int, Timer> TimerMap;
+  // Sorted by due time, then token.
+  typedef std::set<std::pair<uint64_t, int> > TimerQueue;
+
+  explicit TimerScheduler(MainLoopInterface *main_loop)
+      : main_loop_(main_loop), serial_(1), watch_id_(0), watch_time_(0) {
+  }
+
+  static uint64_t GetFirstDue(int interval, bool aligned, uint64_t now) {
+    return aligned ? (now / interval + 1) * interval : now + interval;
+  }
+
+  static uint64_t GetNextDue(const Timer &timer, uint64_t now) {
+    uint64_t due = timer.due + timer.interval;
+    // Skip the missed slots instead of firing in a burst.
+    return due > now ? due : GetFirstDue(timer.interval, timer.aligned, now);
+  }
+
+  void EraseTimer(TimerMap::iterator it) {
+    int token = it->first;
+    WatchCallbackInterface *callback = it->second.callback;
+    queue_.erase(std::make_pair(it->second.due, token));
+    timers_.erase(it);
+    callback->OnRemove(main_loop_, token);
+    Arm();
+  }
+
+  // Gets the time to fire the first batch, i.e. the due time of the last
+  // timer due within kTimerSlack after the first one.
+  uint64_t GetBatchDue() const {
+    TimerQueue::const_iterator it = queue_.begin();
+    uint64_t limit = it->first + kTimerSlack;
+    uint64_t due = it->first;
+    for (; it != queue_.end() && it->first <= limit; ++it)
+      due = it->first;
+    return due;
+  }
+
+  // Makes sure the watch fires when the first batch is due, and that there
+  // is no watch if there is no timer.
+  void Arm() {
+    if (queue_.empty()) {
+      if (watch_id_)
+        main_loop_->RemoveWatch(watch_id_);
+      return;
+    }
+    uint64_t now = main_loop_->GetCurrentTime();
+    uint64_t due = std::max(GetBatchDue(), now);
+    if (watch_id_ && watch_time_ == due)
+      return;
+    if (watch_id_)
+      main_loop_->RemoveWatch(watch_id_);
+    watch_id_ = main_loop_->AddTimeoutWatch(static_cast<int>(due - now), this);
+    if (watch_id_ <= 0)
+      watch_id_ = 0;
+    watch_time_ = due;
+  }
+
+  MainLoopInterface *main_loop_;
+  TimerMap timers_;
+  TimerQueue queue_;
+  int serial_;
+  int watch_id_;
+  uint64_t watch_time_;
+};
+
 class View::Impl : public SmallObject<> {
  public:
   /**
@@ -204,8 +390,10 @@ class View::Impl : public SmallObject<> {
       canvas_cache_(NULL),
       graphics_(NULL),
       scriptable_view_(NULL),
+      layer_cache_bytes_(0),
       clip_region_(0.9),
       children_(element_factory, NULL, owner),
+      layout_count_(0),
 #ifdef _DEBUG
       draw_count_(0),
       view_draw_count_(0),
@@ -254,6 +442,8 @@ class View::Impl : public SmallObject<> {
       canvas_cache_ = NULL;
     }
 
+    ClearScratchCanvases();
+
     if (view_host_) {
       view_host_->SetView(NULL);
       view_host_->Destroy();
@@ -1124,6 +1314,8 @@ class View::Impl : public SmallObject<> {
 
       width_ = width;
       height_ = height;
+      // Relative sizes and positions of all top level elements may change.
+      children_.QueueLayout();
 
       // In some case, QueueResize() may not cause redraw,
       // so do layout here to make sure the layout is correct.
@@ -1202,10 +1394,14 @@ class View::Impl : public SmallObject<> {
       theme_changed_ = false;
     }
 
+    layout_count_ = 0;
     children_.CalculateSize();
 
     AutoUpdateSize();
     children_.Layout();
+#if defined(_DEBUG) && defined(VIEW_VERBOSE_DEBUG)
+    DLOG("Layout count: %d", layout_count_);
+#endif
 
     // Let posted events be processed after Layout() and before actual Draw().
     // This can prevent some flickers, for example, onsize of labels.
@@ -1362,6 +1558,97 @@ class View::Impl : public SmallObject<> {
 #endif
   }
 
+  CanvasInterface *AcquireScratchCanvas(double width, double height) {
+    if (!graphics_ || width <= 0 || height <= 0)
+      return NULL;
+    double bucket_width = ceil(width / kScratchCanvasBucket) *
+        kScratchCanvasBucket;
+    double bucket_height = ceil(height / kScratchCanvasBucket) *
+        kScratchCanvasBucket;
+    for (ScratchCanvases::iterator it = scratch_canvases_.begin();
+         it != scratch_canvases_.end(); ++it) {
+      CanvasInterface *canvas = *it;
+      if (canvas->GetWidth() == bucket_width &&
+          canvas->GetHeight() == bucket_height) {
+        scratch_canvases_.erase(it);
+        canvas->ClearCanvas();
+        return canvas;
+      }
+    }
+    return graphics_->NewCanvas(bucket_width, bucket_height);
+  }
+
+  void ReleaseScratchCanvas(CanvasInterface *canvas) {
+    if (!canvas) return;
+    if (scratch_canvases_.size() >= kMaxScratchCanvases) {
+      // Drops the least recently used one.
+      scratch_canvases_.front()->Destroy();
+      scratch_canvases_.erase(scratch_canvases_.begin());
+    }
+    scratch_canvases_.push_back(canvas);
+  }
+
+  bool ReserveLayerCache(BasicElement *element, size_t bytes) {
+    if (bytes > kMaxLayerCacheBytes)
+      return false;
+    ReleaseLayerCache(element);
+
+    // Demotes the least recently used layers until the new one fits. The
+    // ancestors of the element can't be demoted, because the element might
+    // be drawn into their caches right now.
+    LayerCaches::iterator it = layer_caches_.begin();
+    while (layer_cache_bytes_ + bytes > kMaxLayerCacheBytes &&
+           it != layer_caches_.end()) {
+      BasicElement *layer = it->first;
+      BasicElement *ancestor = element->GetParentElement();
+      while (ancestor && ancestor != layer)
+        ancestor = ancestor->GetParentElement();
+      if (ancestor) {
+        ++it;
+        continue;
+      }
+      layer_cache_bytes_ -= it->second;
+      it = layer_caches_.erase(it);
+      layer->DemoteLayer();
+    }
+    if (layer_cache_bytes_ + bytes > kMaxLayerCacheBytes)
+      return false;
+
+    layer_caches_.push_back(std::make_pair(element, bytes));
+    layer_cache_bytes_ += bytes;
+    return true;
+  }
+
+  void TouchLayerCache(BasicElement *element) {
+    for (LayerCaches::iterator it = layer_caches_.begin();
+         it != layer_caches_.end(); ++it) {
+      if (it->first == element) {
+        layer_caches_.splice(layer_caches_.end(), layer_caches_, it);
+        return;
+      }
+    }
+  }
+
+  void ReleaseLayerCache(BasicElement *element) {
+    for (LayerCaches::iterator it = layer_caches_.begin();
+         it != layer_caches_.end(); ++it) {
+      if (it->first == element) {
+        ASSERT(layer_cache_bytes_ >= it->second);
+        layer_cache_bytes_ -= it->second;
+        layer_caches_.erase(it);
+        return;
+      }
+    }
+  }
+
+  void ClearScratchCanvases() {
+    for (ScratchCanvases::iterator it = scratch_canvases_.begin();
+         it != scratch_canvases_.end(); ++it) {
+      (*it)->Destroy();
+    }
+    scratch_canvases_.clear();
+  }
+
 #ifdef _DEBUG
   static bool DrawRectOnCanvasCallback(double x, double y, double w, double h,
                                        CanvasInterface *canvas) {
@@ -1598,13 +1885,9 @@ class View::Impl : public SmallObject<> {
     TimerWatchCallback *watch =
         new TimerWatchCallback(this, slot, start_value, end_value,
                                duration, current_time, true);
-    int id = main_loop_->AddTimeoutWatch(kAnimationInterval, watch);
-    if (id > 0) {
-      watch->SetWatchId(id);
-    } else {
-      DLOG("Failed to add animation timer.");
-      delete watch;
-    }
+    int id = TimerScheduler::Get(main_loop_)->AddTimer(kAnimationInterval,
+                                                       true, watch);
+    watch->SetWatchId(id);
     return id;
   }
 
@@ -1625,13 +1908,8 @@ class View::Impl : public SmallObject<> {
 
     TimerWatchCallback *watch =
         new TimerWatchCallback(this, slot, 0, 0, 0, 0, true);
-    int id = main_loop_->AddTimeoutWatch(timeout, watch);
-    if (id > 0) {
-      watch->SetWatchId(id);
-    } else {
-      DLOG("Failed to add timeout timer.");
-      delete watch;
-    }
+    int id = TimerScheduler::Get(main_loop_)->AddTimer(timeout, false, watch);
+    watch->SetWatchId(id);
     return id;
   }
 
@@ -1652,19 +1930,14 @@ class View::Impl : public SmallObject<> {
 
     TimerWatchCallback *watch =
         new TimerWatchCallback(this, slot, 0, 0, -1, 0, true);
-    int id = main_loop_->AddTimeoutWatch(interval, watch);
-    if (id > 0) {
-      watch->SetWatchId(id);
-    } else {
-      DLOG("Failed to add interval timer.");
-      delete watch;
-    }
+    int id = TimerScheduler::Get(main_loop_)->AddTimer(interval, false, watch);
+    watch->SetWatchId(id);
     return id;
   }
 
   void RemoveTimer(int token) {
     if (token > 0)
-      main_loop_->RemoveWatch(token);
+      TimerScheduler::Get(main_loop_)->RemoveTimer(token);
   }
 
   ImageInterface *LoadImage(const Variant &src, bool is_mask) {
@@ -1808,6 +2081,16 @@ class View::Impl : public SmallObject<> {
   GraphicsInterface *graphics_;
   ScriptableInterface *scriptable_view_;
 
+  // Blank canvases for indirect draw of elements, the most recently released
+  // one is at the end.
+  typedef std::vector<CanvasInterface *> ScratchCanvases;
+  ScratchCanvases scratch_canvases_;
+  // Automatically promoted elements and the memory used by their canvas
+  // caches, the most recently used one is at the end.
+  typedef std::list<std::pair<BasicElement *, size_t> > LayerCaches;
+  LayerCaches layer_caches_;
+  size_t layer_cache_bytes_;
+
   EventSignal oncancel_event_;
   EventSignal onclick_event_;
   EventSignal onclose_event_;
@@ -1868,6 +2151,8 @@ class View::Impl : public SmallObject<> {
 
   std::string caption_;
 
+  // Number of elements visited by the last Layout().
+  int layout_count_;
 #ifdef _DEBUG
   int draw_count_;
   int view_draw_count_;
@@ -1910,6 +2195,9 @@ class View::Impl : public SmallObject<> {
   static const int kMinTimeout = 10;
   static const int kMinInterval = 10;
   static const uint64_t kMinTimeBetweenTimerCall = 5;
+  static const size_t kMaxScratchCanvases = 8;
+  static const size_t kMaxLayerCacheBytes = 4 * 1024 * 1024;
+  static const int kScratchCanvasBucket = 32;
 };
 
 View::View(ViewHostInterface *view_host,
@@ -2253,6 +2541,26 @@ bool View::IsClipRegionEnabled() const {
   return impl_->clip_region_enabled_;
 }
 
+CanvasInterface *View::AcquireScratchCanvas(double width, double height) {
+  return impl_->AcquireScratchCanvas(width, height);
+}
+
+void View::ReleaseScratchCanvas(CanvasInterface *canvas) {
+  impl_->ReleaseScratchCanvas(canvas);
+}
+
+bool View::ReserveLayerCache(BasicElement *element, size_t bytes) {
+  return impl_->ReserveLayerCache(element, bytes);
+}
+
+void View::TouchLayerCache(BasicElement *element) {
+  impl_->TouchLayerCache(element);
+}
+
+void View::ReleaseLayerCache(BasicElement *element) {
+  impl_->ReleaseLayerCache(element);
+}
+
 void View::AddRectangleToClipRegion(const Rectangle &rect) {
   if (!impl_->enable_cache_) {
     Rectangle view_rect(0, 0, impl_->width_, impl_->height_);
@@ -2273,6 +2581,14 @@ void View::IncreaseDrawCount() {
 #endif
 }
 
+void View::IncreaseLayoutCount() {
+  impl_->layout_count_++;
+}
+
+int View::GetLayoutCount() const {
+  return impl_->layout_count_;
+}
+
 int View::BeginAnimation(Slot0<void> *slot,
                          int start_value,
                          int end_value,
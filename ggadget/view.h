@@ -300,6 +300,37 @@ class View : public ViewInterface {
   /** Checks if view's clip region is enabled or not. */
   bool IsClipRegionEnabled() const;
 
+  /**
+   * Gets a blank scratch canvas from the view's canvas pool, which is used
+   * by elements to draw themselves indirectly, eg. with a mask.
+   *
+   * Pooled canvases are kept in size buckets, so the returned canvas might be
+   * a little larger than the requested size.
+   * The canvas must be returned by calling ReleaseScratchCanvas() instead of
+   * being destroyed.
+   */
+  CanvasInterface *AcquireScratchCanvas(double width, double height);
+
+  /** Returns a canvas got from AcquireScratchCanvas() to the pool. */
+  void ReleaseScratchCanvas(CanvasInterface *canvas);
+
+  /**
+   * Reserves memory for a canvas cache of an automatically promoted element.
+   * The least recently used layers of other elements are demoted if the
+   * view's budget of promoted canvas caches would be exceeded.
+   *
+   * @param element the element to be promoted.
+   * @param bytes size of the canvas cache in bytes.
+   * @return @c false if the canvas cache is larger than the whole budget.
+   */
+  bool ReserveLayerCache(BasicElement *element, size_t bytes);
+
+  /** Marks the layer of an element as the most recently used one. */
+  void TouchLayerCache(BasicElement *element);
+
+  /** Releases memory reserved by ReserveLayerCache(). */
+  void ReleaseLayerCache(BasicElement *element);
+
  public: // Timer, interval and animation functions.
   /**
    * Starts an animation timer. The @a slot is called periodically during
@@ -545,6 +576,15 @@ class View : public ViewInterface {
   /** For performance testing. */
   void IncreaseDrawCount();
 
+  /**
+   * For performance testing. Called by each element visited by Layout(),
+   * so that the cost of incremental layout can be measured.
+   */
+  void IncreaseLayoutCount();
+
+  /** Gets the number of elements visited by the last Layout(). */
+  int GetLayoutCount() const;
+
  private:
   class Impl;
   Impl *impl_;
@@ -348,6 +348,8 @@ void ViewElement::Layout() {
 
 void ViewElement::QueueDrawChildView() {
   if (impl_->child_view_) {
+    // The child view is laid out by Layout() of this element.
+    QueueLayout();
     GetView()->QueueDraw();
   }
 }
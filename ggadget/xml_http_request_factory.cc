@@ -14,16 +14,680 @@
   limitations under the License.
 */
 
+#include <cstring>
+#include <ctime>
+#include <map>
+
 #include "xml_http_request_interface.h"
+#include "gadget_consts.h"
+#include "http_cache.h"
+#include "logger.h"
+#include "main_loop_interface.h"
+#include "scriptable_binary_data.h"
+#include "signals.h"
+#include "slot.h"
+#include "xml_dom_interface.h"
+#include "xml_http_request_utils.h"
+#include "xml_parser_interface.h"
 
 namespace ggadget {
 
+static const Variant kOpenDefaultArgs[] = {
+  Variant(), Variant(),
+  Variant(true),
+  Variant(static_cast<const char *>(NULL)),
+  Variant(static_cast<const char *>(NULL))
+};
+
+static const Variant kSendDefaultArgs[] = { Variant("") };
+
+// Request headers that make a request bypass the cache, because the caller
+// handles caching itself, or the response may depend on them.
+static const char *kBypassCacheHeaders[] = {
+  "Authorization", "Cache-Control", "Cookie", "If-Match",
+  "If-Modified-Since", "If-None-Match", "If-Range", "If-Unmodified-Since",
+  "Pragma", "Range",
+};
+
+/**
+ * Wraps an XMLHttpRequest object created by the real factory to serve GET
+ * requests from the shared HttpCache.
+ *
+ * Fresh cached responses are served without network access. Stale ones are
+ * revalidated with conditional requests, and 304 responses are replaced with
+ * the cached responses transparently.
+ *
+ * Responses are cached under the url prefixed with the cache partition of
+ * the session, because they may depend on the cookies of the session.
+ */
+class CachedXMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
+ public:
+  DEFINE_CLASS_ID(0x4c3b0e8a9d1f4e27, XMLHttpRequestInterface);
+
+  CachedXMLHttpRequest(XMLHttpRequestInterface *request, HttpCache *cache,
+                       XMLParserInterface *xml_parser,
+                       const std::string &partition)
+      : request_(request),
+        cache_(cache),
+        partition_(partition),
+        xml_parser_(xml_parser),
+        response_dom_(NULL),
+        replay_watch_(0),
+        state_(UNSENT),
+        mode_(PASS_THROUGH),
+        async_(false),
+        cacheable_(false),
+        streamed_(false),
+        active_(false) {
+    request_->Ref();
+    request_connection_ = request_->ConnectOnReadyStateChange(
+        NewSlot(this, &CachedXMLHttpRequest::OnRequestStateChange));
+  }
+
+  virtual void DoClassRegister() {
+    RegisterClassSignal("onreadystatechange",
+                        &CachedXMLHttpRequest::onreadystatechange_signal_);
+    RegisterProperty("readyState",
+                     NewSlot(&CachedXMLHttpRequest::GetReadyState), NULL);
+    RegisterMethod("open",
+        NewSlotWithDefaultArgs(NewSlot(&CachedXMLHttpRequest::ScriptOpen),
+                               kOpenDefaultArgs));
+    RegisterMethod("setRequestHeader",
+                   NewSlot(&CachedXMLHttpRequest::ScriptSetRequestHeader));
+    RegisterMethod("send",
+        NewSlotWithDefaultArgs(NewSlot(&CachedXMLHttpRequest::ScriptSend),
+                               kSendDefaultArgs));
+    RegisterMethod("abort", NewSlot(&CachedXMLHttpRequest::Abort));
+    RegisterMethod("getAllResponseHeaders",
+        NewSlot(&CachedXMLHttpRequest::ScriptGetAllResponseHeaders));
+    RegisterMethod("getResponseHeader",
+                   NewSlot(&CachedXMLHttpRequest::ScriptGetResponseHeader));
+    RegisterProperty("responseStream",
+                     NewSlot(&CachedXMLHttpRequest::ScriptGetResponseBody),
+                     NULL);
+    RegisterProperty("responseBody",
+                     NewSlot(&CachedXMLHttpRequest::ScriptGetResponseBody),
+                     NULL);
+    RegisterProperty("responseText",
+                     NewSlot(&CachedXMLHttpRequest::ScriptGetResponseText),
+                     NULL);
+    RegisterProperty("responseXML",
+                     NewSlot(&CachedXMLHttpRequest::ScriptGetResponseXML),
+                     NULL);
+    RegisterProperty("status",
+                     NewSlot(&CachedXMLHttpRequest::ScriptGetStatus), NULL);
+    RegisterProperty("statusText",
+                     NewSlot(&CachedXMLHttpRequest::ScriptGetStatusText),
+                     NULL);
+  }
+
+  ~CachedXMLHttpRequest() {
+    CancelReplay();
+    ClearResponse();
+    request_connection_->Disconnect();
+    request_->Unref();
+  }
+
+  virtual Connection *ConnectOnReadyStateChange(Slot0<void> *handler) {
+    return onreadystatechange_signal_.Connect(handler);
+  }
+
+  virtual State GetReadyState() {
+    return mode_ == PASS_THROUGH ? request_->GetReadyState() : state_;
+  }
+
+  virtual ExceptionCode Open(const char *method, const char *url, bool async,
+                             const char *user, const char *password) {
+    CancelReplay();
+    ClearResponse();
+    mode_ = PASS_THROUGH;
+    url_ = url ? url : "";
+    cache_key_ = partition_.empty() ? url_ : partition_ + "\n" + url_;
+    async_ = async;
+    cacheable_ = !streamed_ && method && strcasecmp(method, "GET") == 0 &&
+                 !user && !password && IsValidWebURL(url_.c_str()) &&
+                 GetUsernamePasswordFromURL(url_.c_str()).empty();
+    return request_->Open(method, url, async, user, password);
+  }
+
+  virtual ExceptionCode SetRequestHeader(const char *header,
+                                         const char *value) {
+    if (header) {
+      for (size_t i = 0; i < arraysize(kBypassCacheHeaders); ++i) {
+        if (strcasecmp(header, kBypassCacheHeaders[i]) == 0)
+          cacheable_ = false;
+      }
+    }
+    return request_->SetRequestHeader(header, value);
+  }
+
+  virtual ExceptionCode Send(const std::string &data) {
+    if (!cacheable_ || mode_ != PASS_THROUGH ||
+        request_->GetReadyState() != OPENED)
+      return SendRequest(&data, NULL);
+
+    std::string etag, last_modified;
+    switch (cache_->Lookup(cache_key_, GetCurrentTime(), &cached_response_,
+                           &etag, &last_modified)) {
+      case HttpCache::FRESH:
+        mode_ = FROM_CACHE;
+        state_ = OPENED;
+        // The request won't be sent, so release it. Its state changes are
+        // ignored in FROM_CACHE mode.
+        request_->Abort();
+        if (async_ && GetGlobalMainLoop()) {
+          // Keep this object alive until the response is delivered.
+          Ref();
+          replay_watch_ = GetGlobalMainLoop()->AddTimeoutWatch(
+              0, new WatchCallbackSlot(
+                  NewSlot(this, &CachedXMLHttpRequest::OnReplay)));
+        } else {
+          ReplayStates();
+        }
+        return NO_ERR;
+      case HttpCache::STALE:
+        if (!etag.empty())
+          request_->SetRequestHeader("If-None-Match", etag.c_str());
+        if (!last_modified.empty())
+          request_->SetRequestHeader("If-Modified-Since",
+                                     last_modified.c_str());
+        mode_ = REVALIDATING;
+        state_ = OPENED;
+        return SendRequest(&data, NULL);
+      default:
+        return SendRequest(&data, NULL);
+    }
+  }
+
+  virtual ExceptionCode Send(const DOMDocumentInterface *data) {
+    // Only GET requests are cached, which have no data.
+    return SendRequest(NULL, data);
+  }
+
+  virtual void Abort() {
+    Mode mode = mode_;
+    State state = state_;
+    CancelReplay();
+    ClearResponse();
+    // State changes of the request are forwarded from now on.
+    mode_ = PASS_THROUGH;
+    request_->Abort();
+    if (mode == FROM_CACHE &&
+        (state == OPENED || state == HEADERS_RECEIVED || state == LOADING)) {
+      // Delivering the cached response is aborted. Like the backends, report
+      // the DONE state, then reset to UNSENT silently.
+      mode_ = FROM_CACHE;
+      if (ChangeState(DONE))
+        mode_ = PASS_THROUGH;
+    }
+  }
+
+  virtual ExceptionCode GetAllResponseHeaders(const std::string **result) {
+    if (mode_ != FROM_CACHE)
+      return request_->GetAllResponseHeaders(result);
+
+    ASSERT(result);
+    if (state_ == HEADERS_RECEIVED || state_ == LOADING || state_ == DONE) {
+      *result = &cached_response_.headers;
+      return NO_ERR;
+    }
+    *result = NULL;
+    return INVALID_STATE_ERR;
+  }
+
+  virtual ExceptionCode GetResponseHeader(const char *header,
+                                          const std::string **result) {
+    if (mode_ != FROM_CACHE)
+      return request_->GetResponseHeader(header, result);
+
+    ASSERT(result);
+    if (!header)
+      return NULL_POINTER_ERR;
+    *result = NULL;
+    if (state_ == HEADERS_RECEIVED || state_ == LOADING || state_ == DONE) {
+      CaseInsensitiveStringMap::const_iterator it =
+          response_headers_map_.find(header);
+      if (it != response_headers_map_.end())
+        *result = &it->second;
+      return NO_ERR;
+    }
+    return INVALID_STATE_ERR;
+  }
+
+  virtual ExceptionCode GetResponseText(std::string *result) {
+    if (mode_ != FROM_CACHE)
+      return request_->GetResponseText(result);
+
+    ASSERT(result);
+    if (state_ == LOADING) {
+      result->clear();
+      return NO_ERR;
+    } else if (state_ == DONE) {
+      if (response_text_.empty() && !cached_response_.body.empty()) {
+        std::string encoding;
+        xml_parser_->ConvertContentToUTF8(cached_response_.body,
+                                          url_.c_str(),
+                                          response_content_type_.c_str(),
+                                          response_encoding_.c_str(),
+                                          kEncodingFallback,
+                                          &encoding, &response_text_);
+      }
+      *result = response_text_;
+      return NO_ERR;
+    }
+    result->clear();
+    return INVALID_STATE_ERR;
+  }
+
+  virtual ExceptionCode GetResponseBody(std::string *result) {
+    if (mode_ != FROM_CACHE)
+      return request_->GetResponseBody(result);
+
+    ASSERT(result);
+    if (state_ == LOADING || state_ == DONE) {
+      *result = cached_response_.body;
+      return NO_ERR;
+    }
+    result->clear();
+    return INVALID_STATE_ERR;
+  }
+
+  virtual ExceptionCode GetResponseXML(DOMDocumentInterface **result) {
+    if (mode_ != FROM_CACHE)
+      return request_->GetResponseXML(result);
+
+    ASSERT(result);
+    if (state_ == DONE) {
+      if (!response_dom_ && !cached_response_.body.empty()) {
+        std::string encoding;
+        response_dom_ = xml_parser_->CreateDOMDocument();
+        response_dom_->Ref();
+        if (!xml_parser_->ParseContentIntoDOM(cached_response_.body, NULL,
+                                              url_.c_str(),
+                                              response_content_type_.c_str(),
+                                              response_encoding_.c_str(),
+                                              kEncodingFallback,
+                                              response_dom_,
+                                              &encoding, &response_text_) ||
+            !response_dom_->GetDocumentElement()) {
+          response_dom_->Unref();
+          response_dom_ = NULL;
+        }
+      }
+      *result = response_dom_;
+      return NO_ERR;
+    }
+    return INVALID_STATE_ERR;
+  }
+
+  virtual ExceptionCode GetStatus(unsigned short *result) {
+    if (mode_ != FROM_CACHE)
+      return request_->GetStatus(result);
+
+    ASSERT(result);
+    if (state_ == LOADING || state_ == DONE) {
+      *result = cached_response_.status;
+      return NO_ERR;
+    }
+    *result = 0;
+    return INVALID_STATE_ERR;
+  }
+
+  virtual ExceptionCode GetStatusText(const std::string **result) {
+    if (mode_ != FROM_CACHE)
+      return request_->GetStatusText(result);
+
+    ASSERT(result);
+    if (state_ == LOADING || state_ == DONE) {
+      *result = &cached_response_.status_text;
+      return NO_ERR;
+    }
+    *result = NULL;
+    return INVALID_STATE_ERR;
+  }
+
+  virtual bool IsSuccessful() {
+    return mode_ == FROM_CACHE ? state_ == DONE : request_->IsSuccessful();
+  }
+
+  virtual std::string GetEffectiveUrl() {
+    return mode_ == FROM_CACHE ? cached_response_.effective_url :
+                                 request_->GetEffectiveUrl();
+  }
+
+  virtual std::string GetResponseContentType() {
+    return mode_ == FROM_CACHE ? response_content_type_ :
+                                 request_->GetResponseContentType();
+  }
+
+  virtual Connection *ConnectOnDataReceived(
+      Slot2<size_t, const void *, size_t> *receiver) {
+    // Streamed responses are delivered to the receiver only, so they can't
+    // be cached.
+    streamed_ = true;
+    cacheable_ = false;
+    return request_->ConnectOnDataReceived(receiver);
+  }
+
+ private:
+  enum Mode {
+    // All calls are forwarded to the wrapped request.
+    PASS_THROUGH,
+    // The wrapped request is revalidating a stale cached response. Its
+    // state changes are hidden until it finishes.
+    REVALIDATING,
+    // The response is served from the cache.
+    FROM_CACHE,
+  };
+
+  static uint64_t GetCurrentTime() {
+    // The cache needs wall clock time because cached responses are persisted.
+    return static_cast<uint64_t>(time(NULL)) * 1000;
+  }
+
+  // Sends the wrapped request with either data or doc.
+  ExceptionCode SendRequest(const std::string *data,
+                            const DOMDocumentInterface *doc) {
+    // Hold a reference in case this object is released by a state change
+    // handler during the synchronous part of the request.
+    Ref();
+    if (async_ && !active_) {
+      // Keep this object alive during the request, as the wrapped request
+      // does for itself.
+      active_ = true;
+      Ref();
+    }
+    ExceptionCode code = data ? request_->Send(*data) : request_->Send(doc);
+    if (code != NO_ERR) {
+      if (mode_ == REVALIDATING)
+        mode_ = PASS_THROUGH;
+      if (active_) {
+        active_ = false;
+        Unref();
+      }
+    }
+    Unref();
+    return code;
+  }
+
+  void ClearResponse() {
+    cached_response_ = HttpCache::Response();
+    response_headers_map_.clear();
+    response_content_type_.clear();
+    response_encoding_.clear();
+    response_text_.clear();
+    if (response_dom_) {
+      response_dom_->Unref();
+      response_dom_ = NULL;
+    }
+  }
+
+  void CancelReplay() {
+    if (replay_watch_) {
+      GetGlobalMainLoop()->RemoveWatch(replay_watch_);
+      replay_watch_ = 0;
+      // Remove the reference added in Send(). Don't delete this object now,
+      // because we are in one of its methods.
+      Unref(true);
+    }
+  }
+
+  bool OnReplay(int watch_id) {
+    GGL_UNUSED(watch_id);
+    replay_watch_ = 0;
+    ReplayStates();
+    // Remove the reference added in Send().
+    Unref();
+    return false;
+  }
+
+  // Delivers cached_response_ to the caller.
+  void ReplayStates() {
+    ASSERT(mode_ == FROM_CACHE);
+    ParseResponseHeaders(cached_response_.headers, &response_headers_map_,
+                         &response_content_type_, &response_encoding_);
+    ChangeState(HEADERS_RECEIVED) && ChangeState(LOADING) &&
+        ChangeState(DONE);
+  }
+
+  // Returns false if the state is changed again by the handlers, e.g. the
+  // handler aborted or reopened this request.
+  bool ChangeState(State new_state) {
+    state_ = new_state;
+    onreadystatechange_signal_();
+    return state_ == new_state && mode_ != PASS_THROUGH;
+  }
+
+  void StoreResponse() {
+    HttpCache::Response response;
+    const std::string *headers = NULL, *status_text = NULL;
+    if (request_->GetStatus(&response.status) != NO_ERR ||
+        request_->GetAllResponseHeaders(&headers) != NO_ERR || !headers ||
+        request_->GetStatusText(&status_text) != NO_ERR || !status_text ||
+        request_->GetResponseBody(&response.body) != NO_ERR)
+      return;
+    response.headers = *headers;
+    response.status_text = *status_text;
+    response.effective_url = request_->GetEffectiveUrl();
+    cache_->Store(cache_key_, response, GetCurrentTime());
+  }
+
+  void OnRequestStateChange() {
+    State request_state = request_->GetReadyState();
+    if (mode_ == FROM_CACHE)
+      return;
+
+    bool finished = (request_state == DONE);
+    if (mode_ == PASS_THROUGH) {
+      if (finished && cacheable_ && request_->IsSuccessful())
+        StoreResponse();
+      // Hold a reference because the handlers may release this object.
+      Ref();
+      onreadystatechange_signal_();
+    } else {
+      // Revalidating.
+      if (!finished)
+        return;
+      Ref();
+      unsigned short status = 0;
+      const std::string *headers = NULL;
+      if (request_->IsSuccessful() &&
+          request_->GetStatus(&status) == NO_ERR && status == 304 &&
+          request_->GetAllResponseHeaders(&headers) == NO_ERR && headers &&
+          cache_->Refresh(cache_key_, *headers, GetCurrentTime(),
+                          &cached_response_)) {
+        mode_ = FROM_CACHE;
+        ReplayStates();
+      } else if (request_->IsSuccessful()) {
+        // The response was modified. Deliver the new response.
+        StoreResponse();
+        ChangeState(HEADERS_RECEIVED) && ChangeState(LOADING) &&
+            ChangeState(DONE);
+        if (mode_ == REVALIDATING)
+          mode_ = PASS_THROUGH;
+      } else {
+        mode_ = PASS_THROUGH;
+        onreadystatechange_signal_();
+      }
+    }
+
+    if (finished && active_) {
+      // The request finished, so remove the reference added in Send().
+      active_ = false;
+      Unref();
+    }
+    Unref();
+  }
+
+  // Used in the methods for script to throw an script exception on errors.
+  bool CheckException(ExceptionCode code) {
+    if (code != NO_ERR) {
+      SetPendingException(new XMLHttpRequestException(code));
+      return false;
+    }
+    return true;
+  }
+
+  void ScriptOpen(const char *method, const char *url, bool async,
+                  const char *user, const char *password) {
+    CheckException(Open(method, url, async, user, password));
+  }
+
+  void ScriptSetRequestHeader(const char *header, const char *value) {
+    CheckException(SetRequestHeader(header, value));
+  }
+
+  void ScriptSend(const Variant &v_data) {
+    std::string data;
+    if (v_data.ConvertToString(&data)) {
+      CheckException(Send(data));
+    } else if (v_data.type() == Variant::TYPE_SCRIPTABLE) {
+      ScriptableInterface *scriptable =
+          VariantValue<ScriptableInterface *>()(v_data);
+      if (!scriptable) {
+        CheckException(Send(std::string()));
+      } else if (scriptable->IsInstanceOf(DOMDocumentInterface::CLASS_ID)) {
+        CheckException(Send(down_cast<DOMDocumentInterface *>(scriptable)));
+      } else if (scriptable->IsInstanceOf(ScriptableBinaryData::CLASS_ID)) {
+        CheckException(
+            Send(down_cast<ScriptableBinaryData *>(scriptable)->data()));
+      } else {
+        CheckException(SYNTAX_ERR);
+      }
+    } else {
+      CheckException(SYNTAX_ERR);
+    }
+  }
+
+  Variant ScriptGetAllResponseHeaders() {
+    const std::string *result = NULL;
+    CheckException(GetAllResponseHeaders(&result));
+    return result ? Variant(*result) : Variant(static_cast<const char *>(NULL));
+  }
+
+  Variant ScriptGetResponseHeader(const char *header) {
+    const std::string *result = NULL;
+    CheckException(GetResponseHeader(header, &result));
+    return result ? Variant(*result) : Variant(static_cast<const char *>(NULL));
+  }
+
+  ScriptableBinaryData *ScriptGetResponseBody() {
+    std::string result;
+    if (CheckException(GetResponseBody(&result)) && !result.empty())
+      return new ScriptableBinaryData(result);
+    return NULL;
+  }
+
+  std::string ScriptGetResponseText() {
+    std::string result;
+    CheckException(GetResponseText(&result));
+    return result;
+  }
+
+  DOMDocumentInterface *ScriptGetResponseXML() {
+    DOMDocumentInterface *result = NULL;
+    CheckException(GetResponseXML(&result));
+    return result;
+  }
+
+  unsigned short ScriptGetStatus() {
+    unsigned short result = 0;
+    CheckException(GetStatus(&result));
+    return result;
+  }
+
+  Variant ScriptGetStatusText() {
+    const std::string *result = NULL;
+    CheckException(GetStatusText(&result));
+    return result ? Variant(*result) : Variant(static_cast<const char *>(NULL));
+  }
+
+  XMLHttpRequestInterface *request_;
+  Connection *request_connection_;
+  HttpCache *cache_;
+  std::string partition_;
+  XMLParserInterface *xml_parser_;
+  DOMDocumentInterface *response_dom_;
+  Signal0<void> onreadystatechange_signal_;
+
+  std::string url_;
+  std::string cache_key_;
+  HttpCache::Response cached_response_;
+  CaseInsensitiveStringMap response_headers_map_;
+  std::string response_content_type_;
+  std::string response_encoding_;
+  std::string response_text_;
+  int replay_watch_;
+
+  State state_ : 3;
+  Mode mode_   : 2;
+  bool async_     : 1;
+  bool cacheable_ : 1;
+  // Set once a data receiver is connected. It persists across Open() calls
+  // because the receiver does.
+  bool streamed_  : 1;
+  // If the wrapped request is working in async mode.
+  bool active_    : 1;
+};
+
+/**
+ * Wraps the factory set by SetXMLHttpRequestFactory(), so that all
+ * XMLHttpRequest backends share the HttpCache.
+ */
+class CachedXMLHttpRequestFactory : public XMLHttpRequestFactoryInterface {
+ public:
+  CachedXMLHttpRequestFactory() : factory_(NULL) { }
+
+  void SetFactory(XMLHttpRequestFactoryInterface *factory) {
+    factory_ = factory;
+  }
+
+  virtual int CreateSession() {
+    return factory_->CreateSession();
+  }
+
+  virtual void DestroySession(int session_id) {
+    partitions_.erase(session_id);
+    factory_->DestroySession(session_id);
+  }
+
+  virtual XMLHttpRequestInterface *CreateXMLHttpRequest(
+      int session_id, XMLParserInterface *parser) {
+    XMLHttpRequestInterface *request =
+        factory_->CreateXMLHttpRequest(session_id, parser);
+    if (!request || !parser)
+      return request;
+    std::map<int, std::string>::const_iterator it =
+        partitions_.find(session_id);
+    return new CachedXMLHttpRequest(
+        request, GetGlobalHttpCache(), parser,
+        it == partitions_.end() ? std::string() : it->second);
+  }
+
+  virtual void SetDefaultUserAgent(const char *user_agent) {
+    factory_->SetDefaultUserAgent(user_agent);
+  }
+
+  void SetCachePartition(int session_id, const char *partition) {
+    if (partition && *partition)
+      partitions_[session_id] = partition;
+    else
+      partitions_.erase(session_id);
+  }
+
+ private:
+  XMLHttpRequestFactoryInterface *factory_;
+  std::map<int, std::string> partitions_;
+};
+
 static XMLHttpRequestFactoryInterface *g_factory = NULL;
+static CachedXMLHttpRequestFactory g_cached_factory;
 
 bool SetXMLHttpRequestFactory(XMLHttpRequestFactoryInterface *factory) {
   ASSERT(!g_factory && factory);
   if (!g_factory && factory) {
     g_factory = factory;
+    g_cached_factory.SetFactory(factory);
     return true;
   }
   return false;
@@ -31,7 +695,11 @@ bool SetXMLHttpRequestFactory(XMLHttpRequestFactoryInterface *factory) {
 
 XMLHttpRequestFactoryInterface *GetXMLHttpRequestFactory() {
   EXPECT_M(g_factory, ("The XMLHttpRequest factory has not been set yet."));
-  return g_factory;
+  return g_factory ? &g_cached_factory : NULL;
+}
+
+void SetXMLHttpRequestCachePartition(int session_id, const char *partition) {
+  g_cached_factory.SetCachePartition(session_id, partition);
 }
 
 } // namespace ggadget
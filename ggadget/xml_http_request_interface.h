@@ -215,6 +215,15 @@ bool SetXMLHttpRequestFactory(XMLHttpRequestFactoryInterface *factory);
  */
 XMLHttpRequestFactoryInterface *GetXMLHttpRequestFactory();
 
+/**
+ * @relates XMLHttpRequestFactoryInterface
+ * Sets the HTTP cache partition of the XMLHttpRequest objects created in a
+ * session. Requests in different partitions never share cached responses,
+ * so each gadget should use its own partition for its session. Sessions
+ * without partition, including session 0, share the default partition.
+ */
+void SetXMLHttpRequestCachePartition(int session_id, const char *partition);
+
 /** @} */
 
 } // namespace ggadget
@@ -14,6 +14,7 @@
   limitations under the License.
 */
 
+#include <cstdio>
 #include <cstring>
 #include <algorithm>
 
@@ -212,6 +213,68 @@ void ParseResponseHeaders(const std::string &response_headers,
   }
 }
 
+// Returns the number of days from 1970-01-01 to the specified date.
+static int64_t DaysFromEpoch(int year, int month, int day) {
+  // Counts years from March, so that the leap day is the last day of a year.
+  year -= month <= 2;
+  int64_t era = (year >= 0 ? year : year - 399) / 400;
+  int64_t year_of_era = year - era * 400;
+  int64_t day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 +
+                        day - 1;
+  int64_t day_of_era = year_of_era * 365 + year_of_era / 4 -
+                       year_of_era / 100 + day_of_year;
+  return era * 146097 + day_of_era - 719468;
+}
+
+static int ParseMonth(const char *name) {
+  static const char *kMonths[] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+  };
+  for (size_t i = 0; i < arraysize(kMonths); ++i) {
+    if (strncasecmp(name, kMonths[i], 3) == 0)
+      return static_cast<int>(i) + 1;
+  }
+  return 0;
+}
+
+// http://www.w3.org/Protocols/rfc2616/rfc2616-sec3.html#sec3.3.1
+bool ParseHTTPDate(const char *date, uint64_t *time) {
+  ASSERT(time);
+  if (!date)
+    return false;
+
+  char month_name[4] = { 0 };
+  int year = 0, day = 0, hour = 0, minute = 0, second = 0;
+  const char *comma = strchr(date, ',');
+  if (comma) {
+    // RFC 1123: "Sun, 06 Nov 1994 08:49:37 GMT" or
+    // RFC 850: "Sunday, 06-Nov-94 08:49:37 GMT".
+    if (sscanf(comma + 1, " %d %3s %d %d:%d:%d",
+               &day, month_name, &year, &hour, &minute, &second) != 6 &&
+        sscanf(comma + 1, " %d-%3s-%d %d:%d:%d",
+               &day, month_name, &year, &hour, &minute, &second) != 6)
+      return false;
+    if (year < 100)
+      year += year < 70 ? 2000 : 1900;
+  } else {
+    // ANSI C asctime(): "Sun Nov  6 08:49:37 1994".
+    if (sscanf(date, "%*s %3s %d %d:%d:%d %d",
+               month_name, &day, &hour, &minute, &second, &year) != 6)
+      return false;
+  }
+
+  int month = ParseMonth(month_name);
+  if (!month || day < 1 || day > 31 || hour > 23 || minute > 59 ||
+      second > 60 || year < 1970)
+    return false;
+
+  int64_t seconds = DaysFromEpoch(year, month, day) * 86400 +
+                    hour * 3600 + minute * 60 + second;
+  *time = static_cast<uint64_t>(seconds) * 1000;
+  return true;
+}
+
 // The name of the options to store backoff data.
 static const char kBackoffOptions[] = "backoff";
 // The name of the options item to store backoff data.
@@ -18,6 +18,7 @@
 #define GGADGET_XML_HTTP_REQUEST_UTILS_H__
 
 #include <string>
+#include <ggadget/string_utils.h>
 
 namespace ggadget {
 
@@ -55,6 +56,12 @@ void ParseResponseHeaders(const std::string &response_headers,
                           std::string *response_content_type,
                           std::string *response_encoding);
 
+/**
+ * Parses a date in any of the formats allowed by HTTP/1.1, e.g.
+ * "Sun, 06 Nov 1994 08:49:37 GMT", into milliseconds since the epoch.
+ */
+bool ParseHTTPDate(const char *date, uint64_t *time);
+
 /** Makes sure backoff options is created. */
 bool EnsureXHRBackoffOptions(uint64_t now);
 
@@ -18,6 +18,12 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#if defined(OS_POSIX)
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
 #include <cstring>
 #include <vector>
 #include <string>
@@ -49,6 +55,15 @@ static const uLong kMaxFieldSize = 200000;
 static const char kZipGlobalComment[] = "Created by Google Gadgets for Linux.";
 static const char kZipReadMeFile[] = ".readme";
 static const char kTempZipFile[] = "%%Temp%%.zip";
+// Initial number of buckets of the index of the central directory, must be a
+// power of 2.
+static const size_t kMinIndexBuckets = 16;
+// Signatures of the headers in zip archives.
+static const uint32_t kCentralHeaderSignature = 0x02014b50;
+static const uint32_t kLocalHeaderSignature = 0x04034b50;
+// Sizes of the fixed parts of the headers.
+static const size_t kCentralHeaderSize = 46;
+static const size_t kLocalHeaderSize = 30;
 
 namespace {
 #if defined(OS_WIN)
@@ -71,18 +86,6 @@ void StringReplace(char* path, char old_char, char new_char) {
 }
 #endif
 
-int UnzLocateFile(unzFile file, const char* szFileName, int iCaseSensitivity) {
-#if defined(OS_WIN)
-  int name_buffer_length = strlen(szFileName) + 1;
-  scoped_array<char> file_name(new char[name_buffer_length]);
-  strcpy_s(file_name.get(), name_buffer_length, szFileName);
-  StringReplace(file_name.get(), '\\', '/');
-  return ::unzLocateFile(file, file_name.get(), iCaseSensitivity);
-#elif defined(OS_POSIX)
-  return ::unzLocateFile(file, szFileName, iCaseSensitivity);
-#endif
-}
-
 int UnzGetCurrentFileInfo(unzFile file, unz_file_info* pfile_info,
                           char* szFileName, uLong fileNameBufferSize,
                           void* extraField, uLong extraFieldBufferSize,
@@ -126,11 +129,160 @@ int ZipOpenNewFileInZip(zipFile file,
                                size_extrafield_global, comment, method, level);
 #endif
 }
+// FNV-1a of a file name in the archive, case folded if the file names are
+// case insensitive.
+uint32_t HashFileName(const char *name) {
+  uint32_t hash = 2166136261U;
+  for (; *name; ++name) {
+    unsigned char c = static_cast<unsigned char>(*name);
+    if (kZipCaseSensitivity != 1 && c >= 'A' && c <= 'Z')
+      c = static_cast<unsigned char>(c - 'A' + 'a');
+    hash = (hash ^ c) * 16777619U;
+  }
+  return hash;
+}
+
+uint32_t ReadUInt16(const char *p) {
+  const unsigned char *u = reinterpret_cast<const unsigned char *>(p);
+  return u[0] | (u[1] << 8);
+}
+
+uint32_t ReadUInt32(const char *p) {
+  const unsigned char *u = reinterpret_cast<const unsigned char *>(p);
+  return u[0] | (u[1] << 8) | (u[2] << 16) |
+         (static_cast<uint32_t>(u[3]) << 24);
+}
+
+// Maps a file into memory. The mapping stays valid if the file is replaced,
+// but the file must not be truncated in place while it's mapped.
+bool MapFile(const char *path, const char **data, size_t *size) {
+  *data = NULL;
+  *size = 0;
+#if defined(OS_POSIX)
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat stat_value;
+  if (fstat(fd, &stat_value) == 0 && S_ISREG(stat_value.st_mode) &&
+      stat_value.st_size > 0) {
+    void *addr = mmap(NULL, static_cast<size_t>(stat_value.st_size),
+                      PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr != MAP_FAILED) {
+      *data = static_cast<const char *>(addr);
+      *size = static_cast<size_t>(stat_value.st_size);
+    }
+  }
+  ::close(fd);
+#endif
+  return *data != NULL;
+}
+
+void UnmapFile(const char *data, size_t size) {
+#if defined(OS_POSIX)
+  if (data)
+    munmap(const_cast<char *>(data), size);
+#endif
+}
+
+// A read only stream on an archive mapped into memory, through which unzip
+// reads the archive without system calls.
+struct MappedStream {
+  const char *data;
+  uLong size;
+  uLong pos;
+};
+
+voidpf ZCALLBACK OpenMappedStream(voidpf opaque, const char *filename,
+                                  int mode) {
+  GGL_UNUSED(filename);
+  if ((mode & ZLIB_FILEFUNC_MODE_READWRITEFILTER) != ZLIB_FILEFUNC_MODE_READ)
+    return NULL;
+  MappedStream *stream = new MappedStream(
+      *static_cast<const MappedStream *>(opaque));
+  stream->pos = 0;
+  return stream;
+}
+
+uLong ZCALLBACK ReadMappedStream(voidpf opaque, voidpf stream_ptr, void *buf,
+                                 uLong size) {
+  GGL_UNUSED(opaque);
+  MappedStream *stream = static_cast<MappedStream *>(stream_ptr);
+  if (stream->pos >= stream->size)
+    return 0;
+  size = std::min(size, stream->size - stream->pos);
+  memcpy(buf, stream->data + stream->pos, size);
+  stream->pos += size;
+  return size;
+}
+
+long ZCALLBACK TellMappedStream(voidpf opaque, voidpf stream_ptr) {
+  GGL_UNUSED(opaque);
+  return static_cast<long>(static_cast<MappedStream *>(stream_ptr)->pos);
+}
+
+long ZCALLBACK SeekMappedStream(voidpf opaque, voidpf stream_ptr,
+                                uLong offset, int origin) {
+  GGL_UNUSED(opaque);
+  MappedStream *stream = static_cast<MappedStream *>(stream_ptr);
+  uLong base;
+  switch (origin) {
+    case ZLIB_FILEFUNC_SEEK_SET: base = 0; break;
+    case ZLIB_FILEFUNC_SEEK_CUR: base = stream->pos; break;
+    case ZLIB_FILEFUNC_SEEK_END: base = stream->size; break;
+    default: return -1;
+  }
+  if (offset > stream->size - base)
+    return -1;
+  stream->pos = base + offset;
+  return 0;
+}
+
+int ZCALLBACK CloseMappedStream(voidpf opaque, voidpf stream_ptr) {
+  GGL_UNUSED(opaque);
+  delete static_cast<MappedStream *>(stream_ptr);
+  return 0;
+}
+
+int ZCALLBACK TestMappedStreamError(voidpf opaque, voidpf stream_ptr) {
+  GGL_UNUSED(opaque);
+  GGL_UNUSED(stream_ptr);
+  return 0;
+}
+
+// Opens an archive for reading. The archive is mapped into memory if
+// possible, in which case @a map_data and @a map_size are set to the mapping.
+unzFile OpenArchive(const char *path, const char **map_data,
+                    size_t *map_size) {
+  if (MapFile(path, map_data, map_size)) {
+    MappedStream archive = { *map_data, static_cast<uLong>(*map_size), 0 };
+    zlib_filefunc_def filefunc = {
+      OpenMappedStream, ReadMappedStream, NULL, TellMappedStream,
+      SeekMappedStream, CloseMappedStream, TestMappedStreamError, &archive
+    };
+    unzFile handle = unzOpen2(path, &filefunc);
+    if (handle)
+      return handle;
+    UnmapFile(*map_data, *map_size);
+    *map_data = NULL;
+    *map_size = 0;
+  }
+  return unzOpen(path);
+}
 } // namespace
 
 class ZipFileManager::Impl : public SmallObject<> {
  public:
-  Impl() : unzip_handle_(NULL), zip_handle_(NULL) {
+  // A file in the central directory.
+  struct Entry {
+    std::string name;
+    uint32_t hash;
+    unz_file_pos pos;
+    unz_file_info info;
+  };
+
+  Impl()
+      : unzip_handle_(NULL), zip_handle_(NULL),
+        map_data_(NULL), map_size_(0) {
   }
 
   ~Impl() {
@@ -144,15 +296,185 @@ class ZipFileManager::Impl : public SmallObject<> {
     temp_dir_.clear();
     base_path_.clear();
 
-    if (unzip_handle_)
-      unzClose(unzip_handle_);
+    CloseArchive();
     if (zip_handle_)
       zipClose(zip_handle_, kZipGlobalComment);
 
-    unzip_handle_ = NULL;
     zip_handle_ = NULL;
   }
 
+  void CloseArchive() {
+    if (unzip_handle_)
+      unzClose(unzip_handle_);
+    UnmapFile(map_data_, map_size_);
+    unzip_handle_ = NULL;
+    map_data_ = NULL;
+    map_size_ = 0;
+    entries_.clear();
+    buckets_.clear();
+  }
+
+  // Gets the information of the current file of the unzip handle.
+  int GetCurrentFileInfo(unz_file_info *info, std::string *name) {
+    char filename[256];
+    int res = ggadget::UnzGetCurrentFileInfo(unzip_handle_, info,
+                                             filename, sizeof(filename),
+                                             NULL, 0, NULL, 0);
+    if (res != UNZ_OK)
+      return res;
+    // In most cases filename buffer is big enough to contain the file name.
+    if (info->size_filename < sizeof(filename)) {
+      name->assign(filename, info->size_filename);
+      return UNZ_OK;
+    }
+    std::vector<char> buffer(info->size_filename + 1);
+    res = ggadget::UnzGetCurrentFileInfo(unzip_handle_, info,
+                                         &buffer[0], buffer.size(),
+                                         NULL, 0, NULL, 0);
+    if (res == UNZ_OK)
+      name->assign(&buffer[0], info->size_filename);
+    return res;
+  }
+
+  // Returns the bucket where the name is, or where it should be inserted.
+  size_t FindBucket(const char *name, uint32_t hash) const {
+    size_t mask = buckets_.size() - 1;
+    size_t i = hash & mask;
+    while (buckets_[i] >= 0) {
+      const Entry &entry = entries_[buckets_[i]];
+      if (entry.hash == hash && GadgetStrCmp(entry.name.c_str(), name) == 0)
+        break;
+      i = (i + 1) & mask;
+    }
+    return i;
+  }
+
+  // Indexes the central directory of the archive opened for reading, so that
+  // the files can be found without scanning the central directory.
+  void BuildIndex() {
+    entries_.clear();
+    unz_global_info global_info;
+    if (unzGetGlobalInfo(unzip_handle_, &global_info) == UNZ_OK)
+      entries_.reserve(global_info.number_entry);
+
+    int res = unzGoToFirstFile(unzip_handle_);
+    while (res == UNZ_OK) {
+      entries_.push_back(Entry());
+      Entry *entry = &entries_.back();
+      res = GetCurrentFileInfo(&entry->info, &entry->name);
+      if (res == UNZ_OK)
+        res = unzGetFilePos(unzip_handle_, &entry->pos);
+      if (res != UNZ_OK) {
+        entries_.pop_back();
+        break;
+      }
+      entry->hash = HashFileName(entry->name.c_str());
+      res = unzGoToNextFile(unzip_handle_);
+    }
+    if (res != UNZ_END_OF_LIST_OF_FILE)
+      LOG("Error reading the central directory of %s", base_path_.c_str());
+
+    // Keep the load factor under 1/2.
+    size_t bucket_count = kMinIndexBuckets;
+    while (bucket_count < entries_.size() * 2)
+      bucket_count *= 2;
+    buckets_.assign(bucket_count, -1);
+    for (size_t i = 0; i < entries_.size(); ++i) {
+      size_t bucket = FindBucket(entries_[i].name.c_str(), entries_[i].hash);
+      // The first one of the duplicated files wins, as unzLocateFile().
+      if (buckets_[bucket] < 0)
+        buckets_[bucket] = static_cast<int>(i);
+    }
+  }
+
+  const Entry *FindEntry(const std::string &relative_path) const {
+    if (buckets_.empty())
+      return NULL;
+    int index = buckets_[FindBucket(relative_path.c_str(),
+                                    HashFileName(relative_path.c_str()))];
+    return index >= 0 ? &entries_[index] : NULL;
+  }
+
+  // Finds a file, and makes it the current file of the unzip handle.
+  const Entry *LocateFile(const std::string &relative_path) {
+    const Entry *entry = FindEntry(relative_path);
+    if (!entry)
+      return NULL;
+    unz_file_pos pos = entry->pos;
+    return unzGoToFilePos(unzip_handle_, &pos) == UNZ_OK ? entry : NULL;
+  }
+
+  // Gets the data of a file in the mapped archive, or NULL if the archive
+  // isn't mapped or the headers are not as expected.
+  const char *GetMappedData(const Entry &entry) const {
+    if (!map_data_)
+      return NULL;
+    size_t central = entry.pos.pos_in_zip_directory;
+    if (central > map_size_ || map_size_ - central < kCentralHeaderSize ||
+        ReadUInt32(map_data_ + central) != kCentralHeaderSignature)
+      return NULL;
+    size_t local = ReadUInt32(map_data_ + central + 42);
+    if (local > map_size_ || map_size_ - local < kLocalHeaderSize ||
+        ReadUInt32(map_data_ + local) != kLocalHeaderSignature)
+      return NULL;
+    size_t offset = local + kLocalHeaderSize +
+                    ReadUInt16(map_data_ + local + 26) +
+                    ReadUInt16(map_data_ + local + 28);
+    if (offset > map_size_ || map_size_ - offset < entry.info.compressed_size)
+      return NULL;
+    return map_data_ + offset;
+  }
+
+  // Reads a stored or deflated file directly from the mapped archive.
+  // Returns -1 if the file can't be read this way.
+  int ReadMappedFile(const Entry &entry, const std::string &relative_path,
+                     std::string *data) {
+    const unz_file_info &info = entry.info;
+    // Encrypted files are not supported.
+    if (info.flag & 1)
+      return -1;
+    bool stored = info.compression_method == 0 &&
+                  info.compressed_size == info.uncompressed_size;
+    if (!stored && info.compression_method != Z_DEFLATED)
+      return -1;
+    const char *src = GetMappedData(entry);
+    if (!src)
+      return -1;
+
+    size_t size = info.uncompressed_size;
+    if (stored) {
+      data->assign(src, size);
+    } else if (size) {
+      data->resize(size);
+      z_stream stream;
+      memset(&stream, 0, sizeof(stream));
+      if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+        return -1;
+      stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(src));
+      stream.avail_in = static_cast<uInt>(info.compressed_size);
+      stream.next_out = reinterpret_cast<Bytef *>(&(*data)[0]);
+      stream.avail_out = static_cast<uInt>(size);
+      int res = inflate(&stream, Z_FINISH);
+      inflateEnd(&stream);
+      if (res != Z_STREAM_END || stream.total_out != size) {
+        LOG("Error reading file: %s in zip archive %s",
+            relative_path.c_str(), base_path_.c_str());
+        data->clear();
+        return 0;
+      }
+    }
+
+    if (crc32(crc32(0, NULL, 0),
+              reinterpret_cast<const Bytef *>(data->c_str()),
+              static_cast<uInt>(size)) != info.crc) {
+      LOG("CRC error in file: %s in zip file: %s",
+          relative_path.c_str(), base_path_.c_str());
+      data->clear();
+      return 0;
+    }
+    return 1;
+  }
+
   bool IsValid() {
     return !base_path_.empty() && (zip_handle_ || unzip_handle_);
   }
@@ -173,6 +495,8 @@ class ZipFileManager::Impl : public SmallObject<> {
 
     unzFile unzip_handle = NULL;
     zipFile zip_handle = NULL;
+    const char *map_data = NULL;
+    size_t map_size = 0;
     ggadget::StatStruct stat_value;
     memset(&stat_value, 0, sizeof(stat_value));
     if (ggadget::stat(path.c_str(), &stat_value) == 0) {
@@ -186,7 +510,7 @@ class ZipFileManager::Impl : public SmallObject<> {
         return false;
       }
 
-      unzip_handle = unzOpen(path.c_str());
+      unzip_handle = OpenArchive(path.c_str(), &map_data, &map_size);
       if (!unzip_handle) {
         LOG("Failed to open zip file %s for reading", path.c_str());
         return false;
@@ -210,7 +534,11 @@ class ZipFileManager::Impl : public SmallObject<> {
 
     unzip_handle_ = unzip_handle;
     zip_handle_ = zip_handle;
+    map_data_ = map_data;
+    map_size_ = map_size;
     base_path_ = path;
+    if (unzip_handle_)
+      BuildIndex();
     return true;
   }
 
@@ -225,8 +553,25 @@ class ZipFileManager::Impl : public SmallObject<> {
     if (!SwitchToRead())
       return false;
 
-    if (ggadget::UnzLocateFile(unzip_handle_, relative_path.c_str(),
-                               kZipCaseSensitivity) != UNZ_OK)
+    const Entry *entry = FindEntry(relative_path);
+    if (!entry)
+      return false;
+    if (entry->info.uncompressed_size > kMaxFileSize) {
+      LOG("File %s is too big", relative_path.c_str());
+      return false;
+    }
+
+    int result = ReadMappedFile(*entry, relative_path, data);
+    if (result >= 0)
+      return result == 1;
+    return ReadUnzipFile(relative_path, entry->info.uncompressed_size, data);
+  }
+
+  // Reads a file through the unzip handle, into a buffer of the size given
+  // in the central directory.
+  bool ReadUnzipFile(const std::string &relative_path, size_t size_hint,
+                     std::string *data) {
+    if (!LocateFile(relative_path))
       return false;
 
     if (unzOpenCurrentFile(unzip_handle_) != UNZ_OK) {
@@ -236,28 +581,34 @@ class ZipFileManager::Impl : public SmallObject<> {
     }
 
     bool result = true;
-    const int kChunkSize = 2048;
-    char buffer[kChunkSize];
+    const size_t kChunkSize = 2048;
+    size_t size = 0;
+    // Read one more byte to reach the end of the file, in case the size in
+    // the central directory is wrong.
+    data->resize(size_hint + 1);
     while (true) {
-      int read_size = unzReadCurrentFile(unzip_handle_, buffer, kChunkSize);
+      if (size == data->size())
+        data->resize(size + kChunkSize);
+      int read_size = unzReadCurrentFile(unzip_handle_, &(*data)[size],
+                                         static_cast<unsigned>(
+                                             data->size() - size));
       if (read_size > 0) {
-        data->append(buffer, read_size);
-        if (data->length() > kMaxFileSize) {
+        size += read_size;
+        if (size > kMaxFileSize) {
           LOG("File %s is too big", relative_path.c_str());
-          data->clear();
           result = false;
           break;
         }
       } else if (read_size < 0) {
         LOG("Error reading file: %s in zip archive %s",
             relative_path.c_str(), base_path_.c_str());
-        data->clear();
         result = false;
         break;
       } else {
         break;
       }
     }
+    data->resize(result ? size : 0);
 
     if (unzCloseCurrentFile(unzip_handle_) != UNZ_OK) {
       LOG("CRC error in file: %s in zip file: %s",
@@ -382,8 +733,7 @@ class ZipFileManager::Impl : public SmallObject<> {
 
     if (res) {
       // Copy the temp zip file over the original zip.
-      unzClose(unzip_handle_);
-      unzip_handle_ = NULL;
+      CloseArchive();
       res = ggadget::unlink(base_path_.c_str()) == 0 &&
             CopyFile(temp_file.c_str(), base_path_.c_str());
       if (!res) {
@@ -402,11 +752,7 @@ class ZipFileManager::Impl : public SmallObject<> {
     if (!CheckFilePath(file, &relative_path, NULL))
       return false;
 
-    if (!SwitchToRead())
-      return false;
-
-    if (ggadget::UnzLocateFile(unzip_handle_, relative_path.c_str(),
-                               kZipCaseSensitivity) != UNZ_OK)
+    if (!SwitchToRead() || !FindEntry(relative_path))
       return false;
 
     if (into_file->empty()) {
@@ -431,7 +777,8 @@ class ZipFileManager::Impl : public SmallObject<> {
       return false;
     }
 
-    if (unzOpenCurrentFile(unzip_handle_) != UNZ_OK) {
+    if (!LocateFile(relative_path) ||
+        unzOpenCurrentFile(unzip_handle_) != UNZ_OK) {
       LOG("Can't open file %s for reading in zip archive %s.",
           relative_path.c_str(), base_path_.c_str());
       fclose(out_fp);
@@ -478,9 +825,7 @@ class ZipFileManager::Impl : public SmallObject<> {
     bool result = CheckFilePath(file, &relative_path, &full_path);
     if (path) *path = full_path;
 
-    return result && SwitchToRead() &&
-           ggadget::UnzLocateFile(unzip_handle_, relative_path.c_str(),
-                                  kZipCaseSensitivity) == UNZ_OK;
+    return result && SwitchToRead() && FindEntry(relative_path);
   }
 
   bool IsDirectlyAccessible(const char *file, std::string *path) {
@@ -501,12 +846,10 @@ class ZipFileManager::Impl : public SmallObject<> {
     std::string full_path, relative_path;
     bool result = CheckFilePath(file, &relative_path, &full_path);
 
-    unz_file_info file_info;
+    const Entry *entry = NULL;
     if (result && SwitchToRead() &&
-        ggadget::UnzLocateFile(unzip_handle_, relative_path.c_str(),
-                               kZipCaseSensitivity) == UNZ_OK &&
-        ggadget::UnzGetCurrentFileInfo(unzip_handle_, &file_info,
-                                       NULL, 0, NULL, 0, NULL, 0) == UNZ_OK) {
+        (entry = FindEntry(relative_path)) != NULL) {
+      const unz_file_info &file_info = entry->info;
       struct tm tm;
       memset(&tm, 0, sizeof(tm));
       tm.tm_year = file_info.tmu_date.tm_year - 1900;
@@ -535,39 +878,28 @@ class ZipFileManager::Impl : public SmallObject<> {
     if (!SwitchToRead())
       return -1;
 
-    int res = unzGoToFirstFile(unzip_handle_);
-    while (res == UNZ_OK) {
-      unz_file_info file_info;
-      char filename[256];
-      res = ggadget::UnzGetCurrentFileInfo(unzip_handle_, &file_info,
-                                           filename, sizeof(filename),
-                                           NULL, 0, NULL, 0);
-      if (res != UNZ_OK)
-        break;
-      char *filename_ptr = filename;
-      size_t filename_size = static_cast<size_t>(file_info.size_filename + 1);
-      // In most cases filename buffer is big enough to contain the file name.
-      if (filename_size > sizeof(filename)) {
-        filename_ptr = new char[filename_size];
-        res = ggadget::UnzGetCurrentFileInfo(unzip_handle_, &file_info,
-                                             filename_ptr, filename_size,
-                                             NULL, 0, NULL, 0);
-        if (res != UNZ_OK)
-          break;
+    // The callback may read files, which moves the unzip handle, so the
+    // index is enumerated instead.
+    for (size_t i = 0; i < entries_.size(); ++i) {
+      const char *filename = entries_[i].name.c_str();
+      size_t filename_size = entries_[i].name.size();
+      if (!filename_size || filename[filename_size - 1] == kDirSeparator ||
+          strcmp(filename, kZipReadMeFile) == 0 ||
+          GadgetStrNCmp(dir_name.c_str(), filename, dir_name.size()) != 0)
+        continue;
+      // Some callbacks expect the file to be the current file.
+      unz_file_pos pos = entries_[i].pos;
+      if (unzGoToFilePos(unzip_handle_, &pos) != UNZ_OK) {
+        delete callback;
+        return -1;
       }
-      if (filename_ptr[filename_size - 1] != kDirSeparator &&
-          strcmp(filename_ptr, kZipReadMeFile) != 0 &&
-          GadgetStrNCmp(dir_name.c_str(), filename_ptr, dir_name.size()) == 0 &&
-          !(*callback)(filename_ptr + dir_name.size())) {
-        if (filename_ptr != filename) delete [] filename_ptr;
+      if (!(*callback)(filename + dir_name.size())) {
         delete callback;
         return 1;
       }
-      if (filename_ptr != filename) delete [] filename_ptr;
-      res = unzGoToNextFile(unzip_handle_);
     }
     delete callback;
-    return res == UNZ_OK || res == UNZ_END_OF_LIST_OF_FILE ? 0 : -1;
+    return 0;
   }
 
   // Check if the given file path is valid and return the full path and
@@ -636,7 +968,7 @@ class ZipFileManager::Impl : public SmallObject<> {
       if (unzGoToFirstFile(unzip_handle_) == UNZ_OK)
         return true;
       // The unzip handle is not usable. Reopen it.
-      unzClose(unzip_handle_);
+      CloseArchive();
     }
 
     if (zip_handle_) {
@@ -644,11 +976,14 @@ class ZipFileManager::Impl : public SmallObject<> {
       zip_handle_ = NULL;
     }
 
-    unzip_handle_ = unzOpen(base_path_.c_str());
-    if (!unzip_handle_)
+    unzip_handle_ = OpenArchive(base_path_.c_str(), &map_data_, &map_size_);
+    if (!unzip_handle_) {
       LOG("Can't open zip archive %s for reading.", base_path_.c_str());
+      return false;
+    }
 
-    return unzip_handle_ != NULL;
+    BuildIndex();
+    return true;
   }
 
   bool SwitchToWrite() {
@@ -658,10 +993,7 @@ class ZipFileManager::Impl : public SmallObject<> {
     if (zip_handle_)
       return true;
 
-    if (unzip_handle_) {
-      unzClose(unzip_handle_);
-      unzip_handle_ = NULL;
-    }
+    CloseArchive();
 
     // If the file already exists, then try to open in append mode,
     // otherwise open in create mode.
@@ -720,6 +1052,13 @@ class ZipFileManager::Impl : public SmallObject<> {
 
   unzFile unzip_handle_;
   zipFile zip_handle_;
+
+  // The archive mapped into memory while it's opened for reading.
+  const char *map_data_;
+  size_t map_size_;
+  // The files in the central directory, and the hash table of their indexes.
+  std::vector<Entry> entries_;
+  std::vector<int> buckets_;
 };
 
 